@@ -0,0 +1,669 @@
+#include "apu.h"
+
+#include <limits.h>
+#include <string.h>
+
+// a channel that can't change its output has no events
+#define NEVER ULLONG_MAX
+
+// mixed output at full scale
+#define VOLUME 30000
+
+// $4015
+#define STATUS_DMC 0x10
+#define STATUS_FRAME_IRQ 0x40
+#define STATUS_DMC_IRQ 0x80
+
+// frame counter steps: quarter frame (envelopes, linear counter), half frame
+// (length counters, sweeps), IRQ
+#define QUARTER 1
+#define HALF 2
+#define IRQ 4
+
+static const int frame_times[2][5] = {{7457, 14913, 22371, 29829}, {7457, 14913, 22371, 29829, 37281}};
+static const int frame_actions[2][5] = {{QUARTER, QUARTER | HALF, QUARTER, QUARTER | HALF | IRQ}, {QUARTER, QUARTER | HALF, QUARTER, 0, QUARTER | HALF}};
+static const int frame_periods[2] = {29830, 37282};
+static const int frame_lengths[2] = {4, 5};
+
+static const unsigned char lengths[32] = {
+    10, 254, 20, 2, 40, 4, 80, 6, 160, 8, 60, 10, 14, 12, 26, 14,
+    12, 16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30,
+};
+
+static const unsigned char duties[4][8] = {
+    {0, 1, 0, 0, 0, 0, 0, 0},
+    {0, 1, 1, 0, 0, 0, 0, 0},
+    {0, 1, 1, 1, 1, 0, 0, 0},
+    {1, 0, 0, 1, 1, 1, 1, 1},
+};
+
+static const unsigned char triangle_steps[32] = {
+    15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+};
+
+// in CPU cycles
+static const short noise_periods[16] = {4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068};
+static const short dmc_rates[16] = {428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54};
+
+/*
+    Channel units
+*/
+
+static int volume(const APUEnvelope *envelope)
+{
+    return envelope->constant ? envelope->period : envelope->decay;
+}
+
+static void clock_envelope(APUEnvelope *envelope)
+{
+    if (envelope->start)
+    {
+        envelope->start = 0;
+        envelope->decay = 15;
+        envelope->divider = envelope->period;
+    }
+    else if (envelope->divider == 0)
+    {
+        envelope->divider = envelope->period;
+        if (envelope->decay)
+        {
+            --envelope->decay;
+        }
+        else if (envelope->loop)
+        {
+            envelope->decay = 15;
+        }
+    }
+    else
+    {
+        --envelope->divider;
+    }
+}
+
+static void clock_length(int *length, int halt)
+{
+    if (*length && !halt)
+    {
+        --*length;
+    }
+}
+
+// Period the sweep would set (pulse 1 negates in ones' complement)
+static int sweep_target(const APUPulse *pulse, int channel)
+{
+    int change = pulse->timer >> pulse->sweep_shift;
+    return pulse->sweep_negate ? pulse->timer - change - (channel == 0) : pulse->timer + change;
+}
+
+// Muted by the sweep unit, whether or not it is enabled
+static int pulse_muted(const APUPulse *pulse, int channel)
+{
+    return pulse->timer < 8 || sweep_target(pulse, channel) > 0x7FF;
+}
+
+static void clock_sweep(APUPulse *pulse, int channel)
+{
+    if (pulse->sweep_divider == 0 && pulse->sweep_enabled && pulse->sweep_shift && !pulse_muted(pulse, channel))
+    {
+        pulse->timer = sweep_target(pulse, channel);
+    }
+    if (pulse->sweep_divider == 0 || pulse->sweep_reload)
+    {
+        pulse->sweep_divider = pulse->sweep_period;
+        pulse->sweep_reload = 0;
+    }
+    else
+    {
+        --pulse->sweep_divider;
+    }
+}
+
+static void clock_linear(APUTriangle *triangle)
+{
+    if (triangle->linear_reload)
+    {
+        triangle->linear = triangle->linear_period;
+    }
+    else if (triangle->linear)
+    {
+        --triangle->linear;
+    }
+    if (!triangle->control)
+    {
+        triangle->linear_reload = 0;
+    }
+}
+
+// Start or stop a channel's events as it becomes able to change its output or not
+static void wake(APU *apu, unsigned long long *next, int running, int period)
+{
+    if (!running)
+    {
+        *next = NEVER;
+    }
+    else if (*next == NEVER)
+    {
+        *next = apu->cycle + period;
+    }
+}
+
+static void update_pulse(APU *apu, int channel)
+{
+    APUPulse *pulse = &apu->pulse[channel];
+    int level = pulse->length && !pulse_muted(pulse, channel) ? volume(&pulse->envelope) : 0;
+    pulse->output = duties[pulse->duty][pulse->step] ? level : 0;
+    wake(apu, &pulse->next, apu->sample_rate && level, (pulse->timer + 1) * 2);
+}
+
+static void update_triangle(APU *apu)
+{
+    APUTriangle *triangle = &apu->triangle;
+    // it holds its level when stopped, and ultrasonic periods are left silent
+    triangle->output = triangle_steps[triangle->step];
+    wake(apu, &triangle->next, apu->sample_rate && triangle->length && triangle->linear && triangle->timer >= 2, triangle->timer + 1);
+}
+
+static void update_noise(APU *apu)
+{
+    APUNoise *noise = &apu->noise;
+    int level = noise->length ? volume(&noise->envelope) : 0;
+    noise->output = noise->shift & 1 ? 0 : level;
+    wake(apu, &noise->next, apu->sample_rate && level, noise->period);
+}
+
+static void update_dmc(APU *apu)
+{
+    APUDMC *dmc = &apu->dmc;
+    // the timer only matters while there are bits to play or bytes to fetch,
+    // synthesizing or not
+    wake(apu, &dmc->next, !dmc->silence || dmc->buffer_full || dmc->remaining, dmc->rate);
+}
+
+static void update(APU *apu)
+{
+    update_pulse(apu, 0);
+    update_pulse(apu, 1);
+    update_triangle(apu);
+    update_noise(apu);
+    update_dmc(apu);
+}
+
+// Record a change of the mixed output at the current cycle
+static void mix(APU *apu)
+{
+    if (!apu->sample_rate)
+    {
+        return;
+    }
+    int level = apu->pulse_table[apu->pulse[0].output + apu->pulse[1].output] +
+                apu->tnd_table[3 * apu->triangle.output + 2 * apu->noise.output + apu->dmc.level];
+    if (level != apu->mix)
+    {
+        Blip_add_delta(&apu->blip, apu->cycle - apu->blip_start, level - apu->mix);
+        apu->mix = level;
+    }
+}
+
+static void end_blip_frame(APU *apu)
+{
+    Blip_end_frame(&apu->blip, apu->cycle - apu->blip_start);
+    apu->blip_start = apu->cycle;
+}
+
+/*
+    Timers
+*/
+
+// Refill the sample buffer from memory
+static void dmc_fetch(APU *apu)
+{
+    APUDMC *dmc = &apu->dmc;
+    if (dmc->buffer_full || !dmc->remaining)
+    {
+        return;
+    }
+    dmc->buffer = Bus_read(apu->bus, dmc->address);
+    dmc->buffer_full = 1;
+    dmc->address = dmc->address == 0xFFFF ? 0x8000 : dmc->address + 1;
+    if (--dmc->remaining == 0)
+    {
+        if (dmc->loop)
+        {
+            dmc->address = dmc->sample_address;
+            dmc->remaining = dmc->sample_length;
+        }
+        else if (dmc->irq_enabled)
+        {
+            apu->dmc_irq = 1;
+            Bus_irq(apu->bus, BUS_IRQ_DMC, 1);
+        }
+    }
+}
+
+static void clock_dmc(APU *apu)
+{
+    APUDMC *dmc = &apu->dmc;
+    if (!dmc->silence)
+    {
+        if (dmc->shift & 1)
+        {
+            dmc->level += dmc->level <= 125 ? 2 : 0;
+        }
+        else
+        {
+            dmc->level -= dmc->level >= 2 ? 2 : 0;
+        }
+        dmc->shift >>= 1;
+    }
+    if (--dmc->bits == 0)
+    {
+        // start the next output cycle with the buffered byte, if there is one
+        dmc->bits = 8;
+        dmc->silence = !dmc->buffer_full;
+        dmc->shift = dmc->buffer;
+        dmc->buffer_full = 0;
+        dmc_fetch(apu);
+    }
+    dmc->next += dmc->rate;
+    update_dmc(apu);
+}
+
+static void clock_frame(APU *apu)
+{
+    int actions = frame_actions[apu->five_step][apu->frame_step];
+    if (actions & QUARTER)
+    {
+        clock_envelope(&apu->pulse[0].envelope);
+        clock_envelope(&apu->pulse[1].envelope);
+        clock_envelope(&apu->noise.envelope);
+        clock_linear(&apu->triangle);
+    }
+    if (actions & HALF)
+    {
+        for (int i = 0; i < 2; ++i)
+        {
+            clock_length(&apu->pulse[i].length, apu->pulse[i].envelope.loop);
+            clock_sweep(&apu->pulse[i], i);
+        }
+        clock_length(&apu->triangle.length, apu->triangle.control);
+        clock_length(&apu->noise.length, apu->noise.envelope.loop);
+    }
+    if ((actions & IRQ) && !apu->irq_inhibit)
+    {
+        apu->frame_irq = 1;
+        Bus_irq(apu->bus, BUS_IRQ_FRAME, 1);
+    }
+
+    if (++apu->frame_step == frame_lengths[apu->five_step])
+    {
+        apu->frame_step = 0;
+        apu->frame_start += frame_periods[apu->five_step];
+    }
+    apu->frame_next = apu->frame_start + frame_times[apu->five_step][apu->frame_step];
+    update(apu);
+
+    // keep the blip buffer's frames short even if nobody reads samples
+    if (apu->sample_rate)
+    {
+        end_blip_frame(apu);
+    }
+}
+
+static inline unsigned long long earliest(unsigned long long a, unsigned long long b)
+{
+    return a < b ? a : b;
+}
+
+// Run every event before target, in order
+static void run(APU *apu, unsigned long long target)
+{
+    for (;;)
+    {
+        unsigned long long now = earliest(apu->frame_next, apu->dmc.next);
+        now = earliest(now, earliest(apu->pulse[0].next, apu->pulse[1].next));
+        now = earliest(now, earliest(apu->triangle.next, apu->noise.next));
+        if (now >= target)
+        {
+            break;
+        }
+        apu->cycle = now;
+
+        for (int i = 0; i < 2; ++i)
+        {
+            APUPulse *pulse = &apu->pulse[i];
+            if (pulse->next == now)
+            {
+                pulse->step = (pulse->step + 1) & 7;
+                pulse->next += (pulse->timer + 1) * 2;
+                update_pulse(apu, i);
+            }
+        }
+        if (apu->triangle.next == now)
+        {
+            apu->triangle.step = (apu->triangle.step + 1) & 31;
+            apu->triangle.next += apu->triangle.timer + 1;
+            update_triangle(apu);
+        }
+        if (apu->noise.next == now)
+        {
+            APUNoise *noise = &apu->noise;
+            int feedback = (noise->shift ^ (noise->shift >> (noise->mode ? 6 : 1))) & 1;
+            noise->shift = noise->shift >> 1 | feedback << 14;
+            noise->next += noise->period;
+            update_noise(apu);
+        }
+        if (apu->dmc.next == now)
+        {
+            clock_dmc(apu);
+        }
+        if (apu->frame_next == now)
+        {
+            clock_frame(apu);
+        }
+        mix(apu);
+    }
+    apu->cycle = target;
+}
+
+// Find the next thing the CPU can see without an access: a frame counter step
+// (IRQ) or a DMC fetch (a memory read, and an IRQ after the last byte)
+static void schedule(APU *apu)
+{
+    unsigned long long next = apu->frame_next;
+    APUDMC *dmc = &apu->dmc;
+    if (dmc->remaining && dmc->next != NEVER)
+    {
+        next = earliest(next, dmc->next + (unsigned long long) (dmc->bits - 1) * dmc->rate);
+    }
+    apu->next_event = next + 1;
+}
+
+void APU_sync(APU *apu)
+{
+    run(apu, apu->bus->cycle);
+}
+
+size_t APU_samples(APU *apu, int16_t *out, size_t count)
+{
+    if (!apu->sample_rate)
+    {
+        return 0;
+    }
+    APU_sync(apu);
+    end_blip_frame(apu);
+    return Blip_read(&apu->blip, out, count);
+}
+
+void APU_adjust_rate(APU *apu, double ratio)
+{
+    if (!apu->sample_rate)
+    {
+        return;
+    }
+    // the rate applies to a whole blip frame, so start a new one
+    APU_sync(apu);
+    end_blip_frame(apu);
+    Blip_set_rates(&apu->blip, APU_CLOCK_RATE, apu->sample_rate * ratio);
+}
+
+/*
+    Registers
+*/
+
+static void reset_frame_counter(APU *apu)
+{
+    apu->frame_step = 0;
+    apu->frame_start = apu->cycle;
+    apu->frame_next = apu->frame_start + frame_times[apu->five_step][0];
+}
+
+static void write_status(APU *apu, int data)
+{
+    apu->enabled = data & 0x1F;
+    int *lengths[4] = {&apu->pulse[0].length, &apu->pulse[1].length, &apu->triangle.length, &apu->noise.length};
+    for (int i = 0; i < 4; ++i)
+    {
+        if (!(data & (1 << i)))
+        {
+            *lengths[i] = 0;
+        }
+    }
+
+    APUDMC *dmc = &apu->dmc;
+    apu->dmc_irq = 0;
+    if (!(data & STATUS_DMC))
+    {
+        dmc->remaining = 0;
+    }
+    else if (!dmc->remaining)
+    {
+        dmc->address = dmc->sample_address;
+        dmc->remaining = dmc->sample_length;
+        dmc_fetch(apu);
+    }
+}
+
+static int read_status(APU *apu)
+{
+    int data = (apu->pulse[0].length ? 0x01 : 0) | (apu->pulse[1].length ? 0x02 : 0) |
+               (apu->triangle.length ? 0x04 : 0) | (apu->noise.length ? 0x08 : 0) |
+               (apu->dmc.remaining ? STATUS_DMC : 0) |
+               (apu->frame_irq ? STATUS_FRAME_IRQ : 0) | (apu->dmc_irq ? STATUS_DMC_IRQ : 0);
+    apu->frame_irq = 0;
+    return data;
+}
+
+static void write_envelope(APUEnvelope *envelope, int data)
+{
+    envelope->loop = (data & 0x20) != 0;
+    envelope->constant = (data & 0x10) != 0;
+    envelope->period = data & 0x0F;
+}
+
+static void write_register(APU *apu, int addr, int data)
+{
+    if (addr < 0x4008)
+    {
+        int channel = (addr >> 2) & 1;
+        APUPulse *pulse = &apu->pulse[channel];
+        switch (addr & 3)
+        {
+        case 0:
+            pulse->duty = data >> 6;
+            write_envelope(&pulse->envelope, data);
+            break;
+        case 1:
+            pulse->sweep_enabled = (data & 0x80) != 0;
+            pulse->sweep_period = (data >> 4) & 7;
+            pulse->sweep_negate = (data & 0x08) != 0;
+            pulse->sweep_shift = data & 7;
+            pulse->sweep_reload = 1;
+            break;
+        case 2:
+            pulse->timer = (pulse->timer & 0x700) | data;
+            break;
+        case 3:
+            pulse->timer = (pulse->timer & 0xFF) | (data & 7) << 8;
+            if (apu->enabled & (1 << channel))
+            {
+                pulse->length = lengths[data >> 3];
+            }
+            pulse->step = 0;
+            pulse->envelope.start = 1;
+            break;
+        }
+        return;
+    }
+
+    APUTriangle *triangle = &apu->triangle;
+    APUNoise *noise = &apu->noise;
+    APUDMC *dmc = &apu->dmc;
+    switch (addr)
+    {
+    case 0x4008:
+        triangle->control = (data & 0x80) != 0;
+        triangle->linear_period = data & 0x7F;
+        break;
+    case 0x400A:
+        triangle->timer = (triangle->timer & 0x700) | data;
+        break;
+    case 0x400B:
+        triangle->timer = (triangle->timer & 0xFF) | (data & 7) << 8;
+        if (apu->enabled & 0x04)
+        {
+            triangle->length = lengths[data >> 3];
+        }
+        triangle->linear_reload = 1;
+        break;
+
+    case 0x400C:
+        write_envelope(&noise->envelope, data);
+        break;
+    case 0x400E:
+        noise->mode = (data & 0x80) != 0;
+        noise->period = noise_periods[data & 0x0F];
+        break;
+    case 0x400F:
+        if (apu->enabled & 0x08)
+        {
+            noise->length = lengths[data >> 3];
+        }
+        noise->envelope.start = 1;
+        break;
+
+    case 0x4010:
+        dmc->irq_enabled = (data & 0x80) != 0;
+        dmc->loop = (data & 0x40) != 0;
+        dmc->rate = dmc_rates[data & 0x0F];
+        if (!dmc->irq_enabled)
+        {
+            apu->dmc_irq = 0;
+        }
+        break;
+    case 0x4011:
+        dmc->level = data & 0x7F;
+        break;
+    case 0x4012:
+        dmc->sample_address = 0xC000 | data << 6;
+        break;
+    case 0x4013:
+        dmc->sample_length = data * 16 + 1;
+        break;
+
+    case 0x4015:
+        write_status(apu, data);
+        break;
+
+    case 0x4017:
+        apu->five_step = (data & 0x80) != 0;
+        apu->irq_inhibit = (data & 0x40) != 0;
+        if (apu->irq_inhibit)
+        {
+            apu->frame_irq = 0;
+        }
+        reset_frame_counter(apu);
+        if (apu->five_step)
+        {
+            // 5-step mode clocks everything straight away
+            apu->frame_step = 1;
+            clock_frame(apu);
+            reset_frame_counter(apu);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+void APU_message(APU *apu, Bus *bus)
+{
+    int addr;
+
+    switch (bus->message)
+    {
+    case BUS_TICK:
+        if (bus->cycle >= apu->next_event)
+        {
+            APU_sync(apu);
+            schedule(apu);
+        }
+        break;
+
+    case BUS_READ:
+        if (bus->addr == 0x4015)
+        {
+            APU_sync(apu);
+            bus->data = read_status(apu);
+            Bus_irq(bus, BUS_IRQ_FRAME, 0);
+        }
+        break;
+
+    case BUS_WRITE:
+        addr = bus->addr;
+        if ((addr >= 0x4000 && addr <= 0x4013) || addr == 0x4015 || addr == 0x4017)
+        {
+            int data = bus->data;
+            APU_sync(apu);
+            write_register(apu, addr, data);
+            // writes only ever acknowledge IRQs
+            Bus_irq(bus, BUS_IRQ_FRAME, apu->frame_irq);
+            Bus_irq(bus, BUS_IRQ_DMC, apu->dmc_irq);
+            update(apu);
+            mix(apu);
+            schedule(apu);
+        }
+        break;
+
+    case BUS_RESET:
+        APU_sync(apu);
+        write_status(apu, 0);
+        apu->frame_irq = 0;
+        Bus_irq(bus, BUS_IRQ_FRAME | BUS_IRQ_DMC, 0);
+        reset_frame_counter(apu);
+        update(apu);
+        mix(apu);
+        schedule(apu);
+        break;
+
+    default:
+        break;
+    }
+}
+
+void APU_init(APU *apu, Bus *bus, int sample_rate)
+{
+    memset(apu, 0, sizeof(*apu));
+    apu->bus = bus;
+    apu->sample_rate = sample_rate;
+    apu->cycle = apu->blip_start = bus->cycle;
+
+    apu->pulse[0].next = apu->pulse[1].next = apu->triangle.next = apu->noise.next = apu->dmc.next = NEVER;
+    apu->noise.shift = 1;
+    apu->noise.period = noise_periods[0];
+    apu->dmc.rate = dmc_rates[0];
+    apu->dmc.bits = 8;
+    apu->dmc.silence = 1;
+    apu->dmc.sample_address = 0xC000;
+    apu->dmc.sample_length = 1;
+    reset_frame_counter(apu);
+
+    // nonlinear mixer (nesdev)
+    for (int n = 1; n < 31; ++n)
+    {
+        apu->pulse_table[n] = 95.52 / (8128.0 / n + 100) * VOLUME + 0.5;
+    }
+    for (int n = 1; n < 203; ++n)
+    {
+        apu->tnd_table[n] = 163.67 / (24329.0 / n + 100) * VOLUME + 0.5;
+    }
+    if (sample_rate)
+    {
+        Blip_init(&apu->blip, APU_CLOCK_RATE, sample_rate);
+    }
+
+    apu->device.message = (BusDeviceMessage) &APU_message;
+    update(apu);
+    schedule(apu);
+}
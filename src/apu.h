@@ -0,0 +1,114 @@
+#pragma once
+
+#include "blip.h"
+#include "bus.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// NTSC CPU clock
+#define APU_CLOCK_RATE 1789773
+
+// Volume envelope shared by the pulse and noise channels
+typedef struct APUEnvelope
+{
+    int loop;     // also halts the length counter
+    int constant; // volume is fixed rather than decaying
+    int period;   // volume or decay period
+    int start, divider, decay;
+} APUEnvelope;
+
+typedef struct APUPulse
+{
+    APUEnvelope envelope;
+    int duty, step;
+    int timer;  // period in APU cycles - 1
+    int length;
+    int sweep_enabled, sweep_period, sweep_negate, sweep_shift, sweep_divider, sweep_reload;
+    int output;
+    unsigned long long next; // CPU cycle of the next sequencer step
+} APUPulse;
+
+typedef struct APUTriangle
+{
+    int control; // also halts the length counter
+    int linear_period, linear, linear_reload;
+    int step;
+    int timer;
+    int length;
+    int output;
+    unsigned long long next;
+} APUTriangle;
+
+typedef struct APUNoise
+{
+    APUEnvelope envelope;
+    int mode; // short sequence
+    int period;
+    int shift; // 15-bit LFSR
+    int length;
+    int output;
+    unsigned long long next;
+} APUNoise;
+
+typedef struct APUDMC
+{
+    int irq_enabled, loop;
+    int rate;
+    int level;
+    int sample_address, sample_length;
+    int address, remaining; // bytes left to fetch
+    int buffer, buffer_full;
+    int shift, bits, silence;
+    unsigned long long next;
+} APUDMC;
+
+// The APU only runs when it has to: when its registers are accessed, at frame
+// counter steps and DMC fetches (which the CPU can see without an access), and
+// when samples are wanted. Between those it runs from one channel event to the
+// next rather than every cycle, and records changes of the mixed output in a
+// band-limited step buffer that makes samples only when they are read.
+typedef struct APU
+{
+    BusDevice device;
+    Bus *bus;
+
+    APUPulse pulse[2];
+    APUTriangle triangle;
+    APUNoise noise;
+    APUDMC dmc;
+    int enabled; // channels enabled in $4015
+
+    // frame counter
+    int five_step, irq_inhibit;
+    int frame_step;
+    unsigned long long frame_start; // CPU cycle the sequence started
+    unsigned long long frame_next;  // CPU cycle of the next step
+    int frame_irq, dmc_irq;
+
+    unsigned long long cycle;      // next CPU cycle to run
+    unsigned long long next_event; // CPU cycle to catch up at without an access
+
+    // output: 0 sample rate is audio off, which keeps register and IRQ behaviour
+    // but never synthesizes
+    int sample_rate;
+    int mix;                       // last mixed level
+    unsigned long long blip_start; // CPU cycle of the blip buffer's frame start
+    int pulse_table[31];
+    int tnd_table[203];
+    Blip blip;
+} APU;
+
+// Samples are made at sample_rate, or not at all if it is 0
+void APU_init(APU *apu, Bus *bus, int sample_rate);
+
+// Run up to the bus's current cycle
+void APU_sync(APU *apu);
+
+// Samples made up to the bus's current cycle. Returns the number read into out,
+// at most count.
+size_t APU_samples(APU *apu, int16_t *out, size_t count);
+
+// Scale the output sample rate by ratio from the next sample on, to steer how
+// fast a consumer's buffer fills (see Audio_push)
+void APU_adjust_rate(APU *apu, double ratio);
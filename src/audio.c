@@ -0,0 +1,149 @@
+#include "audio.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+int Audio_init(Audio *audio, size_t latency)
+{
+    // the rate control divides by it
+    if (!latency)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    size_t size = 1;
+    while (size < latency * 2)
+    {
+        size <<= 1;
+    }
+    audio->samples = calloc(size, sizeof(int16_t));
+    if (!audio->samples)
+    {
+        return -1;
+    }
+    audio->size = size;
+    audio->target = latency;
+    atomic_init(&audio->head, 0);
+    atomic_init(&audio->tail, 0);
+    atomic_init(&audio->underruns, 0);
+    atomic_init(&audio->missing, 0);
+    atomic_init(&audio->dropped, 0);
+    atomic_init(&audio->ratio, 1);
+    return 0;
+}
+
+void Audio_free(Audio *audio)
+{
+    free(audio->samples);
+    audio->samples = 0;
+}
+
+// Copy count samples into the ring at index, wrapping around its end
+static void write_ring(Audio *audio, size_t index, const int16_t *samples, size_t count)
+{
+    size_t start = index & (audio->size - 1);
+    size_t first = count < audio->size - start ? count : audio->size - start;
+    memcpy(audio->samples + start, samples, first * sizeof(int16_t));
+    memcpy(audio->samples, samples + first, (count - first) * sizeof(int16_t));
+}
+
+static void read_ring(Audio *audio, size_t index, int16_t *samples, size_t count)
+{
+    size_t start = index & (audio->size - 1);
+    size_t first = count < audio->size - start ? count : audio->size - start;
+    memcpy(samples, audio->samples + start, first * sizeof(int16_t));
+    memcpy(samples + first, audio->samples, (count - first) * sizeof(int16_t));
+}
+
+double Audio_push(Audio *audio, const int16_t *samples, size_t count)
+{
+    size_t head = atomic_load_explicit(&audio->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&audio->tail, memory_order_acquire);
+    size_t room = audio->size - (head - tail);
+    if (count > room)
+    {
+        atomic_fetch_add_explicit(&audio->dropped, count - room, memory_order_relaxed);
+        count = room;
+    }
+    write_ring(audio, head, samples, count);
+    atomic_store_explicit(&audio->head, head + count, memory_order_release);
+
+    // proportional to how far the fill is from the target, at most the full
+    // adjustment either way
+    double error = ((double) audio->target - (double) (head + count - tail)) / audio->target;
+    error = error < -1 ? -1 : error > 1 ? 1 : error;
+    double ratio = 1 + error * AUDIO_MAX_ADJUST;
+    atomic_store_explicit(&audio->ratio, ratio, memory_order_relaxed);
+    return ratio;
+}
+
+size_t Audio_pull(Audio *audio, int16_t *out, size_t count)
+{
+    size_t tail = atomic_load_explicit(&audio->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&audio->head, memory_order_acquire);
+    size_t available = head - tail;
+    size_t real = count < available ? count : available;
+    read_ring(audio, tail, out, real);
+    atomic_store_explicit(&audio->tail, tail + real, memory_order_release);
+
+    if (real < count)
+    {
+        memset(out + real, 0, (count - real) * sizeof(int16_t));
+        atomic_fetch_add_explicit(&audio->underruns, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&audio->missing, count - real, memory_order_relaxed);
+    }
+    return real;
+}
+
+static void *sink_thread(void *arg)
+{
+    AudioSink *sink = arg;
+    int16_t *buffer = malloc(sink->period * sizeof(int16_t));
+    long long interval = (long long) sink->period * 1000000000 / sink->rate;
+
+    // absolute deadlines, so late wake ups don't add up to a slower rate
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    while (buffer && !atomic_load_explicit(&sink->stop, memory_order_relaxed))
+    {
+        Audio_pull(sink->audio, buffer, sink->period);
+        atomic_fetch_add_explicit(&sink->pulled, sink->period, memory_order_relaxed);
+
+        deadline.tv_nsec += interval;
+        while (deadline.tv_nsec >= 1000000000)
+        {
+            deadline.tv_nsec -= 1000000000;
+            ++deadline.tv_sec;
+        }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, 0) == EINTR)
+        {
+        }
+    }
+    free(buffer);
+    return 0;
+}
+
+int AudioSink_start(AudioSink *sink, Audio *audio, int rate, size_t period)
+{
+    sink->audio = audio;
+    sink->rate = rate;
+    sink->period = period;
+    atomic_init(&sink->stop, 0);
+    atomic_init(&sink->pulled, 0);
+    int error = pthread_create(&sink->thread, 0, sink_thread, sink);
+    if (error)
+    {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+void AudioSink_stop(AudioSink *sink)
+{
+    atomic_store_explicit(&sink->stop, 1, memory_order_relaxed);
+    pthread_join(sink->thread, 0);
+}
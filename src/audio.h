@@ -0,0 +1,68 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The most the rate controller changes the sample rate by
+#define AUDIO_MAX_ADJUST 0.005
+
+// Carries samples from the emulation thread to an audio thread. The ring is
+// single producer, single consumer and wait-free: each side only ever writes its
+// own index. The producer steers the APU's output rate by the fill level, a little
+// faster when the ring runs low and a little slower when it fills up, so audio
+// neither underruns nor drifts into latency when emulation is paced by video.
+typedef struct Audio
+{
+    int16_t *samples;
+    size_t size; // power of 2
+    size_t target; // fill level the rate controller aims for
+
+    // on separate cache lines so the threads don't contend
+    _Alignas(64) atomic_size_t head; // written by the producer
+    _Alignas(64) atomic_size_t tail; // written by the consumer
+
+    // metrics, readable from any thread
+    _Alignas(64) atomic_ullong underruns; // pulls that came up short
+    atomic_ullong missing;                // samples pulls had to fill with silence
+    atomic_ullong dropped;                // samples pushed to a full ring
+    _Atomic double ratio;                 // last rate adjustment, set by the producer
+} Audio;
+
+// A ring holding latency samples at the target fill level, and room for as many
+// again. Returns 0, or -1 and sets errno (EINVAL for no latency, ENOMEM).
+int Audio_init(Audio *audio, size_t latency);
+
+void Audio_free(Audio *audio);
+
+// Samples in the ring
+static inline size_t Audio_fill(Audio *audio)
+{
+    return atomic_load_explicit(&audio->head, memory_order_acquire) - atomic_load_explicit(&audio->tail, memory_order_acquire);
+}
+
+// Producer: add samples, dropping what doesn't fit. Returns the ratio to scale
+// the sample rate by for the next batch (see APU_adjust_rate).
+double Audio_push(Audio *audio, const int16_t *samples, size_t count);
+
+// Consumer: take count samples, padding with silence if there aren't enough.
+// Returns the number that were real.
+size_t Audio_pull(Audio *audio, int16_t *out, size_t count);
+
+// Stand-in for a sound card: a thread that pulls period samples at rate, on
+// schedule whether or not they are there
+typedef struct AudioSink
+{
+    Audio *audio;
+    int rate;
+    size_t period;
+    pthread_t thread;
+    atomic_int stop;
+    atomic_ullong pulled; // samples taken, real or not
+} AudioSink;
+
+// Returns 0, or -1 and sets errno
+int AudioSink_start(AudioSink *sink, Audio *audio, int rate, size_t period);
+
+void AudioSink_stop(AudioSink *sink);
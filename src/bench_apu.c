@@ -0,0 +1,79 @@
+#include "apu.h"
+#include "bus.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define FRAMES 3600
+#define FRAME_CYCLES 29781
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// A minute of all five channels changing notes every frame, reading the samples
+// at the end of each frame
+static void run(const char *name, int sample_rate)
+{
+    static unsigned char memory[0x4000];
+    static int16_t samples[4096];
+    Bus bus;
+    static APU apu;
+
+    srand(1);
+    for (size_t i = 0; i < sizeof(memory); ++i)
+    {
+        memory[i] = rand();
+    }
+    Bus_init(&bus);
+    Bus_map(&bus, 0xC000, sizeof(memory), memory, 0);
+    APU_init(&apu, &bus, sample_rate);
+    Bus_connect(&bus, (BusDevice*) &apu);
+
+    Bus_write(&bus, 0x4017, 0x40);
+    Bus_write(&bus, 0x4015, 0x1F);
+    Bus_write(&bus, 0x4000, 0xBF);
+    Bus_write(&bus, 0x4004, 0x7F);
+    Bus_write(&bus, 0x4008, 0xFF);
+    Bus_write(&bus, 0x400C, 0x3F);
+    Bus_write(&bus, 0x4010, 0x4E); // looped
+    Bus_write(&bus, 0x4013, 0xFF);
+
+    size_t total = 0;
+    double start = now();
+    for (int frame = 0; frame < FRAMES; ++frame)
+    {
+        int note = frame % 48;
+        Bus_write(&bus, 0x4002, 100 + note * 10);
+        Bus_write(&bus, 0x4003, 0x01);
+        Bus_write(&bus, 0x4006, 200 - note);
+        Bus_write(&bus, 0x4007, 0x00);
+        Bus_write(&bus, 0x400A, 150 + note * 3);
+        Bus_write(&bus, 0x400B, 0x00);
+        Bus_write(&bus, 0x400E, note & 0x0F);
+        Bus_write(&bus, 0x400F, 0x00);
+        if (frame % 16 == 0)
+        {
+            Bus_write(&bus, 0x4015, 0x1F);
+        }
+        for (int i = 0; i < FRAME_CYCLES; ++i)
+        {
+            Bus_tick(&bus);
+        }
+        total += APU_samples(&apu, samples, 4096);
+    }
+    double elapsed = now() - start;
+    printf("%-24s %8.1f x realtime (%zu samples)\n", name, (double) FRAMES * FRAME_CYCLES / APU_CLOCK_RATE / elapsed, total);
+}
+
+int main()
+{
+    run("apu 48 kHz", 48000);
+    run("apu 44.1 kHz", 44100);
+    run("apu off", 0);
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include "capture.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FRAMES 3600
+#define SAMPLES_PER_FRAME 735 // 44.1 kHz
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main()
+{
+    static Capture capture;
+    static unsigned short frame[VIDEO_PIXELS];
+    static unsigned char y[VIDEO_PIXELS], u[VIDEO_PIXELS / 4], v[VIDEO_PIXELS / 4];
+    static int16_t samples[SAMPLES_PER_FRAME];
+
+    srand(1);
+    for (int i = 0; i < VIDEO_PIXELS; ++i)
+    {
+        frame[i] = rand() % VIDEO_COLORS;
+    }
+
+    char video[] = "/tmp/nes_capture_XXXXXX", audio[] = "/tmp/nes_capture_XXXXXX";
+    close(mkstemp(video));
+    close(mkstemp(audio));
+    if (Capture_open(&capture, video, audio, 44100, 1) < 0)
+    {
+        perror(video);
+        return 1;
+    }
+
+    // conversion alone, into memory
+    double start = now();
+    for (int n = 0; n < FRAMES; ++n)
+    {
+        Capture_yuv420(&capture, frame, y, u, v);
+    }
+    printf("%-24s %10.1f frames/s\n", "yuv420", FRAMES / (now() - start));
+
+    // a minute of video with audio through the mapped files
+    start = now();
+    double worst = 0;
+    for (int n = 0; n < FRAMES; ++n)
+    {
+        double frame_start = now();
+        Capture_frame(&capture, frame);
+        Capture_audio(&capture, samples, SAMPLES_PER_FRAME);
+        double elapsed = now() - frame_start;
+        worst = elapsed > worst ? elapsed : worst;
+        frame[n % VIDEO_PIXELS] ^= 1;
+    }
+    double elapsed = now() - start;
+    printf("%-24s %10.1f frames/s %8.3f ms worst %6llu stalls\n", "capture", FRAMES / elapsed, worst * 1e3, capture.stalls);
+
+    start = now();
+    Capture_close(&capture);
+    printf("%-24s %10.1f ms\n", "close", (now() - start) * 1e3);
+    unlink(video);
+    unlink(audio);
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include "env.h"
+#include "test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define STEPS 300
+#define FRAMESKIP 4
+#define GRAYS 20000
+
+// A rom that draws: reset sets a palette and turns on NMI and rendering, then
+// counts in $10. Each NMI counts in $11, writes $10 to the nametable and CHR-RAM,
+// and scrolls.
+static const unsigned char reset[] = {
+    0x78, 0xA9, 0x40, 0x8D, 0x17, 0x40,                         // SEI, no frame IRQ
+    0xA9, 0x3F, 0x8D, 0x06, 0x20, 0xA9, 0x00, 0x8D, 0x06, 0x20, // palette
+    0xA9, 0x0F, 0x8D, 0x07, 0x20, 0xA9, 0x30, 0x8D, 0x07, 0x20,
+    0xA9, 0x16, 0x8D, 0x07, 0x20, 0xA9, 0x27, 0x8D, 0x07, 0x20,
+    0xA9, 0x80, 0x8D, 0x00, 0x20, 0xA9, 0x1E, 0x8D, 0x01, 0x20, // NMI, rendering
+    0xE6, 0x10, 0x4C, 0x2E, 0x80,                               // INC $10; JMP
+};
+static const unsigned char nmi[] = {
+    0xE6, 0x11,                                                 // INC $11
+    0xA9, 0x20, 0x8D, 0x06, 0x20, 0xA5, 0x11, 0x8D, 0x06, 0x20, // $20xx = $10
+    0xA5, 0x10, 0x8D, 0x07, 0x20,
+    0xA9, 0x00, 0x8D, 0x06, 0x20, 0xA5, 0x11, 0x8D, 0x06, 0x20, // $00xx = $10
+    0xA5, 0x10, 0x8D, 0x07, 0x20,
+    0xA5, 0x11, 0x8D, 0x05, 0x20, 0x8D, 0x05, 0x20,             // scroll
+    0xA9, 0x80, 0x8D, 0x00, 0x20, 0x40,                         // RTI
+};
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main()
+{
+    char *path = write_nrom(reset, sizeof(reset), nmi, sizeof(nmi));
+
+    Machine *machine = Machine_create(path, 0, PPU_SCANLINE, 0);
+    if (!machine)
+    {
+        perror(path);
+        return 1;
+    }
+    Env env;
+    Env_init(&env, machine);
+    EnvView view;
+
+    // every frame drawn, then only the last of each step
+    double start = now();
+    for (int step = 0; step < STEPS; ++step)
+    {
+        Controller_schedule(&machine->controller, machine->bus.cycle, 0, step);
+        for (int i = 0; i < FRAMESKIP; ++i)
+        {
+            Machine_frame(machine);
+        }
+    }
+    double drawn = now() - start;
+    start = now();
+    for (int step = 0; step < STEPS; ++step)
+    {
+        Env_step(&env, step, FRAMESKIP, &view);
+    }
+    double skipped = now() - start;
+    printf("step of %d frames, all drawn  %8.1f steps/s\n", FRAMESKIP, STEPS / drawn);
+    printf("step of %d frames, last drawn %8.1f steps/s\n", FRAMESKIP, STEPS / skipped);
+
+    static unsigned char gray[VIDEO_PIXELS];
+    for (int scale = 1; scale <= 4; scale *= 2)
+    {
+        start = now();
+        for (int i = 0; i < GRAYS; ++i)
+        {
+            Env_gray(&env, view.frame, scale, gray);
+        }
+        printf("gray 1/%d                     %8.2f us\n", scale, (now() - start) / GRAYS * 1e6);
+    }
+
+    Machine_destroy(machine);
+    unlink(path);
+    return 0;
+}
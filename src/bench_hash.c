@@ -0,0 +1,36 @@
+#include "hash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define FRAME_SIZE (256 * 240 * 2)
+#define FRAMES 20000
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main()
+{
+    unsigned char *frame = malloc(FRAME_SIZE);
+    srand(1);
+    for (int i = 0; i < FRAME_SIZE; ++i)
+    {
+        frame[i] = rand();
+    }
+
+    uint64_t h = 0;
+    double start = now();
+    for (int n = 0; n < FRAMES; ++n)
+    {
+        h = hash64(frame, FRAME_SIZE, h);
+    }
+    double elapsed = now() - start;
+    printf("%-24s %8.2f GB/s %10.0f frames/s (%016llx)\n", "hash64 frame", (double) FRAMES * FRAME_SIZE / elapsed / 1e9, FRAMES / elapsed, (unsigned long long) h);
+    free(frame);
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include "host.h"
+#include "test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SECONDS 2
+
+// A rom that draws: reset turns on NMI and rendering and counts in $10. Each NMI
+// counts in $11, writes $10 to the nametable and scrolls.
+static const unsigned char reset[] = {
+    0x78, 0xA9, 0x40, 0x8D, 0x17, 0x40,                         // SEI, no frame IRQ
+    0xA9, 0x80, 0x8D, 0x00, 0x20, 0xA9, 0x1E, 0x8D, 0x01, 0x20, // NMI, rendering
+    0xE6, 0x10, 0x4C, 0x10, 0x80,                               // INC $10; JMP
+};
+static const unsigned char nmi[] = {
+    0xE6, 0x11,                                                 // INC $11
+    0xA9, 0x20, 0x8D, 0x06, 0x20, 0xA5, 0x11, 0x8D, 0x06, 0x20, // $20xx = $10
+    0xA5, 0x10, 0x8D, 0x07, 0x20,
+    0xA5, 0x11, 0x8D, 0x05, 0x20, 0x8D, 0x05, 0x20,             // scroll
+    0xA9, 0x80, 0x8D, 0x00, 0x20, 0x40,                         // RTI
+};
+
+// Serve count sessions at 60 Hz for a while and report how they kept up
+static void run(const char *path, int count)
+{
+    Host host;
+    if (Host_start(&host, 0, 0, 1) < 0)
+    {
+        perror("host");
+        exit(1);
+    }
+    HostSession **sessions = calloc(count, sizeof(HostSession*));
+    for (int i = 0; i < count; ++i)
+    {
+        if (!(sessions[i] = Host_open(&host, path, 0, 0, 0, 0)))
+        {
+            perror("session");
+            exit(1);
+        }
+    }
+    sleep(SECONDS);
+
+    // the percentiles are of each session's, the worst of them
+    unsigned long long frames = 0, late = 0;
+    uint32_t p50 = 0, p99 = 0, max = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        HostStats stats;
+        Host_stats(sessions[i], &stats);
+        frames += stats.frames;
+        late += stats.late;
+        p50 = stats.p50 > p50 ? stats.p50 : p50;
+        p99 = stats.p99 > p99 ? stats.p99 : p99;
+        max = stats.max > max ? stats.max : max;
+    }
+    printf("%4d sessions %8.1f fps each %6.2f%% late  p50 %6.2f ms  p99 %6.2f ms  max %6.2f ms\n", count,
+           (double) frames / count / SECONDS, frames ? 100.0 * late / frames : 0, p50 * 1e-6, p99 * 1e-6, max * 1e-6);
+    Host_stop(&host);
+    free(sessions);
+}
+
+int main()
+{
+    char *path = write_nrom(reset, sizeof(reset), nmi, sizeof(nmi));
+
+    for (int count = 1; count <= 256; count *= 4)
+    {
+        run(path, count);
+    }
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include "machine.h"
+#include "test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FRAMES 1200
+#define SAMPLE_RATE 48000
+
+// A stand-in for a game. The main loop reads the controller, moves 64 sprites
+// in the OAM page and mixes them through a subroutine with (zp),Y accesses, then
+// waits for the next NMI. The NMI saves registers, does OAM DMA, writes the
+// nametable and scroll, plays a note and counts frames in $30.
+static const unsigned char reset[] = {
+    0x78, 0xD8, 0xA2, 0xFF, 0x9A,                   // SEI; CLD; LDX #$FF; TXS
+    0xA9, 0x02, 0x85, 0x23, 0xA9, 0x03, 0x85, 0x25, // ($22) = $0200, ($24) = $0300
+    0xA9, 0x40, 0x8D, 0x17, 0x40,                   // no frame IRQ
+    0xA9, 0x0F, 0x8D, 0x15, 0x40,                   // channels on
+    0xA9, 0x80, 0x8D, 0x00, 0x20,                   // NMI
+    0xA9, 0x1E, 0x8D, 0x01, 0x20,                   // rendering
+    0xA9, 0x01, 0x8D, 0x16, 0x40,                   // loop: strobe
+    0xA9, 0x00, 0x8D, 0x16, 0x40,
+    0xA2, 0x08,                                     // read 8 buttons into $20
+    0xAD, 0x16, 0x40, 0x4A, 0x26, 0x20, 0xCA, 0xD0, 0xF7,
+    0xA2, 0x00,                                     // move each sprite
+    0xBD, 0x00, 0x02, 0x18, 0x69, 0x01, 0x9D, 0x00, 0x02,
+    0xBD, 0x03, 0x02, 0x38, 0xE5, 0x20, 0x9D, 0x03, 0x02,
+    0x20, 0x00, 0x81,                               // JSR mix
+    0xE8, 0xE8, 0xE8, 0xE8, 0xD0, 0xE5,
+    0xA5, 0x30, 0xC5, 0x31, 0xF0, 0xFA, 0x85, 0x31, // wait for NMI
+    0x4C, 0x21, 0x80,                               // JMP loop
+};
+static const unsigned char mix[] = {
+    0x8A, 0x4A, 0x4A, 0xA8,       // Y = X / 4
+    0xB1, 0x22, 0x0A,             // LDA ($22),Y; ASL
+    0x7D, 0x01, 0x02, 0x91, 0x24, // ADC $0201,X; STA ($24),Y
+    0x49, 0x5A, 0x9D, 0x02, 0x02, // EOR #$5A; STA $0202,X
+    0x60,
+};
+static const unsigned char nmi[] = {
+    0x48, 0x8A, 0x48, 0x98, 0x48,                   // save A, X, Y
+    0xA9, 0x00, 0x8D, 0x03, 0x20,                   // OAM DMA
+    0xA9, 0x02, 0x8D, 0x14, 0x40,
+    0xAD, 0x02, 0x20,                               // nametable
+    0xA9, 0x20, 0x8D, 0x06, 0x20, 0xA5, 0x30, 0x8D, 0x06, 0x20, 0x8D, 0x07, 0x20,
+    0x8D, 0x05, 0x20, 0xA9, 0x00, 0x8D, 0x05, 0x20, // scroll
+    0xA9, 0x80, 0x8D, 0x00, 0x20,
+    0xA9, 0xBF, 0x8D, 0x00, 0x40,                   // note
+    0xA5, 0x30, 0x8D, 0x02, 0x40, 0xA9, 0x08, 0x8D, 0x03, 0x40,
+    0xE6, 0x30,                                     // INC $30
+    0x68, 0xA8, 0x68, 0xAA, 0x68, 0x40,             // restore; RTI
+};
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Run the game for FRAMES frames with the buttons changing every frame and audio
+// drained as main does
+static void run(const char *name, const char *path, PPUMode mode)
+{
+    static int16_t samples[BLIP_SIZE];
+
+    Machine *machine = Machine_create(path, 0, mode, SAMPLE_RATE);
+    if (!machine)
+    {
+        perror(name);
+        exit(1);
+    }
+
+    double start = now();
+    while (machine->ppu.frames < FRAMES)
+    {
+        unsigned long long frame = machine->ppu.frames;
+        Controller_schedule(&machine->controller, machine->bus.cycle + 1000, 0, frame * 37);
+        while (machine->ppu.frames == frame)
+        {
+            Bus_tick(&machine->bus);
+        }
+        APU_samples(&machine->apu, samples, BLIP_SIZE);
+    }
+    double elapsed = now() - start;
+
+    // the game has to have kept up with the frames for the numbers to mean much
+    if (machine->ram_bytes[0x30] != (unsigned char) (FRAMES - 1))
+    {
+        fprintf(stderr, "%s: the game ran %d frames\n", name, machine->ram_bytes[0x30]);
+        exit(1);
+    }
+    printf("%-24s %8.1f fps\n", name, FRAMES / elapsed);
+    Machine_destroy(machine);
+}
+
+int main()
+{
+    size_t size = 16 + 0x8000 + 0x2000;
+    unsigned char *rom = calloc(1, size);
+    memcpy(rom, "NES\x1A", 4);
+    rom[4] = 2;
+    rom[5] = 1;
+    unsigned char *prg = rom + 16;
+    memcpy(prg, reset, sizeof(reset));
+    memcpy(prg + 0x100, mix, sizeof(mix));
+    memcpy(prg + 0x200, nmi, sizeof(nmi));
+    memcpy(prg + 0x7FFA, (unsigned char[]) {0x00, 0x82, 0x00, 0x80, 0x00, 0x82}, 6);
+    srand(1);
+    for (int i = 0; i < 0x2000; ++i)
+    {
+        rom[16 + 0x8000 + i] = rand();
+    }
+    char *path = write_temp(rom, size);
+    free(rom);
+
+    run("machine scanline", path, PPU_SCANLINE);
+    run("machine dot", path, PPU_DOT);
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include "bus.h"
+#include "cart.h"
+#include "cpu.h"
+#include "ram.h"
+#include "test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CYCLES 20000000
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Run program from the last 8KB bank of a mapper's rom and report speed
+static void run(const char *name, int mapper, const unsigned char *program, size_t size, int switches_per_loop, int loop_cycles)
+{
+    size_t rom_size = 16 + 0x40000 + 0x20000;
+    unsigned char *rom = calloc(1, rom_size);
+    memcpy(rom, "NES\x1A", 4);
+    rom[4] = 16; // 256KB PRG
+    rom[5] = 16; // 128KB CHR
+    rom[6] = (mapper & 0xF) << 4;
+
+    unsigned char *last = rom + 16 + 0x40000 - 0x2000;
+    memcpy(last, program, size);
+    last[0x1FFC] = 0x00; // reset $E000
+    last[0x1FFD] = 0xE0;
+
+    Bus bus;
+    Cart cart;
+    CPU cpu;
+    RAM ram;
+
+    char *path = write_temp(rom, rom_size);
+    Bus_init(&bus);
+    CPU_init(&cpu, &bus);
+    RAM_init(&ram, 0x800, 0, 0x1FFF);
+    if (Cart_open(&cart, &bus, path, 0) < 0)
+    {
+        perror(name);
+        exit(1);
+    }
+    unlink(path);
+    free(rom);
+
+    Bus_connect(&bus, (BusDevice*) &cpu);
+    Bus_connect(&bus, (BusDevice*) &ram);
+    Bus_connect(&bus, (BusDevice*) &cart);
+    Bus_message(&bus, BUS_RESET);
+
+    double start = now();
+    for (int i = 0; i < CYCLES; ++i)
+    {
+        Bus_message(&bus, BUS_TICK);
+    }
+    double elapsed = now() - start;
+
+    double loops = (double)CYCLES / loop_cycles;
+    printf("%-24s %8.2f Mcycles/s %10.2f Mswitches/s\n", name, CYCLES / elapsed / 1e6, loops * switches_per_loop / elapsed / 1e6);
+    Cart_close(&cart);
+}
+
+int main()
+{
+    // E000 LDA #$06; STA $8000; STX $8001; LDA $8000; INX; JMP $E000
+    static const unsigned char mmc3[] = {0xA9, 0x06, 0x8D, 0x00, 0x80, 0x8E, 0x01, 0x80, 0xAD, 0x00, 0x80, 0xE8, 0x4C, 0x00, 0xE0};
+    run("mmc3 prg switch", 4, mmc3, sizeof(mmc3), 2, 2 + 4 + 4 + 4 + 2 + 3);
+
+    // E000 STX $8000; LDA $8000; INX; JMP $E000
+    static const unsigned char uxrom[] = {0x8E, 0x00, 0x80, 0xAD, 0x00, 0x80, 0xE8, 0x4C, 0x00, 0xE0};
+    run("uxrom prg switch", 2, uxrom, sizeof(uxrom), 1, 4 + 4 + 2 + 3);
+
+    // E000 LDA #$80; STA $8000 (reset) then 5x LSR/STA $E000 ...; INX; JMP
+    static const unsigned char mmc1[] = {
+        0x8A,             // TXA
+        0x8D, 0x00, 0xE0, // STA $E000
+        0x4A,             // LSR
+        0x8D, 0x00, 0xE0, // STA $E000
+        0x4A,             // LSR
+        0x8D, 0x00, 0xE0, // STA $E000
+        0x4A,             // LSR
+        0x8D, 0x00, 0xE0, // STA $E000
+        0x4A,             // LSR
+        0x8D, 0x00, 0xE0, // STA $E000
+        0xAD, 0x00, 0x80, // LDA $8000
+        0xE8,             // INX
+        0x4C, 0x00, 0xE0, // JMP $E000
+    };
+    run("mmc1 prg switch", 1, mmc1, sizeof(mmc1), 1, 2 + 5 * 4 + 4 * 2 + 4 + 2 + 3);
+
+    // baseline without switching: same loop shape writing to ram
+    static const unsigned char none[] = {0x8E, 0x00, 0x00, 0xAD, 0x00, 0x80, 0xE8, 0x4C, 0x00, 0xE0};
+    run("no switch (ram write)", 2, none, sizeof(none), 0, 4 + 4 + 2 + 3);
+
+    return 0;
+}
@@ -0,0 +1,43 @@
+#include "ntsc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define FRAMES 300
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void run(const char *name, NTSC *ntsc, const unsigned short *frame, uint32_t *out, int threads)
+{
+    NTSC_init(ntsc, threads);
+    double start = now();
+    for (int n = 0; n < FRAMES; ++n)
+    {
+        NTSC_filter(ntsc, frame, n % 3 * 4, out);
+    }
+    printf("%-24s %8.1f fps\n", name, FRAMES / (now() - start));
+    NTSC_free(ntsc);
+}
+
+int main()
+{
+    static NTSC ntsc;
+    static unsigned short frame[PPU_WIDTH * PPU_HEIGHT];
+    static uint32_t out[NTSC_WIDTH * NTSC_HEIGHT];
+
+    srand(1);
+    for (int i = 0; i < PPU_WIDTH * PPU_HEIGHT; ++i)
+    {
+        frame[i] = rand() % 512;
+    }
+
+    run("ntsc 512x240 1 thread", &ntsc, frame, out, 1);
+    run("ntsc 512x240 all cores", &ntsc, frame, out, 0);
+    return 0;
+}
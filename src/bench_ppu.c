@@ -0,0 +1,135 @@
+#include "bus.h"
+#include "cart.h"
+#include "cpu.h"
+#include "pipeline.h"
+#include "ppu.h"
+#include "ram.h"
+#include "test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FRAMES 600
+#define FRAME_CYCLES 29781
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Render FRAMES frames of noise tiles and sprites, with or without a CPU, and
+// drawn on the emulation thread or a second one
+static void run(const char *name, PPUMode mode, int with_cpu, int pipelined)
+{
+    // reset: LDA #$80; STA $2000; LDA #$1E; STA $2001; JMP *
+    static const unsigned char reset[] = {0xA9, 0x80, 0x8D, 0x00, 0x20, 0xA9, 0x1E, 0x8D, 0x01, 0x20, 0x4C, 0x0A, 0xE0};
+    // nmi: LDA #$02; STA $4014; LDA #$00; STA $2005; STA $2005; RTI
+    static const unsigned char nmi[] = {0xA9, 0x02, 0x8D, 0x14, 0x40, 0xA9, 0x00, 0x8D, 0x05, 0x20, 0x8D, 0x05, 0x20, 0x40};
+
+    size_t rom_size = 16 + 0x8000 + 0x2000;
+    unsigned char *rom = calloc(1, rom_size);
+    memcpy(rom, "NES\x1A", 4);
+    rom[4] = 2;
+    rom[5] = 1;
+
+    unsigned char *prg = rom + 16;
+    memcpy(prg + 0x6000, reset, sizeof(reset));
+    memcpy(prg + 0x6010, nmi, sizeof(nmi));
+    prg[0x7FFA] = 0x10; // nmi $E010
+    prg[0x7FFB] = 0xE0;
+    prg[0x7FFC] = 0x00; // reset $E000
+    prg[0x7FFD] = 0xE0;
+
+    srand(1);
+    for (int i = 0; i < 0x2000; ++i)
+    {
+        rom[16 + 0x8000 + i] = rand();
+    }
+
+    Bus bus;
+    Cart cart;
+    CPU cpu;
+    RAM ram;
+    static PPU ppu;
+
+    char *path = write_temp(rom, rom_size);
+    Bus_init(&bus);
+    if (Cart_open(&cart, &bus, path, 0) < 0)
+    {
+        perror(name);
+        exit(1);
+    }
+    unlink(path);
+    free(rom);
+
+    PPU_init(&ppu, &bus, &cart, mode);
+    for (int i = 0; i < 0x800; ++i)
+    {
+        ppu.ciram[i] = rand();
+    }
+    for (int i = 0; i < 256; ++i)
+    {
+        ppu.oam[i] = rand();
+    }
+    Bus_connect(&bus, (BusDevice*) &cart);
+    Bus_connect(&bus, (BusDevice*) &ppu);
+
+    if (with_cpu)
+    {
+        CPU_init(&cpu, &bus);
+        RAM_init(&ram, 0x800, 0, 0x1FFF);
+        memset(ram.bytes, 0, 0x800);
+        for (int i = 0x200; i < 0x300; ++i)
+        {
+            ram.bytes[i] = rand();
+        }
+        Bus_connect(&bus, (BusDevice*) &cpu);
+        Bus_connect(&bus, (BusDevice*) &ram);
+        Bus_message(&bus, BUS_RESET);
+    }
+    else
+    {
+        Bus_write(&bus, 0x2001, 0x1E);
+    }
+
+    static Pipeline pipeline;
+    if (pipelined && Pipeline_start(&pipeline, &ppu, 0, 0, 0) < 0)
+    {
+        perror(name);
+        exit(1);
+    }
+
+    double start = now();
+    for (long i = 0; i < (long) FRAMES * FRAME_CYCLES; ++i)
+    {
+        Bus_tick(&bus);
+    }
+    if (pipelined)
+    {
+        Pipeline_stop(&pipeline);
+    }
+    double elapsed = now() - start;
+
+    printf("%-24s %8.1f fps (%llu frames)\n", name, ppu.frames / elapsed, ppu.frames);
+    if (with_cpu)
+    {
+        free(ram.bytes);
+    }
+    Cart_close(&cart);
+}
+
+int main()
+{
+    run("ppu scanline", PPU_SCANLINE, 0, 0);
+    run("ppu dot", PPU_DOT, 0, 0);
+    run("cpu + ppu scanline", PPU_SCANLINE, 1, 0);
+    run("cpu + ppu dot", PPU_DOT, 1, 0);
+    run("cpu + ppu pipelined", PPU_SCANLINE, 1, 1);
+    run("cpu + ppu dot pipelined", PPU_DOT, 1, 1);
+    return 0;
+}
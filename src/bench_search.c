@@ -0,0 +1,58 @@
+#include "search.h"
+#include "test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PASSES 20000
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main()
+{
+    size_t size = 16 + 0x4000;
+    unsigned char *rom = calloc(1, size);
+    memcpy(rom, "NES\x1A", 4);
+    rom[4] = 1;
+    char *path = write_temp(rom, size);
+    free(rom);
+
+    Machine *machine = Machine_create(path, 0, PPU_SCANLINE, 0);
+    Search search;
+    if (!machine || Search_init(&search, machine) < 0)
+    {
+        perror(path);
+        return 1;
+    }
+    srand(1);
+    for (int i = 0; i < MACHINE_RAM_SIZE; ++i)
+    {
+        machine->ram_bytes[i] = rand();
+    }
+
+    // a first pass, with every index still a candidate
+    for (int width = 1; width <= 2; ++width)
+    {
+        double start = now();
+        for (int i = 0; i < PASSES; ++i)
+        {
+            Search_reset(&search);
+            Search_filter(&search, machine, SEARCH_UNCHANGED, width, 0);
+        }
+        double elapsed = now() - start;
+        printf("search %zu bytes, %d-bit %8.2f us\n", search.size, width * 8, elapsed / PASSES * 1e6);
+    }
+
+    Search_free(&search);
+    Machine_destroy(machine);
+    unlink(path);
+    return 0;
+}
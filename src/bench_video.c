@@ -0,0 +1,62 @@
+#include "video.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define FRAMES 2000
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report(const char *name, double elapsed, size_t pixel_size)
+{
+    printf("%-24s %8.1f MB/s %10.1f frames/s\n", name, (double) FRAMES * VIDEO_PIXELS * pixel_size / elapsed / 1e6, FRAMES / elapsed);
+}
+
+int main()
+{
+    static Video video;
+    static uint32_t rgba[VIDEO_PIXELS];
+    static uint16_t rgb565[VIDEO_PIXELS];
+
+    Video_init(&video);
+    unsigned short *frame = video.frames[0];
+    srand(1);
+    for (int i = 0; i < VIDEO_PIXELS; ++i)
+    {
+        frame[i] = rand() % VIDEO_COLORS;
+    }
+
+    // one lookup per pixel, for comparison
+    double start = now();
+    for (int n = 0; n < FRAMES; ++n)
+    {
+        for (int i = 0; i < VIDEO_PIXELS; ++i)
+        {
+            rgba[i] = video.rgba[frame[i]];
+        }
+        frame[n % VIDEO_PIXELS] ^= rgba[n % VIDEO_PIXELS] & 1;
+    }
+    report("rgba scalar", now() - start, 4);
+
+    start = now();
+    for (int n = 0; n < FRAMES; ++n)
+    {
+        Video_rgba(&video, frame, rgba);
+    }
+    report("rgba", now() - start, 4);
+
+    start = now();
+    for (int n = 0; n < FRAMES; ++n)
+    {
+        Video_rgb565(&video, frame, rgb565);
+    }
+    report("rgb565", now() - start, 2);
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include "blip.h"
+
+#include <math.h>
+#include <string.h>
+
+// Steps are cut off a little below the output's Nyquist frequency
+#define CUTOFF 0.45
+
+// Integrated levels leak this fraction per sample, a high pass like the NES's own
+#define BASS_SHIFT 9
+
+#define UNITY (1 << 14)
+
+void Blip_init(Blip *blip, double clock_rate, double sample_rate)
+{
+    memset(blip, 0, sizeof(*blip));
+    Blip_set_rates(blip, clock_rate, sample_rate);
+
+    // Blackman windowed sinc impulses, delayed by BLIP_HALF - 1 samples so every
+    // tap lands at or after the sample of the step
+    for (int phase = 0; phase < BLIP_PHASES; ++phase)
+    {
+        double taps[BLIP_HALF * 2], sum = 0;
+        for (int i = 0; i < BLIP_HALF * 2; ++i)
+        {
+            double x = i - (BLIP_HALF - 1) - (double) phase / BLIP_PHASES;
+            double sinc = x == 0 ? 1 : sin(M_PI * 2 * CUTOFF * x) / (M_PI * 2 * CUTOFF * x);
+            double window = 0.42 + 0.5 * cos(M_PI * x / BLIP_HALF) + 0.08 * cos(M_PI * 2 * x / BLIP_HALF);
+            taps[i] = sinc * window;
+            sum += taps[i];
+        }
+
+        // every phase sums to exactly unity so steps settle on the right level
+        int total = 0;
+        for (int i = 0; i < BLIP_HALF * 2; ++i)
+        {
+            blip->kernel[phase][i] = lround(taps[i] * UNITY / sum);
+            total += blip->kernel[phase][i];
+        }
+        blip->kernel[phase][BLIP_HALF - 1] += UNITY - total;
+    }
+}
+
+void Blip_set_rates(Blip *blip, double clock_rate, double sample_rate)
+{
+    blip->factor = (uint64_t) (sample_rate / clock_rate * 4294967296.0 + 0.5);
+}
+
+void Blip_end_frame(Blip *blip, unsigned clocks)
+{
+    blip->offset += clocks * blip->factor;
+    size_t available = Blip_available(blip);
+    if (available > BLIP_SIZE / 2)
+    {
+        Blip_read(blip, 0, available - BLIP_SIZE / 2);
+    }
+}
+
+size_t Blip_read(Blip *blip, int16_t *out, size_t count)
+{
+    size_t available = Blip_available(blip);
+    if (count > available)
+    {
+        count = available;
+    }
+
+    int64_t sum = blip->integrator;
+    for (size_t i = 0; i < count; ++i)
+    {
+        sum += blip->buffer[i];
+        int64_t sample = sum / UNITY;
+        if (out)
+        {
+            out[i] = sample < INT16_MIN ? INT16_MIN : sample > INT16_MAX ? INT16_MAX : sample;
+        }
+        sum -= sum >> BASS_SHIFT;
+    }
+    blip->integrator = sum;
+
+    size_t size = sizeof(blip->buffer) / sizeof(blip->buffer[0]);
+    memmove(blip->buffer, blip->buffer + count, (size - count) * sizeof(int32_t));
+    memset(blip->buffer + size - count, 0, count * sizeof(int32_t));
+    blip->offset -= (uint64_t) count << 32;
+    return count;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Kernel: phases per sample, and taps either side of a step
+#define BLIP_PHASE_BITS 5
+#define BLIP_PHASES (1 << BLIP_PHASE_BITS)
+#define BLIP_HALF 8
+
+// Samples buffered, half of which can be waiting to be read while the other half
+// is being added to
+#define BLIP_SIZE 8192
+
+// Band-limited step buffer. A source records the changes in its output level at
+// the clock they happen; each change adds a band-limited step to the samples
+// around it. Samples are made by integrating the buffer when they're read, so the
+// cost is per change and per sample, never per clock.
+typedef struct Blip
+{
+    uint64_t factor; // samples per clock, 32.32 fixed point
+    uint64_t offset; // position of clock 0 of the current frame, 32.32
+    int64_t integrator;
+    int32_t buffer[BLIP_SIZE + BLIP_HALF * 2];
+    int16_t kernel[BLIP_PHASES][BLIP_HALF * 2]; // each phase sums to 1 << 14
+} Blip;
+
+void Blip_init(Blip *blip, double clock_rate, double sample_rate);
+
+// Change the clock rate, keeping buffered samples
+void Blip_set_rates(Blip *blip, double clock_rate, double sample_rate);
+
+// Add a change in level of delta at clock time of the current frame
+static inline void Blip_add_delta(Blip *blip, unsigned time, int delta)
+{
+    uint64_t position = blip->offset + time * blip->factor;
+    int32_t *out = blip->buffer + (position >> 32);
+    const int16_t *kernel = blip->kernel[(position >> (32 - BLIP_PHASE_BITS)) & (BLIP_PHASES - 1)];
+    for (int i = 0; i < BLIP_HALF * 2; ++i)
+    {
+        out[i] += kernel[i] * delta;
+    }
+}
+
+// End the current frame clocks after it started, making the samples before then
+// available. A frame may be at most BLIP_SIZE / 2 samples long. Unread samples
+// beyond BLIP_SIZE / 2 are dropped, oldest first.
+void Blip_end_frame(Blip *blip, unsigned clocks);
+
+// Samples ready to be read
+static inline size_t Blip_available(const Blip *blip)
+{
+    return blip->offset >> 32;
+}
+
+// Read up to count samples (or drop them if out is null). Returns the number read.
+size_t Blip_read(Blip *blip, int16_t *out, size_t count);
@@ -1,9 +1,16 @@
 #include "bus.h"
 #include <assert.h>
+#include <string.h>
 
 void Bus_init(Bus *bus)
 {
     bus->devices = 0;
+    bus->cycle = 0;
+    bus->stall = 0;
+    bus->irq = 0;
+    bus->nmi = 0;
+    memset(bus->read_map, 0, sizeof(bus->read_map));
+    memset(bus->write_map, 0, sizeof(bus->write_map));
 }
 
 int Bus_connect(Bus *bus, BusDevice *device)
@@ -41,10 +48,40 @@ int Bus_disconnect(Bus *bus, BusDevice *device)
 
 void Bus_message(Bus *bus, Message message)
 {
-    bus->message = message;
+    // a device may send messages while handling one (a PPU raising NMI while it
+    // catches up), so every device still sees the message and address it was sent
+    int addr = bus->addr;
+    int data = bus->data;
 
     for (BusDevice *device = bus->devices; device; device = device->next)
     {
+        bus->message = message;
+        bus->addr = addr;
+        if (message != BUS_READ)
+        {
+            bus->data = data;
+        }
         device->message(device, bus);
     }
+    bus->message = message;
+}
+
+void Bus_map(Bus *bus, int addr, int size, unsigned char *read, unsigned char *write)
+{
+    assert((addr & BUS_PAGE_MASK) == 0 && (size & BUS_PAGE_MASK) == 0);
+    assert(addr + size <= 0x10000);
+
+    for (int page = addr >> BUS_PAGE_SHIFT, end = (addr + size) >> BUS_PAGE_SHIFT; page < end; ++page)
+    {
+        bus->read_map[page] = read;
+        bus->write_map[page] = write;
+        if (read)
+        {
+            read += BUS_PAGE_SIZE;
+        }
+        if (write)
+        {
+            write += BUS_PAGE_SIZE;
+        }
+    }
 }
@@ -22,23 +22,45 @@ typedef enum Message
     // Write a byte
     BUS_WRITE,
 
-    // Non-maskable interrupt (vblank)
-    BUS_NMI,
-
-    // Interrupt
-    BUS_IRQ,
-
     // Reset
     BUS_RESET,
 
 } Message;
 
+// IRQ sources, each holding its bit of Bus.irq for as long as it asserts the line
+#define BUS_IRQ_FRAME 0x01  // APU frame counter
+#define BUS_IRQ_DMC 0x02    // APU DMC sample end
+#define BUS_IRQ_MAPPER 0x04 // mapper scanline counter
+
+// The address space is split into pages that can be mapped directly to memory
+#define BUS_PAGE_SHIFT 8
+#define BUS_PAGE_SIZE (1 << BUS_PAGE_SHIFT)
+#define BUS_PAGE_MASK (BUS_PAGE_SIZE - 1)
+#define BUS_PAGES (0x10000 >> BUS_PAGE_SHIFT)
+
 typedef struct Bus
 {
     BusDevice *devices;
     Message message;
     int addr;
     int data;
+
+    // CPU cycles since power on, devices that run lazily catch up to this
+    unsigned long long cycle;
+
+    // Cycles DMA halts the CPU for, taken by the CPU after the current instruction
+    int stall;
+
+    // Interrupt lines, which the CPU looks at between instructions. IRQ is level
+    // triggered and stays asserted while any source holds it; NMI is edge triggered
+    // and taken once.
+    int irq; // BUS_IRQ_* sources asserting IRQ
+    int nmi; // an NMI edge the CPU hasn't taken yet
+
+    // Pages backed by plain memory are accessed through these pointers without a
+    // message. A null page falls back to sending BUS_READ/BUS_WRITE to devices.
+    unsigned char *read_map[BUS_PAGES];
+    unsigned char *write_map[BUS_PAGES];
 } Bus;
 
 void Bus_init(Bus *bus);
@@ -52,9 +74,37 @@ int Bus_disconnect(Bus *bus, BusDevice *device);
 // Send a message to every device on the bus
 void Bus_message(Bus *bus, Message message);
 
+// Advance one CPU cycle
+static inline void Bus_tick(Bus *bus)
+{
+    ++bus->cycle;
+    Bus_message(bus, BUS_TICK);
+}
+
+// Assert or release a source's IRQ
+static inline void Bus_irq(Bus *bus, int source, int asserted)
+{
+    bus->irq = asserted ? bus->irq | source : bus->irq & ~source;
+}
+
+// Signal NMI
+static inline void Bus_nmi(Bus *bus)
+{
+    bus->nmi = 1;
+}
+
+// Map size bytes at addr directly to memory (page aligned). Either pointer may be
+// null to leave that direction to the devices.
+void Bus_map(Bus *bus, int addr, int size, unsigned char *read, unsigned char *write);
+
 // Read a byte from the bus (convenience method)
 static inline int Bus_read(Bus *bus, int addr)
 {
+    unsigned char *page = bus->read_map[(addr >> BUS_PAGE_SHIFT) & (BUS_PAGES - 1)];
+    if (page)
+    {
+        return page[addr & BUS_PAGE_MASK];
+    }
     bus->addr = addr;
     Bus_message(bus, BUS_READ);
     return bus->data;
@@ -63,6 +113,12 @@ static inline int Bus_read(Bus *bus, int addr)
 // Write a byte to the bus (convenience method)
 static inline void Bus_write(Bus *bus, int addr, int byte)
 {
+    unsigned char *page = bus->write_map[(addr >> BUS_PAGE_SHIFT) & (BUS_PAGES - 1)];
+    if (page)
+    {
+        page[addr & BUS_PAGE_MASK] = byte;
+        return;
+    }
     bus->addr = addr;
     bus->data = byte;
     Bus_message(bus, BUS_WRITE);
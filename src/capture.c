@@ -0,0 +1,439 @@
+#ifdef __linux__
+#define _GNU_SOURCE // fallocate, sync_file_range
+#endif
+
+#include "capture.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_AVX2 1
+#endif
+
+// Windows overlap by the largest single write so that any write that doesn't fit
+// in one window fits in the next. Both are page multiples.
+#define WINDOW (16 << 20)
+#define RESERVE_MAX (1 << 20)
+
+// NTSC frame rate (39375000 / 655171 = 60.0988) and pixel aspect
+#define Y4M_HEADER "YUV4MPEG2 W256 H240 F39375000:655171 Ip A8:7 C420jpeg\n"
+#define WAV_HEADER_SIZE 44
+
+// Grow the file to cover a window at offset and map it
+static unsigned char *map_window(CaptureStream *stream, size_t offset)
+{
+    size_t end = offset + WINDOW;
+    if (end > stream->extended)
+    {
+        // allocate the blocks now rather than on the writer's page faults
+#ifdef __linux__
+        if (fallocate(stream->fd, 0, stream->extended, end - stream->extended) < 0 && ftruncate(stream->fd, end) < 0)
+#else
+        if (ftruncate(stream->fd, end) < 0)
+#endif
+        {
+            return 0;
+        }
+        stream->extended = end;
+    }
+
+    int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+    flags |= MAP_POPULATE;
+#endif
+    void *map = mmap(0, WINDOW, PROT_READ | PROT_WRITE, flags, stream->fd, offset);
+    return map == MAP_FAILED ? 0 : map;
+}
+
+static void unmap_window(CaptureStream *stream, unsigned char *map, size_t offset)
+{
+    // start write back without waiting for it
+#ifdef __linux__
+    sync_file_range(stream->fd, offset, WINDOW, SYNC_FILE_RANGE_WRITE);
+#else
+    msync(map, WINDOW, MS_ASYNC);
+#endif
+    munmap(map, WINDOW);
+}
+
+// A stream the thread has work for, called with the lock held
+static CaptureStream *pending(Capture *capture)
+{
+    CaptureStream *streams[2] = {&capture->video, &capture->audio};
+    for (int i = 0; i < 2; ++i)
+    {
+        CaptureStream *stream = streams[i];
+        if (stream->fd >= 0 && (stream->retired || (!stream->next && !capture->stop && !capture->error)))
+        {
+            return stream;
+        }
+    }
+    return 0;
+}
+
+// Keep a window mapped ahead of each stream and unmap the ones it has left
+static void *capture_thread(void *arg)
+{
+    Capture *capture = arg;
+    pthread_mutex_lock(&capture->lock);
+    for (;;)
+    {
+        CaptureStream *stream = pending(capture);
+        if (!stream)
+        {
+            if (capture->stop)
+            {
+                break;
+            }
+            pthread_cond_wait(&capture->work, &capture->lock);
+            continue;
+        }
+
+        if (!stream->next && !capture->stop && !capture->error)
+        {
+            size_t offset = stream->map_offset + WINDOW - RESERVE_MAX;
+            pthread_mutex_unlock(&capture->lock);
+            unsigned char *map = map_window(stream, offset);
+            int error = errno;
+            pthread_mutex_lock(&capture->lock);
+            if (map)
+            {
+                stream->next = map;
+                stream->next_offset = offset;
+            }
+            else
+            {
+                capture->error = error;
+            }
+        }
+        else
+        {
+            unsigned char *map = stream->retired;
+            size_t offset = stream->retired_offset;
+            pthread_mutex_unlock(&capture->lock);
+            unmap_window(stream, map, offset);
+            pthread_mutex_lock(&capture->lock);
+            stream->retired = 0;
+        }
+        pthread_cond_broadcast(&capture->ready);
+    }
+    pthread_mutex_unlock(&capture->lock);
+    return 0;
+}
+
+// Move on to the window the thread prepared, waiting only if it hasn't yet
+static int switch_window(Capture *capture, CaptureStream *stream)
+{
+    pthread_mutex_lock(&capture->lock);
+    if (!stream->next || stream->retired)
+    {
+        ++capture->stalls;
+    }
+    while ((!stream->next || stream->retired) && !capture->error)
+    {
+        pthread_cond_wait(&capture->ready, &capture->lock);
+    }
+    if (capture->error)
+    {
+        errno = capture->error;
+        pthread_mutex_unlock(&capture->lock);
+        return -1;
+    }
+    stream->retired = stream->map;
+    stream->retired_offset = stream->map_offset;
+    stream->map = stream->next;
+    stream->map_offset = stream->next_offset;
+    stream->next = 0;
+    pthread_cond_signal(&capture->work);
+    pthread_mutex_unlock(&capture->lock);
+    return 0;
+}
+
+// Claim size (at most RESERVE_MAX) contiguous bytes at the end of the stream
+static unsigned char *reserve(Capture *capture, CaptureStream *stream, size_t size)
+{
+    if (stream->size + size > stream->map_offset + WINDOW && switch_window(capture, stream) < 0)
+    {
+        return 0;
+    }
+    unsigned char *p = stream->map + (stream->size - stream->map_offset);
+    stream->size += size;
+    return p;
+}
+
+static int open_stream(CaptureStream *stream, const char *path)
+{
+    memset(stream, 0, sizeof(*stream));
+    stream->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (stream->fd < 0)
+    {
+        return -1;
+    }
+    stream->map = map_window(stream, 0);
+    if (!stream->map)
+    {
+        int error = errno;
+        close(stream->fd);
+        stream->fd = -1;
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+// Unmap what's left and trim the file to what was written
+static int trim_stream(CaptureStream *stream)
+{
+    munmap(stream->map, WINDOW);
+    if (stream->next)
+    {
+        munmap(stream->next, WINDOW);
+    }
+    return ftruncate(stream->fd, stream->size);
+}
+
+static void put16(unsigned char *p, int value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+static void put32(unsigned char *p, uint32_t value)
+{
+    put16(p, value);
+    put16(p + 2, value >> 16);
+}
+
+int Capture_open(Capture *capture, const char *y4m_path, const char *wav_path, int rate, int channels)
+{
+    memset(capture, 0, sizeof(*capture));
+    capture->video.fd = capture->audio.fd = -1;
+    capture->channels = channels;
+
+    // BT.601 studio range
+    for (int i = 0; i < VIDEO_COLORS; ++i)
+    {
+        uint32_t rgba = Video_color(i);
+        int r = rgba & 0xFF, g = rgba >> 8 & 0xFF, b = rgba >> 16 & 0xFF;
+        int y = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+        int u = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+        int v = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+        capture->yuv[i] = y | u << 8 | v << 16;
+    }
+
+    if (y4m_path && open_stream(&capture->video, y4m_path) < 0)
+    {
+        return -1;
+    }
+    if (wav_path && open_stream(&capture->audio, wav_path) < 0)
+    {
+        int error = errno;
+        if (y4m_path)
+        {
+            trim_stream(&capture->video);
+            close(capture->video.fd);
+        }
+        errno = error;
+        return -1;
+    }
+
+    if (y4m_path)
+    {
+        memcpy(reserve(capture, &capture->video, sizeof(Y4M_HEADER) - 1), Y4M_HEADER, sizeof(Y4M_HEADER) - 1);
+    }
+    if (wav_path)
+    {
+        // 16-bit PCM, sizes filled in on close
+        unsigned char *header = reserve(capture, &capture->audio, WAV_HEADER_SIZE);
+        memcpy(header, "RIFF\0\0\0\0WAVEfmt ", 16);
+        put32(header + 16, 16);
+        put16(header + 20, 1);
+        put16(header + 22, channels);
+        put32(header + 24, rate);
+        put32(header + 28, rate * channels * 2);
+        put16(header + 32, channels * 2);
+        put16(header + 34, 16);
+        memcpy(header + 36, "data\0\0\0\0", 8);
+    }
+
+    pthread_mutex_init(&capture->lock, 0);
+    pthread_cond_init(&capture->work, 0);
+    pthread_cond_init(&capture->ready, 0);
+    int error = pthread_create(&capture->thread, 0, capture_thread, capture);
+    if (error)
+    {
+        CaptureStream *streams[2] = {&capture->video, &capture->audio};
+        for (int i = 0; i < 2; ++i)
+        {
+            if (streams[i]->fd >= 0)
+            {
+                trim_stream(streams[i]);
+                close(streams[i]->fd);
+            }
+        }
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+#ifdef HAVE_AVX2
+
+// 16 pixels of a row pair at a time: gather Y | U << 8 | V << 16 per pixel, keep
+// the Y bytes and average U and V over each 2x2 block
+__attribute__((target("avx2")))
+static void yuv420_avx2(const uint32_t *lut, const unsigned short *frame, unsigned char *y, unsigned char *u, unsigned char *v)
+{
+    const __m256i colors = _mm256_set1_epi16(VIDEO_COLORS - 1);
+    const __m256i low = _mm256_set1_epi32(0xFF);
+    // U, V of each pixel into the low bytes of its 16-bit halves
+    const __m256i chroma = _mm256_setr_epi8(1, -1, 2, -1, 5, -1, 6, -1, 9, -1, 10, -1, 13, -1, 14, -1,
+                                            1, -1, 2, -1, 5, -1, 6, -1, 9, -1, 10, -1, 13, -1, 14, -1);
+    const __m256i round = _mm256_set1_epi32(0x00020002);
+    // U bytes then V bytes of each 128-bit lane
+    const __m256i split = _mm256_setr_epi8(0, 4, 8, 12, 2, 6, 10, 14, -1, -1, -1, -1, -1, -1, -1, -1,
+                                           0, 4, 8, 12, 2, 6, 10, 14, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 3, 6, 7);
+
+    for (int row = 0; row < PPU_HEIGHT; row += 2)
+    {
+        for (int x = 0; x < PPU_WIDTH; x += 16)
+        {
+            __m256i pixels[2][2];
+            for (int r = 0; r < 2; ++r)
+            {
+                const unsigned short *src = frame + (row + r) * PPU_WIDTH + x;
+                __m256i indices = _mm256_and_si256(_mm256_loadu_si256((const __m256i*) src), colors);
+                pixels[r][0] = _mm256_i32gather_epi32((const int*) lut, _mm256_cvtepu16_epi32(_mm256_castsi256_si128(indices)), 4);
+                pixels[r][1] = _mm256_i32gather_epi32((const int*) lut, _mm256_cvtepu16_epi32(_mm256_extracti128_si256(indices, 1)), 4);
+
+                // packing works within 128-bit lanes, so put the quarters back in order
+                __m256i words = _mm256_packus_epi32(_mm256_and_si256(pixels[r][0], low), _mm256_and_si256(pixels[r][1], low));
+                words = _mm256_permute4x64_epi64(words, 0xD8);
+                __m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), 0x08);
+                _mm_storeu_si128((__m128i*) (y + (row + r) * PPU_WIDTH + x), _mm256_castsi256_si128(bytes));
+            }
+
+            // summed down then across
+            __m256i left = _mm256_add_epi32(_mm256_shuffle_epi8(pixels[0][0], chroma), _mm256_shuffle_epi8(pixels[1][0], chroma));
+            __m256i right = _mm256_add_epi32(_mm256_shuffle_epi8(pixels[0][1], chroma), _mm256_shuffle_epi8(pixels[1][1], chroma));
+            __m256i sums = _mm256_permute4x64_epi64(_mm256_hadd_epi32(left, right), 0xD8);
+            __m256i means = _mm256_srli_epi16(_mm256_add_epi16(sums, round), 2);
+            __m128i planes = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(means, split), order));
+            int offset = row / 2 * (PPU_WIDTH / 2) + x / 2;
+            _mm_storel_epi64((__m128i*) (u + offset), planes);
+            _mm_storel_epi64((__m128i*) (v + offset), _mm_unpackhi_epi64(planes, planes));
+        }
+    }
+}
+
+#endif
+
+void Capture_yuv420(const Capture *capture, const unsigned short *frame, unsigned char *y, unsigned char *u, unsigned char *v)
+{
+#ifdef HAVE_AVX2
+    if (__builtin_cpu_supports("avx2"))
+    {
+        yuv420_avx2(capture->yuv, frame, y, u, v);
+        return;
+    }
+#endif
+    const uint32_t *lut = capture->yuv;
+    for (int row = 0; row < PPU_HEIGHT; row += 2)
+    {
+        const unsigned short *top = frame + row * PPU_WIDTH;
+        const unsigned short *bottom = top + PPU_WIDTH;
+        for (int x = 0; x < PPU_WIDTH; x += 2)
+        {
+            uint32_t a = lut[top[x] & (VIDEO_COLORS - 1)], b = lut[top[x + 1] & (VIDEO_COLORS - 1)];
+            uint32_t c = lut[bottom[x] & (VIDEO_COLORS - 1)], d = lut[bottom[x + 1] & (VIDEO_COLORS - 1)];
+            y[row * PPU_WIDTH + x] = a;
+            y[row * PPU_WIDTH + x + 1] = b;
+            y[(row + 1) * PPU_WIDTH + x] = c;
+            y[(row + 1) * PPU_WIDTH + x + 1] = d;
+            int offset = row / 2 * (PPU_WIDTH / 2) + x / 2;
+            u[offset] = ((a >> 8 & 0xFF) + (b >> 8 & 0xFF) + (c >> 8 & 0xFF) + (d >> 8 & 0xFF) + 2) >> 2;
+            v[offset] = ((a >> 16 & 0xFF) + (b >> 16 & 0xFF) + (c >> 16 & 0xFF) + (d >> 16 & 0xFF) + 2) >> 2;
+        }
+    }
+}
+
+int Capture_frame(Capture *capture, const unsigned short *frame)
+{
+    // converted straight into the file's pages
+    unsigned char *p = reserve(capture, &capture->video, CAPTURE_FRAME_SIZE);
+    if (!p)
+    {
+        return -1;
+    }
+    memcpy(p, "FRAME\n", 6);
+    unsigned char *y = p + 6;
+    Capture_yuv420(capture, frame, y, y + VIDEO_PIXELS, y + VIDEO_PIXELS * 5 / 4);
+    ++capture->frames;
+    return 0;
+}
+
+int Capture_audio(Capture *capture, const int16_t *samples, size_t count)
+{
+    while (count)
+    {
+        size_t chunk = count < RESERVE_MAX / 2 ? count : RESERVE_MAX / 2;
+        unsigned char *p = reserve(capture, &capture->audio, chunk * 2);
+        if (!p)
+        {
+            return -1;
+        }
+        memcpy(p, samples, chunk * 2);
+        samples += chunk;
+        count -= chunk;
+    }
+    return 0;
+}
+
+int Capture_close(Capture *capture)
+{
+    pthread_mutex_lock(&capture->lock);
+    capture->stop = 1;
+    pthread_cond_signal(&capture->work);
+    pthread_mutex_unlock(&capture->lock);
+    pthread_join(capture->thread, 0);
+    pthread_mutex_destroy(&capture->lock);
+    pthread_cond_destroy(&capture->work);
+    pthread_cond_destroy(&capture->ready);
+
+    int error = capture->error;
+    CaptureStream *video = &capture->video;
+    if (video->fd >= 0 && (trim_stream(video) < 0 || close(video->fd) < 0) && !error)
+    {
+        error = errno;
+    }
+
+    CaptureStream *audio = &capture->audio;
+    if (audio->fd >= 0)
+    {
+        // the header is unmapped by now, so patch its sizes in directly
+        unsigned char riff[4], data[4];
+        put32(riff, audio->size - 8);
+        put32(data, audio->size - WAV_HEADER_SIZE);
+        if ((trim_stream(audio) < 0 || pwrite(audio->fd, riff, 4, 4) != 4 || pwrite(audio->fd, data, 4, 40) != 4) && !error)
+        {
+            error = errno;
+        }
+        if (close(audio->fd) < 0 && !error)
+        {
+            error = errno;
+        }
+    }
+
+    if (error)
+    {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "video.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bytes of one Y4M frame: "FRAME\n", then Y at full and U, V at half resolution
+#define CAPTURE_FRAME_SIZE (6 + VIDEO_PIXELS * 3 / 2)
+
+// An output file written through a window mapped into memory. The writer fills
+// the current window while the capture thread grows the file and maps the next
+// one ahead of it, so writing never waits on the file system.
+typedef struct CaptureStream
+{
+    int fd;
+    size_t size;          // bytes written
+
+    unsigned char *map;   // current window
+    size_t map_offset;
+    unsigned char *next;  // prepared by the thread, or 0
+    size_t next_offset;
+    unsigned char *retired; // left for the thread to flush and unmap, or 0
+    size_t retired_offset;
+    size_t extended;      // file size so far
+} CaptureStream;
+
+// Writes frames to a Y4M file and samples to a WAV file
+typedef struct Capture
+{
+    CaptureStream video;  // fd < 0 without video
+    CaptureStream audio;  // fd < 0 without audio
+    int channels;
+
+    uint32_t yuv[VIDEO_COLORS]; // Y | U << 8 | V << 16 of each PPU pixel
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t work;  // the writer switched windows or is closing
+    pthread_cond_t ready; // the thread prepared a window
+    int stop;
+    int error;            // errno of a failed extend or map
+
+    unsigned long long frames;
+    unsigned long long stalls; // window switches that waited on the thread
+} Capture;
+
+// Start capturing frames to y4m_path and 16-bit samples at rate to wav_path
+// (either may be null). Returns 0, or -1 and sets errno.
+int Capture_open(Capture *capture, const char *y4m_path, const char *wav_path, int rate, int channels);
+
+// Append a frame of PPU pixels, converted to YUV420. Returns 0, or -1 and sets
+// errno if the file couldn't be grown.
+int Capture_frame(Capture *capture, const unsigned short *frame);
+
+// Append count interleaved samples
+int Capture_audio(Capture *capture, const int16_t *samples, size_t count);
+
+// Finish both files, trimmed to what was written. Returns 0, or -1 and sets errno.
+int Capture_close(Capture *capture);
+
+// Convert a frame to planar YUV420 through the capture's colour table
+void Capture_yuv420(const Capture *capture, const unsigned short *frame, unsigned char *y, unsigned char *u, unsigned char *v);
@@ -0,0 +1,419 @@
+#include "cart.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PRG_WINDOW_ADDR(WINDOW) (0x6000 + (WINDOW) * CART_PRG_WINDOW_SIZE)
+
+void Cart_message(Cart *cart, Bus *bus)
+{
+    // mapped windows are normally accessed by the bus directly, this only serves
+    // reads sent without going through the map
+    int addr = bus->addr;
+    unsigned char *bank;
+
+    switch (bus->message)
+    {
+    case BUS_READ:
+        if (addr >= 0x6000 && addr <= 0xFFFF)
+        {
+            bank = cart->prg_map[(addr - 0x6000) / CART_PRG_WINDOW_SIZE];
+            if (bank)
+            {
+                bus->data = bank[addr % CART_PRG_WINDOW_SIZE];
+            }
+        }
+        break;
+
+    case BUS_WRITE:
+        if (addr >= 0x8000 && addr <= 0xFFFF && cart->mapper->write)
+        {
+            int data = bus->data;
+            if (cart->sync)
+            {
+                cart->sync(cart->sync_arg);
+            }
+            cart->mapper->write(cart, addr, data);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+void Cart_map_prg(Cart *cart, int window, unsigned char *bank, int writable)
+{
+    assert(window >= 0 && window < CART_PRG_WINDOWS);
+    cart->prg_map[window] = bank;
+    Bus_map(cart->bus, PRG_WINDOW_ADDR(window), CART_PRG_WINDOW_SIZE, bank, writable ? bank : 0);
+    if (cart->remap)
+    {
+        cart->remap(cart->remap_arg, window);
+    }
+}
+
+void Cart_remap(Cart *cart)
+{
+    for (int i = 0; i < CART_PRG_WINDOWS; ++i)
+    {
+        Cart_map_prg(cart, i, cart->prg_map[i], cart->bus->write_map[PRG_WINDOW_ADDR(i) >> BUS_PAGE_SHIFT] != 0);
+    }
+}
+
+void Cart_mirror(Cart *cart, int mirroring)
+{
+    // four-screen boards cannot change their layout
+    if (cart->mirroring == MIRRORING_FOUR_SCREEN)
+    {
+        mirroring = MIRRORING_FOUR_SCREEN;
+    }
+    cart->mirroring = mirroring;
+
+    unsigned char *a = cart->ciram, *b = cart->ciram ? cart->ciram + 0x400 : 0;
+    switch (mirroring)
+    {
+    case MIRRORING_HORIZONTAL:
+        cart->nt_map[0] = cart->nt_map[1] = a;
+        cart->nt_map[2] = cart->nt_map[3] = b;
+        break;
+
+    case MIRRORING_VERTICAL:
+        cart->nt_map[0] = cart->nt_map[2] = a;
+        cart->nt_map[1] = cart->nt_map[3] = b;
+        break;
+
+    case MIRRORING_SINGLE_LOW:
+        cart->nt_map[0] = cart->nt_map[1] = cart->nt_map[2] = cart->nt_map[3] = a;
+        break;
+
+    case MIRRORING_SINGLE_HIGH:
+        cart->nt_map[0] = cart->nt_map[1] = cart->nt_map[2] = cart->nt_map[3] = b;
+        break;
+
+    case MIRRORING_FOUR_SCREEN:
+        cart->nt_map[0] = a;
+        cart->nt_map[1] = b;
+        cart->nt_map[2] = cart->vram;
+        cart->nt_map[3] = cart->vram + 0x400;
+        break;
+    }
+}
+
+void Cart_attach_ciram(Cart *cart, unsigned char *ciram)
+{
+    cart->ciram = ciram;
+    Cart_mirror(cart, cart->mirroring);
+}
+
+// Replace header values with the ones the rom index has for it
+static void correct(INES *ines, const RomDBEntry *entry)
+{
+    ines->mapper = entry->mapper;
+    ines->submapper = entry->submapper;
+    ines->four_screen = entry->mirroring == MIRRORING_FOUR_SCREEN;
+    if (!ines->four_screen)
+    {
+        ines->mirroring = entry->mirroring;
+    }
+    ines->battery = entry->battery;
+    ines->prg_ram_size = entry->battery ? 0 : entry->prg_ram_size;
+    ines->prg_nvram_size = entry->battery ? entry->prg_ram_size : 0;
+}
+
+int Cart_open(Cart *cart, Bus *bus, const char *path, const RomDB *db)
+{
+    memset(cart, 0, sizeof(*cart));
+    cart->save.fd = -1;
+    cart->bus = bus;
+    cart->device.message = (BusDeviceMessage) &Cart_message;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size < INES_HEADER_SIZE)
+    {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    // map the whole file, sections are used in place and paged in on demand
+    void *file = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED)
+    {
+        return -1;
+    }
+    cart->file = file;
+    cart->file_size = st.st_size;
+
+    if (INES_parse(&cart->ines, cart->file, cart->file_size) < 0)
+    {
+        Cart_close(cart);
+        errno = EINVAL;
+        return -1;
+    }
+
+    INES *ines = &cart->ines;
+    if (db)
+    {
+        const RomDBEntry *entry = RomDB_identify(db, path, cart->file, cart->file_size, st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec);
+        if (entry)
+        {
+            correct(ines, entry);
+        }
+    }
+
+    cart->mapper = Mapper_find(ines->mapper);
+    if (!cart->mapper)
+    {
+        Cart_close(cart);
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    cart->prg = cart->file + ines->prg_offset;
+    cart->prg_size = ines->prg_size;
+
+    if (ines->chr_size)
+    {
+        cart->chr = cart->file + ines->chr_offset;
+        cart->chr_size = ines->chr_size;
+    }
+    else
+    {
+        cart->chr_size = ines->chr_ram_size + ines->chr_nvram_size;
+        if (!cart->chr_size)
+        {
+            cart->chr_size = 0x2000;
+        }
+        cart->chr = calloc(1, cart->chr_size);
+        cart->chr_ram = 1;
+    }
+
+    // the trainer lives at $7000 so it needs PRG-RAM even if the header says none
+    cart->prg_ram_size = ines->prg_ram_size + ines->prg_nvram_size;
+    if (ines->trainer_offset && cart->prg_ram_size < CART_PRG_WINDOW_SIZE)
+    {
+        cart->prg_ram_size = CART_PRG_WINDOW_SIZE;
+    }
+    if (cart->prg_ram_size)
+    {
+        // always back the whole window so smaller sizes mirror harmlessly
+        cart->prg_ram = calloc(1, cart->prg_ram_size < CART_PRG_WINDOW_SIZE ? CART_PRG_WINDOW_SIZE : cart->prg_ram_size);
+        if (ines->trainer_offset)
+        {
+            memcpy(cart->prg_ram + 0x1000, cart->file + ines->trainer_offset, INES_TRAINER_SIZE);
+        }
+    }
+
+    if (ines->four_screen)
+    {
+        cart->vram = calloc(1, 0x800);
+        cart->mirroring = MIRRORING_FOUR_SCREEN;
+    }
+    else
+    {
+        cart->mirroring = ines->mirroring;
+    }
+
+    if (!cart->chr || TileCache_init(&cart->tiles, cart->chr_size / TILE_SIZE) < 0 ||
+        (cart->prg_ram_size && !cart->prg_ram) || (ines->four_screen && !cart->vram))
+    {
+        Cart_close(cart);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    // PRG-RAM is always at $6000 unless the mapper says otherwise
+    if (cart->prg_ram)
+    {
+        Cart_map_prg(cart, 0, cart->prg_ram, 1);
+    }
+    cart->mapper->reset(cart);
+
+    return 0;
+}
+
+// Each part of moved RAM starts on a cache line
+#define RAM_ALIGN(SIZE) (((SIZE) + 63) & ~(size_t) 63)
+
+static size_t prg_ram_bytes(const Cart *cart)
+{
+    if (!cart->prg_ram)
+    {
+        return 0;
+    }
+    return cart->prg_ram_size < CART_PRG_WINDOW_SIZE ? CART_PRG_WINDOW_SIZE : cart->prg_ram_size;
+}
+
+// Point p, if it is inside the size bytes at from, at the same place in to
+static unsigned char *rebase(unsigned char *p, unsigned char *from, size_t size, unsigned char *to)
+{
+    return p && p >= from && p < from + size ? to + (p - from) : p;
+}
+
+// Re-point PRG-RAM and every window showing part of it from the size bytes at
+// from to the same place in to
+static void rebase_prg_ram(Cart *cart, unsigned char *from, size_t size, unsigned char *to)
+{
+    for (int i = 0; i < CART_PRG_WINDOWS; ++i)
+    {
+        unsigned char *bank = rebase(cart->prg_map[i], from, size, to);
+        if (bank != cart->prg_map[i])
+        {
+            Cart_map_prg(cart, i, bank, cart->bus->write_map[PRG_WINDOW_ADDR(i) >> BUS_PAGE_SHIFT] != 0);
+        }
+    }
+    cart->prg_ram = to;
+}
+
+void Cart_move_prg_ram(Cart *cart, unsigned char *ram)
+{
+    if (cart->prg_ram && ram != cart->prg_ram)
+    {
+        memcpy(ram, cart->prg_ram, prg_ram_bytes(cart));
+        rebase_prg_ram(cart, cart->prg_ram, prg_ram_bytes(cart), ram);
+    }
+}
+
+int Cart_open_save(Cart *cart, const char *path, int interval)
+{
+    if (!cart->ines.battery || !cart->prg_ram)
+    {
+        return 0;
+    }
+
+    // the whole window is backed so the file covers it too, and a new file starts
+    // from what is there now, trainer included
+    size_t size = prg_ram_bytes(cart);
+    if (Save_open(&cart->save, path, cart->prg_ram, size, interval) < 0)
+    {
+        return -1;
+    }
+
+    unsigned char *old = cart->prg_ram;
+    rebase_prg_ram(cart, old, size, cart->save.ram);
+    if (!cart->memory)
+    {
+        free(old);
+    }
+    return 0;
+}
+
+size_t Cart_ram_size(const Cart *cart)
+{
+    return RAM_ALIGN(prg_ram_bytes(cart)) + (cart->chr_ram ? RAM_ALIGN(cart->chr_size) : 0) + (cart->vram ? 0x800 : 0);
+}
+
+void Cart_move(Cart *cart, Bus *bus, unsigned char *memory)
+{
+    // PRG-RAM in a save file stays there, but its space is kept for a copy
+    size_t reserved = prg_ram_bytes(cart);
+    size_t prg_size = cart->save.map ? 0 : reserved;
+    unsigned char *prg_ram = prg_size ? memory : cart->prg_ram;
+    unsigned char *chr = cart->chr_ram ? memory + RAM_ALIGN(reserved) : cart->chr;
+    unsigned char *vram = cart->vram ? memory + RAM_ALIGN(reserved) + (cart->chr_ram ? RAM_ALIGN(cart->chr_size) : 0) : 0;
+
+    if (prg_size)
+    {
+        memcpy(prg_ram, cart->prg_ram, prg_size);
+    }
+    if (cart->chr_ram)
+    {
+        memcpy(chr, cart->chr, cart->chr_size);
+    }
+    if (vram)
+    {
+        memcpy(vram, cart->vram, 0x800);
+    }
+
+    // the windows keep pointing at the same bytes, now on the new bus
+    int writable[CART_PRG_WINDOWS];
+    for (int i = 0; i < CART_PRG_WINDOWS; ++i)
+    {
+        writable[i] = cart->bus->write_map[PRG_WINDOW_ADDR(i) >> BUS_PAGE_SHIFT] != 0;
+        cart->prg_map[i] = rebase(cart->prg_map[i], cart->prg_ram, prg_size, prg_ram);
+    }
+    for (int i = 0; i < CART_CHR_WINDOWS; ++i)
+    {
+        cart->chr_map[i] = rebase(cart->chr_map[i], cart->chr, cart->chr_ram ? cart->chr_size : 0, chr);
+    }
+    for (int i = 0; i < 4; ++i)
+    {
+        cart->nt_map[i] = rebase(cart->nt_map[i], cart->vram, vram ? 0x800 : 0, vram);
+    }
+    Bus_map(cart->bus, 0x6000, CART_PRG_WINDOWS * CART_PRG_WINDOW_SIZE, 0, 0);
+    cart->bus = bus;
+    for (int i = 0; i < CART_PRG_WINDOWS; ++i)
+    {
+        Cart_map_prg(cart, i, cart->prg_map[i], writable[i]);
+    }
+
+    if (!cart->memory)
+    {
+        if (prg_size)
+        {
+            free(cart->prg_ram);
+        }
+        if (cart->chr_ram)
+        {
+            free(cart->chr);
+        }
+        free(cart->vram);
+    }
+    cart->prg_ram = prg_ram;
+    cart->chr = chr;
+    cart->vram = vram;
+    cart->memory = memory;
+}
+
+void Cart_close(Cart *cart)
+{
+    if (cart->bus)
+    {
+        Bus_map(cart->bus, 0x6000, CART_PRG_WINDOWS * CART_PRG_WINDOW_SIZE, 0, 0);
+    }
+    if (cart->chr_ram && !cart->memory)
+    {
+        free(cart->chr);
+    }
+    TileCache_free(&cart->tiles);
+    if (cart->save.map)
+    {
+        Save_close(&cart->save);
+    }
+    else if (!cart->memory)
+    {
+        free(cart->prg_ram);
+    }
+    if (!cart->memory)
+    {
+        free(cart->vram);
+    }
+    if (cart->file)
+    {
+        munmap(cart->file, cart->file_size);
+    }
+    memset(cart->prg_map, 0, sizeof(cart->prg_map));
+    memset(cart->chr_map, 0, sizeof(cart->chr_map));
+    memset(cart->nt_map, 0, sizeof(cart->nt_map));
+    cart->file = 0;
+    cart->prg = cart->chr = cart->prg_ram = cart->vram = cart->memory = 0;
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "bus.h"
+#include "ines.h"
+#include "mapper.h"
+#include "romdb.h"
+#include "save.h"
+#include "tiles.h"
+
+#include <stddef.h>
+
+// PRG windows are 8KB at $6000 (PRG-RAM), $8000, $A000, $C000 and $E000
+#define CART_PRG_WINDOWS 5
+#define CART_PRG_WINDOW_SIZE 0x2000
+
+// CHR windows are 1KB covering PPU $0000-$1FFF
+#define CART_CHR_WINDOWS 8
+#define CART_CHR_WINDOW_SIZE 0x400
+
+typedef struct Cart
+{
+    BusDevice device;
+    Bus *bus;
+
+    // the rom file, mapped read only
+    unsigned char *file;
+    size_t file_size;
+    INES ines;
+
+    // rom sections point into the file, ram is allocated
+    unsigned char *prg, *chr, *prg_ram;
+    size_t prg_size, chr_size;
+    int prg_ram_size;
+    Save save; // backs prg_ram once Cart_open_save is called
+    int chr_ram; // chr is writable ram
+    TileCache tiles; // decoded chr
+
+    // what each window currently points at (0 if unmapped)
+    unsigned char *prg_map[CART_PRG_WINDOWS];
+    unsigned char *chr_map[CART_CHR_WINDOWS];
+
+    // nametables ($2000-$2FFF) in 1KB windows, pointing into the console's
+    // 2KB CIRAM or the cart's own VRAM for four-screen boards
+    unsigned char *nt_map[4];
+    unsigned char *ciram, *vram;
+    int mirroring; // enum Mirroring
+    unsigned char *memory; // holds the RAM after Cart_move (not the cart's to free)
+
+    const Mapper *mapper;
+    MapperRegisters regs;
+    int irq; // mapper is asserting IRQ
+
+    // called before every mapper register write, so a device that runs lazily
+    // (the PPU) can catch up while the old banks are still mapped
+    void (*sync)(void *arg);
+    void *sync_arg;
+
+    // called after a PRG window is pointed somewhere, so patches to what the CPU
+    // reads there (cheats) follow the bank
+    void (*remap)(void *arg, int window);
+    void *remap_arg;
+} Cart;
+
+// Map the rom file at path and connect its PRG to the bus. If db is given and knows
+// the rom, its mapper, mirroring and PRG-RAM override the header. Returns 0 on
+// success, or -1 and sets errno if the file could not be mapped or is not a valid image.
+int Cart_open(Cart *cart, Bus *bus, const char *path, const RomDB *db);
+
+// Move battery backed PRG-RAM into the save file at path, written back every
+// interval frames. Does nothing for carts without a battery. Returns 0 or -1.
+int Cart_open_save(Cart *cart, const char *path, int interval);
+
+// Call at the end of every frame
+static inline void Cart_frame(Cart *cart)
+{
+    if (cart->save.map)
+    {
+        Save_frame(&cart->save);
+    }
+}
+
+// Unmap the rom and free cart ram
+void Cart_close(Cart *cart);
+
+// Bytes of memory Cart_move needs for PRG-RAM, CHR-RAM and four-screen VRAM
+size_t Cart_ram_size(const Cart *cart);
+
+// Move the cart's RAM into memory (Cart_ram_size bytes, 64 byte aligned) and its
+// PRG windows onto bus, for a cart that lives inside a larger allocation
+void Cart_move(Cart *cart, Bus *bus, unsigned char *memory);
+
+// Copy PRG-RAM into ram (as big as Cart_ram_size reserves for it) and point the
+// windows showing it there, e.g. after copying a cart whose RAM lives elsewhere
+void Cart_move_prg_ram(Cart *cart, unsigned char *ram);
+
+// Point PRG window (0 = $6000 ... 4 = $E000) at 8KB of memory
+void Cart_map_prg(Cart *cart, int window, unsigned char *bank, int writable);
+
+// Map every PRG window onto the bus again as it is, e.g. after the bus map was
+// copied from another machine
+void Cart_remap(Cart *cart);
+
+// Point CHR window (0 = $0000 ... 7 = $1C00) at 1KB of memory
+static inline void Cart_map_chr(Cart *cart, int window, unsigned char *bank)
+{
+    cart->chr_map[window] = bank;
+}
+
+// Give the cart the console's 2KB nametable RAM
+void Cart_attach_ciram(Cart *cart, unsigned char *ciram);
+
+// Select nametable mirroring (enum Mirroring)
+void Cart_mirror(Cart *cart, int mirroring);
+
+// Clock the mapper's scanline counter
+static inline void Cart_scanline(Cart *cart)
+{
+    if (cart->mapper->scanline)
+    {
+        cart->mapper->scanline(cart);
+    }
+}
+
+// Read a byte from the PPU pattern tables ($0000-$1FFF)
+static inline int Cart_chr_read(Cart *cart, int addr)
+{
+    return cart->chr_map[(addr >> 10) & 7][addr & 0x3FF];
+}
+
+// Write a byte to the PPU pattern tables, if they are RAM
+static inline void Cart_chr_write(Cart *cart, int addr, int byte)
+{
+    if (cart->chr_ram)
+    {
+        unsigned char *p = &cart->chr_map[(addr >> 10) & 7][addr & 0x3FF];
+        *p = byte;
+        TileCache_invalidate(&cart->tiles, (p - cart->chr) / TILE_SIZE);
+    }
+}
+
+// Decoded pixels (colour 0-3) of the pattern table row at addr ($0000-$1FFF, the
+// row in the low 3 bits), left to right or flipped
+static inline const unsigned char *Cart_chr_row(Cart *cart, int addr, int flipped)
+{
+    const unsigned char *p = cart->chr_map[(addr >> 10) & 7] + (addr & 0x3F0);
+    return TileCache_row(&cart->tiles, cart->chr, (p - cart->chr) / TILE_SIZE, addr & 7, flipped);
+}
+
+// Read a byte from the nametables ($2000-$2FFF, mirrored to $3EFF)
+static inline int Cart_nt_read(Cart *cart, int addr)
+{
+    return cart->nt_map[(addr >> 10) & 3][addr & 0x3FF];
+}
+
+// Write a byte to the nametables
+static inline void Cart_nt_write(Cart *cart, int addr, int byte)
+{
+    cart->nt_map[(addr >> 10) & 3][addr & 0x3FF] = byte;
+}
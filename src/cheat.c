@@ -0,0 +1,161 @@
+#include "cheat.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+// Game Genie letters, by the 4 bits each stands for
+static const char letters[] = "APZLGITYEOXUKSVN";
+
+static int decode_genie(const char *code, size_t length, Cheat *cheat)
+{
+    int n[8];
+    for (size_t i = 0; i < length; ++i)
+    {
+        const char *p = strchr(letters, toupper((unsigned char) code[i]));
+        if (!p)
+        {
+            return -1;
+        }
+        n[i] = p - letters;
+    }
+
+    // the bits are shuffled across the letters
+    cheat->addr = 0x8000 | (n[3] & 7) << 12 | (n[5] & 7) << 8 | (n[4] & 8) << 8 | (n[2] & 7) << 4 | (n[1] & 8) << 4 | (n[4] & 7) | (n[3] & 8);
+    cheat->value = (n[1] & 7) << 4 | (n[0] & 8) << 4 | (n[0] & 7);
+    if (length == 6)
+    {
+        cheat->value |= n[5] & 8;
+        cheat->compare = -1;
+    }
+    else
+    {
+        cheat->value |= n[7] & 8;
+        cheat->compare = (n[7] & 7) << 4 | (n[6] & 8) << 4 | (n[6] & 7) | (n[5] & 8);
+    }
+    return 0;
+}
+
+int Cheat_decode(const char *code, Cheat *cheat)
+{
+    size_t length = strlen(code);
+    if ((length == 6 || length == 8) && decode_genie(code, length, cheat) == 0)
+    {
+        return 0;
+    }
+
+    unsigned addr, value, compare;
+    int end = 0;
+    if (sscanf(code, "%4x?%2x:%2x%n", &addr, &compare, &value, &end) == 3 && (size_t) end == length)
+    {
+        *cheat = (Cheat) {addr, value, compare};
+        return 0;
+    }
+    end = 0;
+    if (sscanf(code, "%4x:%2x%n", &addr, &value, &end) == 2 && (size_t) end == length)
+    {
+        *cheat = (Cheat) {addr, value, -1};
+        return 0;
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+// The copy for page, made the first time it's needed
+static unsigned char *shadow(Cheats *cheats, int page)
+{
+    int i = 0;
+    while (i < cheats->shadow_count && cheats->pages[i] != page)
+    {
+        ++i;
+    }
+    if (i == cheats->shadow_count)
+    {
+        cheats->pages[cheats->shadow_count++] = page;
+    }
+    return cheats->shadows[i];
+}
+
+// Point page at a patched copy of the ROM the cart has there, if it has cheats
+static void patch(Cheats *cheats, int page)
+{
+    Cart *cart = cheats->cart;
+    Bus *bus = cart->bus;
+    int addr = page << BUS_PAGE_SHIFT;
+    const unsigned char *bank = cart->prg_map[(addr - 0x6000) / CART_PRG_WINDOW_SIZE];
+    if (!bank || bus->write_map[page])
+    {
+        return;
+    }
+
+    const unsigned char *rom = bank + addr % CART_PRG_WINDOW_SIZE;
+    unsigned char *copy = 0;
+    for (int i = 0; i < cheats->count; ++i)
+    {
+        const Cheat *cheat = &cheats->cheats[i];
+        if (cheat->addr >> BUS_PAGE_SHIFT != page)
+        {
+            continue;
+        }
+        if (!copy)
+        {
+            copy = shadow(cheats, page);
+            memcpy(copy, rom, BUS_PAGE_SIZE);
+        }
+        int offset = cheat->addr & BUS_PAGE_MASK;
+        if (cheat->compare < 0 || rom[offset] == cheat->compare)
+        {
+            copy[offset] = cheat->value;
+        }
+    }
+    if (copy)
+    {
+        bus->read_map[page] = copy;
+    }
+}
+
+// The cart just mapped window, over any copies there
+static void remap(void *arg, int window)
+{
+    Cheats *cheats = arg;
+    int first = (0x6000 + window * CART_PRG_WINDOW_SIZE) >> BUS_PAGE_SHIFT;
+    for (int page = first; page < first + CART_PRG_WINDOW_SIZE / BUS_PAGE_SIZE; ++page)
+    {
+        patch(cheats, page);
+    }
+}
+
+void Cheats_init(Cheats *cheats, Cart *cart)
+{
+    memset(cheats, 0, sizeof(*cheats));
+    cheats->cart = cart;
+    cart->remap = remap;
+    cart->remap_arg = cheats;
+}
+
+int Cheats_add(Cheats *cheats, const Cheat *cheat)
+{
+    if (cheat->addr < 0x8000 || cheat->addr > 0xFFFF)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (cheats->count == CHEATS_MAX)
+    {
+        errno = ENOSPC;
+        return -1;
+    }
+    cheats->cheats[cheats->count++] = *cheat;
+    patch(cheats, cheat->addr >> BUS_PAGE_SHIFT);
+    return 0;
+}
+
+void Cheats_free(Cheats *cheats)
+{
+    Cart *cart = cheats->cart;
+    cart->remap = 0;
+    cart->remap_arg = 0;
+    cheats->count = 0;
+    Cart_remap(cart);
+}
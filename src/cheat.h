@@ -0,0 +1,46 @@
+#pragma once
+
+#include "bus.h"
+#include "cart.h"
+
+#define CHEATS_MAX 64
+
+// Reads of addr ($8000-$FFFF) give value instead, or only when the byte there is
+// compare if compare isn't -1
+typedef struct Cheat
+{
+    int addr;
+    int value;
+    int compare;
+} Cheat;
+
+// Cheats applied through the bus map. Each page of ROM with a cheat on it is read
+// from a patched copy instead of the rom, so reads cost the same with or without
+// them, and every other page is untouched. The copies are made again whenever the
+// mapper switches the bank under them, and a compare is checked against the bank
+// that is there. Pages mapped to RAM are left alone.
+typedef struct Cheats
+{
+    Cart *cart;
+    Cheat cheats[CHEATS_MAX];
+    int count;
+
+    // a patched copy of each page with cheats, in the order they are needed
+    unsigned char shadows[CHEATS_MAX][BUS_PAGE_SIZE];
+    int pages[CHEATS_MAX]; // the bus page each copy is for
+    int shadow_count;
+} Cheats;
+
+// Parse a Game Genie code (6 or 8 letters) or a raw one: "AAAA:VV", or "AAAA?CC:VV"
+// with a compare, in hex. Returns 0, or -1 and sets errno to EINVAL.
+int Cheat_decode(const char *code, Cheat *cheat);
+
+// Start applying cheats to cart's PRG, with none yet
+void Cheats_init(Cheats *cheats, Cart *cart);
+
+// Returns 0, or -1 and sets errno (EINVAL for an address below $8000, ENOSPC if
+// there are CHEATS_MAX already)
+int Cheats_add(Cheats *cheats, const Cheat *cheat);
+
+// Remove every cheat and stop patching the cart
+void Cheats_free(Cheats *cheats);
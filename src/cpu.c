@@ -164,12 +164,12 @@ void interrupt(CPU *cpu, int addr)
     // push pc
     push_pc(cpu);
 
+    // push status, as it was before the interrupt (RTI lets IRQs in again)
+    PHP(cpu);
+
     // disable interrupts
     cpu->i = 1;
 
-    // push status
-    PHP(cpu);
-
     // clear break flag
     cpu->b = 0;
 
@@ -784,35 +784,28 @@ void CPU_reset(CPU *cpu)
     cpu->cycles = 8;
 }
 
-// Trigger interrupt request
-void CPU_irq(CPU *cpu)
+// Take an interrupt request (7 cycles, this one included)
+static void CPU_irq(CPU *cpu)
 {
-    // if interupts disabled, do nothing
-    if (cpu->i)
-    {
-        return;
-    }
-
     // clear break flag
     cpu->b = 0;
 
     interrupt(cpu, 0xFFFE);
 
     // update cycles
-    cpu->cycles += 7;
+    cpu->cycles = 6;
 }
 
-// Trigger non-maskable interrupt
-void CPU_nmi(CPU *cpu)
+// Take a non-maskable interrupt
+static void CPU_nmi(CPU *cpu)
 {
     // clear break flag
     cpu->b = 0;
 
-    // after current instruction finished, interrupt
     interrupt(cpu, 0xFFFA);
 
     // update cycles
-    cpu->cycles += 8;
+    cpu->cycles = 6;
 }
 
 void CPU_tick(CPU *cpu)
@@ -823,6 +816,20 @@ void CPU_tick(CPU *cpu)
         return;
     }
 
+    // between instructions: look at the interrupt lines, NMI first
+    Bus *bus = cpu->bus;
+    if (bus->nmi)
+    {
+        bus->nmi = 0;
+        CPU_nmi(cpu);
+        return;
+    }
+    if (bus->irq && !cpu->i)
+    {
+        CPU_irq(cpu);
+        return;
+    }
+
     int op = Bus_read(cpu->bus, cpu->pc++);
     int am_extra_cycle, in_extra_cycle;
 
@@ -851,20 +858,16 @@ void CPU_tick(CPU *cpu)
     {
         --cpu->cycles;
     }
+
+    // a DMA started by this instruction halts the CPU once it is done
+    cpu->cycles += cpu->bus->stall;
+    cpu->bus->stall = 0;
 }
 
 void CPU_message(CPU *cpu, Bus *bus)
 {
     switch (bus->message)
     {
-    case BUS_IRQ:
-        CPU_irq(cpu);
-        break;
-
-    case BUS_NMI:
-        CPU_nmi(cpu);
-        break;
-
     case BUS_TICK:
         CPU_tick(cpu);
         break;
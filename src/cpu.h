@@ -22,7 +22,7 @@ typedef struct CPU
 
     // current instruction
     unsigned address : 16; // address
-    unsigned cycles : 4;   // number of cycles left
+    unsigned cycles : 11;  // number of cycles left (with a DMA stall)
     unsigned mode : 2;     // type of addressing mode
 } CPU;
 
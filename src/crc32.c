@@ -0,0 +1,141 @@
+#include "crc32.h"
+
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_CLMUL 1
+#endif
+
+static uint32_t table[8][256];
+static pthread_once_t table_once = PTHREAD_ONCE_INIT;
+
+static void init_table(void)
+{
+    for (int i = 0; i < 256; ++i)
+    {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+        table[0][i] = crc;
+    }
+    for (int i = 0; i < 256; ++i)
+    {
+        for (int slice = 1; slice < 8; ++slice)
+        {
+            table[slice][i] = (table[slice - 1][i] >> 8) ^ table[0][table[slice - 1][i] & 0xFF];
+        }
+    }
+}
+
+// Slice-by-8 on the raw (uninverted) crc state
+static uint32_t crc32_slice8(uint32_t crc, const unsigned char *p, size_t size)
+{
+    pthread_once(&table_once, init_table);
+
+    for (; size >= 8; size -= 8, p += 8)
+    {
+        uint32_t lo = (p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24) ^ crc;
+        uint32_t hi = p[4] | p[5] << 8 | p[6] << 16 | (uint32_t)p[7] << 24;
+        crc = table[7][lo & 0xFF] ^ table[6][(lo >> 8) & 0xFF] ^
+              table[5][(lo >> 16) & 0xFF] ^ table[4][lo >> 24] ^
+              table[3][hi & 0xFF] ^ table[2][(hi >> 8) & 0xFF] ^
+              table[1][(hi >> 16) & 0xFF] ^ table[0][hi >> 24];
+    }
+    while (size--)
+    {
+        crc = (crc >> 8) ^ table[0][(crc ^ *p++) & 0xFF];
+    }
+    return crc;
+}
+
+#ifdef HAVE_CLMUL
+
+// Fold 16 bytes at a time with carry-less multiplies (Intel, "Fast CRC Computation for
+// Generic Polynomials Using PCLMULQDQ"), bit-reflected constants for 0x04C11DB7.
+// size must be a multiple of 16 and at least 64.
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_clmul(uint32_t crc, const unsigned char *p, size_t size)
+{
+    const __m128i r2r1 = _mm_set_epi64x(0x1c6e41596, 0x154442bd4);
+    const __m128i r4r3 = _mm_set_epi64x(0x0ccaa009e, 0x1751997d0);
+    const __m128i r5 = _mm_set_epi64x(0, 0x163cd6124);
+    const __m128i poly = _mm_set_epi64x(0x1F7011641, 0x1DB710641); // mu, P
+    const __m128i mask32 = _mm_set_epi32(0, 0, 0, -1);
+
+    __m128i x1 = _mm_loadu_si128((const __m128i *)(p + 0x00));
+    __m128i x2 = _mm_loadu_si128((const __m128i *)(p + 0x10));
+    __m128i x3 = _mm_loadu_si128((const __m128i *)(p + 0x20));
+    __m128i x4 = _mm_loadu_si128((const __m128i *)(p + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+    p += 64;
+    size -= 64;
+
+#define FOLD(X, K, NEXT)                                          \
+    do                                                            \
+    {                                                             \
+        __m128i lo = _mm_clmulepi64_si128(X, K, 0x00);            \
+        __m128i hi = _mm_clmulepi64_si128(X, K, 0x11);            \
+        X = _mm_xor_si128(_mm_xor_si128(lo, hi), NEXT);           \
+    } while (0)
+
+    // four lanes of 16 bytes in parallel
+    for (; size >= 64; size -= 64, p += 64)
+    {
+        FOLD(x1, r2r1, _mm_loadu_si128((const __m128i *)(p + 0x00)));
+        FOLD(x2, r2r1, _mm_loadu_si128((const __m128i *)(p + 0x10)));
+        FOLD(x3, r2r1, _mm_loadu_si128((const __m128i *)(p + 0x20)));
+        FOLD(x4, r2r1, _mm_loadu_si128((const __m128i *)(p + 0x30)));
+    }
+
+    // lanes into one, then the remaining 16 byte blocks
+    FOLD(x1, r4r3, x2);
+    FOLD(x1, r4r3, x3);
+    FOLD(x1, r4r3, x4);
+    for (; size >= 16; size -= 16, p += 16)
+    {
+        FOLD(x1, r4r3, _mm_loadu_si128((const __m128i *)p));
+    }
+
+#undef FOLD
+
+    // 128 -> 64 bits
+    __m128i t = _mm_clmulepi64_si128(r4r3, x1, 0x01);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), t);
+
+    // 64 -> 32 bits
+    t = _mm_srli_si128(x1, 4);
+    x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), r5, 0x00);
+    x1 = _mm_xor_si128(x1, t);
+
+    // Barrett reduction
+    t = x1;
+    x1 = _mm_and_si128(x1, mask32);
+    x1 = _mm_clmulepi64_si128(x1, poly, 0x10);
+    x1 = _mm_and_si128(x1, mask32);
+    x1 = _mm_clmulepi64_si128(x1, poly, 0x00);
+    x1 = _mm_xor_si128(x1, t);
+    return _mm_extract_epi32(x1, 1);
+}
+
+#endif
+
+uint32_t crc32(uint32_t crc, const void *data, size_t size)
+{
+    const unsigned char *p = data;
+    crc = ~crc;
+
+#ifdef HAVE_CLMUL
+    if (size >= 64 && __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1"))
+    {
+        size_t bulk = size & ~(size_t)15;
+        crc = crc32_clmul(crc, p, bulk);
+        p += bulk;
+        size -= bulk;
+    }
+#endif
+
+    return ~crc32_slice8(crc, p, size);
+}
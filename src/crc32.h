@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Update a CRC-32 (IEEE 802.3, as used by zlib and rom databases) with size bytes.
+// Start with crc = 0. Uses PCLMULQDQ folding when the CPU supports it.
+uint32_t crc32(uint32_t crc, const void *data, size_t size);
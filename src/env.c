@@ -0,0 +1,108 @@
+#include "env.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_AVX2 1
+#endif
+
+void Env_init(Env *env, Machine *machine)
+{
+    env->machine = machine;
+    env->buttons = machine->controller.buttons[0];
+
+    // BT.601 full range
+    for (int i = 0; i < VIDEO_COLORS; ++i)
+    {
+        uint32_t rgba = Video_color(i);
+        int r = rgba & 0xFF, g = rgba >> 8 & 0xFF, b = rgba >> 16 & 0xFF;
+        env->gray[i] = (77 * r + 150 * g + 29 * b + 128) >> 8;
+    }
+}
+
+void Env_step(Env *env, int buttons, int frames, EnvView *view)
+{
+    Machine *machine = env->machine;
+    buttons &= 0xFF;
+    if (buttons != env->buttons)
+    {
+        Controller_schedule(&machine->controller, machine->bus.cycle, 0, buttons);
+        env->buttons = buttons;
+    }
+
+    // a frame is drawn while it runs, so only the last one needs the PPU to draw
+    machine->ppu.skip = 1;
+    for (int i = 1; i < frames; ++i)
+    {
+        Machine_frame(machine);
+    }
+    machine->ppu.skip = 0;
+    Machine_frame(machine);
+
+    view->ram = machine->ram_bytes;
+    view->prg_ram = machine->cart.prg_ram;
+    view->prg_ram_size = machine->cart.prg_ram ? machine->cart.prg_ram_size : 0;
+    view->frame = machine->ppu.framebuffer;
+}
+
+#ifdef HAVE_AVX2
+
+// Luma of 16 pixels at a time, gathered and summed down count rows
+__attribute__((target("avx2")))
+static void column_sums_avx2(const uint32_t *lut, const unsigned short *rows, int count, uint16_t *sums)
+{
+    const __m256i colors = _mm256_set1_epi16(VIDEO_COLORS - 1);
+    for (int x = 0; x < PPU_WIDTH; x += 16)
+    {
+        __m256i sum = _mm256_setzero_si256();
+        for (int r = 0; r < count; ++r)
+        {
+            __m256i indices = _mm256_and_si256(_mm256_loadu_si256((const __m256i*) (rows + r * PPU_WIDTH + x)), colors);
+            __m256i low = _mm256_i32gather_epi32((const int*) lut, _mm256_cvtepu16_epi32(_mm256_castsi256_si128(indices)), 4);
+            __m256i high = _mm256_i32gather_epi32((const int*) lut, _mm256_cvtepu16_epi32(_mm256_extracti128_si256(indices, 1)), 4);
+            // packing works within 128-bit lanes, so put the quarters back in order
+            sum = _mm256_add_epi16(sum, _mm256_permute4x64_epi64(_mm256_packus_epi32(low, high), 0xD8));
+        }
+        _mm256_storeu_si256((__m256i*) (sums + x), sum);
+    }
+}
+
+#endif
+
+static void column_sums(const uint32_t *lut, const unsigned short *rows, int count, uint16_t *sums)
+{
+#ifdef HAVE_AVX2
+    if (__builtin_cpu_supports("avx2"))
+    {
+        column_sums_avx2(lut, rows, count, sums);
+        return;
+    }
+#endif
+    for (int x = 0; x < PPU_WIDTH; ++x)
+    {
+        unsigned sum = 0;
+        for (int r = 0; r < count; ++r)
+        {
+            sum += lut[rows[r * PPU_WIDTH + x] & (VIDEO_COLORS - 1)];
+        }
+        sums[x] = sum;
+    }
+}
+
+void Env_gray(const Env *env, const unsigned short *frame, int scale, unsigned char *out)
+{
+    int width = PPU_WIDTH / scale, area = scale * scale;
+    uint16_t sums[PPU_WIDTH]; // at most 255 * ENV_SCALE_MAX rows
+    for (int row = 0; row < PPU_HEIGHT / scale; ++row)
+    {
+        column_sums(env->gray, frame + row * scale * PPU_WIDTH, scale, sums);
+        for (int x = 0; x < width; ++x)
+        {
+            unsigned sum = 0;
+            for (int i = 0; i < scale; ++i)
+            {
+                sum += sums[x * scale + i];
+            }
+            out[row * width + x] = (sum + area / 2) / area;
+        }
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "machine.h"
+#include "video.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Largest downsampling factor for Env_gray
+#define ENV_SCALE_MAX 16
+
+// What an agent sees after a step. These point into the machine, so they are
+// never copied and stay valid (and change) as it runs.
+typedef struct EnvView
+{
+    const unsigned char *ram;     // MACHINE_RAM_SIZE bytes of work RAM
+    const unsigned char *prg_ram; // the cart's PRG-RAM, or 0
+    size_t prg_ram_size;
+    const unsigned short *frame;  // the last frame, PPU_WIDTH x PPU_HEIGHT PPU pixels
+} EnvView;
+
+// A machine (without video attached) stepped by an agent a few frames at a time,
+// for training loops
+typedef struct Env
+{
+    Machine *machine;
+    int buttons; // held on controller 1
+    uint32_t gray[VIDEO_COLORS]; // luma of each PPU pixel, widened for 32-bit gathers
+} Env;
+
+void Env_init(Env *env, Machine *machine);
+
+// Hold buttons on controller 1 and run frames frames (at least 1). Only the last
+// one is drawn; the others run the same but leave the frame alone. Fills view.
+void Env_step(Env *env, int buttons, int frames, EnvView *view);
+
+// Average each scale x scale block of a frame down to one byte of luma, writing
+// PPU_WIDTH / scale x PPU_HEIGHT / scale bytes to out. scale is 1, 2, 4, 8 or 16.
+void Env_gray(const Env *env, const unsigned short *frame, int scale, unsigned char *out);
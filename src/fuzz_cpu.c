@@ -0,0 +1,834 @@
+#include "6502.h"
+#include "recomp.h"
+#include "test.h"
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Differential fuzzing of the native code against the interpreter.
+//
+// Each program is 16K of random instructions with operands aimed mostly at RAM,
+// translated by Recomp_emit and compiled. Each case starts both machines at a
+// random block with random registers and RAM, then runs the candidate a step at
+// a time (Recomp_step) and ticks the reference (CPU_tick) to the same cycle,
+// comparing registers, flags, the cycles left on the instruction, RAM and every
+// access that goes to a device. The first difference is shrunk to a small
+// reproducer, listed and written to a file that can be run again later.
+//
+// usage: fuzz_cpu [-s seed] [-n programs] [-c cases] [-j threads] [-o reproducer]
+//        fuzz_cpu <reproducer>...
+
+#define PRG_SIZE 0x4000 // mirrored at $8000 and $C000
+#define CODE_SIZE 0x3F00
+#define INIT 0xFF00 // masks IRQs and parks the CPU at PARK
+#define ROOTS 24     // branches from INIT that are never taken, for Recomp_emit to follow
+#define PARK (INIT + 7 + 2 * ROOTS)
+
+#define CASE_STEPS 64
+#define CASE_CYCLES 2000
+#define TRACE_MAX 256
+#define LOG_SIZE 64
+#define NOP_TRIALS 64
+
+static const unsigned char init[] = {
+    0x78,             // SEI
+    0xA9, 0x40,       // LDA #$40
+    0x8D, 0x17, 0x40, // STA $4017 (no frame IRQ)
+    0x18,             // CLC
+                      // BCS root for each root, then
+                      // park: JMP park
+                      // root: JMP into the code for each root
+};
+
+enum
+{
+    IMP,
+    ACC,
+    IMM,
+    ZPG,
+    ZPX,
+    ZPY,
+    ABS,
+    ABX,
+    ABY,
+    IND,
+    IDX,
+    IDY,
+    REL,
+};
+
+typedef struct Opcode
+{
+    const char *name;
+    int mode, opcode;
+} Opcode;
+
+static const Opcode opcodes[] = {
+#define X(INSTRUCTION, ADDRESSING_MODE, OPCODE, CYCLES) {#INSTRUCTION, ADDRESSING_MODE, OPCODE},
+    INSTRUCTION_SET()
+#undef X
+};
+#define OPCODES (int) (sizeof(opcodes) / sizeof(opcodes[0]))
+
+static const int lengths[] = {
+    [IMP] = 1, [ACC] = 1, [IMM] = 2, [ZPG] = 2, [ZPX] = 2, [ZPY] = 2, [ABS] = 3,
+    [ABX] = 3, [ABY] = 3, [IND] = 3, [IDX] = 2, [IDY] = 2, [REL] = 2,
+};
+
+// A reproducer: the program and where both machines start. Devices are as they
+// would be cycle cycles after power on with the CPU parked.
+typedef struct Case
+{
+    unsigned char prg[PRG_SIZE];
+    unsigned long long cycle;
+    uint16_t pc;
+    uint8_t a, x, y, sp, p;
+    unsigned char ram[MACHINE_RAM_SIZE];
+} Case;
+
+// The accesses that went to devices
+typedef struct Access
+{
+    unsigned long long cycle;
+    int addr, data, write;
+} Access;
+
+typedef struct Log
+{
+    BusDevice device;
+    int count;
+    Access accesses[LOG_SIZE];
+} Log;
+
+typedef struct Mismatch
+{
+    char what[32];
+    int expected, actual;
+    int step;
+} Mismatch;
+
+typedef struct Fuzzer
+{
+    uint64_t rng;
+    char path[32]; // the program as a rom, then as C and a shared object
+    unsigned char prg[PRG_SIZE];
+    int loaded;
+
+    Machine *origin; // parked after power on
+    Machine *a;      // reference
+    Machine *b;      // candidate
+    Log logs[2];
+    void *library;
+    const RecompProgram *program;
+    Recomp recomp;
+    int dirty; // a device saw an access since the machines left origin
+
+    int trace[TRACE_MAX]; // where the reference started instructions in the last case
+    int traced;
+
+    unsigned long long cases, cycles;
+} Fuzzer;
+
+static uint64_t next(Fuzzer *f)
+{
+    // splitmix64
+    uint64_t z = (f->rng += 0x9E3779B97F4A7C15);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+    return z ^ (z >> 31);
+}
+
+static int length(int opcode)
+{
+    for (int i = 0; i < OPCODES; ++i)
+    {
+        if (opcodes[i].opcode == opcode)
+        {
+            return lengths[opcodes[i].mode];
+        }
+    }
+    return 1;
+}
+
+/*
+    Programs
+*/
+
+// Where instructions start, so jumps and branches land on them
+typedef struct Layout
+{
+    int starts[CODE_SIZE];
+    int count;
+} Layout;
+
+static int code_address(Fuzzer *f, const Layout *layout)
+{
+    return 0x8000 | (next(f) & 0x4000) | layout->starts[next(f) % layout->count];
+}
+
+// An instruction within reach of a branch at the k-th start, if there is one
+static int branch_offset(Fuzzer *f, const Layout *layout, int k)
+{
+    int target = k + (int) (next(f) % 61) - 30;
+    target = target < 0 ? 0 : target >= layout->count ? layout->count - 1 : target;
+    int offset = layout->starts[target] - (layout->starts[k] + 2);
+    return offset >= -128 && offset < 128 ? offset & 0xFF : next(f) & 0xFF;
+}
+
+// Mostly RAM, sometimes PRG-RAM or ROM, rarely a device
+static int data_address(Fuzzer *f)
+{
+    int r = next(f) % 64;
+    if (r == 0)
+    {
+        return next(f) & 1 ? 0x2000 + next(f) % 8 : 0x4000 + next(f) % 0x18;
+    }
+    if (r < 6)
+    {
+        return 0x6000 + next(f) % 0x2000;
+    }
+    if (r < 12)
+    {
+        return 0x8000 + next(f) % 0x8000;
+    }
+    return next(f) % 0x800;
+}
+
+static void generate(Fuzzer *f, unsigned char *prg)
+{
+    static _Thread_local Layout layout;
+    const Opcode *chosen[CODE_SIZE];
+    memset(prg, 0, PRG_SIZE);
+    layout.count = 0;
+    for (int at = 0; at < CODE_SIZE - 3;)
+    {
+        const Opcode *op = &opcodes[next(f) % OPCODES];
+        if (strcmp(op->name, "BRK"))
+        {
+            chosen[layout.count] = op;
+            layout.starts[layout.count++] = at;
+            at += lengths[op->mode];
+        }
+    }
+
+    for (int k = 0; k < layout.count; ++k)
+    {
+        const Opcode *op = chosen[k];
+        int at = layout.starts[k];
+        int operand = next(f) & 0xFF;
+        if (op->mode == ABS || op->mode == ABX || op->mode == ABY)
+        {
+            operand = !strcmp(op->name, "JMP") || !strcmp(op->name, "JSR") ? code_address(f, &layout) : data_address(f);
+        }
+        else if (op->mode == IND)
+        {
+            operand = next(f) % 0x800;
+        }
+        else if (op->mode == REL)
+        {
+            operand = branch_offset(f, &layout, k);
+        }
+        prg[at] = op->opcode;
+        prg[at + 1] = operand & 0xFF;
+        if (lengths[op->mode] == 3)
+        {
+            prg[at + 2] = operand >> 8;
+        }
+    }
+
+    unsigned char *p = prg + (INIT & (PRG_SIZE - 1));
+    memcpy(p, init, sizeof(init));
+    p += sizeof(init);
+    for (int k = 0; k < ROOTS; ++k)
+    {
+        *p++ = 0xB0;
+        *p++ = 3 + 2 * (ROOTS - k - 1) + 3 * k;
+    }
+    *p++ = 0x4C, *p++ = PARK & 0xFF, *p++ = PARK >> 8;
+    for (int k = 0; k < ROOTS; ++k)
+    {
+        int root = code_address(f, &layout);
+        *p++ = 0x4C, *p++ = root & 0xFF, *p++ = root >> 8;
+    }
+    int nmi = code_address(f, &layout), irq = code_address(f, &layout);
+    memcpy(prg + PRG_SIZE - 6, (unsigned char[]) {nmi & 0xFF, nmi >> 8, INIT & 0xFF, INIT >> 8, irq & 0xFF, irq >> 8}, 6);
+}
+
+static void log_message(Log *log, Bus *bus)
+{
+    // ahead of the devices, so a read's data isn't there yet
+    if ((bus->message == BUS_READ || bus->message == BUS_WRITE) && log->count < LOG_SIZE)
+    {
+        int write = bus->message == BUS_WRITE;
+        log->accesses[log->count++] = (Access) {bus->cycle, bus->addr, write ? bus->data : 0, write};
+    }
+}
+
+static void unload(Fuzzer *f)
+{
+    if (!f->loaded)
+    {
+        return;
+    }
+    Recomp_free(&f->recomp);
+    dlclose(f->library);
+    Machine_destroy(f->origin);
+    Machine_destroy(f->a);
+    Machine_destroy(f->b);
+    f->loaded = 0;
+}
+
+// Put both machines back to origin
+static void restore(Fuzzer *f)
+{
+    Machine *machines[2] = {f->a, f->b};
+    for (int i = 0; i < 2; ++i)
+    {
+        Bus_disconnect(&machines[i]->bus, &f->logs[i].device);
+        Machine_copy(machines[i], f->origin);
+        Bus_connect(&machines[i]->bus, &f->logs[i].device);
+        f->logs[i].count = 0;
+    }
+    f->dirty = 0;
+}
+
+// Power on machines for prg and build its native code. Returns 0, or -1.
+static int load(Fuzzer *f, const unsigned char *prg)
+{
+    unload(f);
+
+    static const unsigned char header[16] = {'N', 'E', 'S', 0x1A, 1, 0};
+    strcpy(f->path, "/tmp/nes_fuzz_XXXXXX");
+    int fd = mkstemp(f->path);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    int written = write(fd, header, sizeof(header)) == sizeof(header) && write(fd, prg, PRG_SIZE) == PRG_SIZE;
+    close(fd);
+    f->origin = written ? Machine_create(f->path, 0, PPU_SCANLINE, 0) : 0;
+    f->a = written ? Machine_create(f->path, 0, PPU_SCANLINE, 0) : 0;
+    f->b = written ? Machine_create(f->path, 0, PPU_SCANLINE, 0) : 0;
+    if (!f->origin || !f->a || !f->b)
+    {
+        unlink(f->path);
+        return -1;
+    }
+    while (f->origin->cpu.pc != PARK)
+    {
+        Bus_tick(&f->origin->bus);
+    }
+
+    char source[64], object[64];
+    snprintf(source, sizeof(source), "%s.c", f->path);
+    snprintf(object, sizeof(object), "%s.so", f->path);
+    FILE *out = fopen(source, "w");
+    int blocks = out ? Recomp_emit(out, f->origin, "fuzz_program") : -1;
+    if (out)
+    {
+        fclose(out);
+    }
+    f->library = blocks > 0 && build_native(source, object) == 0 ? dlopen(object, RTLD_NOW) : 0;
+    unlink(f->path);
+    unlink(source);
+    unlink(object);
+    f->program = f->library ? dlsym(f->library, "fuzz_program") : 0;
+    if (!f->program || Recomp_init(&f->recomp, f->program, f->b) < 0)
+    {
+        fprintf(stderr, "fuzz_cpu: can't build native code for a program\n");
+        return -1;
+    }
+
+    for (int i = 0; i < 2; ++i)
+    {
+        f->logs[i].device.message = (BusDeviceMessage) &log_message;
+        Bus_connect(&(i ? f->b : f->a)->bus, &f->logs[i].device);
+    }
+    memcpy(f->prg, prg, PRG_SIZE);
+    f->loaded = 1;
+    restore(f);
+    return 0;
+}
+
+/*
+    Cases
+*/
+
+static void start(Machine *machine, const Case *c)
+{
+    CPU *cpu = &machine->cpu;
+    cpu->pc = c->pc;
+    cpu->a = c->a;
+    cpu->x = c->x;
+    cpu->y = c->y;
+    cpu->sp = c->sp;
+    cpu->n = c->p >> 7;
+    cpu->v = (c->p >> 6) & 1;
+    cpu->b = (c->p >> 4) & 1;
+    cpu->d = (c->p >> 3) & 1;
+    cpu->i = (c->p >> 2) & 1;
+    cpu->z = (c->p >> 1) & 1;
+    cpu->c = c->p & 1;
+    cpu->cycles = 0;
+    memcpy(machine->ram_bytes, c->ram, MACHINE_RAM_SIZE);
+    memset(machine->cart.prg_ram, 0, machine->cart.prg_ram_size);
+}
+
+#define DIFFER(WHAT, EXPECTED, ACTUAL)                                       \
+    if ((EXPECTED) != (ACTUAL))                                              \
+    {                                                                        \
+        snprintf(m->what, sizeof(m->what), "%s", WHAT);                      \
+        m->expected = (EXPECTED);                                            \
+        m->actual = (ACTUAL);                                                \
+        return 1;                                                            \
+    }
+
+// Returns 1 and says what differs first in m if the machines aren't the same
+static int compare(Fuzzer *f, Mismatch *m)
+{
+    const CPU *a = &f->a->cpu, *b = &f->b->cpu;
+    DIFFER("pc", a->pc, b->pc);
+    DIFFER("a", a->a, b->a);
+    DIFFER("x", a->x, b->x);
+    DIFFER("y", a->y, b->y);
+    DIFFER("sp", a->sp, b->sp);
+    DIFFER("n", a->n, b->n);
+    DIFFER("v", a->v, b->v);
+    DIFFER("b", a->b, b->b);
+    DIFFER("d", a->d, b->d);
+    DIFFER("i", a->i, b->i);
+    DIFFER("z", a->z, b->z);
+    DIFFER("c", a->c, b->c);
+    DIFFER("cycles left", a->cycles, b->cycles);
+    DIFFER("stall", f->a->bus.stall, f->b->bus.stall);
+    DIFFER("irq", f->a->bus.irq, f->b->bus.irq);
+    DIFFER("nmi", f->a->bus.nmi, f->b->bus.nmi);
+    DIFFER("open bus", f->a->bus.data, f->b->bus.data);
+
+    const Log *la = &f->logs[0], *lb = &f->logs[1];
+    DIFFER("device accesses", la->count, lb->count);
+    for (int i = 0; i < la->count; ++i)
+    {
+        const Access *x = &la->accesses[i], *y = &lb->accesses[i];
+        DIFFER("access address", x->addr, y->addr);
+        DIFFER("access is a write", x->write, y->write);
+        DIFFER("access data", x->data, y->data);
+        DIFFER("access cycle", (int) x->cycle, (int) y->cycle);
+    }
+
+    const unsigned char *ra = f->a->ram_bytes, *rb = f->b->ram_bytes;
+    if (memcmp(ra, rb, MACHINE_RAM_SIZE))
+    {
+        int i = 0;
+        while (ra[i] == rb[i])
+        {
+            ++i;
+        }
+        snprintf(m->what, sizeof(m->what), "ram $%04X", i);
+        m->expected = ra[i];
+        m->actual = rb[i];
+        return 1;
+    }
+    ra = f->a->cart.prg_ram, rb = f->b->cart.prg_ram;
+    if (memcmp(ra, rb, f->a->cart.prg_ram_size))
+    {
+        int i = 0;
+        while (ra[i] == rb[i])
+        {
+            ++i;
+        }
+        snprintf(m->what, sizeof(m->what), "prg ram $%04X", 0x6000 + i);
+        m->expected = ra[i];
+        m->actual = rb[i];
+        return 1;
+    }
+    return 0;
+}
+
+// Run a case from machines that are already at its cycle. Returns 1 if they
+// part ways.
+static int run_case(Fuzzer *f, const Case *c, Mismatch *m)
+{
+    Machine *a = f->a, *b = f->b;
+    start(a, c);
+    start(b, c);
+    f->traced = 0;
+    unsigned long long end = b->bus.cycle + CASE_CYCLES;
+    for (int step = 0; step < CASE_STEPS && b->bus.cycle < end; ++step)
+    {
+        // until the code runs out or parks
+        CPU *cpu = &b->cpu;
+        int interrupt = b->bus.nmi || (b->bus.irq && !cpu->i);
+        if (!cpu->cycles && !interrupt && (!f->recomp.index[cpu->pc] || cpu->pc >= INIT))
+        {
+            break;
+        }
+
+        Recomp_step(&f->recomp, b);
+        f->cycles += b->bus.cycle - a->bus.cycle;
+        while (a->bus.cycle < b->bus.cycle)
+        {
+            if (!a->cpu.cycles && f->traced < TRACE_MAX)
+            {
+                f->trace[f->traced++] = a->cpu.pc;
+            }
+            Bus_tick(&a->bus);
+        }
+
+        m->step = step;
+        if (compare(f, m))
+        {
+            return 1;
+        }
+        f->dirty |= f->logs[0].count > 0;
+        f->logs[0].count = f->logs[1].count = 0;
+    }
+    ++f->cases;
+    return 0;
+}
+
+// Run a case from scratch. Returns 1 if the machines part ways, -1 if the program
+// can't be built.
+static int check(Fuzzer *f, const Case *c, Mismatch *m)
+{
+    if ((!f->loaded || memcmp(f->prg, c->prg, PRG_SIZE)) && load(f, c->prg) < 0)
+    {
+        return -1;
+    }
+    restore(f);
+    Machine *machines[2] = {f->a, f->b};
+    for (int i = 0; i < 2; ++i)
+    {
+        // parked, so only time passes for the devices
+        while (machines[i]->bus.cycle < c->cycle)
+        {
+            Bus_tick(&machines[i]->bus);
+        }
+    }
+    return run_case(f, c, m);
+}
+
+static void random_case(Fuzzer *f, Case *c)
+{
+    const RecompBlock *block;
+    do
+    {
+        block = &f->program->blocks[next(f) % f->program->count];
+    } while (block->addr >= INIT);
+    c->pc = block->addr;
+    c->a = next(f);
+    c->x = next(f);
+    c->y = next(f);
+    c->sp = next(f);
+    c->p = next(f);
+    for (int i = 0; i < MACHINE_RAM_SIZE; i += 8)
+    {
+        uint64_t r = next(f);
+        memcpy(c->ram + i, &r, 8);
+    }
+    // most pointers in the zero page point at RAM
+    for (int i = 1; i < 0x100; i += 2)
+    {
+        if (c->ram[i] & 0xC0)
+        {
+            c->ram[i] &= 0x07;
+        }
+    }
+}
+
+/*
+    Shrinking
+*/
+
+// Keep the first time each address appears in trace. Returns how many are left.
+static int distinct(int *trace, int traced)
+{
+    int count = 0;
+    for (int k = 0; k < traced; ++k)
+    {
+        int seen = 0;
+        for (int j = 0; j < count && !seen; ++j)
+        {
+            seen = trace[j] == trace[k];
+        }
+        if (!seen)
+        {
+            trace[count++] = trace[k];
+        }
+    }
+    return count;
+}
+
+static int still_fails(Fuzzer *f, const Case *c)
+{
+    Mismatch m;
+    return check(f, c, &m) == 1;
+}
+
+// Make c simpler while it still fails: no time since power on, no code but what
+// it runs, clear registers and RAM, then NOPs in place of instructions
+static void minimize(Fuzzer *f, Case *c)
+{
+    Case *trial = malloc(sizeof(Case));
+    if (!trial)
+    {
+        return;
+    }
+
+#define TRY(CHANGE)                      \
+    do                                   \
+    {                                    \
+        *trial = *c;                     \
+        CHANGE;                          \
+        if (still_fails(f, trial))       \
+        {                                \
+            *c = *trial;                 \
+        }                                \
+    } while (0)
+
+    TRY(trial->cycle = 0);
+
+    Mismatch m;
+    check(f, c, &m);
+    int trace[TRACE_MAX], traced = f->traced;
+    memcpy(trace, f->trace, sizeof(trace));
+    *trial = *c;
+    memset(trial->prg, 0, CODE_SIZE);
+    for (int k = 0; k < traced; ++k)
+    {
+        int offset = trace[k] & (PRG_SIZE - 1);
+        if (trace[k] >= 0x8000 && offset < CODE_SIZE)
+        {
+            memcpy(trial->prg + offset, c->prg + offset, length(c->prg[offset]));
+        }
+    }
+    if (still_fails(f, trial))
+    {
+        *c = *trial;
+    }
+
+    TRY(trial->a = 0);
+    TRY(trial->x = 0);
+    TRY(trial->y = 0);
+    TRY(trial->sp = 0xFF);
+    TRY(trial->p = 0);
+    for (int size = MACHINE_RAM_SIZE; size; size /= 8)
+    {
+        static const unsigned char zero[MACHINE_RAM_SIZE];
+        for (int at = 0; at < MACHINE_RAM_SIZE; at += size)
+        {
+            if (memcmp(c->ram + at, zero, size))
+            {
+                TRY(memset(trial->ram + at, 0, size));
+            }
+        }
+    }
+
+    traced = distinct(trace, traced);
+    for (int k = 0; k < traced && k < NOP_TRIALS; ++k)
+    {
+        int offset = trace[k] & (PRG_SIZE - 1);
+        if (trace[k] >= 0x8000 && offset < CODE_SIZE && c->prg[offset] != 0xEA)
+        {
+            TRY(memset(trial->prg + offset, 0xEA, length(c->prg[offset])));
+        }
+    }
+
+#undef TRY
+    free(trial);
+}
+
+static void report(Fuzzer *f, const Case *c, const char *path)
+{
+    Mismatch m;
+    check(f, c, &m);
+    printf("mismatch:           %s is $%02X, not $%02X, in step %d\n", m.what, m.actual, m.expected, m.step + 1);
+    printf("start:              pc $%04X a $%02X x $%02X y $%02X sp $%02X p $%02X, cycle %llu\n",
+           c->pc, c->a, c->x, c->y, c->sp, c->p, c->cycle);
+    // the code that ran, once, leaving out what shrinking made NOPs
+    int traced = distinct(f->trace, f->traced);
+    for (int k = 0; k < traced; ++k)
+    {
+        if (Bus_read(&f->a->bus, f->trace[k]) != 0xEA)
+        {
+            disassemble(&f->a->bus, f->trace[k], 1);
+        }
+    }
+    FILE *file = path ? fopen(path, "wb") : 0;
+    if (file && fwrite(c, sizeof(*c), 1, file) == 1 && fclose(file) == 0)
+    {
+        printf("reproducer:         %s\n", path);
+    }
+    else if (path)
+    {
+        perror(path);
+    }
+}
+
+/*
+    Fuzzing
+*/
+
+typedef struct Shared
+{
+    uint64_t seed;
+    int programs, cases;
+    const char *output;
+    atomic_int program; // the next to run
+    atomic_int found;   // a thread has a mismatch
+    int status;
+} Shared;
+
+typedef struct Worker
+{
+    pthread_t thread;
+    Shared *shared;
+    Fuzzer fuzzer;
+} Worker;
+
+static void *work(void *arg)
+{
+    Worker *worker = arg;
+    Shared *shared = worker->shared;
+    Fuzzer *f = &worker->fuzzer;
+    Case *c = malloc(sizeof(Case));
+    Mismatch m;
+    int program;
+    while (c && !atomic_load(&shared->found) && (program = atomic_fetch_add(&shared->program, 1)) < shared->programs)
+    {
+        // each program's cases follow from the seed and its number alone
+        f->rng = shared->seed ^ (uint64_t) program * 0xD1B54A32D192ED03;
+        generate(f, c->prg);
+        if (load(f, c->prg) < 0)
+        {
+            shared->status = 2;
+            atomic_store(&shared->found, 1);
+            break;
+        }
+        for (int k = 0; k < shared->cases && !atomic_load(&shared->found); ++k)
+        {
+            if (f->dirty)
+            {
+                restore(f);
+            }
+            random_case(f, c);
+            c->cycle = f->a->bus.cycle;
+            if (run_case(f, c, &m) && !atomic_exchange(&shared->found, 1))
+            {
+                printf("program %d, case %d\n", program, k);
+                minimize(f, c);
+                report(f, c, shared->output);
+                shared->status = 1;
+            }
+        }
+    }
+    free(c);
+    unload(f);
+    return 0;
+}
+
+static int replay(const char *path)
+{
+    static Fuzzer f;
+    static Case c;
+    Mismatch m;
+    FILE *file = fopen(path, "rb");
+    if (!file || fread(&c, sizeof(c), 1, file) != 1)
+    {
+        perror(path);
+        return 2;
+    }
+    fclose(file);
+    int status = check(&f, &c, &m);
+    if (status == 1)
+    {
+        printf("%s:\n", path);
+        report(&f, &c, 0);
+    }
+    else if (status == 0)
+    {
+        printf("%s: ok\n", path);
+    }
+    unload(&f);
+    return status < 0 ? 2 : status;
+}
+
+int main(int argc, char **argv)
+{
+    Shared shared = {.seed = 1, .programs = 4, .cases = 500000, .output = "fuzz_cpu.case"};
+    int threads = 1, opt;
+    while ((opt = getopt(argc, argv, "s:n:c:j:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            shared.seed = strtoull(optarg, 0, 0);
+            break;
+        case 'n':
+            shared.programs = atoi(optarg);
+            break;
+        case 'c':
+            shared.cases = atoi(optarg);
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'o':
+            shared.output = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-s seed] [-n programs] [-c cases] [-j threads] [-o reproducer]\n"
+                            "       %s <reproducer>...\n",
+                    argv[0], argv[0]);
+            return 2;
+        }
+    }
+
+    // a corpus of reproducers
+    if (optind < argc)
+    {
+        int status = 0;
+        for (int i = optind; i < argc; ++i)
+        {
+            int result = replay(argv[i]);
+            status = result > status ? result : status;
+        }
+        return status;
+    }
+
+    threads = threads > 0 ? threads : sysconf(_SC_NPROCESSORS_ONLN);
+    Worker *workers = calloc(threads, sizeof(Worker));
+    if (!workers)
+    {
+        perror("fuzz_cpu");
+        return 2;
+    }
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < threads; ++i)
+    {
+        workers[i].shared = &shared;
+        pthread_create(&workers[i].thread, 0, work, &workers[i]);
+    }
+    unsigned long long cases = 0, cycles = 0;
+    for (int i = 0; i < threads; ++i)
+    {
+        pthread_join(workers[i].thread, 0);
+        cases += workers[i].fuzzer.cases;
+        cycles += workers[i].fuzzer.cycles;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double elapsed = end.tv_sec - start.tv_sec + (end.tv_nsec - start.tv_nsec) * 1e-9;
+    printf("cases:              %llu (%.0f/s)\n", cases, cases / elapsed);
+    printf("cycles:             %llu (%.0f/s)\n", cycles, cycles / elapsed);
+    free(workers);
+    return shared.status;
+}
@@ -0,0 +1,158 @@
+#include "hash.h"
+#include "cpu.h"
+#include "ppu.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_AVX2 1
+#endif
+
+#define PRIME32_1 0x9E3779B1U
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+
+#define LANES 8
+#define STRIPE 64
+#define BLOCK_STRIPES 16 // between scrambles
+
+// per lane keys: fractional digits of pi
+static const uint64_t secret[2][LANES] = {
+    {0x243F6A8885A308D3, 0x13198A2E03707344, 0xA4093822299F31D0, 0x082EFA98EC4E6C89,
+     0x452821E638D01377, 0xBE5466CF34E90C6C, 0xC0AC29B7C97C50DD, 0x3F84D5B5B5470917},
+    {0x9216D5D98979FB1B, 0xD1310BA698DFB5AC, 0x2FFD72DBD01ADFB7, 0xB8E1AFED6A267E96,
+     0xBA7C9045F12C7F99, 0x24A19947B3916CF7, 0x0801F2E2858EFC16, 0x636920D871574E69},
+};
+
+static inline uint64_t read64(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static void accumulate_scalar(uint64_t *acc, const unsigned char *p, size_t stripes, const uint64_t *keys)
+{
+    for (size_t s = 0; s < stripes; ++s, p += STRIPE)
+    {
+        for (int i = 0; i < LANES; ++i)
+        {
+            uint64_t data = read64(p + i * 8);
+            uint64_t key = data ^ keys[i];
+            acc[i ^ 1] += data;
+            acc[i] += (key & 0xFFFFFFFF) * (key >> 32);
+        }
+    }
+}
+
+static void scramble_scalar(uint64_t *acc, const uint64_t *keys)
+{
+    for (int i = 0; i < LANES; ++i)
+    {
+        acc[i] = (acc[i] ^ (acc[i] >> 47) ^ keys[i]) * PRIME32_1;
+    }
+}
+
+#ifdef HAVE_AVX2
+
+__attribute__((target("avx2")))
+static void accumulate_avx2(uint64_t *acc, const unsigned char *p, size_t stripes, const uint64_t *keys)
+{
+    __m256i acc0 = _mm256_loadu_si256((const __m256i*) acc);
+    __m256i acc1 = _mm256_loadu_si256((const __m256i*) (acc + 4));
+    __m256i key0 = _mm256_loadu_si256((const __m256i*) keys);
+    __m256i key1 = _mm256_loadu_si256((const __m256i*) (keys + 4));
+
+#define LANE(ACC, DATA, KEY)                                                       \
+    do                                                                             \
+    {                                                                              \
+        __m256i key = _mm256_xor_si256(DATA, KEY);                                 \
+        __m256i product = _mm256_mul_epu32(key, _mm256_srli_epi64(key, 32));       \
+        __m256i swapped = _mm256_shuffle_epi32(DATA, _MM_SHUFFLE(1, 0, 3, 2));     \
+        ACC = _mm256_add_epi64(ACC, _mm256_add_epi64(product, swapped));           \
+    } while (0)
+
+    for (size_t s = 0; s < stripes; ++s, p += STRIPE)
+    {
+        LANE(acc0, _mm256_loadu_si256((const __m256i*) p), key0);
+        LANE(acc1, _mm256_loadu_si256((const __m256i*) (p + 32)), key1);
+    }
+
+#undef LANE
+
+    _mm256_storeu_si256((__m256i*) acc, acc0);
+    _mm256_storeu_si256((__m256i*) (acc + 4), acc1);
+}
+
+#endif
+
+static inline uint64_t fold(uint64_t a, uint64_t b)
+{
+    __uint128_t product = (__uint128_t) a * b;
+    return (uint64_t) product ^ (uint64_t) (product >> 64);
+}
+
+uint64_t hash64(const void *data, size_t size, uint64_t seed)
+{
+    const unsigned char *p = data;
+    uint64_t acc[LANES] = {PRIME32_1, PRIME64_1, PRIME64_2, PRIME64_1 ^ PRIME64_2, seed, ~seed, PRIME64_2 ^ seed, PRIME32_1 ^ seed};
+    uint64_t keys[2][LANES];
+    for (int i = 0; i < LANES; ++i)
+    {
+        keys[0][i] = secret[0][i] + (i & 1 ? -seed : seed);
+        keys[1][i] = secret[1][i] + (i & 1 ? seed : -seed);
+    }
+
+    void (*accumulate)(uint64_t *, const unsigned char *, size_t, const uint64_t *) = accumulate_scalar;
+#ifdef HAVE_AVX2
+    if (__builtin_cpu_supports("avx2"))
+    {
+        accumulate = accumulate_avx2;
+    }
+#endif
+
+    size_t stripes = size / STRIPE;
+    for (; stripes >= BLOCK_STRIPES; stripes -= BLOCK_STRIPES, p += BLOCK_STRIPES * STRIPE)
+    {
+        accumulate(acc, p, BLOCK_STRIPES, keys[0]);
+        scramble_scalar(acc, keys[1]);
+    }
+    accumulate(acc, p, stripes, keys[0]);
+    p += stripes * STRIPE;
+
+    // the tail is zero padded, the size tells it apart
+    size_t tail = size % STRIPE;
+    if (tail)
+    {
+        unsigned char last[STRIPE] = {0};
+        memcpy(last, p, tail);
+        accumulate_scalar(acc, last, 1, keys[0]);
+    }
+
+    uint64_t h = size * PRIME64_1 ^ seed;
+    for (int i = 0; i < LANES; i += 2)
+    {
+        h += fold(acc[i] ^ keys[1][i], acc[i + 1] ^ keys[1][i + 1]);
+    }
+    h ^= h >> 37;
+    h *= 0x165667919E3779F9ULL;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t hash_frame(const unsigned short *frame, uint64_t seed)
+{
+    return hash64(frame, PPU_WIDTH * PPU_HEIGHT * sizeof(*frame), seed);
+}
+
+uint64_t hash_state(const CPU *cpu, const unsigned char *ram, size_t ram_size, uint64_t seed)
+{
+    // registers are bitfields, so pack them first
+    unsigned char registers[9] = {
+        cpu->pc & 0xFF, cpu->pc >> 8, cpu->sp, cpu->a, cpu->x, cpu->y,
+        cpu->n << 7 | cpu->v << 6 | cpu->b << 4 | cpu->d << 3 | cpu->i << 2 | cpu->z << 1 | cpu->c,
+        cpu->cycles & 0xFF, cpu->cycles >> 8,
+    };
+    return hash64(ram, ram_size, hash64(registers, sizeof(registers), seed));
+}
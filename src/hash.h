@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct CPU CPU;
+
+// Fast 64-bit non-cryptographic hash in the style of XXH3's long input path: 8
+// lanes of multiply-accumulate over 64-byte stripes, vectorized with AVX2 when the
+// CPU has it. Results are the same on every path and machine (little endian).
+// Chain regions by passing one hash as the seed of the next.
+uint64_t hash64(const void *data, size_t size, uint64_t seed);
+
+// A frame of PPU pixels
+uint64_t hash_frame(const unsigned short *frame, uint64_t seed);
+
+// CPU registers and RAM
+uint64_t hash_state(const CPU *cpu, const unsigned char *ram, size_t ram_size, uint64_t seed);
@@ -0,0 +1,143 @@
+#include "hashlog.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAGIC "NESHASH"
+#define VERSION 1
+
+typedef struct HashLogHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+} HashLogHeader;
+
+int HashLog_create(HashLog *log, const char *path, int flags)
+{
+    log->file = fopen(path, "wb");
+    if (!log->file)
+    {
+        return -1;
+    }
+    log->flags = flags;
+
+    HashLogHeader header = {MAGIC, VERSION, flags};
+    if (fwrite(&header, sizeof(header), 1, log->file) != 1)
+    {
+        fclose(log->file);
+        return -1;
+    }
+    return 0;
+}
+
+int HashLog_write(HashLog *log, uint64_t frame, uint64_t state)
+{
+    uint64_t record[2] = {frame, state};
+    size_t count = log->flags & HASHLOG_STATE ? 2 : 1;
+    return fwrite(record, sizeof(uint64_t), count, log->file) == count ? 0 : -1;
+}
+
+int HashLog_close(HashLog *log)
+{
+    int error = ferror(log->file);
+    return fclose(log->file) == 0 && !error ? 0 : -1;
+}
+
+typedef struct Mapped
+{
+    const unsigned char *map;
+    size_t size;
+    const uint64_t *records;
+    size_t width; // hashes per record
+    size_t frames;
+} Mapped;
+
+static int map_log(Mapped *log, const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    if ((size_t) st.st_size < sizeof(HashLogHeader))
+    {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    log->size = st.st_size;
+    log->map = mmap(0, log->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (log->map == MAP_FAILED)
+    {
+        return -1;
+    }
+    madvise((void*) log->map, log->size, MADV_SEQUENTIAL);
+
+    const HashLogHeader *header = (const HashLogHeader*) log->map;
+    if (memcmp(header->magic, MAGIC, sizeof(header->magic)) != 0 || header->version != VERSION)
+    {
+        munmap((void*) log->map, log->size);
+        errno = EINVAL;
+        return -1;
+    }
+    log->records = (const uint64_t*) (log->map + sizeof(HashLogHeader));
+    log->width = header->flags & HASHLOG_STATE ? 2 : 1;
+    log->frames = (log->size - sizeof(HashLogHeader)) / (log->width * sizeof(uint64_t));
+    return 0;
+}
+
+long long HashLog_diff(const char *a, const char *b)
+{
+    Mapped x, y;
+    if (map_log(&x, a) < 0)
+    {
+        return -2;
+    }
+    if (map_log(&y, b) < 0)
+    {
+        munmap((void*) x.map, x.size);
+        return -2;
+    }
+
+    size_t frames = x.frames < y.frames ? x.frames : y.frames;
+    size_t frame = 0;
+    if (x.width == y.width)
+    {
+        // skip matching runs with memcmp, then find the record
+        const size_t chunk = 4096;
+        while (frame < frames)
+        {
+            size_t n = frames - frame < chunk ? frames - frame : chunk;
+            if (memcmp(x.records + frame * x.width, y.records + frame * y.width, n * x.width * sizeof(uint64_t)) != 0)
+            {
+                break;
+            }
+            frame += n;
+        }
+    }
+    for (; frame < frames; ++frame)
+    {
+        const uint64_t *rx = x.records + frame * x.width, *ry = y.records + frame * y.width;
+        if (rx[0] != ry[0] || (x.width == 2 && y.width == 2 && rx[1] != ry[1]))
+        {
+            break;
+        }
+    }
+
+    long long result = frame < frames || x.frames != y.frames ? (long long) frame : -1;
+    munmap((void*) x.map, x.size);
+    munmap((void*) y.map, y.size);
+    return result;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+// What each record holds
+#define HASHLOG_FRAME 1 // hash of the frame
+#define HASHLOG_STATE 2 // and of the CPU registers and RAM after it
+
+// A log of per-frame hashes, 8 bytes per hash, for comparing runs without storing
+// their output
+typedef struct HashLog
+{
+    FILE *file;
+    int flags;
+} HashLog;
+
+// Start a log at path. Returns 0, or -1 and sets errno.
+int HashLog_create(HashLog *log, const char *path, int flags);
+
+// Append a frame's record (state is ignored without HASHLOG_STATE)
+int HashLog_write(HashLog *log, uint64_t frame, uint64_t state);
+
+// Returns 0, or -1 if anything failed to be written
+int HashLog_close(HashLog *log);
+
+// First frame at which two logs differ. Only frame hashes are compared unless both
+// logs have state hashes. If one log is a prefix of the other, that is the shorter
+// log's length. Returns -1 if the logs match, or -2 and sets errno on error.
+long long HashLog_diff(const char *a, const char *b);
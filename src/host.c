@@ -0,0 +1,378 @@
+#define _GNU_SOURCE // pthread_setaffinity_np
+
+#include "host.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+    Queues
+*/
+
+static void push(HostQueue *queue, HostSession *session)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->tasks[queue->tail++ % HOST_SESSIONS] = session;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// The worker's own frames come oldest first, as they were released
+static HostSession *take_oldest(HostQueue *queue)
+{
+    HostSession *session = 0;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head != queue->tail)
+    {
+        session = queue->tasks[queue->head++ % HOST_SESSIONS];
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return session;
+}
+
+// A thief takes from the other end, away from the owner
+static HostSession *steal_newest(HostQueue *queue)
+{
+    HostSession *session = 0;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head != queue->tail)
+    {
+        session = queue->tasks[--queue->tail % HOST_SESSIONS];
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return session;
+}
+
+/*
+    Threads
+*/
+
+// Release the frames that are due, then sleep until the next one is
+static void *clock_thread(void *arg)
+{
+    Host *host = arg;
+    pthread_mutex_lock(&host->lock);
+    while (!host->stop)
+    {
+        uint64_t now = Input_now();
+        uint64_t next = now + host->period;
+        int released = 0;
+        for (HostSession *session = host->sessions; session; session = session->next)
+        {
+            if (session->state != HOST_IDLE || session->closing)
+            {
+                continue;
+            }
+            if (session->release <= now)
+            {
+                session->state = HOST_QUEUED;
+                push(&host->workers[session->home].queue, session);
+                atomic_fetch_add(&host->queued, 1);
+                released = 1;
+            }
+            else if (session->release < next)
+            {
+                next = session->release;
+            }
+        }
+        if (released)
+        {
+            pthread_cond_broadcast(&host->wake);
+        }
+        struct timespec until = {next / 1000000000, next % 1000000000};
+        pthread_cond_timedwait(&host->changed, &host->lock, &until);
+    }
+    pthread_mutex_unlock(&host->lock);
+    return 0;
+}
+
+static HostSession *take(Host *host, int index)
+{
+    HostSession *session = take_oldest(&host->workers[index].queue);
+    for (int k = 1; !session && k < host->threads; ++k)
+    {
+        session = steal_newest(&host->workers[(index + k) % host->threads].queue);
+    }
+    if (session)
+    {
+        atomic_fetch_sub(&host->queued, 1);
+    }
+    return session;
+}
+
+static void run(Host *host, HostSession *session)
+{
+    pthread_mutex_lock(&host->lock);
+    int closing = session->closing;
+    session->state = closing ? HOST_IDLE : HOST_RUNNING;
+    if (closing)
+    {
+        pthread_cond_broadcast(&host->idle);
+    }
+    pthread_mutex_unlock(&host->lock);
+    if (closing)
+    {
+        return;
+    }
+
+    Machine *machine = session->machine;
+    for (int port = 0; port < 2; ++port)
+    {
+        int buttons = atomic_load(&session->buttons[port]);
+        if (buttons != session->applied[port])
+        {
+            Controller_schedule(&machine->controller, machine->bus.cycle, port, buttons);
+            session->applied[port] = buttons;
+        }
+    }
+
+    uint64_t start = Input_now();
+    Machine_frame(machine);
+    if (session->frame)
+    {
+        session->frame(session->frame_arg, session);
+    }
+    uint64_t end = Input_now();
+
+    // the release only changes while the session is running, on this thread
+    uint64_t deadline = session->release + host->period;
+    uint64_t time = end - start;
+    pthread_mutex_lock(&session->lock);
+    session->times[session->frames++ % HOST_SAMPLES] = time < UINT32_MAX ? time : UINT32_MAX;
+    session->late += end > deadline;
+    pthread_mutex_unlock(&session->lock);
+
+    // a late frame's successor starts now rather than piling up behind it
+    pthread_mutex_lock(&host->lock);
+    session->release = end > deadline ? end : deadline;
+    session->state = HOST_IDLE;
+    pthread_cond_broadcast(&host->idle);
+    pthread_cond_signal(&host->changed);
+    pthread_mutex_unlock(&host->lock);
+}
+
+static void *worker_thread(void *arg)
+{
+    HostWorker *worker = arg;
+    Host *host = worker->host;
+    for (;;)
+    {
+        HostSession *session = take(host, worker->index);
+        if (session)
+        {
+            run(host, session);
+            continue;
+        }
+
+        pthread_mutex_lock(&host->lock);
+        while (!atomic_load(&host->queued) && !host->stop)
+        {
+            pthread_cond_wait(&host->wake, &host->lock);
+        }
+        int stop = host->stop;
+        pthread_mutex_unlock(&host->lock);
+        if (stop)
+        {
+            return 0;
+        }
+    }
+}
+
+/*
+    Public functions
+*/
+
+int Host_start(Host *host, int threads, uint64_t period, int pin)
+{
+    int cores = sysconf(_SC_NPROCESSORS_ONLN);
+    cores = cores > 0 ? cores : 1;
+    memset(host, 0, sizeof(*host));
+    host->threads = threads > 0 ? threads : cores;
+    host->period = period ? period : HOST_PERIOD;
+    host->workers = calloc(host->threads, sizeof(HostWorker));
+    if (!host->workers)
+    {
+        return -1;
+    }
+
+    // the clock sleeps against the same clock as Input_now
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&host->lock, 0);
+    pthread_cond_init(&host->wake, 0);
+    pthread_cond_init(&host->changed, &attr);
+    pthread_cond_init(&host->idle, 0);
+    pthread_condattr_destroy(&attr);
+    atomic_init(&host->queued, 0);
+
+    int started = 0, error = 0;
+    for (; started < host->threads; ++started)
+    {
+        HostWorker *worker = &host->workers[started];
+        worker->host = host;
+        worker->index = started;
+        pthread_mutex_init(&worker->queue.lock, 0);
+        if ((error = pthread_create(&worker->thread, 0, worker_thread, worker)))
+        {
+            break;
+        }
+        if (pin)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(started % cores, &set);
+            pthread_setaffinity_np(worker->thread, sizeof(set), &set);
+        }
+    }
+    if (!error)
+    {
+        error = pthread_create(&host->clock, 0, clock_thread, host);
+    }
+    if (error)
+    {
+        // let the workers that did start see the stop
+        host->threads = started;
+        pthread_mutex_lock(&host->lock);
+        host->stop = 1;
+        pthread_cond_broadcast(&host->wake);
+        pthread_mutex_unlock(&host->lock);
+        for (int i = 0; i < started; ++i)
+        {
+            pthread_join(host->workers[i].thread, 0);
+        }
+        free(host->workers);
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+static void destroy(HostSession *session)
+{
+    Machine_destroy(session->machine);
+    pthread_mutex_destroy(&session->lock);
+    free(session);
+}
+
+void Host_stop(Host *host)
+{
+    pthread_mutex_lock(&host->lock);
+    host->stop = 1;
+    pthread_cond_broadcast(&host->wake);
+    pthread_cond_signal(&host->changed);
+    pthread_mutex_unlock(&host->lock);
+
+    pthread_join(host->clock, 0);
+    for (int i = 0; i < host->threads; ++i)
+    {
+        pthread_join(host->workers[i].thread, 0);
+        pthread_mutex_destroy(&host->workers[i].queue.lock);
+    }
+    while (host->sessions)
+    {
+        HostSession *session = host->sessions;
+        host->sessions = session->next;
+        destroy(session);
+    }
+    pthread_mutex_destroy(&host->lock);
+    pthread_cond_destroy(&host->wake);
+    pthread_cond_destroy(&host->changed);
+    pthread_cond_destroy(&host->idle);
+    free(host->workers);
+}
+
+HostSession *Host_open(Host *host, const char *path, const RomDB *db, int sample_rate, void (*frame)(void *arg, HostSession *session), void *arg)
+{
+    HostSession *session = calloc(1, sizeof(HostSession));
+    if (!session)
+    {
+        return 0;
+    }
+    session->machine = Machine_create(path, db, PPU_SCANLINE, sample_rate);
+    if (!session->machine)
+    {
+        free(session);
+        return 0;
+    }
+    session->host = host;
+    session->frame = frame;
+    session->frame_arg = arg;
+    atomic_init(&session->buttons[0], 0);
+    atomic_init(&session->buttons[1], 0);
+    pthread_mutex_init(&session->lock, 0);
+
+    pthread_mutex_lock(&host->lock);
+    if (host->count == HOST_SESSIONS)
+    {
+        pthread_mutex_unlock(&host->lock);
+        destroy(session);
+        errno = ENOSPC;
+        return 0;
+    }
+    session->home = host->next_home++ % host->threads;
+    session->release = Input_now();
+    session->state = HOST_IDLE;
+    session->next = host->sessions;
+    host->sessions = session;
+    ++host->count;
+    pthread_cond_signal(&host->changed);
+    pthread_mutex_unlock(&host->lock);
+    return session;
+}
+
+void Host_close(HostSession *session)
+{
+    Host *host = session->host;
+    pthread_mutex_lock(&host->lock);
+    session->closing = 1;
+    while (session->state != HOST_IDLE)
+    {
+        pthread_cond_wait(&host->idle, &host->lock);
+    }
+    HostSession **link = &host->sessions;
+    while (*link != session)
+    {
+        link = &(*link)->next;
+    }
+    *link = session->next;
+    --host->count;
+    pthread_mutex_unlock(&host->lock);
+    destroy(session);
+}
+
+void Host_input(HostSession *session, int port, int buttons)
+{
+    atomic_store(&session->buttons[port & 1], buttons & 0xFF);
+}
+
+static int compare_times(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+void Host_stats(HostSession *session, HostStats *stats)
+{
+    uint32_t times[HOST_SAMPLES];
+    pthread_mutex_lock(&session->lock);
+    stats->frames = session->frames;
+    stats->late = session->late;
+    size_t count = session->frames < HOST_SAMPLES ? session->frames : HOST_SAMPLES;
+    memcpy(times, session->times, count * sizeof(uint32_t));
+    pthread_mutex_unlock(&session->lock);
+
+    if (!count)
+    {
+        stats->p50 = stats->p90 = stats->p99 = stats->max = 0;
+        return;
+    }
+    qsort(times, count, sizeof(uint32_t), compare_times);
+    stats->p50 = times[(count - 1) * 50 / 100];
+    stats->p90 = times[(count - 1) * 90 / 100];
+    stats->p99 = times[(count - 1) * 99 / 100];
+    stats->max = times[count - 1];
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "machine.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define HOST_SESSIONS 1024     // open at once, at most
+#define HOST_SAMPLES 1024      // frame times kept per session for percentiles
+#define HOST_PERIOD 16639267   // ns between NTSC frames
+
+typedef struct Host Host;
+typedef struct HostSession HostSession;
+
+enum
+{
+    HOST_IDLE,    // waiting for its next frame's release
+    HOST_QUEUED,  // on a worker's queue
+    HOST_RUNNING, // a worker is running its frame
+};
+
+// One machine served by a host. Its frames are released once a period and have
+// to be done by the end of it. A frame that runs late is counted and the next is
+// released when it finishes, so a slow session never has more than one frame
+// waiting and can't crowd out the others.
+struct HostSession
+{
+    Host *host;
+    Machine *machine;
+    HostSession *next;
+    int home; // the worker its frames are queued on first
+
+    // called on a worker after each frame, to take the picture and sound
+    void (*frame)(void *arg, HostSession *session);
+    void *frame_arg;
+
+    // set by Host_input, applied at the start of the next frame
+    atomic_int buttons[2];
+    int applied[2];
+
+    // guarded by the host's lock
+    int state; // HOST_IDLE, HOST_QUEUED or HOST_RUNNING
+    int closing;
+    uint64_t release; // when the next frame may start
+
+    // guarded by lock
+    pthread_mutex_t lock;
+    unsigned long long frames;
+    unsigned long long late; // frames done after their deadline
+    uint32_t times[HOST_SAMPLES]; // ns each of the last frames took
+};
+
+// Frame time percentiles, in ns
+typedef struct HostStats
+{
+    unsigned long long frames, late;
+    uint32_t p50, p90, p99, max;
+} HostStats;
+
+// A worker's queue of sessions with a frame to run. The worker takes the oldest;
+// idle workers steal the newest.
+typedef struct HostQueue
+{
+    pthread_mutex_t lock;
+    HostSession *tasks[HOST_SESSIONS];
+    size_t head, tail;
+} HostQueue;
+
+typedef struct HostWorker
+{
+    Host *host;
+    int index;
+    pthread_t thread;
+    _Alignas(64) HostQueue queue;
+} HostWorker;
+
+// Runs frames for many sessions on a pool of worker threads. A clock thread
+// releases each session's frames on time onto a worker's queue, and workers with
+// nothing to do steal from the others.
+struct Host
+{
+    HostWorker *workers;
+    int threads;
+    uint64_t period;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;    // workers wait for frames to be queued
+    pthread_cond_t changed; // the clock waits for sessions to come or finish a frame
+    pthread_cond_t idle;    // a session finished a frame
+    HostSession *sessions;
+    int count;
+    atomic_int queued; // frames on queues
+    int stop;
+    int next_home;
+    pthread_t clock;
+};
+
+// Start threads workers (one per core if 0), each pinned to a core if pin is set,
+// releasing frames every period ns (HOST_PERIOD if 0). Returns 0, or -1 and sets
+// errno.
+int Host_start(Host *host, int threads, uint64_t period, int pin);
+
+// Close every session and stop the threads
+void Host_stop(Host *host);
+
+// Power on a machine for the rom at path (looked up in db if given), making
+// audio at sample_rate (0 for none), and start serving it. frame is called with
+// it after every frame if set. Returns the session, or 0 and sets errno.
+HostSession *Host_open(Host *host, const char *path, const RomDB *db, int sample_rate, void (*frame)(void *arg, HostSession *session), void *arg);
+
+// Wait for the session's frame to finish if one is running, then destroy it
+void Host_close(HostSession *session);
+
+// Hold buttons on a controller port from the session's next frame
+void Host_input(HostSession *session, int port, int buttons);
+
+// Frames so far and percentiles of the recent frame times
+void Host_stats(HostSession *session, HostStats *stats);
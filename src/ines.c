@@ -1,90 +1,113 @@
-#include <assert.h>
-#include <ctype.h>
-#include <fcntl.h>
-#include <stdio.h>
-#include <sys/mman.h>
-#include <unistd.h>
+#include "ines.h"
 
-typedef struct Header {
-    char magic[4]; // 4E 45 53 1A
-    unsigned prg_rom : 8; // number of 16KB banks
-    unsigned chr_rom : 8; // number of 8KB banks (0 means board uses CHR RAM)
-    unsigned flags_6 : 8;
-    unsigned flags_7 : 8;
-    unsigned prg_ram : 8; // number of 8KB banks, 0 means 1
-    unsigned flags_9 : 8;
-    unsigned flags_10 : 8;
-    char padding[5];
-} Header;
+#include <string.h>
 
-enum Flags6 {
-    FLAGS_6_MIRRORING = 1 << 0,
-    FLAGS_6_RAM_BATTERY = 1 << 1, // battery backed
-    FLAGS_6_TRAINER_PRESENT = 1 << 2, // 512B trainer at $7000-$71FF
-    FLAGS_6_IGNORE_MIRRORING = 1 << 3, // instead provide four-screen VRAM
-    FLAGS_6_MAPPER_LO_NIBBLE = 0XF << 4,
-};
+// NES 2.0 ROM size from the lsb byte and msb nibble, in units of unit bytes
+static size_t rom_size(int lsb, int msb, size_t unit)
+{
+    if (msb != 0xF)
+    {
+        return ((size_t)msb << 8 | lsb) * unit;
+    }
 
-enum Mirroring {
-    MIRRORING_HORIZONTAL = 0,
-    MIRRORING_VERTICAL = 1,
-};
+    // exponent-multiplier notation: 2^E * (MM * 2 + 1)
+    int exponent = lsb >> 2;
+    int multiplier = (lsb & 3) * 2 + 1;
+    if (exponent >= (int)(8 * sizeof(size_t)) - 3)
+    {
+        return (size_t)-1; // too large for any file
+    }
+    return ((size_t)1 << exponent) * multiplier;
+}
+
+// NES 2.0 RAM size from a shift count (0 means none)
+static int ram_size(int shift)
+{
+    return shift ? 64 << shift : 0;
+}
+
+int INES_parse(INES *ines, const unsigned char *data, size_t size)
+{
+    if (size < INES_HEADER_SIZE || memcmp(data, "NES\x1A", 4) != 0)
+    {
+        return -1;
+    }
+
+    const Header *header = (const Header *)data;
+    int flags_6 = header->flags_6;
+    int flags_7 = header->flags_7;
+
+    memset(ines, 0, sizeof(*ines));
+    ines->nes2 = (flags_7 & FLAGS_7_NES_20) == 0x08;
+    ines->mirroring = (flags_6 & FLAGS_6_MIRRORING) ? MIRRORING_VERTICAL : MIRRORING_HORIZONTAL;
+    ines->four_screen = (flags_6 & FLAGS_6_IGNORE_MIRRORING) != 0;
+    ines->battery = (flags_6 & FLAGS_6_RAM_BATTERY) != 0;
 
-enum Flags7 {
-    FLAGS_7_VS_UNISYSTEM = 1 << 0,
-    FLAGS_7_PLAYCHOICE_10 = 1 << 1,
-    FLAGS_7_NES_20 = 3 << 2,
-    FLAGS_7_MAPPER_HI_NIBBLE = 0XF << 4,
-};
+    if (ines->nes2)
+    {
+        ines->mapper = (flags_6 >> 4) | (flags_7 & FLAGS_7_MAPPER_HI_NIBBLE) | ((data[8] & 0xF) << 8);
+        ines->submapper = data[8] >> 4;
+        ines->prg_size = rom_size(header->prg_rom, data[9] & 0xF, 0x4000);
+        ines->chr_size = rom_size(header->chr_rom, data[9] >> 4, 0x2000);
+        ines->prg_ram_size = ram_size(data[10] & 0xF);
+        ines->prg_nvram_size = ram_size(data[10] >> 4);
+        ines->chr_ram_size = ram_size(data[11] & 0xF);
+        ines->chr_nvram_size = ram_size(data[11] >> 4);
+        ines->tv_system = (data[12] & 3) == 1 ? TV_SYSTEM_PAL : TV_SYSTEM_NTSC;
+    }
+    else
+    {
+        // old dumping tools wrote a signature over bytes 7-15; ignore them if so
+        int dirty = data[12] || data[13] || data[14] || data[15];
+        if (dirty)
+        {
+            flags_7 = 0;
+        }
 
-enum Flags9 {
-    FLAGS_9_TV_SYSTEM = 1 << 0,
-};
+        ines->mapper = (flags_6 >> 4) | (flags_7 & FLAGS_7_MAPPER_HI_NIBBLE);
+        ines->prg_size = (size_t)header->prg_rom * 0x4000;
+        ines->chr_size = (size_t)header->chr_rom * 0x2000;
+        ines->chr_ram_size = ines->chr_size ? 0 : 0x2000;
 
-enum TVSystem {
-    TV_SYSTEM_NTSC = 0,
-    TV_SYSTEM_PAL = 1,
-};
+        int prg_ram = (dirty || !header->prg_ram) ? 1 : header->prg_ram;
+        if (!dirty && (header->flags_10 & FLAGS_10_PRG_RAM_MISSING))
+        {
+            prg_ram = 0;
+        }
+        if (ines->battery)
+        {
+            ines->prg_nvram_size = prg_ram * 0x2000;
+        }
+        else
+        {
+            ines->prg_ram_size = prg_ram * 0x2000;
+        }
+        ines->tv_system = (!dirty && (header->flags_9 & FLAGS_9_TV_SYSTEM)) ? TV_SYSTEM_PAL : TV_SYSTEM_NTSC;
+    }
 
-enum Flags10 {
-    FLAGS_10_TV_SYSTEM_DUAL_COMPAT = 1 << 0,
-    FLAGS_10_TV_SYSTEM_PAL = 1 << 1, // if off then NTSC, unless DUAL_COMPAT set
-    FLAGS_10_PRG_RAM_MISSING = 1 << 4, // $6000-$7FFF, 0: present, 1: missing
-    FLAGS_10_BUS_CONFLICTS = 1 << 5,
-};
+    // banks are switched in 8KB (PRG) and 1KB (CHR) units
+    if (!ines->prg_size || ines->prg_size % 0x2000 || ines->chr_size % 0x400 ||
+        ines->prg_size > size || ines->chr_size > size)
+    {
+        return -1;
+    }
 
-int main() {
-    int fd = open("test/nestest.nes", O_RDONLY);
-    assert(fd >= 0);
-    void *ptr = mmap(0, sizeof(Header), PROT_READ, MAP_PRIVATE, fd, 0);
-    assert(ptr != MAP_FAILED);
+    size_t offset = INES_HEADER_SIZE;
+    if (flags_6 & FLAGS_6_TRAINER_PRESENT)
+    {
+        ines->trainer_offset = offset;
+        offset += INES_TRAINER_SIZE;
+    }
+    ines->prg_offset = offset;
+    offset += ines->prg_size;
+    ines->chr_offset = offset;
+    offset += ines->chr_size;
 
-    Header *header = ptr;
-    printf("magic:              %x %x %x %x\n", header->magic[0], header->magic[1], header->magic[2], header->magic[3]);
-    printf("prg rom:            %d KB\n", header->prg_rom * 16);
-    printf("chr rom:            %d KB\n", header->chr_rom * 8);
-    printf("mapper:             %d\n", ((header->flags_6 & FLAGS_6_MAPPER_LO_NIBBLE) >> 4) | (header->flags_7 & FLAGS_7_MAPPER_HI_NIBBLE));
-    printf("flags 6:            %s\n", isprint(header->flags_6) ? (char[]){(char)header->flags_6, '\0'} : "");
-    printf(" mirroring:         %s\n", (header->flags_6 & FLAGS_6_MIRRORING) ? "vertical" : "horizontal");
-    printf(" ram battery:       %d\n", (header->flags_6 & FLAGS_6_RAM_BATTERY) > 0);
-    printf(" trainer present:   %d\n", (header->flags_6 & FLAGS_6_TRAINER_PRESENT) > 0);
-    printf(" ignore mirroring:  %d\n", (header->flags_6 & FLAGS_6_IGNORE_MIRRORING) > 0);
-    printf(" mapper (lo):       %x\n", (header->flags_6 & FLAGS_6_MAPPER_LO_NIBBLE) >> 4);
-    printf("flags 7:            %s\n", isprint(header->flags_7) ? (char[]){(char)header->flags_7, '\0'} : "");
-    printf(" vs unisystem:      %d\n", (header->flags_7 & FLAGS_7_VS_UNISYSTEM) > 0);
-    printf(" playchoice 10:     %d\n", (header->flags_7 & FLAGS_7_PLAYCHOICE_10) > 0);
-    printf(" nes 2.0:           %d\n", (header->flags_7 & FLAGS_7_NES_20) >> 2);
-    printf(" mapper (hi):       %x\n", (header->flags_7 & FLAGS_7_MAPPER_HI_NIBBLE) >> 4);
-    printf("prg ram:            %d KB\n", (header->prg_ram || 1) * 8);
-    printf("flags 9:            %s\n", isprint(header->flags_9) ? (char[]){(char)header->flags_9, '\0'} : "");
-    printf(" tv system:         %s\n", (header->flags_9 & FLAGS_9_TV_SYSTEM) ? "PAL" : "NTSC");
-    printf("flags 10:           %s\n", isprint(header->flags_10) ? (char[]){(char)header->flags_10, '\0'} : "");
-    printf(" tv system (dual):  %d\n", (header->flags_10 & FLAGS_10_TV_SYSTEM_DUAL_COMPAT) > 0);
-    printf(" tv system:         %s\n", (header->flags_10 & FLAGS_10_TV_SYSTEM_PAL) ? "PAL" : "NTSC");
-    printf(" prg ram:           %s\n", (header->flags_10 & FLAGS_10_PRG_RAM_MISSING) ? "missing" : "present");
-    printf(" bus conflicts:     %d\n", (header->flags_10 & FLAGS_10_BUS_CONFLICTS) > 0);
+    // trailing data (e.g. PlayChoice-10 INST-ROM) is allowed, missing data is not
+    if (offset > size)
+    {
+        return -1;
+    }
 
-    munmap(ptr, sizeof(Header));
-    close(fd);
     return 0;
 }
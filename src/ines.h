@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stddef.h>
+
+typedef struct Header {
+    char magic[4]; // 4E 45 53 1A
+    unsigned prg_rom : 8; // number of 16KB banks
+    unsigned chr_rom : 8; // number of 8KB banks (0 means board uses CHR RAM)
+    unsigned flags_6 : 8;
+    unsigned flags_7 : 8;
+    unsigned prg_ram : 8; // number of 8KB banks, 0 means 1
+    unsigned flags_9 : 8;
+    unsigned flags_10 : 8;
+    char padding[5];
+} Header;
+
+enum Flags6 {
+    FLAGS_6_MIRRORING = 1 << 0,
+    FLAGS_6_RAM_BATTERY = 1 << 1, // battery backed
+    FLAGS_6_TRAINER_PRESENT = 1 << 2, // 512B trainer at $7000-$71FF
+    FLAGS_6_IGNORE_MIRRORING = 1 << 3, // instead provide four-screen VRAM
+    FLAGS_6_MAPPER_LO_NIBBLE = 0XF << 4,
+};
+
+enum Mirroring {
+    MIRRORING_HORIZONTAL = 0,
+    MIRRORING_VERTICAL = 1,
+    // selected by mappers, not the header
+    MIRRORING_SINGLE_LOW = 2,
+    MIRRORING_SINGLE_HIGH = 3,
+    MIRRORING_FOUR_SCREEN = 4,
+};
+
+enum Flags7 {
+    FLAGS_7_VS_UNISYSTEM = 1 << 0,
+    FLAGS_7_PLAYCHOICE_10 = 1 << 1,
+    FLAGS_7_NES_20 = 3 << 2,
+    FLAGS_7_MAPPER_HI_NIBBLE = 0XF << 4,
+};
+
+enum Flags9 {
+    FLAGS_9_TV_SYSTEM = 1 << 0,
+};
+
+enum TVSystem {
+    TV_SYSTEM_NTSC = 0,
+    TV_SYSTEM_PAL = 1,
+};
+
+enum Flags10 {
+    FLAGS_10_TV_SYSTEM_DUAL_COMPAT = 1 << 0,
+    FLAGS_10_TV_SYSTEM_PAL = 1 << 1, // if off then NTSC, unless DUAL_COMPAT set
+    FLAGS_10_PRG_RAM_MISSING = 1 << 4, // $6000-$7FFF, 0: present, 1: missing
+    FLAGS_10_BUS_CONFLICTS = 1 << 5,
+};
+
+#define INES_HEADER_SIZE 16
+#define INES_TRAINER_SIZE 512
+
+// Decoded header of an iNES or NES 2.0 file
+typedef struct INES
+{
+    int nes2;        // header is NES 2.0
+    int mapper;      // mapper number (up to 12 bits for NES 2.0)
+    int submapper;   // NES 2.0 only
+    int mirroring;   // enum Mirroring
+    int four_screen; // cart provides four-screen VRAM
+    int battery;     // PRG-RAM (or NVRAM) is battery backed
+    int tv_system;   // enum TVSystem
+
+    // offsets and sizes of the file sections in bytes
+    size_t trainer_offset; // 0 if not present
+    size_t prg_offset, prg_size;
+    size_t chr_offset, chr_size; // chr_size is 0 if the board uses CHR RAM
+
+    // volatile and battery backed RAM sizes in bytes
+    int prg_ram_size, prg_nvram_size;
+    int chr_ram_size, chr_nvram_size;
+} INES;
+
+// Decode and validate the header of the size bytes of an iNES file at data.
+// Returns 0 on success, -1 if the file is not a valid or supported image.
+int INES_parse(INES *ines, const unsigned char *data, size_t size);
@@ -0,0 +1,182 @@
+#include "input.h"
+
+#include <string.h>
+#include <time.h>
+
+void InputQueue_init(InputQueue *queue)
+{
+    for (size_t i = 0; i < INPUT_QUEUE_SIZE; ++i)
+    {
+        atomic_init(&queue->slots[i].sequence, i);
+    }
+    atomic_init(&queue->head, 0);
+    queue->tail = 0;
+}
+
+int InputQueue_push(InputQueue *queue, const InputEvent *event)
+{
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    for (;;)
+    {
+        // a slot is free for head when its sequence is head, and full until then
+        size_t sequence = atomic_load_explicit(&queue->slots[head & (INPUT_QUEUE_SIZE - 1)].sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t) sequence - (intptr_t) head;
+        if (diff < 0)
+        {
+            return -1;
+        }
+        if (diff > 0)
+        {
+            head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+        }
+        else if (atomic_compare_exchange_weak_explicit(&queue->head, &head, head + 1, memory_order_relaxed, memory_order_relaxed))
+        {
+            break;
+        }
+    }
+    queue->slots[head & (INPUT_QUEUE_SIZE - 1)].event = *event;
+    atomic_store_explicit(&queue->slots[head & (INPUT_QUEUE_SIZE - 1)].sequence, head + 1, memory_order_release);
+    return 0;
+}
+
+int InputQueue_pop(InputQueue *queue, InputEvent *event)
+{
+    size_t tail = queue->tail;
+    if (atomic_load_explicit(&queue->slots[tail & (INPUT_QUEUE_SIZE - 1)].sequence, memory_order_acquire) != tail + 1)
+    {
+        return 0;
+    }
+    *event = queue->slots[tail & (INPUT_QUEUE_SIZE - 1)].event;
+    // free for the producer a lap later
+    atomic_store_explicit(&queue->slots[tail & (INPUT_QUEUE_SIZE - 1)].sequence, tail + INPUT_QUEUE_SIZE, memory_order_release);
+    queue->tail = tail + 1;
+    return 1;
+}
+
+uint64_t Input_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void apply(Controller *controller, const ControllerEvent *event)
+{
+    controller->buttons[event->port & 1] = event->buttons & 0xFF;
+    if (controller->record)
+    {
+        fwrite(event, sizeof(*event), 1, controller->record);
+    }
+}
+
+// Apply the changes up to the current cycle
+static void apply_due(Controller *controller)
+{
+    int due = 0;
+    while (due < controller->pending_count && controller->pending[due].cycle <= controller->bus->cycle)
+    {
+        apply(controller, &controller->pending[due++]);
+    }
+    if (due)
+    {
+        controller->pending_count -= due;
+        memmove(controller->pending, controller->pending + due, controller->pending_count * sizeof(ControllerEvent));
+    }
+}
+
+void Controller_schedule(Controller *controller, unsigned long long cycle, int port, int buttons)
+{
+    if (controller->pending_count == CONTROLLER_PENDING)
+    {
+        // full: the oldest change happens early rather than being lost, and is
+        // recorded when it did so a replay matches
+        ControllerEvent *oldest = &controller->pending[0];
+        if (oldest->cycle > controller->bus->cycle)
+        {
+            oldest->cycle = controller->bus->cycle;
+        }
+        apply(controller, oldest);
+        memmove(controller->pending, controller->pending + 1, --controller->pending_count * sizeof(ControllerEvent));
+    }
+
+    // after any change at the same cycle, so order is kept
+    int i = controller->pending_count++;
+    while (i > 0 && controller->pending[i - 1].cycle > cycle)
+    {
+        controller->pending[i] = controller->pending[i - 1];
+        --i;
+    }
+    controller->pending[i] = (ControllerEvent) {cycle, port, buttons};
+}
+
+void Controller_frame(Controller *controller, uint64_t now)
+{
+    uint64_t start = controller->frame_time;
+    uint64_t span = start && now > start ? now - start : 0;
+    unsigned long long cycle = controller->bus->cycle;
+
+    InputEvent event;
+    while (controller->queue && InputQueue_pop(controller->queue, &event))
+    {
+        unsigned long long offset = 0;
+        if (span && event.time > start)
+        {
+            offset = (event.time - start) * CONTROLLER_FRAME_CYCLES / span;
+            offset = offset < CONTROLLER_FRAME_CYCLES ? offset : CONTROLLER_FRAME_CYCLES - 1;
+        }
+        Controller_schedule(controller, cycle + offset, event.port, event.buttons);
+    }
+    controller->frame_time = now;
+}
+
+static int read_port(Controller *controller, int port)
+{
+    if (controller->strobe)
+    {
+        controller->shift[port] = controller->buttons[port];
+    }
+    int bit = controller->shift[port] & 1;
+    // ones once all 8 buttons are out
+    controller->shift[port] = controller->shift[port] >> 1 | 0x80;
+    return bit;
+}
+
+void Controller_message(Controller *controller, Bus *bus)
+{
+    switch (bus->message)
+    {
+    case BUS_READ:
+        if (bus->addr == 0x4016 || bus->addr == 0x4017)
+        {
+            apply_due(controller);
+            // the upper bits are open bus, usually the address's high byte
+            bus->data = 0x40 | read_port(controller, bus->addr & 1);
+        }
+        break;
+
+    case BUS_WRITE:
+        if (bus->addr == 0x4016)
+        {
+            apply_due(controller);
+            // the buttons are latched for as long as strobe is high
+            if (controller->strobe || (bus->data & 1))
+            {
+                controller->shift[0] = controller->buttons[0];
+                controller->shift[1] = controller->buttons[1];
+            }
+            controller->strobe = bus->data & 1;
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+void Controller_init(Controller *controller, Bus *bus, InputQueue *queue)
+{
+    memset(controller, 0, sizeof(*controller));
+    controller->bus = bus;
+    controller->queue = queue;
+    controller->device.message = (BusDeviceMessage) &Controller_message;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "bus.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Buttons in the order the controller shifts them out
+#define BUTTON_A 0x01
+#define BUTTON_B 0x02
+#define BUTTON_SELECT 0x04
+#define BUTTON_START 0x08
+#define BUTTON_UP 0x10
+#define BUTTON_DOWN 0x20
+#define BUTTON_LEFT 0x40
+#define BUTTON_RIGHT 0x80
+
+#define INPUT_QUEUE_SIZE 256 // power of 2
+#define CONTROLLER_PENDING 64
+
+// CPU cycles an emulated frame is spread over
+#define CONTROLLER_FRAME_CYCLES 29781
+
+// A controller's new button state, at a host time (CLOCK_MONOTONIC nanoseconds)
+typedef struct InputEvent
+{
+    uint64_t time;
+    int port;
+    int buttons;
+} InputEvent;
+
+// Bounded queue from any number of host input threads to the emulation thread.
+// Producers claim a slot with a compare and swap on head, and each slot's
+// sequence number tells the consumer when it has been filled.
+typedef struct InputQueue
+{
+    struct
+    {
+        atomic_size_t sequence;
+        InputEvent event;
+    } slots[INPUT_QUEUE_SIZE];
+    _Alignas(64) atomic_size_t head; // producers
+    _Alignas(64) size_t tail;        // consumer
+} InputQueue;
+
+void InputQueue_init(InputQueue *queue);
+
+// Producer: returns 0, or -1 if the queue is full
+int InputQueue_push(InputQueue *queue, const InputEvent *event);
+
+// Consumer: returns 1 and the oldest event, or 0 if there is none
+int InputQueue_pop(InputQueue *queue, InputEvent *event);
+
+// Host time for events
+uint64_t Input_now();
+
+// A button state change at an emulated cycle, as applied and recorded
+typedef struct ControllerEvent
+{
+    unsigned long long cycle;
+    int port;
+    int buttons;
+} ControllerEvent;
+
+// Standard controllers on $4016/$4017. Host events are given emulated cycles by
+// where they arrived in the host time between the starts of the last two frames,
+// so input that came in halfway through a frame lands halfway through the next
+// one instead of all at its start. Each change is applied when the CPU reaches its
+// cycle, and can be recorded to replay a run with the same timing.
+typedef struct Controller
+{
+    BusDevice device;
+    Bus *bus;
+    InputQueue *queue;
+
+    int buttons[2];
+    int shift[2];
+    int strobe;
+
+    ControllerEvent pending[CONTROLLER_PENDING]; // in cycle order
+    int pending_count;
+
+    uint64_t frame_time; // host time of the last frame start, 0 before the first
+    FILE *record;        // applied events are written here, if set
+} Controller;
+
+void Controller_init(Controller *controller, Bus *bus, InputQueue *queue);
+
+// Call as each emulated frame starts, with the host time, to take the queued
+// events
+void Controller_frame(Controller *controller, uint64_t now);
+
+// Change a port's buttons at cycle (for replays, or input without a queue)
+void Controller_schedule(Controller *controller, unsigned long long cycle, int port, int buttons);
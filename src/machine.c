@@ -0,0 +1,184 @@
+#include "machine.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+Machine *Machine_create(const char *path, const RomDB *db, PPUMode mode, int sample_rate)
+{
+    // the cart knows how much RAM it needs once it's open
+    Bus bus;
+    Cart cart;
+    Bus_init(&bus);
+    if (Cart_open(&cart, &bus, path, db) < 0)
+    {
+        return 0;
+    }
+    size_t size = (sizeof(Machine) + Cart_ram_size(&cart) + 63) & ~(size_t) 63;
+    Machine *machine = aligned_alloc(64, size);
+    if (!machine)
+    {
+        Cart_close(&cart);
+        errno = ENOMEM;
+        return 0;
+    }
+    memset(machine, 0, size);
+    machine->size = size;
+
+    Bus *b = &machine->bus;
+    Bus_init(b);
+    machine->cart = cart;
+    Cart_move(&machine->cart, b, machine->cart_ram);
+    RAM_attach(&machine->ram, machine->ram_bytes, MACHINE_RAM_SIZE, 0x0000, 0x1FFF);
+    for (int mirror = 0; mirror < 0x2000; mirror += MACHINE_RAM_SIZE)
+    {
+        Bus_map(b, mirror, MACHINE_RAM_SIZE, machine->ram_bytes, machine->ram_bytes);
+    }
+    CPU_init(&machine->cpu, b);
+    PPU_init(&machine->ppu, b, &machine->cart, mode);
+    APU_init(&machine->apu, b, sample_rate);
+    Controller_init(&machine->controller, b, 0);
+    Bus_connect(b, (BusDevice*) &machine->cart);
+    Bus_connect(b, (BusDevice*) &machine->ram);
+    Bus_connect(b, (BusDevice*) &machine->ppu);
+    Bus_connect(b, (BusDevice*) &machine->apu);
+    Bus_connect(b, (BusDevice*) &machine->controller);
+    Bus_connect(b, (BusDevice*) &machine->cpu);
+    Bus_message(b, BUS_RESET);
+    return machine;
+}
+
+void Machine_reset(Machine *machine)
+{
+    Bus_message(&machine->bus, BUS_RESET);
+}
+
+void Machine_frame(Machine *machine)
+{
+    unsigned long long frame = machine->ppu.frames;
+    while (machine->ppu.frames == frame)
+    {
+        Bus_tick(&machine->bus);
+    }
+}
+
+void Machine_destroy(Machine *machine)
+{
+    Cart_close(&machine->cart);
+    free(machine);
+}
+
+// Where pointers into a copied machine and its rom file go
+typedef struct Relocation
+{
+    uintptr_t from, size, to;
+    uintptr_t file_from, file_size, file_to;
+} Relocation;
+
+static void *relocate(const Relocation *r, void *pointer)
+{
+    uintptr_t p = (uintptr_t) pointer;
+    if (p - r->from < r->size)
+    {
+        return (void*) (p - r->from + r->to);
+    }
+    if (p - r->file_from < r->file_size)
+    {
+        return (void*) (p - r->file_from + r->file_to);
+    }
+    return pointer;
+}
+
+#define RELOCATE(FIELD) ((FIELD) = relocate(&r, (FIELD)))
+
+void Machine_copy(Machine *dst, const Machine *src)
+{
+    // what belongs to dst outside the arena stays
+    Video *video = dst->ppu.video;
+    unsigned short *frame = dst->ppu.frame;
+    void (*log)(void *arg, const PPULogEntry *entry) = dst->ppu.log;
+    void *log_arg = dst->ppu.log_arg;
+    InputQueue *queue = dst->controller.queue;
+    FILE *record = dst->controller.record;
+    TileCache tiles = dst->cart.tiles;
+    unsigned char *file = dst->cart.file;
+    Save save = dst->cart.save;
+    void (*remap)(void *arg, int window) = dst->cart.remap;
+    void *remap_arg = dst->cart.remap_arg;
+
+    memcpy(dst, src, src->size);
+    Relocation r = {(uintptr_t) src, src->size, (uintptr_t) dst,
+                    (uintptr_t) src->cart.file, src->cart.file_size, (uintptr_t) file};
+
+    Bus *bus = &dst->bus;
+    RELOCATE(bus->devices);
+    for (BusDevice *device = bus->devices; device; device = device->next)
+    {
+        RELOCATE(device->next);
+    }
+    for (int i = 0; i < BUS_PAGES; ++i)
+    {
+        RELOCATE(bus->read_map[i]);
+        RELOCATE(bus->write_map[i]);
+    }
+    RELOCATE(dst->cpu.bus);
+    RELOCATE(dst->ram.bytes);
+
+    PPU *ppu = &dst->ppu;
+    RELOCATE(ppu->bus);
+    RELOCATE(ppu->cart);
+    for (int i = 0; i < CART_CHR_WINDOWS; ++i)
+    {
+        RELOCATE(ppu->logged_chr[i]);
+    }
+    for (int i = 0; i < 4; ++i)
+    {
+        RELOCATE(ppu->logged_nt[i]);
+    }
+    ppu->video = video;
+    ppu->frame = video ? frame : ppu->framebuffer;
+    ppu->log = log;
+    ppu->log_arg = log_arg;
+
+    RELOCATE(dst->apu.bus);
+    RELOCATE(dst->controller.bus);
+    dst->controller.queue = queue;
+    dst->controller.record = record;
+
+    Cart *cart = &dst->cart;
+    RELOCATE(cart->bus);
+    RELOCATE(cart->prg);
+    RELOCATE(cart->chr);
+    RELOCATE(cart->prg_ram);
+    RELOCATE(cart->ciram);
+    RELOCATE(cart->vram);
+    RELOCATE(cart->memory);
+    RELOCATE(cart->sync_arg);
+    for (int i = 0; i < CART_PRG_WINDOWS; ++i)
+    {
+        RELOCATE(cart->prg_map[i]);
+    }
+    for (int i = 0; i < CART_CHR_WINDOWS; ++i)
+    {
+        RELOCATE(cart->chr_map[i]);
+    }
+    for (int i = 0; i < 4; ++i)
+    {
+        RELOCATE(cart->nt_map[i]);
+    }
+    cart->file = file;
+    cart->save = save;
+    cart->tiles = tiles;
+    // src's cheats are in its map, dst's are put back
+    cart->remap = remap;
+    cart->remap_arg = remap_arg;
+    // PRG-RAM in src's save file is copied to dst's own, its file or arena space
+    Cart_move_prg_ram(cart, save.map ? save.ram : dst->cart_ram);
+    Cart_remap(cart);
+    if (cart->chr_ram)
+    {
+        // decoded from dst's old CHR
+        memset(tiles.valid, 0, tiles.tiles);
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "apu.h"
+#include "bus.h"
+#include "cart.h"
+#include "cpu.h"
+#include "input.h"
+#include "ppu.h"
+#include "ram.h"
+#include "romdb.h"
+
+#include <stddef.h>
+
+#define MACHINE_RAM_SIZE 0x800
+
+// A whole console in one 64 byte aligned allocation: the bus and CPU that every
+// cycle touches first, then the internal RAM, the PPU (OAM, palette, nametables),
+// the APU, controllers, the cart with its mapper registers, and after them the
+// cart's PRG-RAM, CHR-RAM and VRAM. Only the rom file (mapped read only) and
+// the decoded tile cache live elsewhere. Copying a machine is one memcpy of size
+// bytes and a pass over its pointers.
+typedef struct Machine
+{
+    Bus bus;
+    CPU cpu;
+    _Alignas(64) unsigned char ram_bytes[MACHINE_RAM_SIZE];
+
+    _Alignas(64) PPU ppu;
+    _Alignas(64) APU apu;
+    _Alignas(64) Controller controller;
+    _Alignas(64) Cart cart;
+    RAM ram;
+
+    size_t size; // bytes allocated, this and cart_ram
+    _Alignas(64) unsigned char cart_ram[];
+} Machine;
+
+// Open the rom at path (looked up in db if given) and power on a machine for it,
+// making audio at sample_rate (0 for none). Returns the machine, or 0 and sets
+// errno.
+Machine *Machine_create(const char *path, const RomDB *db, PPUMode mode, int sample_rate);
+
+// Press reset
+void Machine_reset(Machine *machine);
+
+// Run until the PPU finishes a frame
+void Machine_frame(Machine *machine);
+
+void Machine_destroy(Machine *machine);
+
+// Make dst (a machine for the same rom) an exact copy of src, to snapshot, restore
+// or fork it. Video, a pipeline, an input queue or cheats attached to src are not
+// carried over. Battery RAM is copied into dst's own save file if it has one.
+void Machine_copy(Machine *dst, const Machine *src);
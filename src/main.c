@@ -0,0 +1,461 @@
+#include "apu.h"
+#include "bus.h"
+#include "capture.h"
+#include "cart.h"
+#include "cheat.h"
+#include "cpu.h"
+#include "hash.h"
+#include "hashlog.h"
+#include "input.h"
+#include "machine.h"
+#include "pipeline.h"
+#include "ppu.h"
+#include "ram.h"
+#include "recomp.h"
+#include "romdb.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-d index] <rom.nes>\n"
+            "       %s [-d index] -f frames [-H hashlog [-S]] [-V video.y4m] [-W audio.wav] [-I input] [-P] [-G code]... <rom.nes>\n"
+            "       %s -d index -s <dir> [-c corrections] [-j threads]\n"
+            "       %s -x <hashlog> <hashlog>\n"
+            "       %s [-d index] -R out.c <rom.nes>\n",
+            name, name, name, name, name);
+}
+
+// Build or refresh the rom index
+static int scan(const char *index, const char *dir, const char *corrections, int threads)
+{
+    RomDB previous, db;
+    int have_previous = RomDB_load(&previous, index) == 0;
+
+    if (RomDB_scan(&db, dir, threads, have_previous ? &previous : 0) < 0)
+    {
+        perror(dir);
+        return 1;
+    }
+    if (have_previous)
+    {
+        RomDB_free(&previous);
+    }
+
+    if (corrections)
+    {
+        int corrected = RomDB_load_corrections(&db, corrections);
+        if (corrected < 0)
+        {
+            perror(corrections);
+            return 1;
+        }
+        printf("corrected:          %d\n", corrected);
+    }
+
+    if (RomDB_save(&db, index) < 0)
+    {
+        perror(index);
+        return 1;
+    }
+    printf("indexed:            %zu\n", db.count);
+    RomDB_free(&db);
+    return 0;
+}
+
+#define SAMPLE_RATE 48000
+
+// Where frames go, from the render thread of a pipelined run
+typedef struct Output
+{
+    HashLog *log;
+    Capture *capture;
+    uint64_t hash;
+} Output;
+
+static void output_frame(void *arg, const unsigned short *frame)
+{
+    Output *output = arg;
+    output->hash = hash_frame(frame, 0);
+    if (output->log)
+    {
+        HashLog_write(output->log, output->hash, 0);
+    }
+    if (output->capture)
+    {
+        Capture_frame(output->capture, frame);
+    }
+}
+
+// Run headless for frames frames, logging a hash of every frame (and of the CPU
+// and RAM after it if state is set) and recording video and audio if given. The
+// APU makes no samples without a WAV file. Recorded controller changes are
+// replayed from input if given. Frames are drawn on a second thread if pipelined.
+// The game's native code runs in place of the interpreter if it's built in.
+static int run(Machine *machine, long frames, const char *hashlog, int state, const char *y4m, const char *wav, const char *input, int pipelined)
+{
+    Bus *bus = &machine->bus;
+    PPU *ppu = &machine->ppu;
+    Controller *controller = &machine->controller;
+    HashLog log;
+    static Capture capture;
+    static Pipeline pipeline;
+    static int16_t samples[BLIP_SIZE];
+
+    if (hashlog && HashLog_create(&log, hashlog, HASHLOG_FRAME | (state ? HASHLOG_STATE : 0)) < 0)
+    {
+        perror(hashlog);
+        return 1;
+    }
+    FILE *replay = 0;
+    ControllerEvent next;
+    int have_next = 0;
+    if (input)
+    {
+        replay = fopen(input, "rb");
+        if (!replay)
+        {
+            perror(input);
+            return 1;
+        }
+        have_next = fread(&next, sizeof(next), 1, replay) == 1;
+    }
+    int capturing = y4m || wav;
+    if (capturing && Capture_open(&capture, y4m, wav, SAMPLE_RATE, 1) < 0)
+    {
+        perror(y4m ? y4m : wav);
+        return 1;
+    }
+
+    Output output = {hashlog ? &log : 0, y4m ? &capture : 0, 0};
+    if (pipelined && Pipeline_start(&pipeline, ppu, 0, output_frame, &output) < 0)
+    {
+        perror("pipeline");
+        return 1;
+    }
+
+    static Recomp recomp;
+    int native = 0;
+    if (Recomp_builtin)
+    {
+        native = Recomp_init(&recomp, Recomp_builtin, machine) == 0;
+        if (!native)
+        {
+            perror("native code");
+        }
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t hash = 0;
+    while (ppu->frames < (unsigned long long) frames)
+    {
+        // the changes due in the next two frames, as many as are held at once
+        while (have_next && next.cycle < bus->cycle + 2 * CONTROLLER_FRAME_CYCLES && controller->pending_count < CONTROLLER_PENDING)
+        {
+            Controller_schedule(controller, next.cycle, next.port, next.buttons);
+            have_next = fread(&next, sizeof(next), 1, replay) == 1;
+        }
+        if (native)
+        {
+            Recomp_frame(&recomp, machine);
+        }
+        else
+        {
+            unsigned long long frame = ppu->frames;
+            while (ppu->frames == frame)
+            {
+                Bus_tick(bus);
+            }
+        }
+        if (!pipelined)
+        {
+            hash = hash_frame(ppu->frame, 0);
+            if (hashlog)
+            {
+                HashLog_write(&log, hash, state ? hash_state(&machine->cpu, machine->ram_bytes, MACHINE_RAM_SIZE, 0) : 0);
+            }
+            if (y4m)
+            {
+                Capture_frame(&capture, ppu->frame);
+            }
+        }
+        if (wav)
+        {
+            Capture_audio(&capture, samples, APU_samples(&machine->apu, samples, BLIP_SIZE));
+        }
+    }
+    if (pipelined)
+    {
+        Pipeline_stop(&pipeline);
+        hash = output.hash;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (replay)
+    {
+        fclose(replay);
+    }
+    if (hashlog && HashLog_close(&log) < 0)
+    {
+        perror(hashlog);
+        return 1;
+    }
+    if (capturing && Capture_close(&capture) < 0)
+    {
+        perror(y4m ? y4m : wav);
+        return 1;
+    }
+    double elapsed = end.tv_sec - start.tv_sec + (end.tv_nsec - start.tv_nsec) * 1e-9;
+    printf("frames:             %ld\n", frames);
+    printf("fps:                %.1f\n", frames / elapsed);
+    printf("last frame hash:    %016llx\n", (unsigned long long) hash);
+    if (native)
+    {
+        printf("native cycles:      %.1f%%\n", 100.0 * recomp.native / bus->cycle);
+        Recomp_free(&recomp);
+    }
+    return 0;
+}
+
+// Apply Game Genie or raw cheat codes to the machine's PRG
+static int apply_cheats(Machine *machine, Cheats *cheats, const char **codes, int count)
+{
+    Cheats_init(cheats, &machine->cart);
+    for (int i = 0; i < count; ++i)
+    {
+        Cheat cheat;
+        if (Cheat_decode(codes[i], &cheat) < 0 || Cheats_add(cheats, &cheat) < 0)
+        {
+            perror(codes[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#define SAVE_INTERVAL 60
+
+// Keep battery backed PRG-RAM in the rom's name with .sav in place of its extension,
+// written back every second
+static int open_save(Machine *machine, const char *path)
+{
+    char save[PATH_MAX];
+    const char *slash = strrchr(path, '/');
+    const char *dot = strrchr(slash ? slash : path, '.');
+    int length = dot ? (int) (dot - path) : (int) strlen(path);
+    if (snprintf(save, sizeof(save), "%.*s.sav", length, path) >= (int) sizeof(save))
+    {
+        errno = ENAMETOOLONG;
+        perror(path);
+        return 1;
+    }
+    if (Cart_open_save(&machine->cart, save, SAVE_INTERVAL) < 0)
+    {
+        perror(save);
+        return 1;
+    }
+    return 0;
+}
+
+// Write the game's code out as C for a native build
+static int emit(Machine *machine, const char *path)
+{
+    FILE *out = fopen(path, "w");
+    if (!out)
+    {
+        perror(path);
+        return 1;
+    }
+    int blocks = Recomp_emit(out, machine, "program");
+    if (fclose(out) != 0 || blocks < 0)
+    {
+        perror(path);
+        return 1;
+    }
+    printf("blocks:             %d\n", blocks);
+    return 0;
+}
+
+// Report where two hash logs start to differ
+static int diff(const char *a, const char *b)
+{
+    long long frame = HashLog_diff(a, b);
+    if (frame == -2)
+    {
+        perror("diff");
+        return 2;
+    }
+    if (frame == -1)
+    {
+        printf("identical\n");
+        return 0;
+    }
+    printf("first difference:   frame %lld\n", frame);
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    const char *index = 0, *dir = 0, *corrections = 0, *hashlog = 0, *y4m = 0, *wav = 0, *input = 0, *recompile = 0;
+    const char *codes[CHEATS_MAX];
+    int threads = 0, state = 0, compare = 0, pipelined = 0, code_count = 0, opt;
+    long frames = 0;
+
+    while ((opt = getopt(argc, argv, "d:s:c:j:f:H:SV:W:I:PxR:G:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd':
+            index = optarg;
+            break;
+        case 's':
+            dir = optarg;
+            break;
+        case 'c':
+            corrections = optarg;
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'f':
+            frames = atol(optarg);
+            break;
+        case 'H':
+            hashlog = optarg;
+            break;
+        case 'S':
+            state = 1;
+            break;
+        case 'V':
+            y4m = optarg;
+            break;
+        case 'W':
+            wav = optarg;
+            break;
+        case 'I':
+            input = optarg;
+            break;
+        case 'P':
+            pipelined = 1;
+            break;
+        case 'x':
+            compare = 1;
+            break;
+        case 'R':
+            recompile = optarg;
+            break;
+        case 'G':
+            if (code_count == CHEATS_MAX)
+            {
+                usage(argv[0]);
+                return 2;
+            }
+            codes[code_count++] = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (compare)
+    {
+        if (optind != argc - 2)
+        {
+            usage(argv[0]);
+            return 2;
+        }
+        return diff(argv[optind], argv[optind + 1]);
+    }
+
+    if (dir)
+    {
+        if (!index)
+        {
+            usage(argv[0]);
+            return 2;
+        }
+        return scan(index, dir, corrections, threads);
+    }
+
+    // the CPU and RAM have moved on by the time the render thread has a frame
+    if (optind != argc - 1 || (pipelined && state))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    const char *path = argv[optind];
+
+    RomDB db;
+    if (index && RomDB_load(&db, index) < 0)
+    {
+        perror(index);
+        return 1;
+    }
+
+    if (frames > 0 || recompile)
+    {
+        Machine *machine = Machine_create(path, index ? &db : 0, PPU_SCANLINE, wav ? SAMPLE_RATE : 0);
+        if (!machine)
+        {
+            perror(path);
+            return 1;
+        }
+        // the translated code is of the rom as it is, cheats apply when running
+        static Cheats cheats;
+        int status = recompile ? emit(machine, recompile) : apply_cheats(machine, &cheats, codes, code_count);
+        // a logged run starts from the same RAM every time, so two logs compare
+        if (!recompile && !hashlog && status == 0)
+        {
+            status = open_save(machine, path);
+        }
+        if (!recompile && status == 0)
+        {
+            status = run(machine, frames, hashlog, state, y4m, wav, input, pipelined);
+        }
+        Machine_destroy(machine);
+        if (index)
+        {
+            RomDB_free(&db);
+        }
+        return status;
+    }
+
+    Bus bus;
+    Cart cart;
+
+    Bus_init(&bus);
+    if (Cart_open(&cart, &bus, path, index ? &db : 0) < 0)
+    {
+        perror(path);
+        return 1;
+    }
+
+    INES *ines = &cart.ines;
+    printf("format:             %s\n", ines->nes2 ? "NES 2.0" : "iNES");
+    printf("mapper:             %d.%d (%s)\n", ines->mapper, ines->submapper, cart.mapper->name);
+    printf("prg rom:            %zu KB\n", ines->prg_size / 1024);
+    printf("chr rom:            %zu KB\n", ines->chr_size / 1024);
+    printf("chr ram:            %d KB\n", (ines->chr_ram_size + ines->chr_nvram_size) / 1024);
+    printf("prg ram:            %d KB\n", ines->prg_ram_size / 1024);
+    printf("prg nvram:          %d KB\n", ines->prg_nvram_size / 1024);
+    printf("mirroring:          %s\n", ines->four_screen ? "four-screen" : ines->mirroring == MIRRORING_VERTICAL ? "vertical" : "horizontal");
+    printf("battery:            %d\n", ines->battery);
+    printf("trainer present:    %d\n", ines->trainer_offset != 0);
+    printf("tv system:          %s\n", ines->tv_system == TV_SYSTEM_PAL ? "PAL" : "NTSC");
+
+    Cart_close(&cart);
+    if (index)
+    {
+        RomDB_free(&db);
+    }
+    return 0;
+}
@@ -0,0 +1,407 @@
+#include "mapper.h"
+#include "cart.h"
+
+#include <stddef.h>
+
+/*
+    Bank helpers
+
+    Banks are numbered in units of the window size, negative banks count back
+    from the last bank. Out of range banks wrap like the missing address lines.
+*/
+
+static int wrap(int bank, int banks)
+{
+    return ((bank % banks) + banks) % banks;
+}
+
+// Point 8KB of PRG at addr ($8000-$E000) to bank
+static void prg_8k(Cart *cart, int addr, int bank)
+{
+    bank = wrap(bank, cart->prg_size / 0x2000);
+    Cart_map_prg(cart, (addr - 0x6000) >> 13, cart->prg + bank * 0x2000, 0);
+}
+
+static void prg_16k(Cart *cart, int addr, int bank)
+{
+    prg_8k(cart, addr, bank * 2);
+    prg_8k(cart, addr + 0x2000, bank * 2 + 1);
+}
+
+static void prg_32k(Cart *cart, int bank)
+{
+    prg_16k(cart, 0x8000, bank * 2);
+    prg_16k(cart, 0xC000, bank * 2 + 1);
+}
+
+// Enable PRG-RAM at $6000, optionally read only
+static void prg_ram(Cart *cart, int enabled, int writable)
+{
+    if (cart->prg_ram)
+    {
+        Cart_map_prg(cart, 0, enabled ? cart->prg_ram : 0, writable);
+    }
+}
+
+// Point 1KB of CHR at addr ($0000-$1C00) to bank
+static void chr_1k(Cart *cart, int addr, int bank)
+{
+    bank = wrap(bank, cart->chr_size / 0x400);
+    Cart_map_chr(cart, addr >> 10, cart->chr + bank * 0x400);
+}
+
+static void chr_2k(Cart *cart, int addr, int bank)
+{
+    chr_1k(cart, addr, bank * 2);
+    chr_1k(cart, addr + 0x400, bank * 2 + 1);
+}
+
+static void chr_4k(Cart *cart, int addr, int bank)
+{
+    chr_2k(cart, addr, bank * 2);
+    chr_2k(cart, addr + 0x800, bank * 2 + 1);
+}
+
+static void chr_8k(Cart *cart, int bank)
+{
+    chr_4k(cart, 0x0000, bank * 2);
+    chr_4k(cart, 0x1000, bank * 2 + 1);
+}
+
+// Discrete logic boards see the ROM drive the bus at the same time (NES 2.0 submapper 2)
+static int bus_conflict(Cart *cart, int addr, int data)
+{
+    if (cart->ines.submapper == 2)
+    {
+        data &= cart->prg_map[(addr - 0x6000) >> 13][addr & 0x1FFF];
+    }
+    return data;
+}
+
+/*
+    NROM (0)
+*/
+
+static void NROM_reset(Cart *cart)
+{
+    prg_16k(cart, 0x8000, 0);
+    prg_16k(cart, 0xC000, -1);
+    chr_8k(cart, 0);
+}
+
+/*
+    MMC1 (1)
+*/
+
+static void MMC1_update(Cart *cart)
+{
+    MMC1Registers *r = &cart->regs.mmc1;
+
+    static const int mirroring[] = {
+        MIRRORING_SINGLE_LOW,
+        MIRRORING_SINGLE_HIGH,
+        MIRRORING_VERTICAL,
+        MIRRORING_HORIZONTAL,
+    };
+    Cart_mirror(cart, mirroring[r->control & 3]);
+
+    // 512KB boards (SUROM) use a CHR line to select the 256KB half
+    int outer = cart->prg_size > 0x40000 ? r->chr_0 & 0x10 : 0;
+    int bank = (r->prg & 0xF) | outer;
+
+    switch ((r->control >> 2) & 3)
+    {
+    case 0:
+    case 1:
+        prg_32k(cart, bank >> 1);
+        break;
+
+    case 2:
+        prg_16k(cart, 0x8000, outer);
+        prg_16k(cart, 0xC000, bank);
+        break;
+
+    case 3:
+        prg_16k(cart, 0x8000, bank);
+        prg_16k(cart, 0xC000, 0xF | outer);
+        break;
+    }
+
+    if (r->control & 0x10)
+    {
+        chr_4k(cart, 0x0000, r->chr_0);
+        chr_4k(cart, 0x1000, r->chr_1);
+    }
+    else
+    {
+        chr_8k(cart, r->chr_0 >> 1);
+    }
+
+    prg_ram(cart, !(r->prg & 0x10), 1);
+}
+
+static void MMC1_reset(Cart *cart)
+{
+    MMC1Registers *r = &cart->regs.mmc1;
+    r->shift = r->count = 0;
+    r->control = 0x0C;
+    r->chr_0 = r->chr_1 = r->prg = 0;
+    MMC1_update(cart);
+}
+
+static void MMC1_write(Cart *cart, int addr, int data)
+{
+    MMC1Registers *r = &cart->regs.mmc1;
+
+    if (data & 0x80)
+    {
+        r->shift = r->count = 0;
+        r->control |= 0x0C;
+        MMC1_update(cart);
+        return;
+    }
+
+    // registers are loaded serially, lsb first
+    r->shift |= (data & 1) << r->count;
+    if (++r->count < 5)
+    {
+        return;
+    }
+
+    switch ((addr >> 13) & 3)
+    {
+    case 0:
+        r->control = r->shift;
+        break;
+    case 1:
+        r->chr_0 = r->shift;
+        break;
+    case 2:
+        r->chr_1 = r->shift;
+        break;
+    case 3:
+        r->prg = r->shift;
+        break;
+    }
+    r->shift = r->count = 0;
+    MMC1_update(cart);
+}
+
+/*
+    UxROM (2)
+*/
+
+static void UxROM_write(Cart *cart, int addr, int data)
+{
+    prg_16k(cart, 0x8000, bus_conflict(cart, addr, data));
+}
+
+/*
+    CNROM (3)
+*/
+
+static void CNROM_write(Cart *cart, int addr, int data)
+{
+    chr_8k(cart, bus_conflict(cart, addr, data));
+}
+
+/*
+    MMC3 (4)
+*/
+
+// Re-point the windows of bank register R0-R7
+static void MMC3_switch(Cart *cart, int reg)
+{
+    MMC3Registers *r = &cart->regs.mmc3;
+
+    // bit 6 swaps the switchable bank at $8000 with the fixed second last bank at $C000
+    int swap = r->select & 0x40;
+
+    // bit 7 swaps the 2KB and 1KB pattern table halves
+    int invert = (r->select & 0x80) ? 0x1000 : 0;
+
+    int bank = r->banks[reg];
+    switch (reg)
+    {
+    case 0:
+    case 1:
+        chr_1k(cart, (reg * 0x800) ^ invert, bank & ~1);
+        chr_1k(cart, (reg * 0x800 + 0x400) ^ invert, bank | 1);
+        break;
+
+    case 2:
+    case 3:
+    case 4:
+    case 5:
+        chr_1k(cart, (0x1000 + (reg - 2) * 0x400) ^ invert, bank);
+        break;
+
+    case 6:
+        prg_8k(cart, swap ? 0xC000 : 0x8000, bank);
+        break;
+
+    case 7:
+        prg_8k(cart, 0xA000, bank);
+        break;
+    }
+}
+
+static void MMC3_update(Cart *cart)
+{
+    MMC3Registers *r = &cart->regs.mmc3;
+
+    for (int reg = 0; reg < 8; ++reg)
+    {
+        MMC3_switch(cart, reg);
+    }
+    prg_8k(cart, (r->select & 0x40) ? 0x8000 : 0xC000, -2);
+    prg_8k(cart, 0xE000, -1);
+
+    prg_ram(cart, r->protect & 0x80, !(r->protect & 0x40));
+}
+
+static void MMC3_reset(Cart *cart)
+{
+    MMC3Registers *r = &cart->regs.mmc3;
+    static const int banks[] = {0, 2, 4, 5, 6, 7, 0, 1};
+
+    r->select = 0;
+    for (int i = 0; i < 8; ++i)
+    {
+        r->banks[i] = banks[i];
+    }
+    r->protect = 0x80;
+    r->latch = r->counter = r->reload = r->enabled = 0;
+    MMC3_update(cart);
+}
+
+static void MMC3_write(Cart *cart, int addr, int data)
+{
+    MMC3Registers *r = &cart->regs.mmc3;
+
+    switch (addr & 0xE001)
+    {
+    case 0x8000:
+        // only the mode bits move banks around
+        if ((r->select ^ data) & 0xC0)
+        {
+            r->select = data;
+            MMC3_update(cart);
+        }
+        r->select = data;
+        break;
+
+    case 0x8001:
+        r->banks[r->select & 7] = data;
+        MMC3_switch(cart, r->select & 7);
+        break;
+
+    case 0xA000:
+        Cart_mirror(cart, (data & 1) ? MIRRORING_HORIZONTAL : MIRRORING_VERTICAL);
+        break;
+
+    case 0xA001:
+        r->protect = data;
+        prg_ram(cart, r->protect & 0x80, !(r->protect & 0x40));
+        break;
+
+    case 0xC000:
+        r->latch = data;
+        break;
+
+    case 0xC001:
+        r->counter = 0;
+        r->reload = 1;
+        break;
+
+    case 0xE000:
+        r->enabled = 0;
+        cart->irq = 0; // acknowledge
+        Bus_irq(cart->bus, BUS_IRQ_MAPPER, 0);
+        break;
+
+    case 0xE001:
+        r->enabled = 1;
+        break;
+    }
+}
+
+static void MMC3_scanline(Cart *cart)
+{
+    MMC3Registers *r = &cart->regs.mmc3;
+
+    if (r->counter == 0 || r->reload)
+    {
+        r->counter = r->latch;
+        r->reload = 0;
+    }
+    else
+    {
+        --r->counter;
+    }
+
+    if (r->counter == 0 && r->enabled)
+    {
+        cart->irq = 1;
+        Bus_irq(cart->bus, BUS_IRQ_MAPPER, 1);
+    }
+}
+
+static int MMC3_scanlines_to_irq(Cart *cart)
+{
+    MMC3Registers *r = &cart->regs.mmc3;
+
+    if (!r->enabled)
+    {
+        return -1;
+    }
+    if (r->counter == 0 || r->reload)
+    {
+        // reloads on the next clock, then counts down from the latch
+        return 1 + r->latch;
+    }
+    return r->counter;
+}
+
+/*
+    AxROM (7)
+*/
+
+static void AxROM_reset(Cart *cart)
+{
+    prg_32k(cart, 0);
+    chr_8k(cart, 0);
+    Cart_mirror(cart, MIRRORING_SINGLE_LOW);
+}
+
+static void AxROM_write(Cart *cart, int addr, int data)
+{
+    data = bus_conflict(cart, addr, data);
+    prg_32k(cart, data & 7);
+    Cart_mirror(cart, (data & 0x10) ? MIRRORING_SINGLE_HIGH : MIRRORING_SINGLE_LOW);
+}
+
+/*
+    Public functions
+*/
+
+static const Mapper mappers[] = {
+    {0, "NROM", NROM_reset, 0, 0, 0},
+    {1, "MMC1", MMC1_reset, MMC1_write, 0, 0},
+    {2, "UxROM", NROM_reset, UxROM_write, 0, 0},
+    {3, "CNROM", NROM_reset, CNROM_write, 0, 0},
+    {4, "MMC3", MMC3_reset, MMC3_write, MMC3_scanline, MMC3_scanlines_to_irq},
+    {7, "AxROM", AxROM_reset, AxROM_write, 0, 0},
+};
+
+const Mapper *Mapper_find(int number)
+{
+    for (size_t i = 0; i < sizeof(mappers) / sizeof(mappers[0]); ++i)
+    {
+        if (mappers[i].number == number)
+        {
+            return &mappers[i];
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+typedef struct Cart Cart;
+
+// Board specific bank switching. Every bank switch only re-points PRG/CHR/nametable
+// windows of the cart, so accesses never pay for address translation.
+typedef struct Mapper
+{
+    int number;
+    const char *name;
+
+    // Set the power on banks
+    void (*reset)(Cart *cart);
+
+    // CPU wrote to a register at $8000-$FFFF
+    void (*write)(Cart *cart, int addr, int data);
+
+    // Scanline counter clock (PPU A12 rising edge), may be 0
+    void (*scanline)(Cart *cart);
+
+    // Number of scanline clocks until the next IRQ, or -1 if none is due. Lets the PPU
+    // schedule its next catch up instead of rendering every scanline eagerly. May be 0.
+    int (*scanlines_to_irq)(Cart *cart);
+} Mapper;
+
+typedef struct MMC1Registers
+{
+    int shift, count; // serial port
+    int control, chr_0, chr_1, prg;
+} MMC1Registers;
+
+typedef struct MMC3Registers
+{
+    int select;   // bank select ($8000)
+    int banks[8]; // R0-R7
+    int protect;  // PRG-RAM protect ($A001)
+    int latch, counter, reload, enabled; // scanline IRQ
+} MMC3Registers;
+
+// Mapper registers, only the member for the cart's board is used
+typedef union MapperRegisters
+{
+    MMC1Registers mmc1;
+    MMC3Registers mmc3;
+} MapperRegisters;
+
+// Find the mapper for an iNES mapper number, or 0 if unsupported
+const Mapper *Mapper_find(int number);
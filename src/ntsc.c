@@ -0,0 +1,325 @@
+#include "ntsc.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_AVX2 1
+#endif
+
+// composite levels of black and white, the signal is scaled to 0-1 between them
+#define BLACK 0.312f
+#define WHITE 1.100f
+
+// tint, in subcarrier phases
+#define HUE 3.9
+
+// the TV's gamma over the one sRGB displays assume
+#define GAMMA (2.2 / 1.8)
+
+// pixels repeated past each edge of a line so the filters have input
+#define PAD 2
+
+// the line's samples are split into 4 phases (sample n is at [n % 4][n / 4]) so
+// the filter for 8 consecutive output pixels, 4 samples apart, reads contiguously
+#define POLY ((PPU_WIDTH + 2 * PAD) * NTSC_SAMPLES_PER_PIXEL / 4)
+
+// output pixel j is centred on sample CENTER + 4j
+#define CENTER (PAD * NTSC_SAMPLES_PER_PIXEL + 2)
+
+// luma is averaged over a subcarrier cycle, chroma over a triangle two cycles wide
+#define LUMA_TAPS 12
+#define CHROMA_TAPS 23
+
+// Composite level of a pixel at a subcarrier phase (nesdev wiki, "NTSC video")
+static float level(int pixel, int phase)
+{
+    static const float levels[16] = {
+        0.228f, 0.312f, 0.552f, 0.880f, // low
+        0.616f, 0.840f, 1.100f, 1.100f, // high
+        0.192f, 0.256f, 0.448f, 0.712f, // low, attenuated
+        0.500f, 0.676f, 0.896f, 0.896f, // high, attenuated
+    };
+    int color = pixel & 0x0F;
+    int luma = (pixel >> 4) & 3;
+    int emphasis = (pixel >> 6) & 7;
+    if (color > 13)
+    {
+        luma = 1;
+    }
+
+    float low = levels[luma], high = levels[4 + luma];
+    if (color == 0)
+    {
+        low = high;
+    }
+    if (color > 12)
+    {
+        high = low;
+    }
+    float signal = (color + phase) % 12 < 6 ? high : low;
+
+    // each emphasis bit darkens the signal for a third of the cycle
+    if (((emphasis & 1) && phase % 12 < 6) ||
+        ((emphasis & 2) && (phase + 4) % 12 < 6) ||
+        ((emphasis & 4) && (phase + 8) % 12 < 6))
+    {
+        signal *= 0.746f;
+    }
+    return signal;
+}
+
+static void *filter_worker(void *arg);
+
+void NTSC_init(NTSC *ntsc, int threads)
+{
+    for (int i = 0; i < 1024; ++i)
+    {
+        ntsc->gamma[i] = (int) (pow(i / 1023.0, GAMMA) * 255 + 0.5);
+    }
+
+    for (int pixel = 0; pixel < 512; ++pixel)
+    {
+        for (int start = 0; start < 3; ++start)
+        {
+            for (int k = 0; k < NTSC_SAMPLES_PER_PIXEL; ++k)
+            {
+                int phase = (start * 4 + k) % NTSC_PHASES;
+                float s = (level(pixel, phase) - BLACK) / (WHITE - BLACK);
+                float angle = M_PI * (phase + HUE) / 6;
+                int i = (k % 4) * 2 + k / 4;
+                ntsc->signal[pixel][start][0][i] = s;
+                ntsc->signal[pixel][start][1][i] = s * cos(angle);
+                ntsc->signal[pixel][start][2][i] = s * sin(angle);
+            }
+        }
+    }
+
+    if (threads <= 0)
+    {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    ntsc->threads = threads < 1 ? 1 : threads > NTSC_THREADS_MAX ? NTSC_THREADS_MAX : threads;
+    pthread_mutex_init(&ntsc->lock, 0);
+    pthread_cond_init(&ntsc->start, 0);
+    pthread_cond_init(&ntsc->done, 0);
+    ntsc->frames = 0;
+    ntsc->busy = 0;
+    ntsc->started = 0;
+    ntsc->stop = 0;
+    for (int t = 1; t < ntsc->threads; ++t)
+    {
+        if (pthread_create(&ntsc->workers[t], 0, filter_worker, ntsc) != 0)
+        {
+            ntsc->threads = t;
+        }
+    }
+}
+
+void NTSC_free(NTSC *ntsc)
+{
+    pthread_mutex_lock(&ntsc->lock);
+    ntsc->stop = 1;
+    pthread_cond_broadcast(&ntsc->start);
+    pthread_mutex_unlock(&ntsc->lock);
+    for (int t = 1; t < ntsc->threads; ++t)
+    {
+        pthread_join(ntsc->workers[t], 0);
+    }
+    pthread_cond_destroy(&ntsc->start);
+    pthread_cond_destroy(&ntsc->done);
+    pthread_mutex_destroy(&ntsc->lock);
+    ntsc->threads = 1;
+}
+
+// Lay out a line's composite signal (and I/Q products) by phase
+static void synthesize(const NTSC *ntsc, const unsigned short *row, int phase, float poly[3][4][POLY])
+{
+    for (int x = -PAD; x < PPU_WIDTH + PAD; ++x)
+    {
+        int pixel = row[x < 0 ? 0 : x >= PPU_WIDTH ? PPU_WIDTH - 1 : x] & 511;
+        int start = ((phase + NTSC_SAMPLES_PER_PIXEL * x) % NTSC_PHASES + NTSC_PHASES) % NTSC_PHASES / 4;
+        int m = (x + PAD) * 2;
+        for (int c = 0; c < 3; ++c)
+        {
+            const float *samples = ntsc->signal[pixel][start][c];
+            for (int r = 0; r < 4; ++r)
+            {
+                memcpy(&poly[c][r][m], samples + r * 2, 2 * sizeof(float));
+            }
+        }
+    }
+}
+
+static inline int clamp_byte(const NTSC *ntsc, float f)
+{
+    return ntsc->gamma[f <= 0 ? 0 : f >= 1 ? 1023 : (int) (f * 1023 + 0.5f)];
+}
+
+// FCC YIQ to RGB
+#define R_I 0.946882f
+#define R_Q 0.623557f
+#define G_I -0.274788f
+#define G_Q -0.635691f
+#define B_I -1.108545f
+#define B_Q 1.709007f
+
+static void decode_scalar(const NTSC *ntsc, float poly[3][4][POLY], uint32_t *out)
+{
+    for (int j = 0; j < NTSC_WIDTH; ++j)
+    {
+        float y = 0, i = 0, q = 0;
+        for (int k = -LUMA_TAPS / 2; k < LUMA_TAPS / 2; ++k)
+        {
+            int n = CENTER + 4 * j + k;
+            y += poly[0][n & 3][n >> 2];
+        }
+        for (int k = -CHROMA_TAPS / 2; k <= CHROMA_TAPS / 2; ++k)
+        {
+            int n = CENTER + 4 * j + k;
+            float w = (12 - abs(k)) / 72.0f; // triangle summing to 2 (demodulation gain)
+            i += w * poly[1][n & 3][n >> 2];
+            q += w * poly[2][n & 3][n >> 2];
+        }
+        y /= LUMA_TAPS;
+        out[j] = clamp_byte(ntsc, y + R_I * i + R_Q * q) |
+                 clamp_byte(ntsc, y + G_I * i + G_Q * q) << 8 |
+                 clamp_byte(ntsc, y + B_I * i + B_Q * q) << 16 |
+                 0xFFu << 24;
+    }
+}
+
+#ifdef HAVE_AVX2
+
+__attribute__((target("avx2,fma")))
+static inline __m256i channel_avx2(const NTSC *ntsc, __m256 y, __m256 i, __m256 q, float ci, float cq)
+{
+    __m256 f = _mm256_fmadd_ps(_mm256_set1_ps(cq), q, _mm256_fmadd_ps(_mm256_set1_ps(ci), i, y));
+    f = _mm256_min_ps(_mm256_max_ps(f, _mm256_setzero_ps()), _mm256_set1_ps(1));
+    __m256i index = _mm256_cvtps_epi32(_mm256_mul_ps(f, _mm256_set1_ps(1023)));
+    return _mm256_i32gather_epi32((const int*) ntsc->gamma, index, 4);
+}
+
+// 8 output pixels at a time: every filter tap is one load from the phase array
+__attribute__((target("avx2,fma")))
+static void decode_avx2(const NTSC *ntsc, float poly[3][4][POLY], uint32_t *out)
+{
+    for (int j = 0; j < NTSC_WIDTH; j += 8)
+    {
+        __m256 y = _mm256_setzero_ps(), i = _mm256_setzero_ps(), q = _mm256_setzero_ps();
+        for (int k = -LUMA_TAPS / 2; k < LUMA_TAPS / 2; ++k)
+        {
+            int n = CENTER + k;
+            y = _mm256_add_ps(y, _mm256_loadu_ps(&poly[0][n & 3][(n >> 2) + j]));
+        }
+        for (int k = -CHROMA_TAPS / 2; k <= CHROMA_TAPS / 2; ++k)
+        {
+            int n = CENTER + k;
+            __m256 w = _mm256_set1_ps((12 - abs(k)) / 72.0f);
+            i = _mm256_fmadd_ps(w, _mm256_loadu_ps(&poly[1][n & 3][(n >> 2) + j]), i);
+            q = _mm256_fmadd_ps(w, _mm256_loadu_ps(&poly[2][n & 3][(n >> 2) + j]), q);
+        }
+        y = _mm256_mul_ps(y, _mm256_set1_ps(1.0f / LUMA_TAPS));
+
+        __m256i r = channel_avx2(ntsc, y, i, q, R_I, R_Q);
+        __m256i g = channel_avx2(ntsc, y, i, q, G_I, G_Q);
+        __m256i b = channel_avx2(ntsc, y, i, q, B_I, B_Q);
+        __m256i rgba = _mm256_or_si256(_mm256_or_si256(r, _mm256_slli_epi32(g, 8)),
+                                       _mm256_or_si256(_mm256_slli_epi32(b, 16), _mm256_set1_epi32(0xFF000000)));
+        _mm256_storeu_si256((__m256i*) (out + j), rgba);
+    }
+}
+
+#endif
+
+void NTSC_filter_rows(const NTSC *ntsc, const unsigned short *frame, int phase, uint32_t *out, int first, int count)
+{
+    float poly[3][4][POLY];
+#ifdef HAVE_AVX2
+    int avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+
+    for (int line = first; line < first + count; ++line)
+    {
+        // a scanline is 341 dots, which moves the subcarrier 4 phases along
+        synthesize(ntsc, frame + line * PPU_WIDTH, (phase + line * 4) % NTSC_PHASES, poly);
+#ifdef HAVE_AVX2
+        if (avx2)
+        {
+            decode_avx2(ntsc, poly, out + line * NTSC_WIDTH);
+            continue;
+        }
+#endif
+        decode_scalar(ntsc, poly, out + line * NTSC_WIDTH);
+    }
+}
+
+// Band t of the frame's rows
+static void filter_band(NTSC *ntsc, int t)
+{
+    int first = NTSC_HEIGHT * t / ntsc->threads, end = NTSC_HEIGHT * (t + 1) / ntsc->threads;
+    NTSC_filter_rows(ntsc, ntsc->frame, ntsc->phase, ntsc->out, first, end - first);
+}
+
+static void *filter_worker(void *arg)
+{
+    NTSC *ntsc = arg;
+    pthread_mutex_lock(&ntsc->lock);
+    // bands go to the workers in the order they start, the caller has band 0
+    int t = ++ntsc->started;
+    unsigned long long seen = 0;
+    while (1)
+    {
+        while (!ntsc->stop && ntsc->frames == seen)
+        {
+            pthread_cond_wait(&ntsc->start, &ntsc->lock);
+        }
+        if (ntsc->stop)
+        {
+            break;
+        }
+        seen = ntsc->frames;
+        pthread_mutex_unlock(&ntsc->lock);
+
+        filter_band(ntsc, t);
+
+        pthread_mutex_lock(&ntsc->lock);
+        if (--ntsc->busy == 0)
+        {
+            pthread_cond_signal(&ntsc->done);
+        }
+    }
+    pthread_mutex_unlock(&ntsc->lock);
+    return 0;
+}
+
+void NTSC_filter(NTSC *ntsc, const unsigned short *frame, int phase, uint32_t *out)
+{
+    ntsc->frame = frame;
+    ntsc->phase = phase;
+    ntsc->out = out;
+    if (ntsc->threads == 1)
+    {
+        filter_band(ntsc, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&ntsc->lock);
+    ntsc->busy = ntsc->threads - 1;
+    ++ntsc->frames;
+    pthread_cond_broadcast(&ntsc->start);
+    pthread_mutex_unlock(&ntsc->lock);
+
+    filter_band(ntsc, 0);
+
+    pthread_mutex_lock(&ntsc->lock);
+    while (ntsc->busy)
+    {
+        pthread_cond_wait(&ntsc->done, &ntsc->lock);
+    }
+    pthread_mutex_unlock(&ntsc->lock);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "ppu.h"
+
+#include <pthread.h>
+#include <stdint.h>
+
+// Output is twice the PPU's horizontal resolution
+#define NTSC_WIDTH (PPU_WIDTH * 2)
+#define NTSC_HEIGHT PPU_HEIGHT
+
+// Composite samples per PPU pixel, and per colour subcarrier cycle
+#define NTSC_SAMPLES_PER_PIXEL 8
+#define NTSC_PHASES 12
+
+#define NTSC_THREADS_MAX 64
+
+// Composite video filter: turns PPU pixels (colour and emphasis) into the signal
+// the NES puts out, then decodes it like a TV, with the colour fringes and dot
+// crawl that come with it.
+typedef struct NTSC
+{
+    // a pixel's 8 samples of the normalized signal and its I and Q products, for
+    // each starting phase (always a multiple of 4): [pixel][phase / 4][Y, I, Q][sample]
+    // with samples ordered for the filter's polyphase layout (0, 4, 1, 5, 2, 6, 3, 7)
+    float signal[512][3][3][NTSC_SAMPLES_PER_PIXEL];
+
+    // 0-1 intensity (in 1/1023 steps) to a gamma corrected byte
+    int32_t gamma[1024];
+
+    // workers started at init, each filtering a band of rows of every frame while
+    // the calling thread does the first
+    int threads; // bands, the caller's included
+    pthread_t workers[NTSC_THREADS_MAX];
+    pthread_mutex_t lock;
+    pthread_cond_t start, done;
+    unsigned long long frames; // handed to the workers
+    int busy;                  // workers still on the current frame
+    int started;               // workers that have taken a band
+    int stop;
+
+    // the current frame
+    const unsigned short *frame;
+    int phase;
+    uint32_t *out;
+} NTSC;
+
+// Build the tables and start workers for NTSC_filter to split frames over threads
+// (0 for one per core). With fewer workers than asked for, the bands run on the
+// calling thread.
+void NTSC_init(NTSC *ntsc, int threads);
+
+// Stop the workers
+void NTSC_free(NTSC *ntsc);
+
+// Subcarrier phase of a PPU dot, for a frame pass its ppu->frame_start
+static inline int NTSC_phase(long long dot)
+{
+    return dot * NTSC_SAMPLES_PER_PIXEL % NTSC_PHASES;
+}
+
+// Filter rows [first, first + count) of a PPU frame into RGBA8888 rows of
+// NTSC_WIDTH pixels. phase is the frame's NTSC_phase.
+void NTSC_filter_rows(const NTSC *ntsc, const unsigned short *frame, int phase, uint32_t *out, int first, int count);
+
+// Filter a whole frame, splitting rows over the threads given at init. Not to be
+// called from more than one thread at a time.
+void NTSC_filter(NTSC *ntsc, const unsigned short *frame, int phase, uint32_t *out);
@@ -0,0 +1,176 @@
+#include "pipeline.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Emulation thread: append an entry, waiting for room if the renderer is a whole
+// log behind
+static void push(void *arg, const PPULogEntry *entry)
+{
+    Pipeline *pipeline = arg;
+    size_t head = atomic_load_explicit(&pipeline->head, memory_order_relaxed);
+    while (head - atomic_load_explicit(&pipeline->tail, memory_order_acquire) == PIPELINE_LOG_SIZE)
+    {
+        sched_yield();
+    }
+    pipeline->log[head & (PIPELINE_LOG_SIZE - 1)] = *entry;
+    atomic_store_explicit(&pipeline->head, head + 1, memory_order_release);
+}
+
+static void *render_thread(void *arg)
+{
+    Pipeline *pipeline = arg;
+    PPU *replica = &pipeline->replica;
+    size_t tail = atomic_load_explicit(&pipeline->tail, memory_order_relaxed);
+
+    for (;;)
+    {
+        size_t head = atomic_load_explicit(&pipeline->head, memory_order_acquire);
+        if (tail == head)
+        {
+            // stop only once everything logged is drawn
+            if (atomic_load_explicit(&pipeline->stop, memory_order_acquire) &&
+                atomic_load_explicit(&pipeline->head, memory_order_acquire) == tail)
+            {
+                break;
+            }
+            sched_yield();
+            continue;
+        }
+
+        for (; tail != head; ++tail)
+        {
+            const PPULogEntry *entry = &pipeline->log[tail & (PIPELINE_LOG_SIZE - 1)];
+            const unsigned short *frame = replica->frame;
+            PPU_replay(replica, entry);
+            if (entry->kind == PPU_LOG_FRAME)
+            {
+                if (pipeline->frame)
+                {
+                    pipeline->frame(pipeline->frame_arg, frame);
+                }
+                atomic_fetch_add_explicit(&pipeline->frames, 1, memory_order_relaxed);
+            }
+        }
+        atomic_store_explicit(&pipeline->tail, tail, memory_order_release);
+    }
+    return 0;
+}
+
+int Pipeline_start(Pipeline *pipeline, PPU *ppu, Video *video, void (*frame)(void *arg, const unsigned short *frame), void *arg)
+{
+    Cart *cart = ppu->cart;
+    memset(pipeline, 0, sizeof(*pipeline));
+    pipeline->ppu = ppu;
+    pipeline->frame = frame;
+    pipeline->frame_arg = arg;
+    pipeline->log = malloc(PIPELINE_LOG_SIZE * sizeof(PPULogEntry));
+
+    // the replica's cart shares the ROM, and copies what the CPU can change
+    PPU_sync(ppu);
+    pipeline->cart = *cart;
+    Cart *copy = &pipeline->cart;
+    copy->chr = cart->chr_ram ? malloc(cart->chr_size) : cart->chr;
+    copy->vram = cart->vram ? malloc(0x800) : 0;
+    if (!pipeline->log || !copy->chr || (cart->vram && !copy->vram) || TileCache_init(&copy->tiles, cart->chr_size / TILE_SIZE) < 0)
+    {
+        free(pipeline->log);
+        if (cart->chr_ram)
+        {
+            free(copy->chr);
+        }
+        free(copy->vram);
+        errno = ENOMEM;
+        return -1;
+    }
+    if (cart->chr_ram)
+    {
+        memcpy(copy->chr, cart->chr, cart->chr_size);
+    }
+    if (cart->vram)
+    {
+        memcpy(copy->vram, cart->vram, 0x800);
+    }
+
+    pipeline->replica = *ppu;
+    PPU *replica = &pipeline->replica;
+    replica->cart = copy;
+    replica->replica = 1;
+    replica->log = 0;
+    copy->ciram = replica->ciram;
+    for (int i = 0; i < CART_CHR_WINDOWS; ++i)
+    {
+        copy->chr_map[i] = cart->chr_map[i] ? copy->chr + (cart->chr_map[i] - cart->chr) : 0;
+    }
+    for (int i = 0; i < 4; ++i)
+    {
+        unsigned char *p = cart->nt_map[i];
+        copy->nt_map[i] = p >= cart->ciram && p < cart->ciram + 0x800 ? copy->ciram + (p - cart->ciram) : copy->vram + (p - cart->vram);
+    }
+    PPU_attach_video(replica, video);
+    if (!video)
+    {
+        memcpy(replica->framebuffer, ppu->frame, sizeof(replica->framebuffer));
+    }
+    // only the replica publishes frames
+    pipeline->video = ppu->video;
+    PPU_attach_video(ppu, 0);
+
+    atomic_init(&pipeline->head, 0);
+    atomic_init(&pipeline->tail, 0);
+    atomic_init(&pipeline->stop, 0);
+    atomic_init(&pipeline->frames, 0);
+    PPU_set_log(ppu, push, pipeline);
+
+    int error = pthread_create(&pipeline->thread, 0, render_thread, pipeline);
+    if (error)
+    {
+        PPU_set_log(ppu, 0, 0);
+        PPU_attach_video(ppu, pipeline->video);
+        TileCache_free(&copy->tiles);
+        if (cart->chr_ram)
+        {
+            free(copy->chr);
+        }
+        free(copy->vram);
+        free(pipeline->log);
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+void Pipeline_wait(Pipeline *pipeline)
+{
+    while (atomic_load_explicit(&pipeline->tail, memory_order_acquire) != atomic_load_explicit(&pipeline->head, memory_order_acquire))
+    {
+        sched_yield();
+    }
+}
+
+void Pipeline_stop(Pipeline *pipeline)
+{
+    PPU *ppu = pipeline->ppu;
+    atomic_store_explicit(&pipeline->stop, 1, memory_order_release);
+    pthread_join(pipeline->thread, 0);
+
+    // the replica drew up to the last entry; it draws the rest of the frame from here
+    PPU_set_log(ppu, 0, 0);
+    PPU_replay(&pipeline->replica, &(PPULogEntry) {ppu->now, PPU_LOG_FRAME, 0, 0});
+    PPU_attach_video(ppu, pipeline->video);
+    if (ppu->frame != pipeline->replica.frame)
+    {
+        memcpy(ppu->frame, pipeline->replica.frame, sizeof(ppu->framebuffer));
+    }
+
+    Cart *copy = &pipeline->cart;
+    TileCache_free(&copy->tiles);
+    if (ppu->cart->chr_ram)
+    {
+        free(copy->chr);
+    }
+    free(copy->vram);
+    free(pipeline->log);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "cart.h"
+#include "ppu.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+#define PIPELINE_LOG_SIZE (1 << 16) // entries, power of 2
+
+// Runs the PPU's drawing on a second thread. The emulation thread's PPU keeps
+// time and everything the CPU can read (vblank, sprite 0 hit, overflow, $2007)
+// but draws only the pixels a sprite 0 hit could be on. Every change to what is
+// drawn, register writes and side effecting reads, OAM DMA, and mapper bank
+// switches, goes into a log stamped with its dot. The render thread replays the
+// log on a replica PPU with its own copy of the cart's CHR RAM and nametables, so
+// it draws each frame exactly as the single threaded PPU would, a frame behind.
+typedef struct Pipeline
+{
+    PPU *ppu;
+    Video *video; // ppu's own, detached while the replica draws
+    PPU replica;
+    Cart cart; // the replica's view of the cart: same ROM, its own RAM and banks
+    unsigned char *vram;
+
+    PPULogEntry *log;
+    _Alignas(64) atomic_size_t head; // written by the emulation thread
+    _Alignas(64) atomic_size_t tail; // written by the render thread
+    _Alignas(64) atomic_int stop;
+    atomic_ullong frames; // frames drawn
+
+    // called on the render thread with each finished frame, if set
+    void (*frame)(void *arg, const unsigned short *frame);
+    void *frame_arg;
+
+    pthread_t thread;
+} Pipeline;
+
+// Take over ppu's drawing, publishing frames to video if given and calling frame
+// with each. Any video attached to ppu is detached until Pipeline_stop. Returns 0,
+// or -1 and sets errno.
+int Pipeline_start(Pipeline *pipeline, PPU *ppu, Video *video, void (*frame)(void *arg, const unsigned short *frame), void *arg);
+
+// Wait until the render thread has drawn everything logged so far
+void Pipeline_wait(Pipeline *pipeline);
+
+// Finish drawing what was logged, then give drawing back to ppu
+void Pipeline_stop(Pipeline *pipeline);
@@ -0,0 +1,892 @@
+#include "ppu.h"
+#include "video.h"
+
+#include <stdint.h>
+#include <string.h>
+
+// scanlines
+#define VISIBLE_LINES 240
+#define VBLANK_LINE 241
+#define PRERENDER_LINE 261
+
+// dots of a scanline where something happens
+#define DOT_Y_INCREMENT 256
+#define DOT_COPY_X 257
+#define DOT_MAPPER_CLOCK 260 // sprite pattern fetches raise A12
+#define DOT_COPY_Y 280
+
+// ctrl
+#define CTRL_INCREMENT 0x04
+#define CTRL_SPRITE_TABLE 0x08
+#define CTRL_BG_TABLE 0x10
+#define CTRL_SPRITE_16 0x20
+#define CTRL_NMI 0x80
+
+// mask
+#define MASK_GREYSCALE 0x01
+#define MASK_BG_LEFT 0x02
+#define MASK_SPRITES_LEFT 0x04
+#define MASK_BG 0x08
+#define MASK_SPRITES 0x10
+#define MASK_EMPHASIS 0xE0
+
+// status
+#define STATUS_OVERFLOW 0x20
+#define STATUS_SPRITE0 0x40
+#define STATUS_VBLANK 0x80
+
+// sprite pixel flags
+#define SPRITE_BEHIND 0x40
+#define SPRITE_ZERO 0x80
+
+static inline int rendering(PPU *ppu)
+{
+    return ppu->mask & (MASK_BG | MASK_SPRITES);
+}
+
+// Pixels go to the frame, rather than to a log or nowhere
+static inline int drawing(PPU *ppu)
+{
+    return !ppu->log && !ppu->skip;
+}
+
+static inline int line_length(PPU *ppu, int line)
+{
+    return line == PRERENDER_LINE && ppu->odd && rendering(ppu) ? PPU_DOTS - 1 : PPU_DOTS;
+}
+
+/*
+    Memory
+*/
+
+static inline int palette_index(int addr)
+{
+    // $3F10/$3F14/$3F18/$3F1C mirror the backdrop entries
+    addr &= 0x1F;
+    return (addr & 0x13) == 0x10 ? addr & 0x0F : addr;
+}
+
+static int vram_read(PPU *ppu, int addr)
+{
+    addr &= 0x3FFF;
+    if (addr < 0x2000)
+    {
+        return Cart_chr_read(ppu->cart, addr);
+    }
+    if (addr < 0x3F00)
+    {
+        return Cart_nt_read(ppu->cart, addr);
+    }
+    return ppu->palette[palette_index(addr)];
+}
+
+static void vram_write(PPU *ppu, int addr, int byte)
+{
+    addr &= 0x3FFF;
+    if (addr < 0x2000)
+    {
+        Cart_chr_write(ppu->cart, addr, byte);
+    }
+    else if (addr < 0x3F00)
+    {
+        Cart_nt_write(ppu->cart, addr, byte);
+    }
+    else
+    {
+        ppu->palette[palette_index(addr)] = byte & 0x3F;
+    }
+}
+
+/*
+    Scrolling (v = yyy NN YYYYY XXXXX)
+*/
+
+static void increment_x(PPU *ppu)
+{
+    if ((ppu->v & 0x001F) == 31)
+    {
+        ppu->v &= ~0x001F;
+        ppu->v ^= 0x0400;
+    }
+    else
+    {
+        ++ppu->v;
+    }
+}
+
+static void increment_y(PPU *ppu)
+{
+    if ((ppu->v & 0x7000) != 0x7000)
+    {
+        ppu->v += 0x1000;
+        return;
+    }
+    ppu->v &= ~0x7000;
+
+    int y = (ppu->v & 0x03E0) >> 5;
+    if (y == 29)
+    {
+        y = 0;
+        ppu->v ^= 0x0800;
+    }
+    else if (y == 31)
+    {
+        y = 0;
+    }
+    else
+    {
+        ++y;
+    }
+    ppu->v = (ppu->v & ~0x03E0) | (y << 5);
+}
+
+/*
+    Rendering
+*/
+
+// Give the opaque pixels of a row a palette (8 pixels at once, colours are 0-3)
+static inline void add_palette(unsigned char *row, int palette)
+{
+    uint64_t pixels;
+    memcpy(&pixels, row, 8);
+    uint64_t opaque = (pixels | (pixels >> 1)) & 0x0101010101010101;
+    pixels |= opaque * palette;
+    memcpy(row, &pixels, 8);
+}
+
+// Fetch the background tile at v
+static void fetch_tile(PPU *ppu)
+{
+    int v = ppu->v;
+    int tile = Cart_nt_read(ppu->cart, 0x2000 | (v & 0x0FFF));
+    int attribute = Cart_nt_read(ppu->cart, 0x23C0 | (v & 0x0C00) | ((v >> 4) & 0x38) | ((v >> 2) & 0x07));
+    int palette = ((attribute >> (((v >> 4) & 4) | (v & 2))) & 3) << 2;
+
+    int addr = ((ppu->ctrl & CTRL_BG_TABLE) << 8) | (tile << 4) | ((v >> 12) & 7);
+    memcpy(ppu->tile, Cart_chr_row(ppu->cart, addr, 0), 8);
+    add_palette(ppu->tile, palette);
+    ppu->tile_valid = 1;
+}
+
+// Sort the sprites into the scanlines they cover
+static void bucket_sprites(PPU *ppu)
+{
+    int height = ppu->ctrl & CTRL_SPRITE_16 ? 16 : 8;
+
+    memset(ppu->line_count, 0, sizeof(ppu->line_count));
+    memset(ppu->line_overflow, 0, sizeof(ppu->line_overflow));
+
+    // sprites are drawn one line below their Y
+    for (int i = 0; i < 64; ++i)
+    {
+        int top = ppu->oam[i * 4] + 1;
+        for (int line = top; line < top + height && line < PPU_HEIGHT; ++line)
+        {
+            if (ppu->line_count[line] < 8)
+            {
+                ppu->line_sprites[line][ppu->line_count[line]++] = i;
+            }
+            else
+            {
+                ppu->line_overflow[line] = 1;
+            }
+        }
+    }
+    ppu->sprites_dirty = 0;
+}
+
+// Draw the current scanline's sprites into the sprite row
+static void draw_sprites(PPU *ppu)
+{
+    int line = ppu->scanline;
+    int height = ppu->ctrl & CTRL_SPRITE_16 ? 16 : 8;
+
+    // with rendering off the PPU doesn't evaluate sprites at all
+    int evaluating = rendering(ppu);
+    if (evaluating && ppu->sprites_dirty)
+    {
+        bucket_sprites(ppu);
+    }
+    if (evaluating && ppu->line_overflow[line])
+    {
+        ppu->status |= STATUS_OVERFLOW;
+    }
+
+    int count = evaluating ? ppu->line_count[line] : 0;
+    const unsigned char *found = ppu->line_sprites[line];
+    ppu->sprite0_left = ppu->sprite0_right = 0;
+    if (!drawing(ppu))
+    {
+        // nothing is drawn, only sprite 0 matters for its hit
+        count = count && found[0] == 0;
+    }
+    if (ppu->sprites_drawn)
+    {
+        memset(ppu->sprites, 0, sizeof(ppu->sprites));
+    }
+    ppu->sprites_drawn = count > 0;
+
+    // lower OAM entries have priority, so draw them last
+    while (count--)
+    {
+        const unsigned char *sprite = &ppu->oam[found[count] * 4];
+        int attributes = sprite[2];
+        int row = line - 1 - sprite[0];
+        if (attributes & 0x80)
+        {
+            row = height - 1 - row;
+        }
+
+        int addr;
+        if (height == 16)
+        {
+            addr = ((sprite[1] & 1) << 12) | ((sprite[1] & 0xFE) << 4);
+            if (row >= 8)
+            {
+                addr += 16;
+                row -= 8;
+            }
+        }
+        else
+        {
+            addr = ((ppu->ctrl & CTRL_SPRITE_TABLE) << 9) | (sprite[1] << 4);
+        }
+        unsigned char pixels[8];
+        memcpy(pixels, Cart_chr_row(ppu->cart, addr + row, attributes & 0x40 ? 1 : 0), 8);
+
+        int flags = 0x10 | ((attributes & 3) << 2);
+        if (attributes & 0x20)
+        {
+            flags |= SPRITE_BEHIND;
+        }
+        if (found[count] == 0)
+        {
+            flags |= SPRITE_ZERO;
+            ppu->sprite0_left = sprite[3];
+            ppu->sprite0_right = sprite[3] + 8;
+        }
+        add_palette(pixels, flags);
+
+        for (int i = 0; i < 8 && sprite[3] + i < PPU_WIDTH; ++i)
+        {
+            if (pixels[i])
+            {
+                ppu->sprites[sprite[3] + i] = pixels[i];
+            }
+        }
+    }
+}
+
+// Render pixels of the current scanline up to (not including) x = to
+static void render(PPU *ppu, int to)
+{
+    unsigned short *out = ppu->frame + ppu->scanline * PPU_WIDTH;
+    int show_bg = ppu->mask & MASK_BG;
+    int show_sprites = ppu->mask & MASK_SPRITES;
+    int bg_left = show_bg && (ppu->mask & MASK_BG_LEFT);
+    int sprites_left = show_sprites && (ppu->mask & MASK_SPRITES_LEFT);
+    int grey = ppu->mask & MASK_GREYSCALE ? 0x30 : 0x3F;
+    int emphasis = (ppu->mask & MASK_EMPHASIS) << 1;
+
+    if (!rendering(ppu) && !drawing(ppu))
+    {
+        ppu->line_x = to;
+        return;
+    }
+    if (!rendering(ppu))
+    {
+        unsigned short backdrop = (ppu->palette[0] & grey) | emphasis;
+        for (int x = ppu->line_x; x < to; ++x)
+        {
+            out[x] = backdrop;
+        }
+        ppu->line_x = to;
+        return;
+    }
+
+    // a tile at a time
+    for (int x = ppu->line_x; x < to;)
+    {
+        if (!ppu->tile_valid)
+        {
+            fetch_tile(ppu);
+        }
+        const unsigned char *tile = ppu->tile + ppu->bg_offset;
+        int n = 8 - ppu->bg_offset;
+        if (n > to - x)
+        {
+            n = to - x;
+        }
+        ppu->bg_offset += n;
+        if (ppu->bg_offset == 8)
+        {
+            ppu->bg_offset = 0;
+            ppu->tile_valid = 0;
+            increment_x(ppu);
+        }
+
+        if (!drawing(ppu) && (ppu->sprite0_dot >= 0 || x + n <= ppu->sprite0_left || x >= ppu->sprite0_right))
+        {
+            // drawn by whoever reads the log (if anyone), and no sprite 0 hit here
+            x += n;
+            continue;
+        }
+        for (int end = x + n; x < end; ++x, ++tile)
+        {
+            int bg = (x >= 8 ? show_bg : bg_left) ? *tile : 0;
+            int sprite = (x >= 8 ? show_sprites : sprites_left) ? ppu->sprites[x] : 0;
+            int color = bg;
+            if (sprite)
+            {
+                if (!bg || !(sprite & SPRITE_BEHIND))
+                {
+                    color = sprite & 0x1F;
+                }
+                if (bg && (sprite & SPRITE_ZERO) && x != 255 && ppu->sprite0_dot < 0)
+                {
+                    // the hit sets the flag at its own dot, which the scanline renderer
+                    // has not reached yet
+                    ppu->sprite0_dot = x + 1;
+                    if (ppu->mode == PPU_DOT)
+                    {
+                        ppu->status |= STATUS_SPRITE0;
+                    }
+                }
+            }
+            out[x] = (ppu->palette[color] & grey) | emphasis;
+        }
+    }
+    ppu->line_x = to;
+}
+
+/*
+    Log
+*/
+
+static void log_entry(PPU *ppu, long long time, int kind, int addr, int data)
+{
+    PPULogEntry entry = {time, kind, addr, data};
+    ppu->log(ppu->log_arg, &entry);
+}
+
+// Log the banks that changed since the PPU last ran. The PPU catches up before
+// every mapper write, so they changed at ppu->now.
+static void log_banks(PPU *ppu)
+{
+    Cart *cart = ppu->cart;
+    for (int i = 0; i < CART_CHR_WINDOWS; ++i)
+    {
+        if (cart->chr_map[i] != ppu->logged_chr[i])
+        {
+            ppu->logged_chr[i] = cart->chr_map[i];
+            log_entry(ppu, ppu->now, PPU_LOG_CHR, i, cart->chr_map[i] ? (int) (cart->chr_map[i] - cart->chr) : -1);
+        }
+    }
+    for (int i = 0; i < 4; ++i)
+    {
+        if (cart->nt_map[i] != ppu->logged_nt[i])
+        {
+            ppu->logged_nt[i] = cart->nt_map[i];
+            unsigned char *p = cart->nt_map[i];
+            int offset = p >= cart->ciram && p < cart->ciram + 0x800 ? (int) (p - cart->ciram) : (int) (p - cart->vram) + 0x800;
+            log_entry(ppu, ppu->now, PPU_LOG_NT, i, offset);
+        }
+    }
+}
+
+/*
+    Timing
+*/
+
+static void begin_line(PPU *ppu)
+{
+    if (ppu->scanline >= VISIBLE_LINES)
+    {
+        return;
+    }
+    ppu->line_x = 0;
+    ppu->bg_offset = ppu->x;
+    ppu->tile_valid = 0;
+    ppu->sprite0_dot = -1;
+    draw_sprites(ppu);
+
+    if (ppu->mode == PPU_SCANLINE)
+    {
+        render(ppu, PPU_WIDTH);
+    }
+}
+
+// Next dot of the current scanline (at or after ppu->dot) with something to do
+static int next_dot(PPU *ppu)
+{
+    static const int dots[] = {0, 1, DOT_Y_INCREMENT, DOT_COPY_X, DOT_MAPPER_CLOCK, DOT_COPY_Y};
+    int dot = ppu->dot;
+    int next = line_length(ppu, ppu->scanline);
+
+    for (size_t i = 0; i < sizeof(dots) / sizeof(dots[0]); ++i)
+    {
+        if (dots[i] >= dot)
+        {
+            next = dots[i];
+            break;
+        }
+    }
+    if (ppu->mode == PPU_SCANLINE && ppu->sprite0_dot >= dot && ppu->sprite0_dot < next)
+    {
+        next = ppu->sprite0_dot;
+    }
+    return next;
+}
+
+// Do everything that happens at ppu->dot
+static void step(PPU *ppu)
+{
+    int line = ppu->scanline;
+    int dot = ppu->dot;
+    int render_line = line < VISIBLE_LINES || line == PRERENDER_LINE;
+
+    if (dot == line_length(ppu, line))
+    {
+        ppu->line_start += dot;
+        ppu->dot = 0;
+        if (++ppu->scanline == PPU_LINES)
+        {
+            ppu->scanline = 0;
+            ppu->odd ^= 1;
+            ppu->frame_start = ppu->line_start;
+        }
+        return;
+    }
+
+    if (dot == 0)
+    {
+        begin_line(ppu);
+    }
+    if (dot == 1 && line == VBLANK_LINE)
+    {
+        ppu->status |= STATUS_VBLANK;
+        ++ppu->frames;
+        if (ppu->video)
+        {
+            ppu->frame = Video_publish(ppu->video);
+        }
+        if (ppu->log)
+        {
+            log_entry(ppu, ppu->now + 1, PPU_LOG_FRAME, 0, 0);
+        }
+        if (!ppu->replica)
+        {
+            Cart_frame(ppu->cart);
+            if (ppu->ctrl & CTRL_NMI)
+            {
+                Bus_nmi(ppu->bus);
+            }
+        }
+    }
+    if (dot == 1 && line == PRERENDER_LINE)
+    {
+        ppu->status &= ~(STATUS_VBLANK | STATUS_SPRITE0 | STATUS_OVERFLOW);
+    }
+    if (dot == ppu->sprite0_dot && line < VISIBLE_LINES)
+    {
+        ppu->status |= STATUS_SPRITE0;
+    }
+    if (render_line && rendering(ppu))
+    {
+        if (dot == DOT_Y_INCREMENT)
+        {
+            if (line < VISIBLE_LINES && ppu->line_x < PPU_WIDTH)
+            {
+                render(ppu, PPU_WIDTH);
+            }
+            increment_y(ppu);
+        }
+        if (dot == DOT_COPY_X)
+        {
+            ppu->v = (ppu->v & ~0x041F) | (ppu->t & 0x041F);
+            ppu->tile_valid = 0;
+        }
+        if (dot == DOT_MAPPER_CLOCK && !ppu->replica)
+        {
+            Cart_scanline(ppu->cart);
+        }
+        if (dot == DOT_COPY_Y && line == PRERENDER_LINE)
+        {
+            ppu->v = (ppu->v & ~0x7BE0) | (ppu->t & 0x7BE0);
+        }
+    }
+    else if (dot == DOT_Y_INCREMENT && line < VISIBLE_LINES && ppu->line_x < PPU_WIDTH)
+    {
+        render(ppu, PPU_WIDTH);
+    }
+    ppu->dot = dot + 1;
+}
+
+// Run every dot before target
+static void run(PPU *ppu, long long target)
+{
+    while (ppu->now < target)
+    {
+        int dot = next_dot(ppu);
+        long long time = ppu->line_start + dot;
+        if (time >= target)
+        {
+            ppu->dot = target - ppu->line_start;
+            ppu->now = target;
+            if (ppu->mode == PPU_DOT && ppu->scanline < VISIBLE_LINES && ppu->line_x < ppu->dot && ppu->dot <= PPU_WIDTH)
+            {
+                render(ppu, ppu->dot);
+            }
+            return;
+        }
+        ppu->dot = dot;
+        ppu->now = time;
+        step(ppu);
+    }
+}
+
+// Find the next event the CPU can observe without touching a register: vblank, or
+// the mapper's IRQ
+static void schedule(PPU *ppu)
+{
+    int clocks = rendering(ppu) && ppu->cart->mapper->scanlines_to_irq
+                     ? ppu->cart->mapper->scanlines_to_irq(ppu->cart)
+                     : -1;
+    long long start = ppu->line_start;
+    int line = ppu->scanline;
+    int dot = ppu->dot;
+    long long when;
+
+    // vblank is never more than a frame away
+    for (;;)
+    {
+        if (line == VBLANK_LINE && dot <= 1)
+        {
+            when = start + 1;
+            break;
+        }
+        if (clocks > 0 && (line < VISIBLE_LINES || line == PRERENDER_LINE) && dot <= DOT_MAPPER_CLOCK && --clocks == 0)
+        {
+            when = start + DOT_MAPPER_CLOCK;
+            break;
+        }
+        start += line_length(ppu, line);
+        line = (line + 1) % PPU_LINES;
+        dot = 0;
+    }
+    ppu->next_event = when / 3 + 1;
+}
+
+void PPU_sync(PPU *ppu)
+{
+    if (ppu->log)
+    {
+        log_banks(ppu);
+    }
+    run(ppu, (long long) ppu->bus->cycle * 3);
+}
+
+// Catch up before a mapper switches banks, and look again for its next IRQ
+static void PPU_cart_sync(void *arg)
+{
+    PPU *ppu = arg;
+    PPU_sync(ppu);
+    ppu->next_event = ppu->bus->cycle;
+}
+
+/*
+    Registers
+*/
+
+static int read_register(PPU *ppu, int reg)
+{
+    int data = ppu->latch;
+
+    switch (reg)
+    {
+    case 2:
+        data = (ppu->status & 0xE0) | (ppu->latch & 0x1F);
+        ppu->status &= ~STATUS_VBLANK;
+        ppu->w = 0;
+        break;
+
+    case 4:
+        data = ppu->oam[ppu->oam_addr];
+        break;
+
+    case 7:
+    {
+        int addr = ppu->v & 0x3FFF;
+        if (addr >= 0x3F00)
+        {
+            // palette reads are immediate, the buffer gets the nametable underneath
+            data = vram_read(ppu, addr) | (ppu->latch & 0xC0);
+            ppu->read_buffer = vram_read(ppu, addr & 0x2FFF);
+        }
+        else
+        {
+            data = ppu->read_buffer;
+            ppu->read_buffer = vram_read(ppu, addr);
+        }
+        ppu->v = (ppu->v + (ppu->ctrl & CTRL_INCREMENT ? 32 : 1)) & 0x7FFF;
+        ppu->tile_valid = 0;
+        break;
+    }
+
+    default:
+        break;
+    }
+    ppu->latch = data;
+    return data;
+}
+
+static void write_register(PPU *ppu, int reg, int data)
+{
+    ppu->latch = data;
+
+    switch (reg)
+    {
+    case 0:
+        // enabling NMI during vblank raises it straight away
+        if (!(ppu->ctrl & CTRL_NMI) && (data & CTRL_NMI) && (ppu->status & STATUS_VBLANK) && !ppu->replica)
+        {
+            Bus_nmi(ppu->bus);
+        }
+        if ((ppu->ctrl ^ data) & CTRL_SPRITE_16)
+        {
+            ppu->sprites_dirty = 1;
+        }
+        ppu->ctrl = data;
+        ppu->t = (ppu->t & ~0x0C00) | ((data & 3) << 10);
+        break;
+
+    case 1:
+        ppu->mask = data;
+        break;
+
+    case 3:
+        ppu->oam_addr = data;
+        break;
+
+    case 4:
+        ppu->oam[ppu->oam_addr] = data;
+        ppu->oam_addr = (ppu->oam_addr + 1) & 0xFF;
+        ppu->sprites_dirty = 1;
+        break;
+
+    case 5:
+        if (!ppu->w)
+        {
+            ppu->t = (ppu->t & ~0x001F) | (data >> 3);
+            ppu->x = data & 7;
+        }
+        else
+        {
+            ppu->t = (ppu->t & ~0x73E0) | ((data & 7) << 12) | ((data & 0xF8) << 2);
+        }
+        ppu->w ^= 1;
+        break;
+
+    case 6:
+        if (!ppu->w)
+        {
+            ppu->t = (ppu->t & 0x00FF) | ((data & 0x3F) << 8);
+        }
+        else
+        {
+            ppu->t = (ppu->t & 0xFF00) | data;
+            ppu->v = ppu->t;
+            ppu->tile_valid = 0;
+        }
+        ppu->w ^= 1;
+        break;
+
+    case 7:
+        vram_write(ppu, ppu->v, data);
+        ppu->v = (ppu->v + (ppu->ctrl & CTRL_INCREMENT ? 32 : 1)) & 0x7FFF;
+        ppu->tile_valid = 0;
+        break;
+
+    default:
+        break;
+    }
+}
+
+// Copy a page of CPU memory to OAM, halting the CPU for 513 cycles, or 514 to
+// line up with a read cycle when started on an odd one
+static void dma(PPU *ppu, int page)
+{
+    Bus *bus = ppu->bus;
+    unsigned char *memory = bus->read_map[page]; // a bus page is a DMA page
+    int start = ppu->oam_addr & 0xFF;
+    if (memory)
+    {
+        // RAM or ROM: one copy, in two parts if OAMADDR isn't 0
+        memcpy(ppu->oam + start, memory, 256 - start);
+        memcpy(ppu->oam, memory + 256 - start, start);
+    }
+    else
+    {
+        // registers see every read
+        for (int i = 0; i < 256; ++i)
+        {
+            ppu->oam[(start + i) & 0xFF] = Bus_read(bus, (page << 8) | i);
+        }
+    }
+    ppu->sprites_dirty = 1;
+    bus->stall += 513 + (bus->cycle & 1);
+}
+
+static void reset(PPU *ppu)
+{
+    ppu->ctrl = 0;
+    ppu->mask = 0;
+    ppu->w = 0;
+    ppu->read_buffer = 0;
+    ppu->odd = 0;
+}
+
+void PPU_message(PPU *ppu, Bus *bus)
+{
+    int addr;
+
+    switch (bus->message)
+    {
+    case BUS_TICK:
+        if (bus->cycle >= ppu->next_event)
+        {
+            PPU_sync(ppu);
+            schedule(ppu);
+        }
+        break;
+
+    case BUS_READ:
+        addr = bus->addr;
+        if (addr >= 0x2000 && addr <= 0x3FFF)
+        {
+            PPU_sync(ppu);
+            bus->data = read_register(ppu, addr & 7);
+            if (ppu->log && ((addr & 7) == 2 || (addr & 7) == 7))
+            {
+                log_entry(ppu, ppu->now, PPU_LOG_READ, addr & 7, 0);
+            }
+        }
+        break;
+
+    case BUS_WRITE:
+        addr = bus->addr;
+        if (addr >= 0x2000 && addr <= 0x3FFF)
+        {
+            int data = bus->data;
+            PPU_sync(ppu);
+            write_register(ppu, addr & 7, data);
+            if (ppu->log)
+            {
+                log_entry(ppu, ppu->now, PPU_LOG_WRITE, addr & 7, data);
+            }
+            if ((addr & 7) <= 1)
+            {
+                // NMI and rendering enable change what happens next
+                schedule(ppu);
+            }
+        }
+        else if (addr == 0x4014)
+        {
+            int data = bus->data;
+            PPU_sync(ppu);
+            dma(ppu, data);
+            for (int i = 0; ppu->log && i < 256; i += 4)
+            {
+                log_entry(ppu, ppu->now, PPU_LOG_OAM, i, ppu->oam[i] | ppu->oam[i + 1] << 8 | ppu->oam[i + 2] << 16 | (unsigned) ppu->oam[i + 3] << 24);
+            }
+        }
+        break;
+
+    case BUS_RESET:
+        if (ppu->log)
+        {
+            log_banks(ppu);
+            log_entry(ppu, ppu->now, PPU_LOG_RESET, 0, 0);
+        }
+        reset(ppu);
+        schedule(ppu);
+        break;
+
+    default:
+        break;
+    }
+}
+
+void PPU_attach_video(PPU *ppu, Video *video)
+{
+    ppu->video = video;
+    ppu->frame = video ? video->frames[video->back] : ppu->framebuffer;
+}
+
+void PPU_init(PPU *ppu, Bus *bus, Cart *cart, PPUMode mode)
+{
+    memset(ppu, 0, sizeof(*ppu));
+    ppu->bus = bus;
+    ppu->cart = cart;
+    ppu->mode = mode;
+    ppu->frame = ppu->framebuffer;
+    ppu->sprite0_dot = -1;
+    ppu->sprites_dirty = 1;
+    ppu->now = ppu->line_start = ppu->frame_start = (long long) bus->cycle * 3;
+
+    Cart_attach_ciram(cart, ppu->ciram);
+    cart->sync = PPU_cart_sync;
+    cart->sync_arg = ppu;
+
+    ppu->device.message = (BusDeviceMessage) &PPU_message;
+    schedule(ppu);
+}
+
+void PPU_set_log(PPU *ppu, void (*log)(void *arg, const PPULogEntry *entry), void *arg)
+{
+    PPU_sync(ppu);
+    ppu->log = log;
+    ppu->log_arg = arg;
+    memcpy(ppu->logged_chr, ppu->cart->chr_map, sizeof(ppu->logged_chr));
+    memcpy(ppu->logged_nt, ppu->cart->nt_map, sizeof(ppu->logged_nt));
+}
+
+void PPU_replay(PPU *ppu, const PPULogEntry *entry)
+{
+    Cart *cart = ppu->cart;
+    run(ppu, entry->time);
+
+    switch (entry->kind)
+    {
+    case PPU_LOG_WRITE:
+        write_register(ppu, entry->addr, entry->data);
+        break;
+
+    case PPU_LOG_READ:
+        read_register(ppu, entry->addr);
+        break;
+
+    case PPU_LOG_OAM:
+        for (int i = 0; i < 4; ++i)
+        {
+            ppu->oam[(entry->addr + i) & 0xFF] = (unsigned) entry->data >> (i * 8);
+        }
+        ppu->sprites_dirty = 1;
+        break;
+
+    case PPU_LOG_CHR:
+        cart->chr_map[entry->addr] = entry->data < 0 ? 0 : cart->chr + entry->data;
+        break;
+
+    case PPU_LOG_NT:
+        cart->nt_map[entry->addr] = entry->data < 0x800 ? cart->ciram + entry->data : cart->vram + entry->data - 0x800;
+        break;
+
+    case PPU_LOG_RESET:
+        reset(ppu);
+        break;
+
+    default:
+        break;
+    }
+}
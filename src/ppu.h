@@ -0,0 +1,122 @@
+#pragma once
+
+#include "bus.h"
+#include "cart.h"
+
+typedef struct Video Video;
+
+#define PPU_WIDTH 256
+#define PPU_HEIGHT 240
+#define PPU_DOTS 341  // per scanline
+#define PPU_LINES 262 // per frame
+
+typedef enum PPUMode
+{
+    // Render a whole scanline when it starts. Register writes take effect from the
+    // next scanline.
+    PPU_SCANLINE,
+
+    // Render up to the current dot before every register access, for mid-scanline
+    // raster effects.
+    PPU_DOT,
+} PPUMode;
+
+// A change the CPU made to what the PPU draws, at a dot since power on. A pipeline
+// replays these on another PPU that does the drawing (see pipeline.h).
+typedef enum PPULogKind
+{
+    PPU_LOG_WRITE, // register addr written with data
+    PPU_LOG_READ,  // register addr read (the $2002 and $2007 reads change state)
+    PPU_LOG_OAM,   // 4 bytes of OAM from addr, packed little endian in data (DMA)
+    PPU_LOG_CHR,   // CHR window addr points at data in the cart's CHR, or nowhere if -1
+    PPU_LOG_NT,    // nametable window addr points at data in CIRAM, or 0x800 on in VRAM
+    PPU_LOG_RESET, // reset
+    PPU_LOG_FRAME, // a frame is finished before time
+} PPULogKind;
+
+typedef struct PPULogEntry
+{
+    long long time;
+    int kind;
+    int addr;
+    int data;
+} PPULogEntry;
+
+// The PPU doesn't run every cycle. It catches up to the CPU when its registers are
+// accessed, before a mapper changes banks, and at the cycles where something the
+// CPU can see happens without an access: vblank (NMI) and mapper scanline IRQs.
+typedef struct PPU
+{
+    BusDevice device;
+    Bus *bus;
+    Cart *cart;
+    PPUMode mode;
+
+    // registers
+    int ctrl, mask, status, oam_addr;
+    int v, t, x, w; // vram address, temporary address, fine x scroll, write toggle
+    int read_buffer; // $2007 read buffer
+    int latch;       // last value written to a register (open bus)
+
+    // timing, in dots since power on
+    long long now;        // next dot to run
+    long long line_start; // dot 0 of the current scanline
+    int scanline, dot;    // position of now
+    int odd;              // odd frame (one dot shorter when rendering)
+    long long frame_start; // dot 0 of line 0 of the current frame
+    unsigned long long next_event; // CPU cycle to catch up at without an access
+    unsigned long long frames;     // frames completed
+
+    // current scanline
+    int line_x;      // pixels rendered
+    int bg_offset;   // pixel within the current background tile
+    int tile_valid;  // tile holds the background tile at v
+    int sprite0_dot; // dot of the sprite 0 hit on this line (scanline mode), or -1
+    int sprite0_left, sprite0_right; // x range of sprite 0 on this line (when not drawing)
+    unsigned char tile[8]; // background tile pixels: palette << 2 | color, 0 if transparent
+    unsigned char sprites[PPU_WIDTH]; // sprite pixels: 0x10 | palette << 2 | color, 0 if transparent
+    int sprites_drawn; // sprites holds pixels from an earlier line
+
+    // OAM indices of the sprites on each scanline (at most 8, in OAM order), rebuilt
+    // only when OAM or the sprite size changes
+    unsigned char line_sprites[PPU_HEIGHT][8];
+    unsigned char line_count[PPU_HEIGHT];
+    unsigned char line_overflow[PPU_HEIGHT]; // more than 8 sprites
+    int sprites_dirty;
+
+    unsigned char oam[256];
+    unsigned char palette[32];
+    unsigned char ciram[0x800]; // nametables
+
+    // output: 6 bit colour | emphasis << 6
+    unsigned short *frame;
+    unsigned short framebuffer[PPU_WIDTH * PPU_HEIGHT];
+    Video *video; // receives every finished frame, if attached
+
+    // When log is set the PPU keeps time and status for the CPU but draws nothing,
+    // and reports every change to what is drawn to log instead
+    void (*log)(void *arg, const PPULogEntry *entry);
+    void *log_arg;
+    unsigned char *logged_chr[CART_CHR_WINDOWS], *logged_nt[4]; // banks as last logged
+    int replica; // draws from a log: raises no interrupts and leaves the mapper alone
+
+    // When skip is set the PPU keeps time and status for the CPU just the same but
+    // leaves the frame alone, for frames nobody will look at
+    int skip;
+} PPU;
+
+// Connects the PPU's nametable RAM and catch up to the cart
+void PPU_init(PPU *ppu, Bus *bus, Cart *cart, PPUMode mode);
+
+// Render into video's buffers and publish each frame at vblank, instead of
+// rendering into ppu->framebuffer
+void PPU_attach_video(PPU *ppu, Video *video);
+
+// Run up to the bus's current cycle
+void PPU_sync(PPU *ppu);
+
+// Start or stop reporting changes to log (0 to stop)
+void PPU_set_log(PPU *ppu, void (*log)(void *arg, const PPULogEntry *entry), void *arg);
+
+// Replica: run up to an entry's time and apply it
+void PPU_replay(PPU *ppu, const PPULogEntry *entry);
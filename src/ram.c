@@ -34,7 +34,13 @@ void RAM_message(RAM *ram, Bus *bus)
 
 void RAM_init(RAM *ram, int size, int addr_min, int addr_max)
 {
-    ram->bytes = malloc(size);
+    // zeroed so runs are reproducible
+    RAM_attach(ram, calloc(1, size), size, addr_min, addr_max);
+}
+
+void RAM_attach(RAM *ram, unsigned char *bytes, int size, int addr_min, int addr_max)
+{
+    ram->bytes = bytes;
     ram->size = size;
     ram->addr_min = addr_min;
     ram->addr_max = addr_max;
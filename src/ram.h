@@ -11,3 +11,6 @@ typedef struct RAM
 } RAM;
 
 void RAM_init(RAM *ram, int size, int addr_min, int addr_max);
+
+// Like RAM_init, with memory the caller owns
+void RAM_attach(RAM *ram, unsigned char *bytes, int size, int addr_min, int addr_max);
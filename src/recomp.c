@@ -0,0 +1,951 @@
+#include "recomp.h"
+#include "6502.h"
+#include "crc32.h"
+
+#include <errno.h>
+#include <stdlib.h>
+
+// Overridden by the program a native build links in
+__attribute__((weak)) const RecompProgram *Recomp_builtin = 0;
+
+/*
+    Instructions
+*/
+
+#define MNEMONICS()                                                               \
+    M(ADC) M(AND) M(ASL) M(BCC) M(BCS) M(BEQ) M(BIT) M(BMI) M(BNE) M(BPL) M(BRK) \
+    M(BVC) M(BVS) M(CLC) M(CLD) M(CLI) M(CLV) M(CMP) M(CPX) M(CPY) M(DEC) M(DEX) \
+    M(DEY) M(EOR) M(INC) M(INX) M(INY) M(JMP) M(JSR) M(LDA) M(LDX) M(LDY) M(LSR) \
+    M(NOP) M(ORA) M(PHA) M(PHP) M(PLA) M(PLP) M(ROL) M(ROR) M(RTI) M(RTS) M(SBC) \
+    M(SEC) M(SED) M(SEI) M(STA) M(STX) M(STY) M(TAX) M(TAY) M(TSX) M(TXA) M(TXS) \
+    M(TYA)
+
+enum Mnemonic
+{
+    OP_NONE,
+#define M(NAME) OP_##NAME,
+    MNEMONICS()
+#undef M
+};
+
+static const char *names[] = {
+    "???",
+#define M(NAME) #NAME,
+    MNEMONICS()
+#undef M
+};
+
+enum Mode
+{
+    MODE_IMP,
+    MODE_ACC,
+    MODE_IMM,
+    MODE_ZPG,
+    MODE_ZPX,
+    MODE_ZPY,
+    MODE_REL,
+    MODE_ABS,
+    MODE_ABX,
+    MODE_ABY,
+    MODE_IND,
+    MODE_IDX,
+    MODE_IDY,
+};
+
+static const struct
+{
+    unsigned char mnemonic, mode, cycles;
+} opcodes[256] = {
+#define X(INSTRUCTION, ADDRESSING_MODE, OPCODE, CYCLES) \
+    [OPCODE] = {OP_##INSTRUCTION, MODE_##ADDRESSING_MODE, CYCLES},
+    INSTRUCTION_SET()
+#undef X
+};
+
+static const int lengths[] = {
+    [MODE_IMP] = 1, [MODE_ACC] = 1, [MODE_IMM] = 2, [MODE_ZPG] = 2, [MODE_ZPX] = 2,
+    [MODE_ZPY] = 2, [MODE_REL] = 2, [MODE_ABS] = 3, [MODE_ABX] = 3, [MODE_ABY] = 3,
+    [MODE_IND] = 3, [MODE_IDX] = 2, [MODE_IDY] = 2,
+};
+
+// An instruction at an address
+typedef struct Op
+{
+    int addr, next;
+    int mnemonic, mode, cycles;
+    int operand; // the byte or word after the opcode
+} Op;
+
+// Flags whose values are tracked through a block (I, D and B always are)
+#define FLAG_C 1
+#define FLAG_Z 2
+#define FLAG_V 4
+#define FLAG_N 8
+#define FLAGS 15
+
+static int reads(int mnemonic)
+{
+    switch (mnemonic)
+    {
+    case OP_ADC: case OP_SBC: case OP_ROL: case OP_ROR: case OP_BCC: case OP_BCS:
+        return FLAG_C;
+    case OP_BEQ: case OP_BNE:
+        return FLAG_Z;
+    case OP_BMI: case OP_BPL:
+        return FLAG_N;
+    case OP_BVC: case OP_BVS:
+        return FLAG_V;
+    case OP_PHP:
+        return FLAGS;
+    default:
+        return 0;
+    }
+}
+
+static int writes(int mnemonic)
+{
+    switch (mnemonic)
+    {
+    case OP_ADC: case OP_SBC: case OP_PLP: case OP_RTI:
+        return FLAGS;
+    case OP_ASL: case OP_LSR: case OP_ROL: case OP_ROR: case OP_CMP: case OP_CPX: case OP_CPY:
+        return FLAG_N | FLAG_Z | FLAG_C;
+    case OP_BIT:
+        return FLAG_N | FLAG_Z | FLAG_V;
+    case OP_AND: case OP_EOR: case OP_ORA: case OP_LDA: case OP_LDX: case OP_LDY: case OP_TAX:
+    case OP_TAY: case OP_TSX: case OP_TXA: case OP_TYA: case OP_PLA: case OP_INC: case OP_DEC:
+    case OP_INX: case OP_INY: case OP_DEX: case OP_DEY:
+        return FLAG_N | FLAG_Z;
+    case OP_CLC: case OP_SEC:
+        return FLAG_C;
+    case OP_CLV:
+        return FLAG_V;
+    default:
+        return 0;
+    }
+}
+
+// Instructions that take a cycle more when indexing crosses a page
+static int page_penalty(const Op *op)
+{
+    switch (op->mnemonic)
+    {
+    case OP_ADC: case OP_AND: case OP_CMP: case OP_EOR: case OP_LDA: case OP_LDX: case OP_LDY:
+    case OP_ORA: case OP_SBC:
+        return op->mode == MODE_ABX || op->mode == MODE_ABY || op->mode == MODE_IDY;
+    default:
+        return 0;
+    }
+}
+
+// Whether an instruction may go to the devices, and so end its block early
+static int accesses_memory(const Op *op)
+{
+    switch (op->mnemonic)
+    {
+    case OP_PHA: case OP_PHP: case OP_PLA: case OP_PLP: case OP_JSR: case OP_RTS: case OP_RTI:
+        return 1;
+    default:
+        return op->mode != MODE_IMP && op->mode != MODE_ACC && op->mode != MODE_IMM && op->mode != MODE_REL;
+    }
+}
+
+static int is_branch(int mnemonic)
+{
+    switch (mnemonic)
+    {
+    case OP_BCC: case OP_BCS: case OP_BEQ: case OP_BMI: case OP_BNE: case OP_BPL: case OP_BVC: case OP_BVS:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// Where control goes after an instruction
+static int ends_block(int mnemonic)
+{
+    switch (mnemonic)
+    {
+    case OP_JMP: case OP_JSR: case OP_RTS: case OP_RTI:
+    // the interrupt lines have to be looked at again
+    case OP_CLI: case OP_PLP:
+        return 1;
+    default:
+        return is_branch(mnemonic);
+    }
+}
+
+/*
+    Finding the code
+*/
+
+// A byte of PRG ROM at a CPU address as mapped now, or -1
+static int rom_byte(const Machine *machine, int addr)
+{
+    const unsigned char *page = machine->bus.read_map[(addr >> BUS_PAGE_SHIFT) & (BUS_PAGES - 1)];
+    if (!page)
+    {
+        return -1;
+    }
+    const unsigned char *p = page + (addr & BUS_PAGE_MASK);
+    const Cart *cart = &machine->cart;
+    return p >= cart->prg && p < cart->prg + cart->prg_size ? *p : -1;
+}
+
+// Decode the instruction at addr. Returns 0, or -1 if it isn't in ROM, isn't a
+// known opcode or runs past $FFFF.
+static int decode(const Machine *machine, int addr, Op *op)
+{
+    int opcode = rom_byte(machine, addr);
+    if (opcode < 0 || !opcodes[opcode].mnemonic)
+    {
+        return -1;
+    }
+    op->addr = addr;
+    op->mnemonic = opcodes[opcode].mnemonic;
+    op->mode = opcodes[opcode].mode;
+    op->cycles = opcodes[opcode].cycles;
+    op->next = addr + lengths[op->mode];
+    if (op->next > 0x10000)
+    {
+        return -1;
+    }
+    op->operand = 0;
+    for (int i = 1; i < lengths[op->mode]; ++i)
+    {
+        int byte = rom_byte(machine, addr + i);
+        if (byte < 0)
+        {
+            return -1;
+        }
+        op->operand |= byte << (8 * (i - 1));
+    }
+    return 0;
+}
+
+static int branch_target(const Op *op)
+{
+    return (op->next + (signed char) op->operand) & 0xFFFF;
+}
+
+// RTS goes one past the address JSR pushes, as cpu.c does
+static int return_address(const Op *op)
+{
+    return (op->next + 1) & 0xFFFF;
+}
+
+typedef struct Traversal
+{
+    unsigned char leader[0x10000]; // a block starts here
+    unsigned char seen[0x10000];   // an instruction starts here
+    int work[0x10000];
+    int count;
+} Traversal;
+
+static void mark(Traversal *t, int addr)
+{
+    // code that runs off the end of the address space is left to the CPU
+    if (addr < 0x10000 && !t->leader[addr])
+    {
+        t->leader[addr] = 1;
+        t->work[t->count++] = addr;
+    }
+}
+
+// Follow every path from the vectors, marking where blocks start
+static void traverse(Traversal *t, const Machine *machine)
+{
+    for (int vector = 0xFFFA; vector < 0x10000; vector += 2)
+    {
+        int lo = rom_byte(machine, vector), hi = rom_byte(machine, vector + 1);
+        if (lo >= 0 && hi >= 0)
+        {
+            mark(t, hi << 8 | lo);
+        }
+    }
+
+    while (t->count)
+    {
+        Op op;
+        int pc = t->work[--t->count];
+        while (pc < 0x10000 && !t->seen[pc] && decode(machine, pc, &op) == 0)
+        {
+            t->seen[pc] = 1;
+            if (is_branch(op.mnemonic))
+            {
+                mark(t, branch_target(&op));
+                mark(t, op.next);
+                break;
+            }
+            if (op.mnemonic == OP_JSR)
+            {
+                mark(t, op.operand);
+                mark(t, return_address(&op));
+                break;
+            }
+            if (op.mnemonic == OP_JMP)
+            {
+                if (op.mode == MODE_ABS)
+                {
+                    mark(t, op.operand);
+                }
+                break;
+            }
+            if (op.mnemonic == OP_RTS || op.mnemonic == OP_RTI || op.mnemonic == OP_BRK)
+            {
+                break;
+            }
+            if (op.mnemonic == OP_CLI || op.mnemonic == OP_PLP)
+            {
+                mark(t, op.next);
+                break;
+            }
+            pc = op.next;
+        }
+    }
+}
+
+/*
+    Writing the code
+*/
+
+#define BLOCK_MAX 64
+
+// The value an instruction works on
+static const char *operand(const Op *op, char *buffer)
+{
+    switch (op->mode)
+    {
+    case MODE_ACC:
+        return "a";
+    case MODE_IMM:
+        sprintf(buffer, "0x%02X", op->operand);
+        return buffer;
+    default:
+        return "RECOMP_READ(addr)";
+    }
+}
+
+static void store(FILE *out, const Op *op, const char *value)
+{
+    if (op->mode == MODE_ACC)
+    {
+        fprintf(out, "    a = %s & 0xFF;\n", value);
+    }
+    else
+    {
+        fprintf(out, "    RECOMP_WRITE(addr, %s);\n", value);
+    }
+}
+
+static void set_nz(FILE *out, int live, const char *value)
+{
+    if (live & FLAG_Z)
+    {
+        fprintf(out, "    z = %s == 0;\n", value);
+    }
+    if (live & FLAG_N)
+    {
+        fprintf(out, "    n = (%s >> 7) != 0;\n", value);
+    }
+}
+
+static void emit_address(FILE *out, const Op *op)
+{
+    int o = op->operand;
+    switch (op->mode)
+    {
+    case MODE_ZPG:
+    case MODE_ABS:
+        fprintf(out, "    addr = 0x%04X;\n", o);
+        break;
+    case MODE_ZPX:
+        fprintf(out, "    addr = (0x%02X + x) & 0xFF;\n", o);
+        break;
+    case MODE_ZPY:
+        fprintf(out, "    addr = (0x%02X + y) & 0xFF;\n", o);
+        break;
+    case MODE_ABX:
+        fprintf(out, "    addr = (0x%04X + x) & 0xFFFF;\n", o);
+        break;
+    case MODE_ABY:
+        fprintf(out, "    addr = (0x%04X + y) & 0xFFFF;\n", o);
+        break;
+    case MODE_IDX:
+        fprintf(out, "    t = (0x%02X + x) & 0xFF;\n", o);
+        fprintf(out, "    lo = RECOMP_READ(t);\n");
+        fprintf(out, "    hi = RECOMP_READ((t + 1) & 0xFF);\n");
+        fprintf(out, "    addr = hi << 8 | lo;\n");
+        break;
+    case MODE_IDY:
+        fprintf(out, "    lo = RECOMP_READ(0x%02X);\n", o);
+        fprintf(out, "    hi = RECOMP_READ(0x%02X);\n", (o + 1) & 0xFF);
+        fprintf(out, "    addr = ((hi << 8 | lo) + y) & 0xFFFF;\n");
+        break;
+    default:
+        break;
+    }
+}
+
+static void emit_cycles(FILE *out, const Op *op)
+{
+    if (!page_penalty(op))
+    {
+        fprintf(out, "    last = %d, cycle += %d;\n", op->cycles, op->cycles);
+    }
+    else if (op->mode == MODE_IDY)
+    {
+        fprintf(out, "    last = %d + (addr >> 8 != hi), cycle += last;\n", op->cycles);
+    }
+    else
+    {
+        fprintf(out, "    last = %d + (addr >> 8 != 0x%02X), cycle += last;\n", op->cycles, op->operand >> 8);
+    }
+}
+
+static void emit_branch(FILE *out, const Op *op, const char *condition)
+{
+    int target = branch_target(op);
+    int taken = op->cycles + 1 + ((op->next & 0xFF00) != (target & 0xFF00));
+    fprintf(out, "    if (%s)\n    {\n", condition);
+    fprintf(out, "        last = %d, cycle += %d;\n", taken, taken);
+    fprintf(out, "        RECOMP_LEAVE(0x%04X);\n    }\n", target);
+    fprintf(out, "    last = %d, cycle += %d;\n", op->cycles, op->cycles);
+    fprintf(out, "    RECOMP_LEAVE(0x%04X);\n", op->next & 0xFFFF);
+}
+
+static void emit_pull_status(FILE *out)
+{
+    fprintf(out, "    t = RECOMP_PULL();\n");
+    fprintf(out, "    n = t >> 7, v = (t >> 6) & 1, b = (t >> 4) & 1, d = (t >> 3) & 1;\n");
+    fprintf(out, "    i = (t >> 2) & 1, z = (t >> 1) & 1, c = t & 1;\n");
+}
+
+// One instruction, computing only the flags in live. Semantics follow cpu.c
+// exactly, including how it sets flags from results wider than a byte.
+static void emit_op(FILE *out, const Op *op, int live)
+{
+    char buffer[16];
+    const char *value = operand(op, buffer);
+
+    fprintf(out, "    // $%04X %s\n", op->addr, names[op->mnemonic]);
+    emit_address(out, op);
+
+    switch (op->mnemonic)
+    {
+    case OP_ADC:
+    case OP_SBC:
+        fprintf(out, op->mnemonic == OP_ADC ? "    t = %s;\n" : "    t = %s ^ 0xFF;\n", value);
+        fprintf(out, "    r = a + t + c;\n");
+        if (live & FLAG_C)
+        {
+            fprintf(out, "    c = r > 0xFF;\n");
+        }
+        set_nz(out, live, "r");
+        if (live & FLAG_V)
+        {
+            fprintf(out, op->mnemonic == OP_ADC ? "    v = ((~(a ^ t) & (a ^ r)) & 0x80) != 0;\n"
+                                                : "    v = (r ^ a) & (r ^ t) & 1;\n");
+        }
+        fprintf(out, "    a = r & 0xFF;\n");
+        break;
+
+    case OP_AND:
+    case OP_EOR:
+    case OP_ORA:
+        fprintf(out, "    a %s= %s;\n", op->mnemonic == OP_AND ? "&" : op->mnemonic == OP_EOR ? "^" : "|", value);
+        set_nz(out, live, "a");
+        break;
+
+    case OP_ASL:
+    case OP_LSR:
+        fprintf(out, "    t = %s;\n", value);
+        if (live & FLAG_C)
+        {
+            fprintf(out, op->mnemonic == OP_ASL ? "    c = t >> 7;\n" : "    c = t & 1;\n");
+        }
+        fprintf(out, op->mnemonic == OP_ASL ? "    t <<= 1;\n" : "    t >>= 1;\n");
+        set_nz(out, live, "t");
+        store(out, op, "t");
+        break;
+
+    case OP_ROL:
+        fprintf(out, "    t = %s << 1 | c;\n", value);
+        if (live & FLAG_C)
+        {
+            fprintf(out, "    c = t >> 8;\n");
+        }
+        fprintf(out, "    t &= 0xFF;\n");
+        set_nz(out, live, "t");
+        store(out, op, "t");
+        break;
+
+    case OP_ROR:
+        fprintf(out, "    t = %s | c << 8;\n", value);
+        if (live & FLAG_C)
+        {
+            fprintf(out, "    c = t & 1;\n");
+        }
+        fprintf(out, "    t >>= 1;\n");
+        set_nz(out, live, "t");
+        store(out, op, "t");
+        break;
+
+    case OP_BIT:
+        fprintf(out, "    t = %s;\n", value);
+        if (live & FLAG_V)
+        {
+            fprintf(out, "    v = (t >> 6) & 1;\n");
+        }
+        if (live & FLAG_N)
+        {
+            fprintf(out, "    n = t >> 7;\n");
+        }
+        if (live & FLAG_Z)
+        {
+            fprintf(out, "    z = (t & a) == 0;\n");
+        }
+        break;
+
+    case OP_CMP:
+    case OP_CPX:
+    case OP_CPY:
+    {
+        const char *reg = op->mnemonic == OP_CMP ? "a" : op->mnemonic == OP_CPX ? "x" : "y";
+        fprintf(out, "    t = %s;\n", value);
+        if (live & FLAG_C)
+        {
+            fprintf(out, "    c = %s >= t;\n", reg);
+        }
+        if (live & FLAG_Z)
+        {
+            fprintf(out, "    z = %s == t;\n", reg);
+        }
+        if (live & FLAG_N)
+        {
+            fprintf(out, "    n = ((%s - t) >> 7) & 1;\n", reg);
+        }
+        break;
+    }
+
+    case OP_INC:
+    case OP_DEC:
+        fprintf(out, "    t = (%s %c 1) & 0xFF;\n", value, op->mnemonic == OP_INC ? '+' : '-');
+        set_nz(out, live, "t");
+        store(out, op, "t");
+        break;
+
+    case OP_INX:
+    case OP_INY:
+    case OP_DEX:
+    case OP_DEY:
+    {
+        const char *reg = op->mnemonic == OP_INX || op->mnemonic == OP_DEX ? "x" : "y";
+        fprintf(out, "    %s = (%s %c 1) & 0xFF;\n", reg, reg, op->mnemonic == OP_INX || op->mnemonic == OP_INY ? '+' : '-');
+        set_nz(out, live, reg);
+        break;
+    }
+
+    case OP_LDA:
+    case OP_LDX:
+    case OP_LDY:
+    {
+        const char *reg = op->mnemonic == OP_LDA ? "a" : op->mnemonic == OP_LDX ? "x" : "y";
+        fprintf(out, "    %s = %s;\n", reg, value);
+        set_nz(out, live, reg);
+        break;
+    }
+
+    case OP_STA:
+        store(out, op, "a");
+        break;
+    case OP_STX:
+        store(out, op, "x");
+        break;
+    case OP_STY:
+        store(out, op, "y");
+        break;
+
+    case OP_TAX:
+        fprintf(out, "    x = a;\n");
+        set_nz(out, live, "x");
+        break;
+    case OP_TAY:
+        fprintf(out, "    y = a;\n");
+        set_nz(out, live, "y");
+        break;
+    case OP_TSX:
+        fprintf(out, "    x = sp;\n");
+        set_nz(out, live, "x");
+        break;
+    case OP_TXA:
+        fprintf(out, "    a = x;\n");
+        set_nz(out, live, "a");
+        break;
+    case OP_TYA:
+        fprintf(out, "    a = y;\n");
+        set_nz(out, live, "a");
+        break;
+    case OP_TXS:
+        fprintf(out, "    sp = x;\n");
+        break;
+
+    case OP_PHA:
+        fprintf(out, "    RECOMP_PUSH(a);\n");
+        break;
+    case OP_PHP:
+        fprintf(out, "    RECOMP_PUSH(n << 7 | v << 6 | 0x20 | b << 4 | d << 3 | i << 2 | z << 1 | c);\n");
+        break;
+    case OP_PLA:
+        fprintf(out, "    a = RECOMP_PULL();\n");
+        set_nz(out, live, "a");
+        break;
+    case OP_PLP:
+        emit_pull_status(out);
+        break;
+
+    case OP_CLC:
+        fprintf(out, "    c = 0;\n");
+        break;
+    case OP_CLD:
+        fprintf(out, "    d = 0;\n");
+        break;
+    case OP_CLI:
+        fprintf(out, "    i = 0;\n");
+        break;
+    case OP_CLV:
+        fprintf(out, "    v = 0;\n");
+        break;
+    case OP_SEC:
+        fprintf(out, "    c = 1;\n");
+        break;
+    case OP_SED:
+        fprintf(out, "    d = 1;\n");
+        break;
+    case OP_SEI:
+        fprintf(out, "    i = 1;\n");
+        break;
+    case OP_NOP:
+        break;
+
+    case OP_BCC: emit_branch(out, op, "!c"); return;
+    case OP_BCS: emit_branch(out, op, "c"); return;
+    case OP_BEQ: emit_branch(out, op, "z"); return;
+    case OP_BNE: emit_branch(out, op, "!z"); return;
+    case OP_BMI: emit_branch(out, op, "n"); return;
+    case OP_BPL: emit_branch(out, op, "!n"); return;
+    case OP_BVC: emit_branch(out, op, "!v"); return;
+    case OP_BVS: emit_branch(out, op, "v"); return;
+
+    case OP_JMP:
+        if (op->mode == MODE_IND)
+        {
+            // the pointer's high byte comes from the same page
+            int base = op->operand;
+            fprintf(out, "    lo = RECOMP_READ(0x%04X);\n", base);
+            fprintf(out, "    hi = RECOMP_READ(0x%04X);\n", (base & 0xFF00) | ((base + 1) & 0xFF));
+            emit_cycles(out, op);
+            fprintf(out, "    RECOMP_LEAVE(hi << 8 | lo);\n");
+            return;
+        }
+        emit_cycles(out, op);
+        fprintf(out, "    RECOMP_LEAVE(0x%04X);\n", op->operand);
+        return;
+
+    case OP_JSR:
+        fprintf(out, "    RECOMP_PUSH(0x%02X);\n", (op->next >> 8) & 0xFF);
+        fprintf(out, "    RECOMP_PUSH(0x%02X);\n", op->next & 0xFF);
+        emit_cycles(out, op);
+        fprintf(out, "    RECOMP_LEAVE(0x%04X);\n", op->operand);
+        return;
+
+    case OP_RTS:
+        fprintf(out, "    lo = RECOMP_PULL();\n");
+        fprintf(out, "    hi = RECOMP_PULL();\n");
+        emit_cycles(out, op);
+        fprintf(out, "    RECOMP_LEAVE(((hi << 8 | lo) + 1) & 0xFFFF);\n");
+        return;
+
+    case OP_RTI:
+        emit_pull_status(out);
+        fprintf(out, "    b = 0;\n");
+        fprintf(out, "    lo = RECOMP_PULL();\n");
+        fprintf(out, "    hi = RECOMP_PULL();\n");
+        emit_cycles(out, op);
+        fprintf(out, "    RECOMP_LEAVE(hi << 8 | lo);\n");
+        return;
+
+    default:
+        break;
+    }
+
+    emit_cycles(out, op);
+    if (accesses_memory(op))
+    {
+        fprintf(out, "    if (s->io)\n    {\n        RECOMP_LEAVE(0x%04X);\n    }\n", op->next & 0xFFFF);
+    }
+}
+
+// The block starting at a leader. Returns its size in bytes, or 0 if there is no
+// code there to translate.
+static int emit_block(FILE *out, const Machine *machine, const Traversal *t, int start)
+{
+    Op ops[BLOCK_MAX];
+    int count = 0;
+    int pc = start;
+    while (count < BLOCK_MAX && decode(machine, pc, &ops[count]) == 0 && ops[count].mnemonic != OP_BRK)
+    {
+        pc = ops[count++].next;
+        if (ends_block(ops[count - 1].mnemonic) || pc > 0xFFFF || t->leader[pc])
+        {
+            break;
+        }
+    }
+    if (!count)
+    {
+        return 0;
+    }
+
+    // a flag is only worked out if it is read before being set again, or the
+    // block could end first
+    int live[BLOCK_MAX];
+    int needed = FLAGS;
+    for (int k = count - 1; k >= 0; --k)
+    {
+        if (accesses_memory(&ops[k]))
+        {
+            needed = FLAGS;
+        }
+        live[k] = writes(ops[k].mnemonic) & needed;
+        needed = (needed & ~writes(ops[k].mnemonic)) | reads(ops[k].mnemonic);
+    }
+
+    // the last instruction has to start before the horizon
+    int bound = 0;
+    for (int k = 0; k < count - 1; ++k)
+    {
+        bound += ops[k].cycles + page_penalty(&ops[k]);
+    }
+
+    fprintf(out, "\n// $%04X-$%04X\n", start, pc - 1);
+    fprintf(out, "static void block_%04X(RecompState *s)\n{\n", start);
+    fprintf(out, "    RECOMP_ENTER();\n");
+    fprintf(out, "    if (cycle + %d >= s->horizon)\n    {\n        RECOMP_LEAVE(0x%04X);\n    }\n", bound, start);
+    for (int k = 0; k < count; ++k)
+    {
+        fprintf(out, "\n");
+        emit_op(out, &ops[k], live[k]);
+    }
+    if (!ends_block(ops[count - 1].mnemonic) || ops[count - 1].mnemonic == OP_CLI || ops[count - 1].mnemonic == OP_PLP)
+    {
+        fprintf(out, "    RECOMP_LEAVE(0x%04X);\n", pc & 0xFFFF);
+    }
+    fprintf(out, "}\n");
+    return pc - start;
+}
+
+int Recomp_emit(FILE *out, Machine *machine, const char *name)
+{
+    Traversal *t = calloc(1, sizeof(Traversal));
+    unsigned short *sizes = calloc(0x10000, sizeof(unsigned short));
+    if (!t || !sizes)
+    {
+        free(t);
+        free(sizes);
+        errno = ENOMEM;
+        return -1;
+    }
+    traverse(t, machine);
+
+    fprintf(out, "// %s: native code for a PRG ROM, generated by nes -R\n\n", name);
+    fprintf(out, "#include \"recomp.h\"\n");
+    int count = 0;
+    for (int addr = 0; addr < 0x10000; ++addr)
+    {
+        if (t->leader[addr] && (sizes[addr] = emit_block(out, machine, t, addr)))
+        {
+            ++count;
+        }
+    }
+
+    const Cart *cart = &machine->cart;
+    fprintf(out, "\nstatic const RecompBlock blocks[] = {\n");
+    for (int addr = 0; addr < 0x10000; ++addr)
+    {
+        if (sizes[addr])
+        {
+            const unsigned char *p = machine->bus.read_map[addr >> BUS_PAGE_SHIFT] + (addr & BUS_PAGE_MASK);
+            fprintf(out, "    {0x%04X, %d, 0x%06X, block_%04X},\n", addr, sizes[addr], (unsigned) (p - cart->prg), addr);
+        }
+    }
+    fprintf(out, "};\n\n");
+    fprintf(out, "const RecompProgram %s = {0x%08X, %d, blocks};\n", name, (unsigned) crc32(0, cart->prg, cart->prg_size), count);
+    fprintf(out, "const RecompProgram *Recomp_builtin = &%s;\n", name);
+
+    free(t);
+    free(sizes);
+    if (ferror(out))
+    {
+        errno = EIO;
+        return -1;
+    }
+    return count;
+}
+
+/*
+    Running it
+*/
+
+int Recomp_init(Recomp *recomp, const RecompProgram *program, Machine *machine)
+{
+    if (crc32(0, machine->cart.prg, machine->cart.prg_size) != program->crc)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    recomp->index = calloc(0x10000, sizeof(*recomp->index));
+    if (!recomp->index)
+    {
+        return -1;
+    }
+    for (size_t i = 0; i < program->count; ++i)
+    {
+        recomp->index[program->blocks[i].addr] = &program->blocks[i];
+    }
+    recomp->program = program;
+    recomp->native = 0;
+    recomp->interpreted = 0;
+    return 0;
+}
+
+void Recomp_free(Recomp *recomp)
+{
+    free(recomp->index);
+    recomp->index = 0;
+}
+
+// The block at pc, if the PRG it was made from is mapped there
+static const RecompBlock *lookup(const Recomp *recomp, const Machine *machine, int pc)
+{
+    const RecompBlock *block = recomp->index[pc];
+    if (!block)
+    {
+        return 0;
+    }
+    const unsigned char *code = machine->cart.prg + block->offset;
+    int end = pc + block->size - 1;
+    const unsigned char *first = machine->bus.read_map[pc >> BUS_PAGE_SHIFT];
+    const unsigned char *last = machine->bus.read_map[end >> BUS_PAGE_SHIFT];
+    if (!first || !last || first + (pc & BUS_PAGE_MASK) != code || last + (end & BUS_PAGE_MASK) != code + block->size - 1)
+    {
+        return 0;
+    }
+    return block;
+}
+
+// Only the PPU and APU act on a tick, and only from their next event
+static unsigned long long horizon(const Machine *machine)
+{
+    unsigned long long ppu = machine->ppu.next_event, apu = machine->apu.next_event;
+    return ppu < apu ? ppu : apu;
+}
+
+// Run blocks from the instruction the next tick would start, for as long as
+// nothing but the CPU has anything to do. Returns 0 if no instruction could be run.
+static int run(Recomp *recomp, Machine *machine, const RecompBlock *block, unsigned long long until)
+{
+    Bus *bus = &machine->bus;
+    CPU *cpu = &machine->cpu;
+    RecompState s = {
+        bus, cpu->pc, cpu->a, cpu->x, cpu->y, cpu->sp,
+        cpu->n, cpu->v, cpu->b, cpu->d, cpu->i, cpu->z, cpu->c,
+        bus->cycle + 1, until, 0, 0,
+    };
+    unsigned long long start = s.cycle;
+    do
+    {
+        unsigned long long before = s.cycle;
+        block->run(&s);
+        if (s.cycle == before)
+        {
+            break;
+        }
+    } while (!s.io && !bus->nmi && !(bus->irq && !s.i) && (block = lookup(recomp, machine, s.pc)));
+
+    if (s.cycle == start)
+    {
+        return 0;
+    }
+    cpu->pc = s.pc;
+    cpu->a = s.a;
+    cpu->x = s.x;
+    cpu->y = s.y;
+    cpu->sp = s.sp;
+    cpu->n = s.n;
+    cpu->v = s.v;
+    cpu->b = s.b;
+    cpu->d = s.d;
+    cpu->i = s.i;
+    cpu->z = s.z;
+    cpu->c = s.c;
+    recomp->native += s.cycle - start;
+
+    // as if the CPU had just run the last instruction on a tick
+    bus->cycle = s.cycle - s.last;
+    cpu->cycles = s.last - 1 + bus->stall;
+    bus->stall = 0;
+
+    // an access can bring a device's event forward to that very tick, which the
+    // other devices then take after the CPU
+    if (horizon(machine) <= bus->cycle)
+    {
+        for (BusDevice *device = bus->devices; device; device = device->next)
+        {
+            if (device != &cpu->device)
+            {
+                bus->message = BUS_TICK;
+                device->message(device, bus);
+            }
+        }
+    }
+    return 1;
+}
+
+void Recomp_step(Recomp *recomp, Machine *machine)
+{
+    Bus *bus = &machine->bus;
+    CPU *cpu = &machine->cpu;
+    unsigned long long until = horizon(machine);
+    if (cpu->cycles)
+    {
+        // skip the ticks that only count the instruction down
+        unsigned long long end = bus->cycle + cpu->cycles;
+        if (end < until)
+        {
+            bus->cycle = end;
+            cpu->cycles = 0;
+        }
+        else
+        {
+            Bus_tick(bus);
+        }
+        return;
+    }
+
+    const RecompBlock *block;
+    if (bus->nmi || (bus->irq && !cpu->i) || bus->stall || !(block = lookup(recomp, machine, cpu->pc)) ||
+        !run(recomp, machine, block, until))
+    {
+        ++recomp->interpreted;
+        Bus_tick(bus);
+    }
+}
+
+void Recomp_frame(Recomp *recomp, Machine *machine)
+{
+    unsigned long long frame = machine->ppu.frames;
+    while (machine->ppu.frames == frame)
+    {
+        Recomp_step(recomp, machine);
+    }
+}
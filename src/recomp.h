@@ -0,0 +1,143 @@
+#pragma once
+
+#include "bus.h"
+#include "machine.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Static recompilation of a game's PRG ROM to C.
+//
+// Recomp_emit follows the code from the vectors as the PRG is mapped at power on
+// and writes one C function per basic block, with the operands, flags and cycle
+// counts of each instruction worked out ahead of time. Compiled into a build (see
+// `make native`), Recomp_frame runs those blocks instead of the interpreter
+// whenever it can do so with exactly the same result: a block only starts when
+// it will finish before any device's next event, and it stops after any access
+// that goes to a device, after CLI or PLP, and before BRK or an unknown opcode.
+// Code in RAM, indirect jumps to code that wasn't found, and banks switched in
+// later run on the interpreter.
+
+// CPU registers in plain ints while native code runs
+typedef struct RecompState
+{
+    Bus *bus;
+    int pc, a, x, y, sp;
+    int n, v, b, d, i, z, c;
+    unsigned long long cycle;   // when the next instruction starts
+    unsigned long long horizon; // the earliest cycle a device does anything by itself
+    int last;                   // cycles the last instruction took
+    int io;                     // an access went to the devices
+} RecompState;
+
+typedef void (*RecompBlockFn)(RecompState *s);
+
+typedef struct RecompBlock
+{
+    uint16_t addr;   // CPU address of the first instruction
+    uint16_t size;   // bytes of code
+    uint32_t offset; // where addr was in the PRG ROM
+    RecompBlockFn run;
+} RecompBlock;
+
+// What Recomp_emit generates
+typedef struct RecompProgram
+{
+    uint32_t crc; // of the PRG ROM
+    size_t count;
+    const RecompBlock *blocks; // by address
+} RecompProgram;
+
+// The program compiled into this build, if any
+extern const RecompProgram *Recomp_builtin;
+
+// A program attached to a machine
+typedef struct Recomp
+{
+    const RecompProgram *program;
+    const RecompBlock **index; // block starting at each address, or 0
+
+    unsigned long long native;      // CPU cycles run natively
+    unsigned long long interpreted; // instructions and interrupts left to the CPU
+} Recomp;
+
+// Write C for the machine's game to out, as program name. Returns the number of
+// blocks, or -1 and sets errno.
+int Recomp_emit(FILE *out, Machine *machine, const char *name);
+
+// Use program for machine's game. Returns 0, or -1 and sets errno (EINVAL if the
+// program was made from another PRG ROM).
+int Recomp_init(Recomp *recomp, const RecompProgram *program, Machine *machine);
+
+void Recomp_free(Recomp *recomp);
+
+// Run machine to the end of the frame, as ticking its bus would
+void Recomp_frame(Recomp *recomp, Machine *machine);
+
+// Run a chain of blocks, skip the rest of an instruction, or tick the bus once if
+// neither can be done exactly. Machine is then where ticking its bus to the same
+// cycle would have left it.
+void Recomp_step(Recomp *recomp, Machine *machine);
+
+/*
+    For generated code
+*/
+
+// Plain memory is accessed directly; anything else goes to the devices at the
+// cycle the instruction started on. The interpreter's accesses happen inside a
+// tick, which hands each device the bus's address and data as they were before
+// it, so those are put back afterwards (an open bus read sees the same value).
+static inline int Recomp_read(RecompState *s, unsigned long long cycle, int addr)
+{
+    Bus *bus = s->bus;
+    unsigned char *page = bus->read_map[addr >> BUS_PAGE_SHIFT];
+    if (page)
+    {
+        return page[addr & BUS_PAGE_MASK];
+    }
+    int saved_addr = bus->addr, saved_data = bus->data;
+    bus->cycle = cycle;
+    s->io = 1;
+    int byte = Bus_read(bus, addr);
+    bus->addr = saved_addr;
+    bus->data = saved_data;
+    return byte;
+}
+
+static inline void Recomp_write(RecompState *s, unsigned long long cycle, int addr, int byte)
+{
+    Bus *bus = s->bus;
+    unsigned char *page = bus->write_map[addr >> BUS_PAGE_SHIFT];
+    if (page)
+    {
+        page[addr & BUS_PAGE_MASK] = byte;
+        return;
+    }
+    int saved_addr = bus->addr, saved_data = bus->data;
+    bus->cycle = cycle;
+    s->io = 1;
+    Bus_write(bus, addr, byte);
+    bus->addr = saved_addr;
+    bus->data = saved_data;
+}
+
+#define RECOMP_ENTER()                                                            \
+    int a = s->a, x = s->x, y = s->y, sp = s->sp;                                 \
+    int n = s->n, v = s->v, b = s->b, d = s->d, i = s->i, z = s->z, c = s->c;     \
+    unsigned long long cycle = s->cycle;                                          \
+    int last = s->last, addr, lo, hi, t, r;                                       \
+    (void) addr, (void) lo, (void) hi, (void) t, (void) r, (void) b, (void) d
+
+#define RECOMP_LEAVE(PC)                                                          \
+    do                                                                            \
+    {                                                                             \
+        s->a = a, s->x = x, s->y = y, s->sp = sp;                                 \
+        s->n = n, s->v = v, s->b = b, s->d = d, s->i = i, s->z = z, s->c = c;     \
+        s->cycle = cycle, s->last = last, s->pc = (PC);                           \
+        return;                                                                   \
+    } while (0)
+
+#define RECOMP_READ(ADDR) Recomp_read(s, cycle, (ADDR))
+#define RECOMP_WRITE(ADDR, BYTE) Recomp_write(s, cycle, (ADDR), (BYTE))
+#define RECOMP_PUSH(BYTE) (Recomp_write(s, cycle, 0x100 + sp, (BYTE)), sp = (sp - 1) & 0xFF)
+#define RECOMP_PULL() (sp = (sp + 1) & 0xFF, Recomp_read(s, cycle, 0x100 + sp))
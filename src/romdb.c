@@ -0,0 +1,671 @@
+#include "romdb.h"
+#include "crc32.h"
+#include "ines.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAGIC "NESROMDB"
+#define VERSION 1
+
+// File layout: header, entries, by_crc, strings
+typedef struct FileHeader
+{
+    char magic[8];
+    uint32_t version, entry_size;
+    uint64_t count, strings_size;
+} FileHeader;
+
+_Static_assert(sizeof(RomDBEntry) == 64, "index entries are one cache line");
+
+#define KEY(PRG_CRC, CHR_CRC) ((uint64_t)(PRG_CRC) << 32 | (CHR_CRC))
+
+/*
+    Index
+*/
+
+void RomDB_init(RomDB *db)
+{
+    memset(db, 0, sizeof(*db));
+}
+
+void RomDB_free(RomDB *db)
+{
+    if (db->mapped)
+    {
+        munmap(db->memory, db->memory_size);
+    }
+    else
+    {
+        free(db->memory);
+    }
+    RomDB_init(db);
+}
+
+// Point the index at a block laid out like the file
+static void set_pointers(RomDB *db, size_t count, size_t strings_size)
+{
+    db->count = count;
+    db->strings_size = strings_size;
+    db->entries = (RomDBEntry *)((char *)db->memory + sizeof(FileHeader));
+    db->by_crc = (uint32_t *)(db->entries + count);
+    db->strings = (char *)(db->by_crc + count);
+}
+
+static size_t layout_size(size_t count, size_t strings_size)
+{
+    return sizeof(FileHeader) + count * (sizeof(RomDBEntry) + sizeof(uint32_t)) + strings_size;
+}
+
+// Every index and path offset inside the file, and the last path terminated, so
+// lookups never read past the mapping
+static int consistent(const RomDB *db)
+{
+    if (db->count && (!db->strings_size || db->strings[db->strings_size - 1] != 0))
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < db->count; ++i)
+    {
+        if (db->by_crc[i] >= db->count || db->entries[i].path >= db->strings_size)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int RomDB_load(RomDB *db, const char *path)
+{
+    RomDB_init(db);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(FileHeader))
+    {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    // private and writable so corrections can be applied in memory
+    void *memory = mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+    {
+        return -1;
+    }
+
+    const FileHeader *header = memory;
+    if (memcmp(header->magic, MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != VERSION ||
+        header->entry_size != sizeof(RomDBEntry) ||
+        header->count > UINT32_MAX ||
+        header->strings_size > (size_t)st.st_size ||
+        layout_size(header->count, header->strings_size) != (size_t)st.st_size)
+    {
+        munmap(memory, st.st_size);
+        errno = EINVAL;
+        return -1;
+    }
+
+    db->memory = memory;
+    db->memory_size = st.st_size;
+    db->mapped = 1;
+    set_pointers(db, header->count, header->strings_size);
+    if (!consistent(db))
+    {
+        RomDB_free(db);
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+static int write_all(int fd, const void *data, size_t size)
+{
+    const char *p = data;
+    while (size)
+    {
+        ssize_t n = write(fd, p, size);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+int RomDB_save(const RomDB *db, const char *path)
+{
+    char tmp[PATH_MAX];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    FileHeader header = {MAGIC, VERSION, sizeof(RomDBEntry), db->count, db->strings_size};
+    if (write_all(fd, &header, sizeof(header)) < 0 ||
+        write_all(fd, db->entries, db->count * sizeof(RomDBEntry)) < 0 ||
+        write_all(fd, db->by_crc, db->count * sizeof(uint32_t)) < 0 ||
+        write_all(fd, db->strings, db->strings_size) < 0 ||
+        fsync(fd) < 0)
+    {
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+    close(fd);
+
+    // readers see either the old or the new index, never a partial one
+    if (rename(tmp, path) < 0)
+    {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+// First position in by_crc with a key not less than key
+static size_t lower_bound(const RomDB *db, uint64_t key)
+{
+    size_t lo = 0, hi = db->count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        const RomDBEntry *entry = &db->entries[db->by_crc[mid]];
+        if (KEY(entry->prg_crc, entry->chr_crc) < key)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+const RomDBEntry *RomDB_find(const RomDB *db, uint32_t prg_crc, uint32_t chr_crc)
+{
+    size_t i = lower_bound(db, KEY(prg_crc, chr_crc));
+    if (i < db->count)
+    {
+        const RomDBEntry *entry = &db->entries[db->by_crc[i]];
+        if (entry->prg_crc == prg_crc && entry->chr_crc == chr_crc)
+        {
+            return entry;
+        }
+    }
+    return 0;
+}
+
+const RomDBEntry *RomDB_find_path(const RomDB *db, const char *path)
+{
+    size_t lo = 0, hi = db->count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(RomDB_path(db, &db->entries[mid]), path);
+        if (cmp == 0)
+        {
+            return &db->entries[mid];
+        }
+        if (cmp < 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return 0;
+}
+
+int RomDB_hash(RomDBEntry *entry, const unsigned char *data, size_t size)
+{
+    INES ines;
+    if (INES_parse(&ines, data, size) < 0)
+    {
+        return -1;
+    }
+
+    memset(entry, 0, sizeof(*entry));
+    entry->prg_crc = crc32(0, data + ines.prg_offset, ines.prg_size);
+    entry->chr_crc = crc32(0, data + ines.chr_offset, ines.chr_size);
+    sha1(data + ines.prg_offset, ines.prg_size + ines.chr_size, entry->sha1); // chr follows prg
+    entry->mapper = ines.mapper;
+    entry->submapper = ines.submapper;
+    entry->mirroring = ines.four_screen ? MIRRORING_FOUR_SCREEN : ines.mirroring;
+    entry->battery = ines.battery;
+    entry->prg_ram_size = ines.prg_ram_size + ines.prg_nvram_size;
+    entry->size = size;
+    return 0;
+}
+
+const RomDBEntry *RomDB_identify(const RomDB *db, const char *path, const unsigned char *data, size_t size, int64_t mtime)
+{
+    char real[PATH_MAX];
+    if (realpath(path, real))
+    {
+        const RomDBEntry *entry = RomDB_find_path(db, real);
+        if (entry && entry->size == (int64_t)size && entry->mtime == mtime)
+        {
+            return entry;
+        }
+    }
+
+    // moved or modified, go by contents
+    RomDBEntry hashed;
+    if (RomDB_hash(&hashed, data, size) < 0)
+    {
+        return 0;
+    }
+    // several entries can have the CRCs (copies of the rom, or a collision)
+    uint64_t key = KEY(hashed.prg_crc, hashed.chr_crc);
+    for (size_t i = lower_bound(db, key); i < db->count; ++i)
+    {
+        const RomDBEntry *entry = &db->entries[db->by_crc[i]];
+        if (KEY(entry->prg_crc, entry->chr_crc) != key)
+        {
+            break;
+        }
+        if (memcmp(entry->sha1, hashed.sha1, SHA1_SIZE) == 0)
+        {
+            return entry;
+        }
+    }
+    return 0;
+}
+
+int RomDB_load_corrections(RomDB *db, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        return -1;
+    }
+
+    char line[256];
+    int corrected = 0, result = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        unsigned prg_crc, chr_crc;
+        char mapper_s[16], mirroring_s[4], battery_s[4] = "";
+        int mapper, submapper = 0, prg_ram_kb;
+
+        char *p = line + strspn(line, " \t");
+        if (*p == '#' || *p == '\n' || *p == '\0')
+        {
+            continue;
+        }
+        if (sscanf(p, "%x %x %15s %3s %d %3s", &prg_crc, &chr_crc, mapper_s, mirroring_s, &prg_ram_kb, battery_s) < 5 ||
+            sscanf(mapper_s, "%d.%d", &mapper, &submapper) < 1)
+        {
+            result = -1;
+            break;
+        }
+
+        int mirroring;
+        switch (mirroring_s[0])
+        {
+        case 'h':
+            mirroring = MIRRORING_HORIZONTAL;
+            break;
+        case 'v':
+            mirroring = MIRRORING_VERTICAL;
+            break;
+        case '4':
+            mirroring = MIRRORING_FOUR_SCREEN;
+            break;
+        default:
+            mirroring = -1;
+            break;
+        }
+        if (mirroring < 0)
+        {
+            result = -1;
+            break;
+        }
+
+        // every copy of the rom gets the correction
+        for (size_t i = lower_bound(db, KEY(prg_crc, chr_crc)); i < db->count; ++i)
+        {
+            RomDBEntry *entry = &db->entries[db->by_crc[i]];
+            if (entry->prg_crc != prg_crc || entry->chr_crc != chr_crc)
+            {
+                break;
+            }
+            entry->mapper = mapper;
+            entry->submapper = submapper;
+            entry->mirroring = mirroring;
+            entry->prg_ram_size = prg_ram_kb * 1024;
+            entry->battery = battery_s[0] == 'b';
+            entry->corrected = 1;
+            ++corrected;
+        }
+    }
+
+    fclose(file);
+    if (result < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    return corrected;
+}
+
+/*
+    Scanner
+*/
+
+typedef struct ScanFile
+{
+    char *path;
+    int64_t size, mtime;
+} ScanFile;
+
+typedef struct Scan
+{
+    ScanFile *files;
+    size_t count, capacity;
+
+    RomDBEntry *results;
+    unsigned char *valid;
+    const RomDB *previous;
+    atomic_size_t next;
+} Scan;
+
+static int is_rom(const char *name)
+{
+    size_t length = strlen(name);
+    return length > 4 && strcasecmp(name + length - 4, ".nes") == 0;
+}
+
+// Collect rom files below dir, symlinks are not followed
+static int walk(Scan *scan, const char *dir)
+{
+    DIR *d = opendir(dir);
+    if (!d)
+    {
+        return -1;
+    }
+
+    struct dirent *ent;
+    while ((ent = readdir(d)))
+    {
+        const char *name = ent->d_name;
+        if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2])))
+        {
+            continue;
+        }
+
+        size_t size = strlen(dir) + strlen(name) + 2;
+        char *path = malloc(size);
+        struct stat st;
+        if (!path)
+        {
+            closedir(d);
+            return -1;
+        }
+        snprintf(path, size, "%s/%s", dir, name);
+
+        if (lstat(path, &st) < 0)
+        {
+            free(path);
+            continue;
+        }
+        if (S_ISDIR(st.st_mode))
+        {
+            walk(scan, path);
+        }
+        else if (S_ISREG(st.st_mode) && is_rom(name))
+        {
+            if (scan->count == scan->capacity)
+            {
+                size_t capacity = scan->capacity ? scan->capacity * 2 : 1024;
+                ScanFile *files = realloc(scan->files, capacity * sizeof(ScanFile));
+                if (!files)
+                {
+                    free(path);
+                    closedir(d);
+                    return -1;
+                }
+                scan->files = files;
+                scan->capacity = capacity;
+            }
+            scan->files[scan->count++] = (ScanFile){path, st.st_size, st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec};
+            continue;
+        }
+        free(path);
+    }
+
+    closedir(d);
+    return 0;
+}
+
+static void scan_file(Scan *scan, size_t i)
+{
+    ScanFile *file = &scan->files[i];
+    RomDBEntry *entry = &scan->results[i];
+
+    // unchanged since the last scan
+    if (scan->previous)
+    {
+        const RomDBEntry *old = RomDB_find_path(scan->previous, file->path);
+        if (old && old->size == file->size && old->mtime == file->mtime)
+        {
+            *entry = *old;
+            scan->valid[i] = 1;
+            return;
+        }
+    }
+
+    if (file->size < INES_HEADER_SIZE)
+    {
+        return;
+    }
+
+    int fd = open(file->path, O_RDONLY);
+    if (fd < 0)
+    {
+        return;
+    }
+    void *data = mmap(0, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return;
+    }
+    madvise(data, file->size, MADV_SEQUENTIAL);
+
+    if (RomDB_hash(entry, data, file->size) == 0)
+    {
+        entry->mtime = file->mtime;
+        scan->valid[i] = 1;
+    }
+    munmap(data, file->size);
+}
+
+static void *scan_worker(void *arg)
+{
+    Scan *scan = arg;
+    for (;;)
+    {
+        size_t i = atomic_fetch_add(&scan->next, 1);
+        if (i >= scan->count)
+        {
+            return 0;
+        }
+        scan_file(scan, i);
+    }
+}
+
+static int compare_files(const void *a, const void *b)
+{
+    return strcmp(((const ScanFile *)a)->path, ((const ScanFile *)b)->path);
+}
+
+typedef struct CrcIndex
+{
+    uint64_t key;
+    uint32_t index;
+} CrcIndex;
+
+static int compare_crcs(const void *a, const void *b)
+{
+    uint64_t x = ((const CrcIndex *)a)->key, y = ((const CrcIndex *)b)->key;
+    return (x > y) - (x < y);
+}
+
+int RomDB_scan(RomDB *db, const char *dir, int threads, const RomDB *previous)
+{
+    RomDB_init(db);
+
+    char root[PATH_MAX];
+    if (!realpath(dir, root))
+    {
+        return -1;
+    }
+
+    Scan scan = {0};
+    scan.previous = previous;
+    int result = walk(&scan, root);
+    if (result < 0)
+    {
+        goto done;
+    }
+
+    // sorted by path so the results come out in index order
+    qsort(scan.files, scan.count, sizeof(ScanFile), compare_files);
+    scan.results = calloc(scan.count ? scan.count : 1, sizeof(RomDBEntry));
+    scan.valid = calloc(scan.count ? scan.count : 1, 1);
+    if (!scan.results || !scan.valid)
+    {
+        result = -1;
+        goto done;
+    }
+
+    if (threads < 1)
+    {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    pthread_t *workers = calloc(threads, sizeof(pthread_t));
+    int started = 0;
+    while (workers && started < threads && pthread_create(&workers[started], 0, scan_worker, &scan) == 0)
+    {
+        ++started;
+    }
+    scan_worker(&scan); // help out, and guarantee progress if no thread started
+    for (int i = 0; i < started; ++i)
+    {
+        pthread_join(workers[i], 0);
+    }
+    free(workers);
+
+    // build the index in one block
+    size_t count = 0, strings_size = 0;
+    for (size_t i = 0; i < scan.count; ++i)
+    {
+        if (scan.valid[i])
+        {
+            ++count;
+            strings_size += strlen(scan.files[i].path) + 1;
+        }
+    }
+
+    db->memory_size = layout_size(count, strings_size);
+    db->memory = calloc(1, db->memory_size);
+    CrcIndex *crcs = calloc(count ? count : 1, sizeof(CrcIndex));
+    if (!db->memory || !crcs)
+    {
+        free(crcs);
+        RomDB_free(db);
+        result = -1;
+        goto done;
+    }
+    set_pointers(db, count, strings_size);
+
+    size_t n = 0, offset = 0;
+    for (size_t i = 0; i < scan.count; ++i)
+    {
+        if (!scan.valid[i])
+        {
+            continue;
+        }
+        RomDBEntry *entry = &db->entries[n];
+        *entry = scan.results[i];
+
+        // carry corrections over to new or changed copies of a corrected rom
+        const RomDBEntry *old = previous && !entry->corrected ? RomDB_find(previous, entry->prg_crc, entry->chr_crc) : 0;
+        if (old && old->corrected && memcmp(old->sha1, entry->sha1, SHA1_SIZE) == 0)
+        {
+            entry->mapper = old->mapper;
+            entry->submapper = old->submapper;
+            entry->mirroring = old->mirroring;
+            entry->battery = old->battery;
+            entry->prg_ram_size = old->prg_ram_size;
+            entry->corrected = 1;
+        }
+
+        size_t length = strlen(scan.files[i].path) + 1;
+        memcpy(db->strings + offset, scan.files[i].path, length);
+        entry->path = offset;
+        offset += length;
+
+        crcs[n] = (CrcIndex){KEY(entry->prg_crc, entry->chr_crc), n};
+        ++n;
+    }
+
+    qsort(crcs, count, sizeof(CrcIndex), compare_crcs);
+    for (size_t i = 0; i < count; ++i)
+    {
+        db->by_crc[i] = crcs[i].index;
+    }
+    free(crcs);
+
+done:
+    for (size_t i = 0; i < scan.count; ++i)
+    {
+        free(scan.files[i].path);
+    }
+    free(scan.files);
+    free(scan.results);
+    free(scan.valid);
+    return result;
+}
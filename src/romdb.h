@@ -0,0 +1,73 @@
+#pragma once
+
+#include "sha1.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A rom as identified by its contents, with the header values it should be run with
+typedef struct RomDBEntry
+{
+    uint32_t prg_crc, chr_crc;      // CRC-32 of the PRG and CHR sections
+    unsigned char sha1[SHA1_SIZE];  // SHA-1 of PRG followed by CHR
+    int16_t mapper;
+    uint8_t submapper;
+    uint8_t mirroring;              // enum Mirroring
+    uint8_t battery;
+    uint8_t corrected;              // values come from a correction, not the header
+    uint8_t reserved[2];
+    int32_t prg_ram_size;           // bytes, including battery backed
+    int64_t mtime, size;            // of the file when it was hashed (mtime in ns)
+    uint32_t path;                  // offset into the string table
+    uint32_t reserved_2;
+} RomDBEntry;
+
+// Rom index, persisted as a single file that is mapped on load
+typedef struct RomDB
+{
+    RomDBEntry *entries; // sorted by path
+    uint32_t *by_crc;    // entry indices sorted by prg_crc, chr_crc
+    char *strings;       // nul terminated paths
+    size_t count, strings_size;
+
+    // backing memory: a mapped index file or one allocation
+    void *memory;
+    size_t memory_size;
+    int mapped;
+} RomDB;
+
+void RomDB_init(RomDB *db);
+void RomDB_free(RomDB *db);
+
+// Map an index file. Returns 0 on success or -1 and sets errno.
+int RomDB_load(RomDB *db, const char *path);
+
+// Write the index to a temporary file and rename it over path. Returns 0 or -1.
+int RomDB_save(const RomDB *db, const char *path);
+
+// Build the index of every .nes file below dir, hashing files in parallel on threads
+// threads. Files whose path, size and mtime match an entry of previous (may be 0)
+// reuse it without being read. Corrections in previous carry over. Returns 0 or -1.
+int RomDB_scan(RomDB *db, const char *dir, int threads, const RomDB *previous);
+
+// Read corrections, one per line: "PRGCRC CHRCRC MAPPER[.SUB] h|v|4 PRGRAM_KB [b]"
+// Returns the number of entries corrected or -1.
+int RomDB_load_corrections(RomDB *db, const char *path);
+
+// Hash the iNES image in data into entry, taking values from its header.
+// Returns 0 or -1 if it is not a valid image.
+int RomDB_hash(RomDBEntry *entry, const unsigned char *data, size_t size);
+
+const RomDBEntry *RomDB_find(const RomDB *db, uint32_t prg_crc, uint32_t chr_crc);
+
+// Find by canonical path (see realpath)
+const RomDBEntry *RomDB_find_path(const RomDB *db, const char *path);
+
+// Identify a mapped rom file: by path if its size and mtime are unchanged since it
+// was indexed, otherwise by hashing it. Returns 0 if it is not in the index.
+const RomDBEntry *RomDB_identify(const RomDB *db, const char *path, const unsigned char *data, size_t size, int64_t mtime);
+
+static inline const char *RomDB_path(const RomDB *db, const RomDBEntry *entry)
+{
+    return db->strings + entry->path;
+}
@@ -0,0 +1,236 @@
+#ifdef __linux__
+#define _GNU_SOURCE // sync_file_range
+#endif
+
+#include "save.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAGIC "NESSAVE"
+#define VERSION 1
+
+typedef struct SaveHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t offset; // of the RAM in the file
+    uint32_t size;   // of the RAM
+    uint32_t reserved[3];
+} SaveHeader;
+
+static int write_all(int fd, const void *data, size_t size)
+{
+    const char *p = data;
+    while (size)
+    {
+        ssize_t n = write(fd, p, size);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+// Replace the file at path with a header and ram, atomically: a crash leaves either
+// the old file or the complete new one
+static int rewrite(const char *path, const unsigned char *ram, int size)
+{
+    char tmp[PATH_MAX];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    SaveHeader header = {.magic = MAGIC, .version = VERSION, .offset = sizeof(SaveHeader), .size = size};
+    if (write_all(fd, &header, sizeof(header)) < 0 || write_all(fd, ram, size) < 0 || fsync(fd) < 0)
+    {
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+    close(fd);
+
+    if (rename(tmp, path) < 0)
+    {
+        unlink(tmp);
+        return -1;
+    }
+
+    // make the rename itself durable
+    char dir[PATH_MAX];
+    strcpy(dir, path);
+    int dir_fd = open(dirname(dir), O_RDONLY);
+    if (dir_fd >= 0)
+    {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+    return 0;
+}
+
+// Bring the file at path into the current format for size bytes of RAM
+static int prepare(const char *path, const unsigned char *initial, int size)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        if (errno != ENOENT)
+        {
+            return -1;
+        }
+        if (initial)
+        {
+            return rewrite(path, initial, size);
+        }
+        unsigned char *blank = calloc(1, size);
+        int result = blank ? rewrite(path, blank, size) : -1;
+        free(blank);
+        return result;
+    }
+
+    struct stat st;
+    SaveHeader header = {0};
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    ssize_t n = pread(fd, &header, sizeof(header), 0);
+
+    int valid = n == sizeof(header) && memcmp(header.magic, MAGIC, sizeof(header.magic)) == 0 &&
+                header.version == VERSION && (off_t)header.offset + header.size <= st.st_size;
+    if (valid && header.size == (uint32_t)size)
+    {
+        close(fd);
+        return 0;
+    }
+
+    // a raw save from another emulator, or a different RAM size: keep what fits
+    off_t offset = 0;
+    size_t old_size;
+    if (valid)
+    {
+        offset = header.offset;
+        old_size = header.size;
+    }
+    else if (st.st_size == size)
+    {
+        old_size = size;
+    }
+    else
+    {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    unsigned char *ram = calloc(1, size);
+    int result = -1;
+    if (ram && pread(fd, ram, old_size < (size_t)size ? old_size : (size_t)size, offset) >= 0)
+    {
+        result = rewrite(path, ram, size);
+    }
+    free(ram);
+    close(fd);
+    return result;
+}
+
+int Save_open(Save *save, const char *path, const unsigned char *initial, int size, int interval)
+{
+    memset(save, 0, sizeof(*save));
+    save->fd = -1;
+
+    if (prepare(path, initial, size) < 0)
+    {
+        return -1;
+    }
+
+    int fd = open(path, O_RDWR);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    SaveHeader header;
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header))
+    {
+        close(fd);
+        errno = EIO;
+        return -1;
+    }
+
+    size_t map_size = header.offset + header.size;
+    void *map = mmap(0, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        close(fd);
+        return -1;
+    }
+
+    save->fd = fd;
+    save->map = map;
+    save->map_size = map_size;
+    save->ram = save->map + header.offset;
+    save->size = size;
+    save->interval = interval;
+    return 0;
+}
+
+void Save_frame(Save *save)
+{
+    if (!save->interval || ++save->frames < save->interval)
+    {
+        return;
+    }
+    save->frames = 0;
+
+    // start write back without waiting for it
+#ifdef __linux__
+    sync_file_range(save->fd, 0, save->map_size, SYNC_FILE_RANGE_WRITE);
+#else
+    msync(save->map, save->map_size, MS_ASYNC);
+#endif
+}
+
+int Save_flush(Save *save)
+{
+    return msync(save->map, save->map_size, MS_SYNC);
+}
+
+void Save_close(Save *save)
+{
+    if (save->map)
+    {
+        munmap(save->map, save->map_size);
+    }
+    if (save->fd >= 0)
+    {
+        close(save->fd);
+    }
+    save->map = save->ram = 0;
+    save->fd = -1;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+
+// Battery backed RAM living directly in a shared mapping of a save file, so writes
+// land in the page cache without copying and nothing needs saving on exit.
+typedef struct Save
+{
+    int fd;
+    unsigned char *map; // whole file
+    size_t map_size;
+    unsigned char *ram; // the RAM inside the mapping
+    int size;
+
+    // frames between write backs (0 never, only on Save_flush)
+    int interval, frames;
+} Save;
+
+// Map size bytes of battery RAM from the save file at path, converting a headerless
+// (raw) save, or creating it from initial (zeroes if null). Returns 0 or -1 and sets errno.
+int Save_open(Save *save, const char *path, const unsigned char *initial, int size, int interval);
+
+// Call once per frame, starts write back every interval frames
+void Save_frame(Save *save);
+
+// Write the RAM to disk and wait for it
+int Save_flush(Save *save);
+
+// Unmap. Dirty pages are written back by the kernel in its own time.
+void Save_close(Save *save);
@@ -0,0 +1,245 @@
+#include "search.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_AVX2 1
+#endif
+
+// Snapshots are read 64 bytes at a time, and one byte ahead for 16-bit values
+#define PAD 64
+
+static size_t stride(const Search *search)
+{
+    return (search->size + 63) / 64 * 64 + PAD;
+}
+
+static unsigned char *snapshot(const Search *search, int which)
+{
+    return search->snapshots + which * stride(search);
+}
+
+static void take(const Search *search, const Machine *machine, unsigned char *out)
+{
+    memcpy(out, machine->ram_bytes, MACHINE_RAM_SIZE);
+    if (search->size > MACHINE_RAM_SIZE)
+    {
+        memcpy(out + MACHINE_RAM_SIZE, machine->cart.prg_ram, search->size - MACHINE_RAM_SIZE);
+    }
+}
+
+int Search_init(Search *search, const Machine *machine)
+{
+    memset(search, 0, sizeof(*search));
+    search->size = MACHINE_RAM_SIZE + (machine->cart.prg_ram ? machine->cart.prg_ram_size : 0);
+    search->words = (search->size + 63) / 64;
+    search->snapshots = calloc(2, stride(search));
+    search->candidates = malloc(search->words * sizeof(uint64_t));
+    if (!search->snapshots || !search->candidates)
+    {
+        Search_free(search);
+        return -1;
+    }
+    take(search, machine, snapshot(search, 0));
+    Search_reset(search);
+    return 0;
+}
+
+void Search_free(Search *search)
+{
+    free(search->snapshots);
+    free(search->candidates);
+    search->snapshots = 0;
+    search->candidates = 0;
+}
+
+void Search_reset(Search *search)
+{
+    memset(search->candidates, 0xFF, search->words * sizeof(uint64_t));
+    if (search->size % 64)
+    {
+        search->candidates[search->words - 1] = ~0ull >> (64 - search->size % 64);
+    }
+}
+
+static void clear(Search *search, size_t index)
+{
+    search->candidates[index / 64] &= ~(1ull << index % 64);
+}
+
+#ifdef HAVE_AVX2
+
+// All ones in the lanes where now and then satisfy op
+__attribute__((target("avx2")))
+static inline __m256i match8(__m256i now, __m256i then, SearchOp op, __m256i value)
+{
+    const __m256i ones = _mm256_set1_epi8(-1);
+    switch (op)
+    {
+    case SEARCH_EQUAL:
+        return _mm256_cmpeq_epi8(now, value);
+    case SEARCH_CHANGED:
+        return _mm256_xor_si256(_mm256_cmpeq_epi8(now, then), ones);
+    case SEARCH_UNCHANGED:
+        return _mm256_cmpeq_epi8(now, then);
+    case SEARCH_INCREASED:
+        return _mm256_xor_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(now, then), then), ones);
+    case SEARCH_DECREASED:
+        return _mm256_xor_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(now, then), then), ones);
+    default:
+        return _mm256_cmpeq_epi8(_mm256_sub_epi8(now, then), value);
+    }
+}
+
+__attribute__((target("avx2")))
+static inline __m256i match16(__m256i now, __m256i then, SearchOp op, __m256i value)
+{
+    const __m256i ones = _mm256_set1_epi8(-1);
+    switch (op)
+    {
+    case SEARCH_EQUAL:
+        return _mm256_cmpeq_epi16(now, value);
+    case SEARCH_CHANGED:
+        return _mm256_xor_si256(_mm256_cmpeq_epi16(now, then), ones);
+    case SEARCH_UNCHANGED:
+        return _mm256_cmpeq_epi16(now, then);
+    case SEARCH_INCREASED:
+        return _mm256_xor_si256(_mm256_cmpeq_epi16(_mm256_max_epu16(now, then), then), ones);
+    case SEARCH_DECREASED:
+        return _mm256_xor_si256(_mm256_cmpeq_epi16(_mm256_min_epu16(now, then), then), ones);
+    default:
+        return _mm256_cmpeq_epi16(_mm256_sub_epi16(now, then), value);
+    }
+}
+
+// A bit per byte from i for the 32 indices there. 16-bit values at even indices
+// come from loads at i and at odd ones from loads at i + 1; the low byte of each
+// even lane and the high byte of each odd lane line up with their indices.
+__attribute__((target("avx2")))
+static inline uint32_t match(const unsigned char *now, const unsigned char *then, SearchOp op, int width, __m256i value)
+{
+    __m256i a = _mm256_loadu_si256((const __m256i*) now), b = _mm256_loadu_si256((const __m256i*) then);
+    if (width == 1)
+    {
+        return _mm256_movemask_epi8(match8(a, b, op, value));
+    }
+    __m256i even = match16(a, b, op, value);
+    __m256i odd = match16(_mm256_loadu_si256((const __m256i*) (now + 1)), _mm256_loadu_si256((const __m256i*) (then + 1)), op, value);
+    return _mm256_movemask_epi8(_mm256_blendv_epi8(even, odd, _mm256_set1_epi16((short) 0xFF00)));
+}
+
+__attribute__((target("avx2")))
+static void filter_avx2(Search *search, const unsigned char *now, const unsigned char *then, SearchOp op, int width, int value)
+{
+    __m256i values = width == 1 ? _mm256_set1_epi8(value) : _mm256_set1_epi16(value);
+    for (size_t w = 0; w < search->words; ++w)
+    {
+        // most of the bitmap is soon empty
+        if (!search->candidates[w])
+        {
+            continue;
+        }
+        size_t i = w * 64;
+        uint64_t low = match(now + i, then + i, op, width, values);
+        uint64_t high = match(now + i + 32, then + i + 32, op, width, values);
+        search->candidates[w] &= low | high << 32;
+    }
+}
+
+#endif
+
+static int read_value(const unsigned char *p, size_t index, int width)
+{
+    return width == 1 ? p[index] : p[index] | p[index + 1] << 8;
+}
+
+static int matches(int now, int then, SearchOp op, int width, int value)
+{
+    int mask = width == 1 ? 0xFF : 0xFFFF;
+    switch (op)
+    {
+    case SEARCH_EQUAL:
+        return now == (value & mask);
+    case SEARCH_CHANGED:
+        return now != then;
+    case SEARCH_UNCHANGED:
+        return now == then;
+    case SEARCH_INCREASED:
+        return now > then;
+    case SEARCH_DECREASED:
+        return now < then;
+    default:
+        return ((now - then) & mask) == (value & mask);
+    }
+}
+
+size_t Search_filter(Search *search, const Machine *machine, SearchOp op, int width, int value)
+{
+    const unsigned char *then = snapshot(search, search->last);
+    unsigned char *now = snapshot(search, !search->last);
+    take(search, machine, now);
+    search->last = !search->last;
+
+#ifdef HAVE_AVX2
+    if (__builtin_cpu_supports("avx2"))
+    {
+        filter_avx2(search, now, then, op, width, value);
+    }
+    else
+#endif
+    {
+        for (size_t w = 0; w < search->words; ++w)
+        {
+            for (uint64_t bits = search->candidates[w]; bits; bits &= bits - 1)
+            {
+                size_t index = w * 64 + __builtin_ctzll(bits);
+                if (!matches(read_value(now, index, width), read_value(then, index, width), op, width, value))
+                {
+                    clear(search, index);
+                }
+            }
+        }
+    }
+
+    // a 16-bit value can't run off the end or from RAM into PRG-RAM
+    if (width == 2)
+    {
+        clear(search, search->size - 1);
+        clear(search, MACHINE_RAM_SIZE - 1);
+    }
+    return Search_count(search);
+}
+
+size_t Search_count(const Search *search)
+{
+    size_t count = 0;
+    for (size_t w = 0; w < search->words; ++w)
+    {
+        count += __builtin_popcountll(search->candidates[w]);
+    }
+    return count;
+}
+
+size_t Search_next(const Search *search, size_t index)
+{
+    for (size_t w = index / 64; w < search->words; ++w)
+    {
+        uint64_t bits = search->candidates[w];
+        if (w == index / 64)
+        {
+            bits &= ~0ull << index % 64;
+        }
+        if (bits)
+        {
+            return w * 64 + __builtin_ctzll(bits);
+        }
+    }
+    return search->size;
+}
+
+int Search_value(const Search *search, size_t index, int width)
+{
+    return read_value(snapshot(search, search->last), index, width);
+}
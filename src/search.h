@@ -0,0 +1,53 @@
+#pragma once
+
+#include "machine.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// How a candidate's value now compares, with value where it is used
+typedef enum SearchOp
+{
+    SEARCH_EQUAL,     // is value
+    SEARCH_CHANGED,   // differs from the last snapshot
+    SEARCH_UNCHANGED, // is the same as in the last snapshot
+    SEARCH_INCREASED, // is greater than in the last snapshot (unsigned)
+    SEARCH_DECREASED, // is less than in the last snapshot (unsigned)
+    SEARCH_DELTA,     // went up by value (wrapping, so negative for down)
+} SearchOp;
+
+// Iterative memory search over a machine's work RAM followed by its PRG-RAM, for
+// finding the addresses a game keeps lives, health or a score in. Index i is the
+// RAM byte at $0000 + i below MACHINE_RAM_SIZE and PRG-RAM byte
+// i - MACHINE_RAM_SIZE above. Each pass takes a snapshot, compares it with the
+// last one 32 bytes at a time and clears the bits of a candidate bitmap that
+// don't match; 16-bit values are little endian and may start at any index.
+typedef struct Search
+{
+    size_t size;              // bytes searched
+    unsigned char *snapshots; // two of size bytes (padded), the last and the new
+    int last;                 // which snapshot is the last
+    uint64_t *candidates;     // a bit per index still in the running
+    size_t words;
+} Search;
+
+// Take a first snapshot of the machine and make every index a candidate. Returns
+// 0, or -1 and sets errno.
+int Search_init(Search *search, const Machine *machine);
+
+void Search_free(Search *search);
+
+// Make every index a candidate again
+void Search_reset(Search *search);
+
+// Snapshot the machine and keep the candidates whose 8 or 16-bit (width 1 or 2)
+// values satisfy op. Returns the number left.
+size_t Search_filter(Search *search, const Machine *machine, SearchOp op, int width, int value);
+
+size_t Search_count(const Search *search);
+
+// The first candidate at or after index, or search->size if there is none
+size_t Search_next(const Search *search, size_t index);
+
+// The value at index in the last snapshot
+int Search_value(const Search *search, size_t index, int width);
@@ -0,0 +1,216 @@
+#include "sha1.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_SHA_NI 1
+#endif
+
+#define ROL(X, N) (((X) << (N)) | ((X) >> (32 - (N))))
+
+static void compress_scalar(uint32_t state[5], const unsigned char *p, size_t blocks)
+{
+    for (; blocks--; p += 64)
+    {
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i)
+        {
+            w[i] = (uint32_t)p[i * 4] << 24 | p[i * 4 + 1] << 16 | p[i * 4 + 2] << 8 | p[i * 4 + 3];
+        }
+        for (int i = 16; i < 80; ++i)
+        {
+            w[i] = ROL(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+        for (int i = 0; i < 80; ++i)
+        {
+            uint32_t f, k;
+            if (i < 20)
+            {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            }
+            else if (i < 40)
+            {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            }
+            else if (i < 60)
+            {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            }
+            else
+            {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t t = ROL(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = ROL(b, 30);
+            b = a;
+            a = t;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+    }
+}
+
+#ifdef HAVE_SHA_NI
+
+// Four rounds per group. Group G consumes message words M[G % 4] and prepares the
+// schedule for the groups ahead (msg1 three ahead, xor two ahead, msg2 one ahead).
+#define GROUP(G, E, E_NEXT, M0, M1, M2, M3)                  \
+    E = _mm_sha1nexte_epu32(E, M0);                          \
+    E_NEXT = abcd;                                           \
+    if (G >= 3 && G <= 18)                                   \
+    {                                                        \
+        M1 = _mm_sha1msg2_epu32(M1, M0);                     \
+    }                                                        \
+    abcd = _mm_sha1rnds4_epu32(abcd, E, (G) / 5);            \
+    if (G >= 1 && G <= 16)                                   \
+    {                                                        \
+        M3 = _mm_sha1msg1_epu32(M3, M0);                     \
+    }                                                        \
+    if (G >= 2 && G <= 17)                                   \
+    {                                                        \
+        M2 = _mm_xor_si128(M2, M0);                          \
+    }
+
+__attribute__((target("sha,ssse3,sse4.1")))
+static void compress_ni(uint32_t state[5], const unsigned char *p, size_t blocks)
+{
+    const __m128i shuffle = _mm_set_epi64x(0x0001020304050607, 0x08090a0b0c0d0e0f);
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1B);
+    __m128i e0 = _mm_set_epi32(state[4], 0, 0, 0), e1;
+
+    for (; blocks--; p += 64)
+    {
+        __m128i abcd_save = abcd, e0_save = e0;
+        __m128i m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 0x00)), shuffle);
+        __m128i m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 0x10)), shuffle);
+        __m128i m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 0x20)), shuffle);
+        __m128i m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 0x30)), shuffle);
+
+        // the first group adds E directly
+        e0 = _mm_add_epi32(e0, m0);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+        GROUP(1, e1, e0, m1, m2, m3, m0)
+        GROUP(2, e0, e1, m2, m3, m0, m1)
+        GROUP(3, e1, e0, m3, m0, m1, m2)
+        GROUP(4, e0, e1, m0, m1, m2, m3)
+        GROUP(5, e1, e0, m1, m2, m3, m0)
+        GROUP(6, e0, e1, m2, m3, m0, m1)
+        GROUP(7, e1, e0, m3, m0, m1, m2)
+        GROUP(8, e0, e1, m0, m1, m2, m3)
+        GROUP(9, e1, e0, m1, m2, m3, m0)
+        GROUP(10, e0, e1, m2, m3, m0, m1)
+        GROUP(11, e1, e0, m3, m0, m1, m2)
+        GROUP(12, e0, e1, m0, m1, m2, m3)
+        GROUP(13, e1, e0, m1, m2, m3, m0)
+        GROUP(14, e0, e1, m2, m3, m0, m1)
+        GROUP(15, e1, e0, m3, m0, m1, m2)
+        GROUP(16, e0, e1, m0, m1, m2, m3)
+        GROUP(17, e1, e0, m1, m2, m3, m0)
+        GROUP(18, e0, e1, m2, m3, m0, m1)
+        GROUP(19, e1, e0, m3, m0, m1, m2)
+
+        e0 = _mm_sha1nexte_epu32(e0, e0_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+
+    _mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1B));
+    state[4] = _mm_extract_epi32(e0, 3);
+}
+
+#undef GROUP
+
+#endif
+
+static void compress(uint32_t state[5], const unsigned char *p, size_t blocks)
+{
+#ifdef HAVE_SHA_NI
+    if (__builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1"))
+    {
+        compress_ni(state, p, blocks);
+        return;
+    }
+#endif
+    compress_scalar(state, p, blocks);
+}
+
+void SHA1_init(SHA1 *sha)
+{
+    sha->state[0] = 0x67452301;
+    sha->state[1] = 0xEFCDAB89;
+    sha->state[2] = 0x98BADCFE;
+    sha->state[3] = 0x10325476;
+    sha->state[4] = 0xC3D2E1F0;
+    sha->size = 0;
+}
+
+void SHA1_update(SHA1 *sha, const void *data, size_t size)
+{
+    const unsigned char *p = data;
+    size_t used = sha->size % 64;
+    sha->size += size;
+
+    if (used)
+    {
+        size_t n = 64 - used < size ? 64 - used : size;
+        memcpy(sha->block + used, p, n);
+        p += n;
+        size -= n;
+        if (used + n < 64)
+        {
+            return;
+        }
+        compress(sha->state, sha->block, 1);
+    }
+
+    // whole blocks straight from the input
+    compress(sha->state, p, size / 64);
+    p += size & ~(size_t)63;
+    memcpy(sha->block, p, size % 64);
+}
+
+void SHA1_final(SHA1 *sha, unsigned char digest[SHA1_SIZE])
+{
+    uint64_t bits = sha->size * 8;
+    unsigned char pad[72] = {0x80};
+    size_t n = 64 - (sha->size % 64);
+    if (n < 9)
+    {
+        n += 64;
+    }
+    for (int i = 0; i < 8; ++i)
+    {
+        pad[n - 1 - i] = bits >> (i * 8);
+    }
+    SHA1_update(sha, pad, n);
+
+    for (int i = 0; i < 5; ++i)
+    {
+        digest[i * 4 + 0] = sha->state[i] >> 24;
+        digest[i * 4 + 1] = sha->state[i] >> 16;
+        digest[i * 4 + 2] = sha->state[i] >> 8;
+        digest[i * 4 + 3] = sha->state[i];
+    }
+}
+
+void sha1(const void *data, size_t size, unsigned char digest[SHA1_SIZE])
+{
+    SHA1 sha;
+    SHA1_init(&sha);
+    SHA1_update(&sha, data, size);
+    SHA1_final(&sha, digest);
+}
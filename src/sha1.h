@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA1_SIZE 20
+
+typedef struct SHA1
+{
+    uint32_t state[5];
+    uint64_t size;
+    unsigned char block[64];
+} SHA1;
+
+void SHA1_init(SHA1 *sha);
+
+// Hash size more bytes. Uses the SHA extensions when the CPU supports them.
+void SHA1_update(SHA1 *sha, const void *data, size_t size);
+
+void SHA1_final(SHA1 *sha, unsigned char digest[SHA1_SIZE]);
+
+// Hash size bytes in one go
+void sha1(const void *data, size_t size, unsigned char digest[SHA1_SIZE]);
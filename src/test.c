@@ -1,9 +1,25 @@
+#include <assert.h>
+#include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "6502.h"
 #include "cpu.h"
 #include "util.h"
 
+// set by the Makefile, for generated code to find the headers and match the build
+#ifndef SRC_DIR
+#define SRC_DIR "src"
+#endif
+#ifndef NATIVE_CC
+#define NATIVE_CC "cc"
+#endif
+#ifndef NATIVE_CFLAGS
+#define NATIVE_CFLAGS ""
+#endif
+
 enum AddressingMode
 {
     ABS,
@@ -164,3 +180,38 @@ void print_cpu(CPU *cpu)
     printf("          a      x      y\n");
     printf("regs:    #%02X    #%02X    #%02X\n", cpu->a, cpu->x, cpu->y);
 }
+
+char *write_temp(const void *data, size_t size)
+{
+    static char path[32];
+    strcpy(path, "/tmp/nes_test_XXXXXX");
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    assert(write(fd, data, size) == (ssize_t)size);
+    close(fd);
+    return path;
+}
+
+char *write_nrom(const void *reset, size_t reset_size, const void *nmi, size_t nmi_size)
+{
+    static unsigned char rom[16 + 0x8000];
+    assert(reset_size <= 0x100 && nmi_size <= 0x7EFA);
+    memset(rom, 0, sizeof(rom));
+    memcpy(rom, "NES\x1A", 4);
+    rom[4] = 2;
+    memcpy(rom + 16, reset, reset_size);
+    memcpy(rom + 16 + 0x100, nmi, nmi_size);
+    memcpy(rom + 16 + 0x7FFA, (unsigned char[]) {0x00, 0x81, 0x00, 0x80, 0x00, 0x81}, 6);
+    return write_temp(rom, sizeof(rom));
+}
+
+int build_native(const char *source, const char *object)
+{
+    char command[3 * PATH_MAX];
+    int length = snprintf(command, sizeof(command), "%s -shared -fPIC -O1 %s -I%s -o %s %s", NATIVE_CC, NATIVE_CFLAGS, SRC_DIR, object, source);
+    if (length < 0 || length >= (int) sizeof(command))
+    {
+        return -1;
+    }
+    return system(command);
+}
@@ -1,8 +1,21 @@
 #pragma once
 
+#include <stddef.h>
+
 typedef struct CPU CPU;
 typedef struct Bus Bus;
 
 void print_cpu(CPU *cpu);
 void print_memory(Bus *bus, int addr, int lines);
 void disassemble(Bus *bus, int addr, int lines);
+
+// Write data to a new temporary file and return its path (reused by the next call)
+char *write_temp(const void *data, size_t size);
+
+// Write a 32KB NROM image with reset code at $8000 and the NMI (and IRQ) handler at
+// $8100, and return its path as write_temp does
+char *write_nrom(const void *reset, size_t reset_size, const void *nmi, size_t nmi_size);
+
+// Compile generated C at source into a shared object at object, with the compiler
+// and flags the tests were built with. Returns the exit status of the compiler.
+int build_native(const char *source, const char *object);
@@ -0,0 +1,156 @@
+#include "apu.h"
+#include "bus.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#define RATE 44100
+
+static Bus bus;
+static APU apu;
+static unsigned char memory[0x4000]; // $C000-$FFFF
+
+static void power_on(int sample_rate)
+{
+    Bus_init(&bus);
+    Bus_map(&bus, 0xC000, sizeof(memory), memory, 0);
+    APU_init(&apu, &bus, sample_rate);
+    Bus_connect(&bus, (BusDevice*) &apu);
+}
+
+static void run(long cycles)
+{
+    for (long i = 0; i < cycles; ++i)
+    {
+        Bus_tick(&bus);
+    }
+}
+
+// Zero crossings in samples
+static int crossings(int16_t *samples, size_t count)
+{
+    int total = 0;
+    for (size_t i = 1; i < count; ++i)
+    {
+        total += (samples[i - 1] < 0) != (samples[i] < 0);
+    }
+    return total;
+}
+
+// Register and IRQ behaviour, the same whether or not audio is made
+static void side_effects(int sample_rate)
+{
+    // the frame IRQ comes at the end of each 4-step sequence
+    power_on(sample_rate);
+    run(29829);
+    assert(!bus.irq);
+    run(1);
+    assert(bus.irq == BUS_IRQ_FRAME);
+    run(29830);
+    assert(bus.irq == BUS_IRQ_FRAME);
+    assert(Bus_read(&bus, 0x4015) & 0x40);
+    assert(!(Bus_read(&bus, 0x4015) & 0x40) && !bus.irq);
+
+    // ... unless inhibited, or in 5-step mode
+    run(29830);
+    assert(bus.irq == BUS_IRQ_FRAME);
+    Bus_write(&bus, 0x4017, 0x40);
+    assert(!bus.irq);
+    run(100000);
+    assert(!bus.irq);
+    Bus_write(&bus, 0x4017, 0x80);
+    run(100000);
+    assert(!bus.irq);
+
+    // length counters run out at half frames unless halted, and count only when
+    // enabled
+    power_on(sample_rate);
+    Bus_write(&bus, 0x4017, 0x40);
+    Bus_write(&bus, 0x4003, 0x18); // length 2
+    assert(!(Bus_read(&bus, 0x4015) & 0x01));
+    Bus_write(&bus, 0x4015, 0x0F);
+    Bus_write(&bus, 0x4003, 0x18);
+    Bus_write(&bus, 0x4008, 0x80); // halted
+    Bus_write(&bus, 0x400B, 0x18);
+    assert((Bus_read(&bus, 0x4015) & 0x0F) == 0x05);
+    run(14913 + 1);
+    assert((Bus_read(&bus, 0x4015) & 0x0F) == 0x05);
+    run(29830);
+    assert((Bus_read(&bus, 0x4015) & 0x0F) == 0x04);
+    Bus_write(&bus, 0x4015, 0x00);
+    assert((Bus_read(&bus, 0x4015) & 0x0F) == 0x00);
+
+    // the DMC fetches its sample from memory and raises an IRQ after the last byte
+    power_on(sample_rate);
+    Bus_write(&bus, 0x4017, 0x40);
+    Bus_write(&bus, 0x4010, 0x8F);  // IRQ, fastest rate (54)
+    Bus_write(&bus, 0x4012, 0x00);  // $C000
+    Bus_write(&bus, 0x4013, 0x01);  // 17 bytes
+    Bus_write(&bus, 0x4015, 0x10);
+    assert(Bus_read(&bus, 0x4015) & 0x10);
+    run(54 * 8 * 14);
+    assert(!bus.irq && (Bus_read(&bus, 0x4015) & 0x10));
+    run(54 * 8 * 3);
+    assert(bus.irq == BUS_IRQ_DMC && (Bus_read(&bus, 0x4015) & 0x90) == 0x80);
+    assert(bus.irq == BUS_IRQ_DMC);
+    Bus_write(&bus, 0x4015, 0x00);
+    assert(!(Bus_read(&bus, 0x4015) & 0x80) && !bus.irq);
+}
+
+int main()
+{
+    side_effects(0);
+    side_effects(RATE);
+
+    static int16_t samples[RATE * 2];
+
+    // a 440 Hz square wave: a second of cycles, read a frame at a time, comes out
+    // as a second of samples with two zero crossings a period
+    power_on(RATE);
+    Bus_write(&bus, 0x4017, 0x40);
+    Bus_write(&bus, 0x4015, 0x01);
+    Bus_write(&bus, 0x4000, 0xBF); // 50% duty, halted, constant volume 15
+    Bus_write(&bus, 0x4002, 253);  // 1789773 / 16 / 254 = 440.4 Hz
+    Bus_write(&bus, 0x4003, 0x00);
+    run(APU_CLOCK_RATE / 10);
+    APU_samples(&apu, samples, RATE); // let the high pass settle
+    size_t count = 0;
+    for (int frame = 0; frame < 60; ++frame)
+    {
+        run(APU_CLOCK_RATE / 60);
+        count += APU_samples(&apu, samples + count, RATE * 2 - count);
+    }
+    assert(abs((int) count - RATE) <= 1);
+    int crossed = crossings(samples, count);
+    assert(crossed >= 878 && crossed <= 884);
+    int peak = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        peak = abs(samples[i]) > peak ? abs(samples[i]) : peak;
+    }
+    assert(peak > 1000 && peak < 32767);
+
+    // silence once disabled
+    Bus_write(&bus, 0x4015, 0x00);
+    run(APU_CLOCK_RATE / 2);
+    APU_samples(&apu, samples, RATE);
+    run(APU_CLOCK_RATE / 10);
+    count = APU_samples(&apu, samples, RATE);
+    for (size_t i = 0; i < count; ++i)
+    {
+        assert(abs(samples[i]) < 100);
+    }
+
+    // samples nobody reads are dropped rather than overflowing
+    run(APU_CLOCK_RATE * 2);
+    assert(APU_samples(&apu, samples, RATE * 2) <= BLIP_SIZE / 2);
+
+    // audio off makes nothing
+    power_on(0);
+    Bus_write(&bus, 0x4015, 0x01);
+    Bus_write(&bus, 0x4003, 0x00);
+    run(APU_CLOCK_RATE / 10);
+    assert(APU_samples(&apu, samples, RATE) == 0);
+
+    return 0;
+}
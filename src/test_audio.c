@@ -0,0 +1,175 @@
+#include "apu.h"
+#include "audio.h"
+#include "bus.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#define RATE 48000
+#define COUNT 300000
+
+static Audio audio;
+
+// Push a counting sequence, waiting for room rather than dropping
+static void *produce(void *arg)
+{
+    int16_t chunk[100];
+    int sent = 0;
+    while (sent < COUNT)
+    {
+        size_t room = audio.size - Audio_fill(&audio);
+        size_t count = room < 100 ? room : 100;
+        if (!count)
+        {
+            sched_yield();
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            chunk[i] = sent + i;
+        }
+        Audio_push(&audio, chunk, count);
+        sent += count;
+    }
+    return 0;
+}
+
+// Emulate frames of a 440 Hz tone while the host plays pull samples a frame,
+// with or without rate control. Returns the underruns after the ring first fills.
+static unsigned long long play(int pull, int control, size_t *fill)
+{
+    static Bus bus;
+    static APU apu;
+    static int16_t samples[4096];
+
+    Bus_init(&bus);
+    APU_init(&apu, &bus, RATE);
+    Bus_connect(&bus, (BusDevice*) &apu);
+    Bus_write(&bus, 0x4017, 0x40);
+    Bus_write(&bus, 0x4015, 0x01);
+    Bus_write(&bus, 0x4000, 0xBF);
+    Bus_write(&bus, 0x4002, 253);
+    Bus_write(&bus, 0x4003, 0x00);
+
+    assert(Audio_init(&audio, 2048) == 0);
+    unsigned long long underruns = 0;
+    for (int frame = 0; frame < 3000; ++frame)
+    {
+        // one NES frame of 29780.5 cycles
+        for (int i = 0; i < 29780 + (frame & 1); ++i)
+        {
+            Bus_tick(&bus);
+        }
+        double ratio = Audio_push(&audio, samples, APU_samples(&apu, samples, 4096));
+        if (control)
+        {
+            APU_adjust_rate(&apu, ratio);
+        }
+
+        if (frame == 10)
+        {
+            underruns = atomic_load(&audio.underruns);
+        }
+        if (frame >= 3)
+        {
+            Audio_pull(&audio, samples, pull);
+        }
+    }
+    underruns = atomic_load(&audio.underruns) - underruns;
+    *fill = Audio_fill(&audio);
+    assert(atomic_load(&audio.dropped) == 0 || !control);
+    Audio_free(&audio);
+    return underruns;
+}
+
+int main()
+{
+    int16_t samples[300];
+
+    // a ring needs a fill level to aim for
+    errno = 0;
+    assert(Audio_init(&audio, 0) < 0 && errno == EINVAL);
+
+    // what doesn't fit is dropped, what isn't there is silence
+    assert(Audio_init(&audio, 100) == 0);
+    assert(audio.size == 256);
+    for (int i = 0; i < 300; ++i)
+    {
+        samples[i] = i + 1;
+    }
+    Audio_push(&audio, samples, 300);
+    assert(Audio_fill(&audio) == 256 && atomic_load(&audio.dropped) == 44);
+    assert(Audio_pull(&audio, samples, 200) == 200 && samples[0] == 1 && samples[199] == 200);
+    assert(atomic_load(&audio.underruns) == 0);
+    assert(Audio_pull(&audio, samples, 100) == 56 && samples[55] == 256 && samples[56] == 0 && samples[99] == 0);
+    assert(atomic_load(&audio.underruns) == 1 && atomic_load(&audio.missing) == 44);
+    Audio_free(&audio);
+
+    // the rate follows the fill level, within bounds
+    assert(Audio_init(&audio, 1000) == 0);
+    assert(Audio_push(&audio, samples, 0) == 1 + AUDIO_MAX_ADJUST);
+    Audio_push(&audio, samples, 300);
+    Audio_push(&audio, samples, 200);
+    assert(atomic_load(&audio.ratio) > 1 && atomic_load(&audio.ratio) < 1 + AUDIO_MAX_ADJUST);
+    while (Audio_fill(&audio) < 1000)
+    {
+        Audio_push(&audio, samples, 100);
+    }
+    assert(atomic_load(&audio.ratio) == 1);
+    while (Audio_fill(&audio) < 2000)
+    {
+        Audio_push(&audio, samples, 100);
+    }
+    assert(atomic_load(&audio.ratio) == 1 - AUDIO_MAX_ADJUST);
+    Audio_free(&audio);
+
+    // samples cross threads in order
+    assert(Audio_init(&audio, 1024) == 0);
+    pthread_t thread;
+    pthread_create(&thread, 0, produce, 0);
+    int received = 0;
+    while (received < COUNT)
+    {
+        size_t fill = Audio_fill(&audio);
+        size_t count = fill < 300 ? fill : 300;
+        if (!count)
+        {
+            sched_yield();
+        }
+        Audio_pull(&audio, samples, count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            assert(samples[i] == (int16_t) (received + i));
+        }
+        received += count;
+    }
+    pthread_join(thread, 0);
+    assert(atomic_load(&audio.underruns) == 0 && atomic_load(&audio.dropped) == 0);
+    Audio_free(&audio);
+
+    // a host at 60 Hz plays a little more (or less) than the NES makes a frame:
+    // without control the ring runs dry, with it the fill settles without
+    // underruns or dropped samples
+    size_t fill;
+    assert(play(801, 0, &fill) > 0);
+    assert(play(801, 1, &fill) == 0 && fill < 2048);
+    assert(play(796, 1, &fill) == 0 && fill > 2048 && fill < 4096);
+
+    // the stand-in sink takes samples on its own schedule
+    assert(Audio_init(&audio, RATE) == 0);
+    static int16_t second[RATE];
+    Audio_push(&audio, second, RATE);
+    AudioSink sink;
+    assert(AudioSink_start(&sink, &audio, RATE, 480) == 0);
+    struct timespec wait = {0, 50000000};
+    nanosleep(&wait, 0);
+    AudioSink_stop(&sink);
+    unsigned long long pulled = atomic_load(&sink.pulled);
+    assert(pulled >= 480 && pulled < RATE);
+    assert(Audio_fill(&audio) == RATE - pulled && atomic_load(&audio.underruns) == 0);
+    Audio_free(&audio);
+
+    return 0;
+}
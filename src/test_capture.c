@@ -0,0 +1,136 @@
+#include "capture.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// enough to cross several windows
+#define FRAMES 500
+#define SAMPLES (12 << 20)
+
+static Capture capture;
+static unsigned short frame[VIDEO_PIXELS];
+
+static const unsigned char *map_file(const char *path, size_t *size)
+{
+    int fd = open(path, O_RDONLY);
+    assert(fd >= 0);
+    struct stat st;
+    assert(fstat(fd, &st) == 0);
+    *size = st.st_size;
+    const unsigned char *map = mmap(0, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    assert(map != MAP_FAILED);
+    close(fd);
+    return map;
+}
+
+static void fill(int n)
+{
+    for (int i = 0; i < VIDEO_PIXELS; ++i)
+    {
+        frame[i] = (i * 7 + n * 13 + (i >> 8) * 5) % VIDEO_COLORS;
+    }
+}
+
+int main()
+{
+    char video[] = "/tmp/nes_capture_XXXXXX", audio[] = "/tmp/nes_capture_XXXXXX";
+    close(mkstemp(video));
+    close(mkstemp(audio));
+
+    // YUV420 matches a plain per-block average
+    assert(Capture_open(&capture, video, 0, 0, 0) == 0);
+    static unsigned char y[VIDEO_PIXELS], u[VIDEO_PIXELS / 4], v[VIDEO_PIXELS / 4];
+    fill(0);
+    Capture_yuv420(&capture, frame, y, u, v);
+    for (int row = 0; row < PPU_HEIGHT; ++row)
+    {
+        for (int x = 0; x < PPU_WIDTH; ++x)
+        {
+            assert(y[row * PPU_WIDTH + x] == (capture.yuv[frame[row * PPU_WIDTH + x]] & 0xFF));
+            if (row % 2 == 0 && x % 2 == 0)
+            {
+                int sums[2] = {2, 2};
+                for (int i = 0; i < 4; ++i)
+                {
+                    uint32_t yuv = capture.yuv[frame[(row + i / 2) * PPU_WIDTH + x + i % 2]];
+                    sums[0] += yuv >> 8 & 0xFF;
+                    sums[1] += yuv >> 16 & 0xFF;
+                }
+                int offset = row / 2 * (PPU_WIDTH / 2) + x / 2;
+                assert(u[offset] == sums[0] / 4 && v[offset] == sums[1] / 4);
+            }
+        }
+    }
+    // black at the bottom of studio range, white near the top
+    assert((capture.yuv[0x0F] & 0xFFFFFF) == 0x808010 && (capture.yuv[0x30] & 0xFF) >= 0xD0);
+    assert(Capture_close(&capture) == 0);
+
+    // frames and samples across window switches come back in order
+    assert(Capture_open(&capture, video, audio, 44100, 2) == 0);
+    static int16_t samples[3000];
+    int sample = 0;
+    for (int n = 0; n < FRAMES; ++n)
+    {
+        fill(n);
+        assert(Capture_frame(&capture, frame) == 0);
+        for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); ++i)
+        {
+            samples[i] = sample++;
+        }
+        assert(Capture_audio(&capture, samples, sizeof(samples) / sizeof(samples[0])) == 0);
+    }
+    // one write bigger than a chunk
+    int16_t *big = calloc(SAMPLES, sizeof(int16_t));
+    for (int i = 0; i < SAMPLES; ++i)
+    {
+        big[i] = sample++;
+    }
+    assert(Capture_audio(&capture, big, SAMPLES) == 0);
+    free(big);
+    assert(capture.frames == FRAMES);
+    assert(Capture_close(&capture) == 0);
+
+    size_t size;
+    const unsigned char *map = map_file(video, &size);
+    const char *header = (const char*) map;
+    size_t header_size = strchr(header, '\n') - header + 1;
+    assert(strncmp(header, "YUV4MPEG2 W256 H240 ", 20) == 0);
+    assert(size == header_size + (size_t) FRAMES * CAPTURE_FRAME_SIZE);
+    for (int n = 0; n < FRAMES; n += 37)
+    {
+        const unsigned char *p = map + header_size + (size_t) n * CAPTURE_FRAME_SIZE;
+        assert(memcmp(p, "FRAME\n", 6) == 0);
+        fill(n);
+        Capture_yuv420(&capture, frame, y, u, v);
+        assert(memcmp(p + 6, y, VIDEO_PIXELS) == 0);
+        assert(memcmp(p + 6 + VIDEO_PIXELS, u, VIDEO_PIXELS / 4) == 0);
+        assert(memcmp(p + 6 + VIDEO_PIXELS * 5 / 4, v, VIDEO_PIXELS / 4) == 0);
+    }
+    munmap((void*) map, size);
+
+    map = map_file(audio, &size);
+    assert(size == 44 + (size_t) sample * 2);
+    assert(memcmp(map, "RIFF", 4) == 0 && memcmp(map + 8, "WAVEfmt ", 8) == 0 && memcmp(map + 36, "data", 4) == 0);
+    uint32_t riff, data;
+    memcpy(&riff, map + 4, 4);
+    memcpy(&data, map + 40, 4);
+    assert(riff == size - 8 && data == size - 44);
+    const int16_t *pcm = (const int16_t*) (map + 44);
+    for (int i = 0; i < sample; ++i)
+    {
+        assert(pcm[i] == (int16_t) i);
+    }
+    munmap((void*) map, size);
+
+    // a path that can't be created
+    assert(Capture_open(&capture, "/nonexistent/capture.y4m", 0, 0, 0) < 0);
+
+    unlink(video);
+    unlink(audio);
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include "bus.h"
+#include "cart.h"
+#include "cpu.h"
+#include "ram.h"
+#include "test.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+int main()
+{
+    Bus bus;
+    Cart cart;
+    CPU cpu;
+    RAM ram;
+
+    // 16KB PRG + 8KB CHR NROM with a trainer
+    static unsigned char rom[16 + 512 + 0x4000 + 0x2000];
+    memcpy(rom, "NES\x1A", 4);
+    rom[4] = 1;                                       // 1x 16KB PRG
+    rom[5] = 1;                                       // 1x 8KB CHR
+    rom[6] = FLAGS_6_MIRRORING | FLAGS_6_TRAINER_PRESENT;
+
+    unsigned char *trainer = rom + 16;
+    unsigned char *prg = trainer + 512;
+    unsigned char *chr = prg + 0x4000;
+    trainer[0] = 0x42;
+    chr[0x1FFF] = 0x99;
+
+    // LDA $7000; STA $0002; NOP
+    static const unsigned char program[] = {0xAD, 0x00, 0x70, 0x8D, 0x02, 0x00, 0xEA};
+    memcpy(prg, program, sizeof(program));
+    prg[0x3FFC] = 0x00; // reset vector $8000 (seen at $FFFC through the mirror)
+    prg[0x3FFD] = 0x80;
+
+    char *path = write_temp(rom, sizeof(rom));
+
+    Bus_init(&bus);
+    CPU_init(&cpu, &bus);
+    RAM_init(&ram, 0x800, 0, 0x1FFF);
+    assert(Cart_open(&cart, &bus, path, 0) == 0);
+
+    Bus_connect(&bus, (BusDevice*) &cpu);
+    Bus_connect(&bus, (BusDevice*) &ram);
+    Bus_connect(&bus, (BusDevice*) &cart);
+
+    assert(cart.ines.mapper == 0);
+    assert(cart.ines.mirroring == MIRRORING_VERTICAL);
+    assert(!cart.chr_ram);
+
+    // prg is used in place, not copied
+    assert(cart.prg == cart.file + 16 + 512);
+    assert(Bus_read(&bus, 0x8000) == 0xAD);
+    assert(Bus_read(&bus, 0xC000) == 0xAD);
+    assert(Bus_read(&bus, 0xFFFD) == 0x80);
+
+    // rom is read only, prg ram is not
+    Bus_write(&bus, 0x8000, 0);
+    assert(Bus_read(&bus, 0x8000) == 0xAD);
+    Bus_write(&bus, 0x6000, 0x55);
+    assert(Bus_read(&bus, 0x6000) == 0x55);
+
+    // chr is visible to the ppu and not writable
+    assert(Cart_chr_read(&cart, 0x1FFF) == 0x99);
+    Cart_chr_write(&cart, 0x1FFF, 0);
+    assert(Cart_chr_read(&cart, 0x1FFF) == 0x99);
+
+    // run the program to copy the trainer byte to ram
+    Bus_message(&bus, BUS_RESET);
+    for (int i = 0; i < 20; ++i)
+    {
+        cpu.cycles = 0; // skip wait
+        Bus_message(&bus, BUS_TICK);
+    }
+    assert(Bus_read(&bus, 2) == 0x42);
+
+    Cart_close(&cart);
+    unlink(path);
+
+    // NES 2.0: mapper 258 (msb in byte 8), 32KB PRG via msb nibble, CHR RAM, battery PRG-NVRAM
+    static unsigned char rom2[16 + 0x8000];
+    memcpy(rom2, "NES\x1A", 4);
+    rom2[4] = 2;
+    rom2[5] = 0;
+    rom2[6] = FLAGS_6_RAM_BATTERY | (2 << 4);
+    rom2[7] = 0x08;
+    rom2[8] = 0x31;  // submapper 3, mapper msb 1
+    rom2[9] = 0x00;
+    rom2[10] = 0x70; // 8KB NVRAM
+    rom2[11] = 0x07; // 8KB CHR RAM
+
+    INES ines;
+    assert(INES_parse(&ines, rom2, sizeof(rom2)) == 0);
+    assert(ines.nes2);
+    assert(ines.mapper == 258);
+    assert(ines.submapper == 3);
+
+    // mapper 258 isn't supported, load it as UxROM
+    rom2[8] = 0x30;
+    path = write_temp(rom2, sizeof(rom2));
+
+    assert(Cart_open(&cart, &bus, path, 0) == 0);
+    assert(cart.ines.mapper == 2);
+    assert(cart.ines.battery);
+    assert(cart.prg_size == 0x8000);
+    assert(cart.ines.prg_nvram_size == 0x2000);
+    assert(cart.chr_ram && cart.chr_size == 0x2000);
+    Cart_chr_write(&cart, 0x0400, 0x12);
+    assert(Cart_chr_read(&cart, 0x0400) == 0x12);
+    Cart_close(&cart);
+
+    // truncated files are rejected
+    assert(truncate(path, 16 + 0x4000) == 0);
+    assert(Cart_open(&cart, &bus, path, 0) < 0);
+    unlink(path);
+
+    // bad magic is rejected
+    rom2[0] = 'X';
+    path = write_temp(rom2, sizeof(rom2));
+    assert(Cart_open(&cart, &bus, path, 0) < 0);
+    unlink(path);
+
+    return 0;
+}
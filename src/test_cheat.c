@@ -0,0 +1,129 @@
+#include "cheat.h"
+#include "machine.h"
+#include "test.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BANKS 4
+
+// Spread the bits of a cheat over Game Genie letters, the other way from decoding
+static void encode(const Cheat *cheat, int length, char *code)
+{
+    static const char letters[] = "APZLGITYEOXUKSVN";
+    int a = cheat->addr, v = cheat->value, c = cheat->compare;
+    int n[8];
+    n[0] = (v >> 4 & 8) | (v & 7);
+    n[1] = (a >> 4 & 8) | (v >> 4 & 7);
+    n[2] = a >> 4 & 7;
+    n[3] = (a & 8) | (a >> 12 & 7);
+    n[4] = (a >> 8 & 8) | (a & 7);
+    if (length == 6)
+    {
+        n[5] = (v & 8) | (a >> 8 & 7);
+    }
+    else
+    {
+        n[2] |= 8; // flags a compare on a real Game Genie, ignored here
+        n[5] = (c & 8) | (a >> 8 & 7);
+        n[6] = (c >> 4 & 8) | (c & 7);
+        n[7] = (v & 8) | (c >> 4 & 7);
+    }
+    for (int i = 0; i < length; ++i)
+    {
+        code[i] = letters[n[i]];
+    }
+    code[length] = 0;
+}
+
+int main()
+{
+    // Game Genie and raw codes
+    Cheat cheat;
+    assert(Cheat_decode("SXIOPO", &cheat) == 0 && cheat.addr == 0x91D9 && cheat.value == 0xAD && cheat.compare == -1);
+    assert(Cheat_decode("sxiopo", &cheat) == 0 && cheat.addr == 0x91D9);
+    for (int i = 0; i < 16; ++i)
+    {
+        Cheat in = {0x8000 | 1 << i % 15, 1 << i % 8, 0x80 >> i % 8}, out;
+        char code[9];
+        encode(&in, 8, code);
+        assert(Cheat_decode(code, &out) == 0 && out.addr == in.addr && out.value == in.value && out.compare == in.compare);
+        encode(&in, 6, code);
+        assert(Cheat_decode(code, &out) == 0 && out.addr == in.addr && out.value == in.value && out.compare == -1);
+    }
+    assert(Cheat_decode("C010:EA", &cheat) == 0 && cheat.addr == 0xC010 && cheat.value == 0xEA && cheat.compare == -1);
+    assert(Cheat_decode("8123?02:55", &cheat) == 0 && cheat.addr == 0x8123 && cheat.value == 0x55 && cheat.compare == 2);
+    const char *bad[] = {"", "SXIOP", "SXIOPB", "8000", "8000:", "8000:123", "8000?01:", "8000:EA!", "G000:EA"};
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i)
+    {
+        errno = 0;
+        assert(Cheat_decode(bad[i], &cheat) < 0 && errno == EINVAL);
+    }
+
+    // UxROM, each bank filled with its number
+    size_t size = 16 + BANKS * 0x4000;
+    unsigned char *rom = calloc(1, size);
+    memcpy(rom, "NES\x1A", 4);
+    rom[4] = BANKS;
+    rom[6] = 0x20;
+    for (int i = 0; i < BANKS; ++i)
+    {
+        memset(rom + 16 + i * 0x4000, i, 0x4000);
+    }
+    char *path = write_temp(rom, size);
+    free(rom);
+
+    Machine *a = Machine_create(path, 0, PPU_SCANLINE, 0);
+    Machine *b = Machine_create(path, 0, PPU_SCANLINE, 0);
+    assert(a && b);
+    Bus *bus = &a->bus;
+    unsigned char *page = bus->read_map[0x81];
+
+    static Cheats cheats;
+    Cheats_init(&cheats, &a->cart);
+    errno = 0;
+    assert(Cheats_add(&cheats, &(Cheat) {0x6000, 1, -1}) < 0 && errno == EINVAL);
+    assert(Cheats_add(&cheats, &(Cheat) {0x8123, 0x55, 2}) == 0);
+    assert(Cheats_add(&cheats, &(Cheat) {0xC010, 0xEA, -1}) == 0);
+
+    // only the pages with cheats are redirected, and a compare only matches its bank
+    assert(bus->read_map[0x81] != page && bus->read_map[0x82] == page + BUS_PAGE_SIZE);
+    assert(Bus_read(bus, 0x8123) == 0 && Bus_read(bus, 0xC010) == 0xEA && Bus_read(bus, 0xC011) == BANKS - 1);
+
+    // and they follow bank switches
+    Bus_write(bus, 0x8000, 2);
+    assert(Bus_read(bus, 0x8123) == 0x55 && Bus_read(bus, 0x8124) == 2 && Bus_read(bus, 0xC010) == 0xEA);
+    Bus_write(bus, 0x8000, 1);
+    assert(Bus_read(bus, 0x8123) == 1);
+    Bus_write(bus, 0x8000, 2);
+
+    // a copy without cheats reads the rom, and one with its own keeps them
+    Machine_copy(b, a);
+    assert(Bus_read(&b->bus, 0x8123) == 2 && Bus_read(&b->bus, 0xC010) == BANKS - 1);
+    static Cheats other;
+    Cheats_init(&other, &b->cart);
+    assert(Cheats_add(&other, &(Cheat) {0x8124, 0x66, -1}) == 0);
+    Machine_copy(b, a);
+    assert(Bus_read(&b->bus, 0x8123) == 2 && Bus_read(&b->bus, 0x8124) == 0x66);
+    Cheats_free(&other);
+    assert(Bus_read(&b->bus, 0x8124) == 2);
+
+    for (int i = 2; i < CHEATS_MAX; ++i)
+    {
+        assert(Cheats_add(&cheats, &(Cheat) {0x8000 + i * 0x100 % 0x8000, i, -1}) == 0);
+    }
+    errno = 0;
+    assert(Cheats_add(&cheats, &(Cheat) {0x8000, 1, -1}) < 0 && errno == ENOSPC);
+    assert(Bus_read(bus, 0x8000 + 5 * 0x100) == 5);
+
+    Cheats_free(&cheats);
+    assert(Bus_read(bus, 0x8123) == 2 && Bus_read(bus, 0xC010) == BANKS - 1 && bus->read_map[0x81] == a->cart.prg_map[1] + 0x100);
+
+    Machine_destroy(b);
+    Machine_destroy(a);
+    unlink(path);
+    return 0;
+}
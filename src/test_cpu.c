@@ -12,6 +12,15 @@
 
 #define CLEAR_SCREEN "\e[1;1H\e[2J"
 
+// Run one instruction (or interrupt) to its last cycle
+static void step(Bus *bus, CPU *cpu)
+{
+    do
+    {
+        Bus_tick(bus);
+    } while (cpu->cycles);
+}
+
 int main()
 {
     CPU cpu;
@@ -115,6 +124,46 @@ int main()
     int result = Bus_read(&bus, 2);
     assert(result == 0x1E);
 
+    // interrupts wait for the current instruction: NMI is taken once, IRQ for as
+    // long as it is asserted and I is clear
+    Bus_write(&bus, 0xFFFA, 0x00);
+    Bus_write(&bus, 0xFFFB, 0x90);
+    Bus_write(&bus, 0xFFFE, 0x00);
+    Bus_write(&bus, 0xFFFF, 0x91);
+    Bus_write(&bus, 0x9000, 0x40); // RTI
+    Bus_write(&bus, 0x9100, 0x40); // RTI
+    cpu.pc = 0x8019;
+    cpu.cycles = 0;
+    Bus_tick(&bus);
+    Bus_nmi(&bus);
+    Bus_tick(&bus);
+    assert(cpu.pc == 0x801A && cpu.cycles == 0);
+    step(&bus, &cpu);
+    assert(cpu.pc == 0x9000 && cpu.i && !bus.nmi);
+    step(&bus, &cpu);
+    assert(cpu.pc == 0x801A && !cpu.i);
+    step(&bus, &cpu);
+    assert(cpu.pc == 0x801B);
+
+    cpu.i = 1;
+    Bus_irq(&bus, BUS_IRQ_MAPPER, 1);
+    Bus_irq(&bus, BUS_IRQ_DMC, 1);
+    cpu.pc = 0x8019;
+    step(&bus, &cpu);
+    assert(cpu.pc == 0x801A);
+    cpu.i = 0;
+    step(&bus, &cpu);
+    assert(cpu.pc == 0x9100 && cpu.i);
+    step(&bus, &cpu);
+    assert(cpu.pc == 0x801A && !cpu.i);
+    Bus_irq(&bus, BUS_IRQ_MAPPER, 0);
+    step(&bus, &cpu);
+    assert(cpu.pc == 0x9100);
+    Bus_irq(&bus, BUS_IRQ_DMC, 0);
+    step(&bus, &cpu);
+    step(&bus, &cpu);
+    assert(cpu.pc == 0x801B);
+
 #else
     // interactive
     for (;;)
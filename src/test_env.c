@@ -0,0 +1,94 @@
+#include "env.h"
+#include "test.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// test_machine's drawing rom, with an NMI that also keeps $2002 in $12 and
+// controller 1 in $20
+static const unsigned char reset[] = {
+    0x78, 0xA9, 0x40, 0x8D, 0x17, 0x40,                         // SEI, no frame IRQ
+    0xA9, 0x3F, 0x8D, 0x06, 0x20, 0xA9, 0x00, 0x8D, 0x06, 0x20, // palette
+    0xA9, 0x0F, 0x8D, 0x07, 0x20, 0xA9, 0x30, 0x8D, 0x07, 0x20,
+    0xA9, 0x16, 0x8D, 0x07, 0x20, 0xA9, 0x27, 0x8D, 0x07, 0x20,
+    0xA9, 0x80, 0x8D, 0x00, 0x20, 0xA9, 0x1E, 0x8D, 0x01, 0x20, // NMI, rendering
+    0xE6, 0x10, 0x4C, 0x2E, 0x80,                               // INC $10; JMP
+};
+static const unsigned char nmi[] = {
+    0xE6, 0x11,                                                 // INC $11
+    0xAD, 0x02, 0x20, 0x85, 0x12,                               // $12 = status
+    0xA9, 0x20, 0x8D, 0x06, 0x20, 0xA5, 0x11, 0x8D, 0x06, 0x20, // $20xx = $10
+    0xA5, 0x10, 0x8D, 0x07, 0x20,
+    0xA9, 0x00, 0x8D, 0x06, 0x20, 0xA5, 0x11, 0x8D, 0x06, 0x20, // $00xx = $10
+    0xA5, 0x10, 0x8D, 0x07, 0x20,
+    0xA5, 0x11, 0x8D, 0x05, 0x20, 0x8D, 0x05, 0x20,             // scroll
+    0xA9, 0x01, 0x8D, 0x16, 0x40, 0xA9, 0x00, 0x8D, 0x16, 0x40, // $20 = controller
+    0xA2, 0x08, 0xAD, 0x16, 0x40, 0x4A, 0x26, 0x20, 0xCA, 0xD0, 0xF7,
+    0xA9, 0x80, 0x8D, 0x00, 0x20, 0x40,                         // RTI
+};
+
+static int same(const Machine *a, const Machine *b)
+{
+    return a->bus.cycle == b->bus.cycle && a->cpu.pc == b->cpu.pc && a->ppu.status == b->ppu.status &&
+           memcmp(a->ram_bytes, b->ram_bytes, MACHINE_RAM_SIZE) == 0 &&
+           memcmp(a->ppu.framebuffer, b->ppu.framebuffer, sizeof(a->ppu.framebuffer)) == 0;
+}
+
+int main()
+{
+    char *path = write_nrom(reset, sizeof(reset), nmi, sizeof(nmi));
+
+    Machine *a = Machine_create(path, 0, PPU_SCANLINE, 0);
+    Machine *b = Machine_create(path, 0, PPU_SCANLINE, 0);
+    assert(a && b);
+    Env env;
+    Env_init(&env, a);
+
+    // skipped frames run exactly as drawn ones, and the last is drawn in full
+    EnvView view;
+    int hits = 0;
+    for (int step = 0; step < 40; ++step)
+    {
+        int buttons = step / 3 * 29 & 0xFF, frames = 1 + step % 5;
+        Env_step(&env, buttons, frames, &view);
+        Controller_schedule(&b->controller, b->bus.cycle, 0, buttons);
+        for (int i = 0; i < frames; ++i)
+        {
+            Machine_frame(b);
+        }
+        assert(same(a, b));
+        hits += (a->ram_bytes[0x12] & 0x40) != 0;
+    }
+    assert(hits && a->ram_bytes[0x20] && !a->ppu.skip);
+
+    // the view points into the machine
+    assert(view.ram == a->ram_bytes && view.frame == a->ppu.framebuffer);
+    assert(view.prg_ram == a->cart.prg_ram && view.prg_ram_size == (size_t) a->cart.prg_ram_size);
+
+    // grayscale matches the sums done one pixel at a time
+    static unsigned char gray[VIDEO_PIXELS];
+    for (int scale = 1; scale <= ENV_SCALE_MAX; scale *= 2)
+    {
+        int width = PPU_WIDTH / scale, area = scale * scale;
+        Env_gray(&env, view.frame, scale, gray);
+        for (int y = 0; y < PPU_HEIGHT / scale; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                unsigned sum = 0;
+                for (int i = 0; i < area; ++i)
+                {
+                    sum += env.gray[view.frame[(y * scale + i / scale) * PPU_WIDTH + x * scale + i % scale] & (VIDEO_COLORS - 1)];
+                }
+                assert(gray[y * width + x] == (sum + area / 2) / area);
+            }
+        }
+    }
+
+    Machine_destroy(b);
+    Machine_destroy(a);
+    unlink(path);
+    return 0;
+}
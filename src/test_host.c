@@ -0,0 +1,119 @@
+#include "host.h"
+#include "test.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SESSIONS 4
+#define PERIOD 20000000
+
+// Reset turns on NMI and waits. Each NMI reads controller 1 into $20 and counts
+// in $11.
+static const unsigned char reset[] = {
+    0x78, 0xA9, 0x40, 0x8D, 0x17, 0x40, // SEI, no frame IRQ
+    0xA9, 0x80, 0x8D, 0x00, 0x20,       // NMI
+    0x4C, 0x0B, 0x80,                   // JMP *
+};
+static const unsigned char nmi[] = {
+    0xA9, 0x01, 0x8D, 0x16, 0x40, 0xA9, 0x00, 0x8D, 0x16, 0x40, // strobe
+    0xA2, 0x08, 0xAD, 0x16, 0x40, 0x4A, 0x26, 0x20, 0xCA, 0xD0, 0xF7,
+    0xE6, 0x11, 0x40, // INC $11; RTI
+};
+
+// Each session's frames are checked against a machine run on its own
+typedef struct Check
+{
+    HostSession *session;
+    Machine *reference;
+    int applied;
+    int slow;
+    int mismatches;
+} Check;
+
+static void frame(void *arg, HostSession *session)
+{
+    Check *check = arg;
+    Machine *machine = session->machine, *reference = check->reference;
+    if (session->applied[0] != check->applied)
+    {
+        check->applied = session->applied[0];
+        Controller_schedule(&reference->controller, reference->bus.cycle, 0, check->applied);
+    }
+    Machine_frame(reference);
+    check->mismatches += reference->bus.cycle != machine->bus.cycle || memcmp(reference->ram_bytes, machine->ram_bytes, MACHINE_RAM_SIZE) != 0 ||
+                         memcmp(reference->ppu.framebuffer, machine->ppu.framebuffer, sizeof(machine->ppu.framebuffer)) != 0;
+    if (check->slow)
+    {
+        usleep(PERIOD * 5 / 2000);
+    }
+}
+
+int main()
+{
+    char *path = write_nrom(reset, sizeof(reset), nmi, sizeof(nmi));
+
+    Host host;
+    assert(Host_start(&host, 2, PERIOD, 0) == 0);
+    errno = 0;
+    assert(!Host_open(&host, "/nonexistent.nes", 0, 0, 0, 0) && errno);
+
+    // the last session takes longer than a period over every frame
+    Check checks[SESSIONS] = {0};
+    for (int i = 0; i < SESSIONS; ++i)
+    {
+        checks[i].reference = Machine_create(path, 0, PPU_SCANLINE, 0);
+        checks[i].slow = i == SESSIONS - 1;
+        assert(checks[i].reference);
+    }
+    for (int i = 0; i < SESSIONS; ++i)
+    {
+        checks[i].session = Host_open(&host, path, 0, 0, frame, &checks[i]);
+        assert(checks[i].session);
+    }
+    for (int i = 0; i < 50; ++i)
+    {
+        Host_input(checks[0].session, 0, i * 37);
+        usleep(20000);
+    }
+
+    HostStats stats[SESSIONS];
+    for (int i = 0; i < SESSIONS; ++i)
+    {
+        Host_stats(checks[i].session, &stats[i]);
+        assert(stats[i].frames > 0 && stats[i].late <= stats[i].frames);
+        assert(stats[i].p50 <= stats[i].p90 && stats[i].p90 <= stats[i].p99 && stats[i].p99 <= stats[i].max);
+    }
+
+    // the slow session is late every frame, without holding the others back
+    HostStats *slow = &stats[SESSIONS - 1];
+    assert(slow->late == slow->frames && slow->p50 >= PERIOD);
+    for (int i = 0; i < SESSIONS - 1; ++i)
+    {
+        assert(stats[i].frames >= 2 * slow->frames && 2 * stats[i].late < stats[i].frames);
+    }
+
+    // closing waits for a frame in progress, and the rest go on
+    Host_close(checks[SESSIONS - 1].session);
+    Host_stats(checks[0].session, &stats[0]);
+    usleep(100000);
+    HostStats after;
+    Host_stats(checks[0].session, &after);
+    assert(after.frames > stats[0].frames);
+
+    // a session runs the same as a machine on its own, input included
+    for (int i = 0; i < SESSIONS - 1; ++i)
+    {
+        Host_close(checks[i].session);
+    }
+    for (int i = 0; i < SESSIONS; ++i)
+    {
+        assert(checks[i].mismatches == 0 && !checks[i].reference->ram_bytes[0x20] == (i != 0));
+        Machine_destroy(checks[i].reference);
+    }
+    Host_stop(&host);
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,181 @@
+#include "bus.h"
+#include "input.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+#define EVENTS 100000
+
+static Bus bus;
+static InputQueue queue;
+static Controller controller;
+
+// Push EVENTS events numbered in buttons, tagged with the producer in port
+static void *produce(void *arg)
+{
+    int port = (int) (intptr_t) arg;
+    for (int i = 0; i < EVENTS; ++i)
+    {
+        InputEvent event = {i, port, i};
+        while (InputQueue_push(&queue, &event) < 0)
+        {
+            sched_yield();
+        }
+    }
+    return 0;
+}
+
+static void run(unsigned long long cycle)
+{
+    while (bus.cycle < cycle)
+    {
+        Bus_tick(&bus);
+    }
+}
+
+// Strobe and read a port's 8 buttons
+static int read_buttons(int port)
+{
+    Bus_write(&bus, 0x4016, 1);
+    Bus_write(&bus, 0x4016, 0);
+    int buttons = 0;
+    for (int i = 0; i < 8; ++i)
+    {
+        buttons |= (Bus_read(&bus, 0x4016 + port) & 1) << i;
+    }
+    return buttons;
+}
+
+int main()
+{
+    // events come out in order, and a full queue refuses more
+    InputQueue_init(&queue);
+    InputEvent event = {0, 0, 0};
+    for (int i = 0; i < INPUT_QUEUE_SIZE; ++i)
+    {
+        event.buttons = i;
+        assert(InputQueue_push(&queue, &event) == 0);
+    }
+    assert(InputQueue_push(&queue, &event) < 0);
+    for (int i = 0; i < INPUT_QUEUE_SIZE; ++i)
+    {
+        assert(InputQueue_pop(&queue, &event) && event.buttons == i);
+    }
+    assert(!InputQueue_pop(&queue, &event));
+
+    // ... from several threads at once, each in its own order
+    pthread_t threads[2];
+    for (intptr_t i = 0; i < 2; ++i)
+    {
+        pthread_create(&threads[i], 0, produce, (void*) i);
+    }
+    int next[2] = {0, 0};
+    while (next[0] < EVENTS || next[1] < EVENTS)
+    {
+        if (!InputQueue_pop(&queue, &event))
+        {
+            sched_yield();
+            continue;
+        }
+        assert(event.buttons == next[event.port]);
+        ++next[event.port];
+    }
+    for (int i = 0; i < 2; ++i)
+    {
+        pthread_join(threads[i], 0);
+    }
+
+    // the serial protocol: 8 buttons, then ones; strobe held returns A
+    Bus_init(&bus);
+    InputQueue_init(&queue);
+    Controller_init(&controller, &bus, &queue);
+    Bus_connect(&bus, (BusDevice*) &controller);
+    Controller_schedule(&controller, 0, 0, BUTTON_A | BUTTON_START);
+    Controller_schedule(&controller, 0, 1, BUTTON_LEFT);
+    assert(read_buttons(0) == (BUTTON_A | BUTTON_START));
+    assert((Bus_read(&bus, 0x4016) & 1) == 1);
+    assert(read_buttons(1) == BUTTON_LEFT);
+    Bus_write(&bus, 0x4016, 1);
+    assert((Bus_read(&bus, 0x4016) & 1) == 1 && (Bus_read(&bus, 0x4016) & 1) == 1);
+    Bus_write(&bus, 0x4016, 0);
+
+    // a change applies exactly at its cycle
+    Controller_schedule(&controller, 1000, 0, BUTTON_RIGHT);
+    run(999);
+    assert(read_buttons(0) == (BUTTON_A | BUTTON_START));
+    run(1000);
+    assert(read_buttons(0) == BUTTON_RIGHT);
+
+    // host events land as far into the frame as they came into the last one
+    Controller_frame(&controller, 1000000000);
+    InputEvent half = {1000000000 + 8000000, 0, BUTTON_B};
+    InputEvent late = {1000000000 + 20000000, 0, BUTTON_UP};
+    assert(InputQueue_push(&queue, &half) == 0 && InputQueue_push(&queue, &late) == 0);
+    unsigned long long start = bus.cycle;
+    Controller_frame(&controller, 1000000000 + 16000000);
+    assert(controller.pending_count == 2);
+    assert(controller.pending[0].cycle == start + CONTROLLER_FRAME_CYCLES / 2);
+    assert(controller.pending[1].cycle == start + CONTROLLER_FRAME_CYCLES - 1);
+    run(start + CONTROLLER_FRAME_CYCLES / 2 - 1);
+    assert(read_buttons(0) == BUTTON_RIGHT);
+    run(start + CONTROLLER_FRAME_CYCLES / 2);
+    assert(read_buttons(0) == BUTTON_B);
+    run(start + CONTROLLER_FRAME_CYCLES - 1);
+    assert(read_buttons(0) == BUTTON_UP && controller.pending_count == 0);
+
+    // recorded changes replay at the same cycles
+    FILE *record = tmpfile();
+    controller.record = record;
+    unsigned long long at[3] = {bus.cycle + 10, bus.cycle + 500, bus.cycle + 501};
+    for (int i = 0; i < 3; ++i)
+    {
+        Controller_schedule(&controller, at[i], i & 1, 1 << i);
+    }
+    int reads[700];
+    unsigned long long first = bus.cycle;
+    for (int i = 0; i < 700; ++i)
+    {
+        run(first + i);
+        reads[i] = read_buttons(0) | read_buttons(1) << 8;
+    }
+    controller.record = 0;
+
+    Bus_init(&bus);
+    Controller_init(&controller, &bus, 0);
+    Bus_connect(&bus, (BusDevice*) &controller);
+    rewind(record);
+    ControllerEvent recorded;
+    while (fread(&recorded, sizeof(recorded), 1, record) == 1)
+    {
+        Controller_schedule(&controller, recorded.cycle, recorded.port, recorded.buttons);
+    }
+    fclose(record);
+    // from the state the recording started in
+    Controller_schedule(&controller, 0, 0, BUTTON_UP);
+    Controller_schedule(&controller, 0, 1, BUTTON_LEFT);
+    for (int i = 0; i < 700; ++i)
+    {
+        run(first + i);
+        assert((read_buttons(0) | read_buttons(1) << 8) == reads[i]);
+    }
+    assert(reads[9] == (BUTTON_UP | BUTTON_LEFT << 8) && reads[10] == (1 | BUTTON_LEFT << 8));
+    assert(reads[500] == (1 | 2 << 8) && reads[501] == (4 | 2 << 8));
+
+    // a change forced out of a full queue is recorded at the cycle it took effect
+    record = tmpfile();
+    controller.record = record;
+    unsigned long long now = bus.cycle;
+    for (int i = 0; i <= CONTROLLER_PENDING; ++i)
+    {
+        Controller_schedule(&controller, now + 100 + i, 0, i + 1);
+    }
+    controller.record = 0;
+    rewind(record);
+    assert(fread(&recorded, sizeof(recorded), 1, record) == 1 && recorded.cycle == now && recorded.buttons == 1);
+    assert(fread(&recorded, sizeof(recorded), 1, record) == 0);
+    fclose(record);
+
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include "machine.h"
+#include "test.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// A rom that draws: reset masks IRQs, sets a palette and turns on NMI and rendering, then
+// counts in $10. Each NMI counts in $11, writes $10 to the same offset in a
+// nametable and CHR-RAM, and scrolls.
+static const unsigned char reset[] = {
+    0x78, 0xA9, 0x40, 0x8D, 0x17, 0x40,                         // SEI, no frame IRQ
+    0xA9, 0x3F, 0x8D, 0x06, 0x20, 0xA9, 0x00, 0x8D, 0x06, 0x20, // palette
+    0xA9, 0x0F, 0x8D, 0x07, 0x20, 0xA9, 0x30, 0x8D, 0x07, 0x20,
+    0xA9, 0x16, 0x8D, 0x07, 0x20, 0xA9, 0x27, 0x8D, 0x07, 0x20,
+    0xA9, 0x80, 0x8D, 0x00, 0x20, 0xA9, 0x1E, 0x8D, 0x01, 0x20, // NMI, rendering
+    0xE6, 0x10, 0x4C, 0x2E, 0x80,                               // INC $10; JMP
+};
+static const unsigned char nmi[] = {
+    0xE6, 0x11,                                                 // INC $11
+    0xA9, 0x20, 0x8D, 0x06, 0x20, 0xA5, 0x11, 0x8D, 0x06, 0x20, // $20xx = $10
+    0xA5, 0x10, 0x8D, 0x07, 0x20,
+    0xA9, 0x00, 0x8D, 0x06, 0x20, 0xA5, 0x11, 0x8D, 0x06, 0x20, // $00xx = $10
+    0xA5, 0x10, 0x8D, 0x07, 0x20,
+    0xA5, 0x11, 0x8D, 0x05, 0x20, 0x8D, 0x05, 0x20,             // scroll
+    0xA9, 0x80, 0x8D, 0x00, 0x20, 0x40,                         // RTI
+};
+
+static void run(Machine *machine, int frames)
+{
+    unsigned long long end = machine->ppu.frames + frames;
+    while (machine->ppu.frames < end)
+    {
+        Bus_tick(&machine->bus);
+    }
+}
+
+static int same(const Machine *a, const Machine *b)
+{
+    return a->bus.cycle == b->bus.cycle && a->cpu.pc == b->cpu.pc && a->cpu.a == b->cpu.a && a->cpu.cycles == b->cpu.cycles &&
+           memcmp(a->ram_bytes, b->ram_bytes, MACHINE_RAM_SIZE) == 0 &&
+           memcmp(a->ppu.framebuffer, b->ppu.framebuffer, sizeof(a->ppu.framebuffer)) == 0 &&
+           memcmp(a->ppu.ciram, b->ppu.ciram, sizeof(a->ppu.ciram)) == 0 &&
+           memcmp(a->cart.chr, b->cart.chr, a->cart.chr_size) == 0;
+}
+
+int main()
+{
+    size_t size = 16 + 0x8000;
+    unsigned char *rom = calloc(1, size);
+    memcpy(rom, "NES\x1A", 4);
+    rom[4] = 2;
+    memcpy(rom + 16, reset, sizeof(reset));
+    memcpy(rom + 16 + 0x100, nmi, sizeof(nmi));
+    memcpy(rom + 16 + 0x7FFA, (unsigned char[]) {0x00, 0x81, 0x00, 0x80, 0x00, 0x81}, 6);
+    char *path = strdup(write_temp(rom, size));
+    rom[6] = FLAGS_6_RAM_BATTERY;
+    char *battery = strdup(write_temp(rom, size));
+    free(rom);
+
+    // one aligned block holds the machine and the cart's RAM
+    Machine *a = Machine_create(path, 0, PPU_SCANLINE, 0);
+    assert(a && !a->cart.ines.battery && (uintptr_t) a % 64 == 0 && (uintptr_t) a->ram_bytes % 64 == 0);
+    assert(a->cart.prg_ram == a->cart_ram && a->bus.write_map[0x60] == a->cart_ram);
+    assert(a->cart.chr_ram && a->cart.chr == a->cart_ram + 0x2000 && a->cart.chr + a->cart.chr_size <= (unsigned char*) a + a->size);
+    assert(a->bus.read_map[0x08] == a->ram_bytes);
+    run(a, 30);
+    assert(a->ram_bytes[0x11] == 29 && a->ram_bytes[0x10] && a->cart.chr[29] == a->ppu.ciram[29]);
+
+    // a fork runs the same as the original
+    Machine *b = Machine_create(path, 0, PPU_SCANLINE, 0);
+    Machine *snapshot = Machine_create(path, 0, PPU_SCANLINE, 0);
+    assert(b && snapshot);
+    Machine_copy(b, a);
+    assert(same(a, b) && b->cpu.bus == &b->bus && b->cart.prg_ram == b->cart_ram && b->bus.write_map[0x60] == b->cart_ram && b->bus.read_map[0x08] == b->ram_bytes);
+    run(a, 60);
+    run(b, 60);
+    assert(same(a, b));
+
+    // and a snapshot brings a machine back to where it was
+    Machine_copy(snapshot, a);
+    run(a, 20);
+    Machine_copy(b, a);
+    Machine_copy(a, snapshot);
+    run(a, 20);
+    assert(same(a, b));
+
+    // reset starts the program over, keeping RAM
+    Machine_reset(a);
+    assert(a->cpu.pc == 0x8000 && a->ram_bytes[0x11] == b->ram_bytes[0x11]);
+    run(a, 2);
+    assert(a->ppu.ctrl == 0x80 && a->ram_bytes[0x11] > b->ram_bytes[0x11]);
+
+    Machine_destroy(snapshot);
+    Machine_destroy(b);
+    Machine_destroy(a);
+
+    // battery RAM is copied out of src's save file, into dst's arena or its own file
+    char save_a[] = "/tmp/nes_save_XXXXXX", save_c[] = "/tmp/nes_save_XXXXXX";
+    close(mkstemp(save_a));
+    close(mkstemp(save_c));
+    unlink(save_a);
+    unlink(save_c);
+    a = Machine_create(battery, 0, PPU_SCANLINE, 0);
+    b = Machine_create(battery, 0, PPU_SCANLINE, 0);
+    Machine *c = Machine_create(battery, 0, PPU_SCANLINE, 0);
+    assert(a && b && c);
+    assert(Cart_open_save(&a->cart, save_a, 0) == 0 && Cart_open_save(&c->cart, save_c, 0) == 0);
+    Bus_write(&a->bus, 0x6010, 0x42);
+    Machine_copy(b, a);
+    Machine_copy(c, a);
+    assert(b->cart.prg_ram == b->cart_ram && b->bus.write_map[0x60] == b->cart_ram && Bus_read(&b->bus, 0x6010) == 0x42);
+    assert(c->cart.prg_ram == c->cart.save.ram && c->bus.write_map[0x60] == c->cart.save.ram && Bus_read(&c->bus, 0x6010) == 0x42);
+    Bus_write(&b->bus, 0x6010, 0x43);
+    Bus_write(&c->bus, 0x6010, 0x44);
+    assert(a->cart.save.ram[0x10] == 0x42);
+    Machine_destroy(a);
+    assert(Bus_read(&b->bus, 0x6010) == 0x43 && Bus_read(&c->bus, 0x6010) == 0x44);
+
+    Machine_destroy(c);
+    Machine_destroy(b);
+    unlink(save_a);
+    unlink(save_c);
+    unlink(battery);
+    unlink(path);
+    free(battery);
+    free(path);
+    return 0;
+}
@@ -0,0 +1,176 @@
+#include "bus.h"
+#include "cart.h"
+#include "test.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static Bus bus;
+static Cart cart;
+static unsigned char ciram[0x800];
+
+// Open a rom for mapper with prg_kb of PRG and chr_kb of CHR (0 for CHR RAM). The first
+// byte of every 8KB PRG bank and 1KB CHR bank holds its bank number.
+static void open_rom(int mapper, int prg_kb, int chr_kb)
+{
+    size_t size = 16 + prg_kb * 1024 + chr_kb * 1024;
+    unsigned char *rom = calloc(1, size);
+    memcpy(rom, "NES\x1A", 4);
+    rom[4] = prg_kb / 16;
+    rom[5] = chr_kb / 8;
+    rom[6] = (mapper & 0xF) << 4;
+    rom[7] = mapper & 0xF0;
+
+    for (int bank = 0; bank < prg_kb / 8; ++bank)
+    {
+        rom[16 + bank * 0x2000] = bank;
+    }
+    for (int bank = 0; bank < chr_kb; ++bank)
+    {
+        rom[16 + prg_kb * 1024 + bank * 0x400] = bank;
+    }
+
+    char *path = write_temp(rom, size);
+    Bus_init(&bus);
+    assert(Cart_open(&cart, &bus, path, 0) == 0);
+    Bus_connect(&bus, (BusDevice*) &cart);
+    Cart_attach_ciram(&cart, ciram);
+    unlink(path);
+    free(rom);
+}
+
+// Bank number visible at a CPU address
+static int prg_bank(int addr)
+{
+    return Bus_read(&bus, addr);
+}
+
+// Bank number visible at a PPU address
+static int chr_bank(int addr)
+{
+    return Cart_chr_read(&cart, addr);
+}
+
+static void mmc1_write(int addr, int value)
+{
+    for (int i = 0; i < 5; ++i)
+    {
+        Bus_write(&bus, addr, (value >> i) & 1);
+    }
+}
+
+int main()
+{
+    // NROM: 16KB mirrored
+    open_rom(0, 16, 8);
+    assert(prg_bank(0x8000) == 0 && prg_bank(0xA000) == 1);
+    assert(prg_bank(0xC000) == 0 && prg_bank(0xE000) == 1);
+    Cart_close(&cart);
+
+    // UxROM: switch $8000, last bank fixed at $C000
+    open_rom(2, 128, 0);
+    assert(prg_bank(0x8000) == 0 && prg_bank(0xC000) == 14);
+    Bus_write(&bus, 0x8000, 3);
+    assert(prg_bank(0x8000) == 6 && prg_bank(0xA000) == 7 && prg_bank(0xE000) == 15);
+    Cart_close(&cart);
+
+    // CNROM: 8KB CHR
+    open_rom(3, 32, 32);
+    Bus_write(&bus, 0x8000, 2);
+    assert(chr_bank(0x0000) == 16 && chr_bank(0x1C00) == 23);
+    Cart_close(&cart);
+
+    // AxROM: 32KB PRG and single screen
+    open_rom(7, 256, 0);
+    assert(prg_bank(0x8000) == 0);
+    Bus_write(&bus, 0x8000, 0x12);
+    assert(prg_bank(0x8000) == 8 && prg_bank(0xE000) == 11);
+    assert(cart.nt_map[0] == ciram + 0x400 && cart.nt_map[3] == ciram + 0x400);
+    Cart_close(&cart);
+
+    // MMC1: power on fixes the last bank at $C000
+    open_rom(1, 256, 128);
+    assert(prg_bank(0xC000) == 30);
+    mmc1_write(0xE000, 5);
+    assert(prg_bank(0x8000) == 10 && prg_bank(0xC000) == 30);
+
+    // 4KB CHR mode, vertical mirroring
+    mmc1_write(0x8000, 0x1E);
+    mmc1_write(0xA000, 3);
+    mmc1_write(0xC000, 9);
+    assert(chr_bank(0x0000) == 12 && chr_bank(0x1000) == 36);
+    assert(cart.nt_map[0] == ciram && cart.nt_map[1] == ciram + 0x400 && cart.nt_map[2] == ciram);
+
+    // a write with bit 7 resets the shift register
+    Bus_write(&bus, 0x8000, 1);
+    Bus_write(&bus, 0x8000, 0x80);
+    mmc1_write(0xE000, 2);
+    assert(prg_bank(0x8000) == 4);
+
+    // PRG-RAM can be disabled
+    Bus_write(&bus, 0x6000, 0x77);
+    assert(Bus_read(&bus, 0x6000) == 0x77);
+    mmc1_write(0xE000, 0x10);
+    assert(bus.read_map[0x60] == 0);
+    Cart_close(&cart);
+
+    // MMC3: R6/R7 and fixed banks
+    open_rom(4, 256, 256);
+    assert(prg_bank(0xC000) == 30 && prg_bank(0xE000) == 31);
+    Bus_write(&bus, 0x8000, 6);
+    Bus_write(&bus, 0x8001, 9);
+    Bus_write(&bus, 0x8000, 7);
+    Bus_write(&bus, 0x8001, 4);
+    assert(prg_bank(0x8000) == 9 && prg_bank(0xA000) == 4);
+
+    // PRG mode swaps $8000 and $C000
+    Bus_write(&bus, 0x8000, 0x46);
+    assert(prg_bank(0x8000) == 30 && prg_bank(0xC000) == 9);
+
+    // CHR: R0 2KB, R2 1KB, then inverted
+    Bus_write(&bus, 0x8000, 0);
+    Bus_write(&bus, 0x8001, 21);
+    Bus_write(&bus, 0x8000, 2);
+    Bus_write(&bus, 0x8001, 100);
+    assert(chr_bank(0x0000) == 20 && chr_bank(0x0400) == 21 && chr_bank(0x1000) == 100);
+    Bus_write(&bus, 0x8000, 0x80);
+    assert(chr_bank(0x1000) == 20 && chr_bank(0x0000) == 100);
+
+    // mirroring
+    Bus_write(&bus, 0xA000, 1);
+    assert(cart.nt_map[1] == ciram && cart.nt_map[2] == ciram + 0x400);
+
+    // PRG-RAM write protect
+    Bus_write(&bus, 0x6000, 0x11);
+    Bus_write(&bus, 0xA001, 0xC0);
+    Bus_write(&bus, 0x6000, 0x22);
+    assert(Bus_read(&bus, 0x6000) == 0x11);
+
+    // scanline IRQ fires after latch + 1 clocks once reloaded
+    Bus_write(&bus, 0xC000, 3);
+    Bus_write(&bus, 0xC001, 0);
+    assert(cart.mapper->scanlines_to_irq(&cart) == -1);
+    Bus_write(&bus, 0xE001, 0);
+    assert(cart.mapper->scanlines_to_irq(&cart) == 4);
+    for (int i = 0; i < 3; ++i)
+    {
+        Cart_scanline(&cart);
+        assert(!cart.irq);
+    }
+    assert(cart.mapper->scanlines_to_irq(&cart) == 1);
+    Cart_scanline(&cart);
+    assert(cart.irq);
+    Bus_write(&bus, 0xE000, 0);
+    assert(!cart.irq);
+    Cart_close(&cart);
+
+    // unsupported mappers are rejected
+    unsigned char rom[16 + 0x4000] = {'N', 'E', 'S', 0x1A, 1, 0, 0xF0, 0xF0};
+    char *path = write_temp(rom, sizeof(rom));
+    assert(Cart_open(&cart, &bus, path, 0) < 0);
+    unlink(path);
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include "ntsc.h"
+
+#include <assert.h>
+#include <string.h>
+
+static NTSC ntsc;
+static unsigned short frame[PPU_WIDTH * PPU_HEIGHT];
+static uint32_t out[NTSC_WIDTH * NTSC_HEIGHT];
+static uint32_t threaded[NTSC_WIDTH * NTSC_HEIGHT];
+
+static void fill(int pixel)
+{
+    for (int i = 0; i < PPU_WIDTH * PPU_HEIGHT; ++i)
+    {
+        frame[i] = pixel;
+    }
+}
+
+static int channel(uint32_t rgba, int c)
+{
+    return (rgba >> (c * 8)) & 0xFF;
+}
+
+// The dominant channel of a flat field of a colour
+static int dominant(int pixel)
+{
+    fill(pixel);
+    NTSC_filter_rows(&ntsc, frame, 0, out, 0, NTSC_HEIGHT);
+    uint32_t rgba = out[100 * NTSC_WIDTH + 200];
+    int best = 0;
+    for (int c = 1; c < 3; ++c)
+    {
+        if (channel(rgba, c) > channel(rgba, best))
+        {
+            best = c;
+        }
+    }
+    return best;
+}
+
+int main()
+{
+    NTSC_init(&ntsc, 1);
+
+    // black, white, and the hues land where the palette has them
+    fill(0x0F);
+    NTSC_filter_rows(&ntsc, frame, 0, out, 0, NTSC_HEIGHT);
+    assert((out[0] & 0xFFFFFF) == 0 && out[0] >> 24 == 0xFF);
+    fill(0x30);
+    NTSC_filter_rows(&ntsc, frame, 0, out, 0, NTSC_HEIGHT);
+    assert(channel(out[1000], 0) > 240 && channel(out[1000], 1) > 240 && channel(out[1000], 2) > 240);
+    assert(dominant(0x16) == 0 && dominant(0x1A) == 1 && dominant(0x12) == 2);
+
+    // greys carry no chroma, so they are flat whatever the phase
+    fill(0x10);
+    NTSC_filter_rows(&ntsc, frame, 4, out, 0, NTSC_HEIGHT);
+    for (int i = 0; i < NTSC_WIDTH * NTSC_HEIGHT; ++i)
+    {
+        assert(out[i] == out[0]);
+        assert(channel(out[i], 0) == channel(out[i], 1) && channel(out[i], 1) == channel(out[i], 2));
+    }
+
+    // fine detail fringes, and the fringes crawl from frame to frame
+    for (int i = 0; i < PPU_WIDTH * PPU_HEIGHT; ++i)
+    {
+        frame[i] = i & 1 ? 0x30 : 0x0F;
+    }
+    NTSC_filter_rows(&ntsc, frame, 0, out, 0, NTSC_HEIGHT);
+    uint32_t fringe = out[100 * NTSC_WIDTH + 200];
+    assert(channel(fringe, 0) != channel(fringe, 1) || channel(fringe, 1) != channel(fringe, 2));
+    NTSC_filter_rows(&ntsc, frame, 4, threaded, 0, NTSC_HEIGHT);
+    assert(memcmp(out, threaded, sizeof(out)) != 0);
+
+    // the phase moves 4 per scanline: line 1 at phase 0 is line 0 at phase 4
+    assert(memcmp(&out[NTSC_WIDTH], threaded, NTSC_WIDTH * sizeof(uint32_t)) == 0);
+    assert(NTSC_phase(0) == 0 && NTSC_phase(341) == 4 && NTSC_phase(341 * 262 - 1) == 8);
+
+    // the workers split rows without changing the result, frame after frame
+    static NTSC pool;
+    NTSC_init(&pool, 7);
+    for (int phase = 0; phase < NTSC_PHASES; phase += 4)
+    {
+        NTSC_filter(&ntsc, frame, phase, out);
+        NTSC_filter(&pool, frame, phase, threaded);
+        assert(memcmp(out, threaded, sizeof(out)) == 0);
+    }
+    NTSC_free(&pool);
+    NTSC_free(&ntsc);
+
+    return 0;
+}
@@ -0,0 +1,192 @@
+#include "bus.h"
+#include "cart.h"
+#include "pipeline.h"
+#include "ppu.h"
+#include "test.h"
+#include "video.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define FRAMES 120
+
+typedef struct Machine
+{
+    Bus bus;
+    Cart cart;
+    PPU ppu;
+    unsigned char page[256]; // DMA source at $0200
+} Machine;
+
+static Machine single, piped;
+static Pipeline pipeline;
+static Video video;
+static int drawn;
+
+static void power_on(Machine *machine, const char *path, PPUMode mode)
+{
+    Bus_init(&machine->bus);
+    assert(Cart_open(&machine->cart, &machine->bus, path, 0) == 0);
+    PPU_init(&machine->ppu, &machine->bus, &machine->cart, mode);
+    Bus_connect(&machine->bus, (BusDevice*) &machine->cart);
+    Bus_connect(&machine->bus, (BusDevice*) &machine->ppu);
+    Bus_map(&machine->bus, 0x0200, 256, machine->page, machine->page);
+    Bus_message(&machine->bus, BUS_RESET);
+}
+
+static void count_frame(void *arg, const unsigned short *frame)
+{
+    assert(arg == &pipeline && frame);
+    ++drawn;
+}
+
+// Both machines see the same write, and read the same
+static void both_write(int addr, int data)
+{
+    Bus_write(&single.bus, addr, data);
+    Bus_write(&piped.bus, addr, data);
+}
+
+static void both_read(int addr)
+{
+    assert(Bus_read(&single.bus, addr) == Bus_read(&piped.bus, addr));
+}
+
+// Random PPU traffic through a number of frames, some of it mid-frame, comparing
+// every frame the render thread draws with the single threaded one. With video,
+// the piped PPU has it attached and frames are compared as published.
+static void run(int mapper, int chr_kb, PPUMode mode, int with_video)
+{
+    size_t size = 16 + 32 * 1024 + chr_kb * 1024;
+    unsigned char *rom = calloc(1, size);
+    memcpy(rom, "NES\x1A", 4);
+    rom[4] = 2;
+    rom[5] = chr_kb / 8;
+    rom[6] = (mapper & 0xF) << 4;
+    rom[7] = mapper & 0xF0;
+    for (size_t i = 16 + 32 * 1024; i < size; ++i)
+    {
+        rom[i] = rand();
+    }
+    char *path = write_temp(rom, size);
+    power_on(&single, path, mode);
+    power_on(&piped, path, mode);
+    unlink(path);
+    free(rom);
+
+    Video *out = with_video ? &video : 0;
+    if (out)
+    {
+        Video_init(out);
+        PPU_attach_video(&piped.ppu, out);
+    }
+    assert(Pipeline_start(&pipeline, &piped.ppu, out, count_frame, &pipeline) == 0);
+    assert(!piped.ppu.video);
+    drawn = 0;
+
+    // random pattern tables (for CHR RAM), nametables and palettes
+    both_write(0x2006, 0);
+    both_write(0x2006, 0);
+    for (int i = 0; i < 0x4000; ++i)
+    {
+        both_write(0x2007, rand());
+    }
+    both_write(0x2001, 0x1E);
+
+    for (int frame = 0; frame < FRAMES; ++frame)
+    {
+        unsigned long long frames = single.ppu.frames;
+        unsigned long long cycle = single.bus.cycle + rand() % 1000;
+        while (single.ppu.frames == frames)
+        {
+            Bus_tick(&single.bus);
+            Bus_tick(&piped.bus);
+            if (single.bus.cycle < cycle)
+            {
+                continue;
+            }
+            cycle += rand() % 2000;
+
+            int data = rand() & 0xFF;
+            switch (rand() % 10)
+            {
+            case 0:
+                both_write(0x2000, data & 0x3B);
+                break;
+            case 1:
+                both_write(0x2001, data | 0x18);
+                break;
+            case 2:
+                both_write(0x2005, data);
+                both_write(0x2005, rand());
+                break;
+            case 3:
+                both_read(0x2002);
+                break;
+            case 4:
+                both_write(0x2006, data & 0x3F);
+                both_write(0x2006, rand());
+                both_write(0x2007, rand());
+                both_read(0x2007);
+                break;
+            case 5:
+                for (int i = 0; i < 256; ++i)
+                {
+                    single.page[i] = piped.page[i] = rand();
+                }
+                both_write(0x2003, data);
+                both_write(0x4014, 0x02);
+                break;
+            case 6:
+                both_write(0x2003, data);
+                both_write(0x2004, rand());
+                break;
+            default:
+                // MMC3 CHR banks and mirroring
+                both_write(0x8000, data & 7);
+                both_write(0x8001, rand());
+                both_write(0xA000, rand());
+                break;
+            }
+        }
+        assert(piped.ppu.frames == single.ppu.frames);
+        Pipeline_wait(&pipeline);
+        assert(drawn == frame + 1 && atomic_load(&pipeline.frames) == (unsigned long long) drawn);
+        const unsigned short *frame = out ? Video_acquire(out, 0) : pipeline.replica.framebuffer;
+        assert(memcmp(frame, single.ppu.framebuffer, sizeof(single.ppu.framebuffer)) == 0);
+    }
+
+    // drawing goes back to the PPU mid-frame and carries on the same
+    for (int i = 0; i < 10000; ++i)
+    {
+        Bus_tick(&single.bus);
+        Bus_tick(&piped.bus);
+    }
+    both_write(0x2005, 0x40);
+    both_write(0x2005, 0x10);
+    Pipeline_stop(&pipeline);
+    assert(piped.ppu.video == out);
+    unsigned long long frames = single.ppu.frames;
+    while (single.ppu.frames == frames)
+    {
+        Bus_tick(&single.bus);
+        Bus_tick(&piped.bus);
+    }
+    const unsigned short *frame = out ? Video_acquire(out, 0) : piped.ppu.framebuffer;
+    assert(memcmp(frame, single.ppu.framebuffer, sizeof(single.ppu.framebuffer)) == 0);
+
+    Cart_close(&single.cart);
+    Cart_close(&piped.cart);
+}
+
+int main()
+{
+    srand(1);
+    run(4, 128, PPU_SCANLINE, 0);
+    run(4, 128, PPU_DOT, 0);
+    run(0, 0, PPU_SCANLINE, 0);
+    run(0, 0, PPU_DOT, 1);
+    return 0;
+}
@@ -0,0 +1,256 @@
+#include "bus.h"
+#include "cart.h"
+#include "ppu.h"
+#include "test.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static Bus bus;
+static Cart cart;
+static PPU ppu;
+
+
+static int register_reads;
+
+// Registers at $5000-$50FF that read as their low address byte, inverted
+static void registers(BusDevice *device, Bus *bus)
+{
+    if (bus->message == BUS_READ && (bus->addr & 0xFF00) == 0x5000)
+    {
+        ++register_reads;
+        bus->data = ~bus->addr & 0xFF;
+    }
+}
+
+static BusDevice register_device = {0, registers};
+
+// Power on with a mapper and chr_kb of CHR ROM (0 for CHR RAM)
+static void power_on(int mapper, int chr_kb, PPUMode mode)
+{
+    size_t size = 16 + 32 * 1024 + chr_kb * 1024;
+    unsigned char *rom = calloc(1, size);
+    memcpy(rom, "NES\x1A", 4);
+    rom[4] = 2;
+    rom[5] = chr_kb / 8;
+    rom[6] = (mapper & 0xF) << 4;
+    rom[7] = mapper & 0xF0;
+
+    char *path = write_temp(rom, size);
+    Bus_init(&bus);
+    assert(Cart_open(&cart, &bus, path, 0) == 0);
+    unlink(path);
+    free(rom);
+
+    PPU_init(&ppu, &bus, &cart, mode);
+    Bus_connect(&bus, (BusDevice*) &cart);
+    Bus_connect(&bus, (BusDevice*) &ppu);
+}
+
+static void set_addr(int addr)
+{
+    Bus_write(&bus, 0x2006, addr >> 8);
+    Bus_write(&bus, 0x2006, addr & 0xFF);
+}
+
+// Tick until the PPU has run dot of line (the PPU is synced every cycle to watch it)
+static void run_until(int line, int dot)
+{
+    do
+    {
+        Bus_tick(&bus);
+        PPU_sync(&ppu);
+    } while (ppu.scanline != line || ppu.dot <= dot);
+}
+
+// Tile 1 is solid colour 1, and fills the first nametable
+static void fill_background()
+{
+    set_addr(0x0010);
+    for (int i = 0; i < 16; ++i)
+    {
+        Bus_write(&bus, 0x2007, i < 8 ? 0xFF : 0);
+    }
+    set_addr(0x2000);
+    for (int i = 0; i < 0x3C0; ++i)
+    {
+        Bus_write(&bus, 0x2007, 1);
+    }
+    set_addr(0x3F00);
+    Bus_write(&bus, 0x2007, 0x0F);
+    Bus_write(&bus, 0x2007, 0x16);
+    set_addr(0);
+}
+
+int main()
+{
+    // vblank at dot 1 of line 241, found without touching a register
+    power_on(0, 0, PPU_SCANLINE);
+    Bus_write(&bus, 0x2000, 0x80);
+    while (bus.cycle < (241 * PPU_DOTS + 1) / 3)
+    {
+        Bus_tick(&bus);
+    }
+    assert(!bus.nmi);
+    Bus_tick(&bus);
+    assert(bus.nmi && (ppu.status & 0x80));
+    assert(ppu.scanline == 241 && ppu.dot > 1 && ppu.dot <= 4);
+
+    // reading status clears vblank and the write toggle
+    assert(Bus_read(&bus, 0x2002) & 0x80);
+    assert(!(Bus_read(&bus, 0x2002) & 0x80));
+
+    // $2007 reads are buffered, except the palette
+    set_addr(0x2345);
+    Bus_write(&bus, 0x2007, 0x12);
+    Bus_write(&bus, 0x2007, 0x34);
+    set_addr(0x2345);
+    Bus_read(&bus, 0x2007);
+    assert(Bus_read(&bus, 0x2007) == 0x12);
+    assert(Bus_read(&bus, 0x2007) == 0x34);
+    set_addr(0x3F10);
+    Bus_write(&bus, 0x2007, 0x2A);
+    set_addr(0x3F00);
+    assert(Bus_read(&bus, 0x2007) == 0x2A);
+    Cart_close(&cart);
+
+    // background and sprites in scanline mode
+    power_on(0, 0, PPU_SCANLINE);
+    fill_background();
+    set_addr(0x3F11);
+    Bus_write(&bus, 0x2007, 0x30);
+    set_addr(0);
+    Bus_write(&bus, 0x2003, 0);
+    const unsigned char sprite[4] = {49, 1, 0, 100};
+    for (int i = 0; i < 4; ++i)
+    {
+        Bus_write(&bus, 0x2004, sprite[i]);
+    }
+    for (int i = 4; i < 256; ++i)
+    {
+        Bus_write(&bus, 0x2004, 0xFF);
+    }
+    Bus_write(&bus, 0x2001, 0x18); // left 8 pixels hidden
+
+    // sprite 0 hits at its own dot, even though the line was rendered at dot 0
+    run_until(50, 97);
+    assert(!(ppu.status & 0x40));
+    run_until(50, 101);
+    assert(ppu.status & 0x40);
+    assert(ppu.dot <= 104);
+
+    run_until(241, 1);
+    assert(ppu.frame[0] == 0x0F && ppu.frame[8] == 0x16);
+    assert(ppu.frame[49 * PPU_WIDTH + 100] == 0x16);
+    assert(ppu.frame[50 * PPU_WIDTH + 100] == 0x30 && ppu.frame[57 * PPU_WIDTH + 107] == 0x30);
+    assert(ppu.frame[58 * PPU_WIDTH + 100] == 0x16);
+
+    // a mid-line write shows from the next line
+    run_until(100, 130);
+    Bus_write(&bus, 0x2001, 0x19);
+    run_until(241, 1);
+    assert(ppu.frame[100 * PPU_WIDTH + 200] == 0x16 && ppu.frame[101 * PPU_WIDTH + 8] == 0x10);
+    Cart_close(&cart);
+
+    // ... or from the next dot in dot mode
+    power_on(0, 0, PPU_DOT);
+    fill_background();
+    Bus_write(&bus, 0x2001, 0x0A);
+    run_until(100, 130);
+    Bus_write(&bus, 0x2001, 0x0B);
+    run_until(241, 1);
+    assert(ppu.frame[100 * PPU_WIDTH + 120] == 0x16 && ppu.frame[100 * PPU_WIDTH + 140] == 0x10);
+    assert(ppu.frame[99 * PPU_WIDTH + 200] == 0x16);
+    Cart_close(&cart);
+
+    // at most 8 sprites a line, the 9th sets overflow
+    power_on(0, 0, PPU_SCANLINE);
+    fill_background();
+    set_addr(0x3F11);
+    Bus_write(&bus, 0x2007, 0x30);
+    Bus_write(&bus, 0x2003, 0);
+    for (int i = 0; i < 64; ++i)
+    {
+        const unsigned char sprite[4] = {i < 9 ? 119 : 0xF0, 1, 0, i * 16 + 8};
+        for (int j = 0; j < 4; ++j)
+        {
+            Bus_write(&bus, 0x2004, sprite[j]);
+        }
+    }
+    set_addr(0);
+    Bus_write(&bus, 0x2001, 0x18);
+    run_until(119, 0);
+    assert(!(ppu.status & 0x20));
+    run_until(120, 0);
+    assert(ppu.status & 0x20);
+    assert(ppu.frame[120 * PPU_WIDTH + 7 * 16 + 8] == 0x30 && ppu.frame[120 * PPU_WIDTH + 8 * 16 + 8] == 0x16);
+
+    // OAM writes show on the next lines, sprite size changes too
+    run_until(130, 0);
+    Bus_write(&bus, 0x2003, 0);
+    Bus_write(&bus, 0x2004, 139);
+    run_until(150, 0);
+    assert(ppu.frame[140 * PPU_WIDTH + 8] == 0x30 && ppu.frame[148 * PPU_WIDTH + 8] == 0x16);
+    Bus_write(&bus, 0x2000, 0x20); // 8x16: tile 1 is now $1000 over $1010
+    run_until(241, 1);
+    assert(ppu.frame[148 * PPU_WIDTH + 8] == 0x16);
+    set_addr(0x1010);
+    Bus_write(&bus, 0x2007, 0xFF);
+    set_addr(0);
+    run_until(0, 0);
+    run_until(241, 1);
+    assert(ppu.frame[140 * PPU_WIDTH + 8] == 0x16 && ppu.frame[148 * PPU_WIDTH + 8] == 0x30);
+
+    // with rendering off no sprites are evaluated, so none overflow
+    Bus_write(&bus, 0x2003, 0);
+    Bus_write(&bus, 0x2004, 119);
+    Bus_write(&bus, 0x2001, 0);
+    run_until(0, 0);
+    run_until(200, 0);
+    assert(!(ppu.status & 0x20));
+    Bus_write(&bus, 0x2001, 0x18);
+    run_until(241, 1);
+    run_until(0, 0);
+    run_until(200, 0);
+    assert(ppu.status & 0x20);
+    Cart_close(&cart);
+
+    // OAM DMA copies a page from OAMADDR on and halts the CPU for 513 or 514 cycles
+    power_on(0, 8, PPU_SCANLINE);
+    unsigned char page[256];
+    for (int i = 0; i < 256; ++i)
+    {
+        page[i] = i;
+    }
+    Bus_map(&bus, 0x0200, 256, page, page);
+    Bus_write(&bus, 0x2003, 0x10);
+    Bus_write(&bus, 0x4014, 0x02);
+    assert(ppu.oam[0x10] == 0 && ppu.oam[0xFF] == 0xEF && ppu.oam[0] == 0xF0 && ppu.oam[0x0F] == 0xFF);
+    assert(bus.stall == 513);
+    bus.stall = 0;
+    Bus_tick(&bus);
+    Bus_connect(&bus, &register_device);
+    register_reads = 0;
+    Bus_write(&bus, 0x2003, 0);
+    Bus_write(&bus, 0x4014, 0x50);
+    assert(register_reads == 256 && ppu.oam[0] == 0xFF && ppu.oam[0xFF] == 0);
+    assert(bus.stall == 514);
+    Cart_close(&cart);
+
+    // MMC3 scanline IRQ is raised on its scanline without register reads
+    power_on(4, 8, PPU_SCANLINE);
+    Bus_write(&bus, 0xC000, 10);
+    Bus_write(&bus, 0xC001, 0);
+    Bus_write(&bus, 0xE001, 0);
+    Bus_write(&bus, 0x2001, 0x18);
+    while (!cart.irq)
+    {
+        Bus_tick(&bus);
+    }
+    assert(ppu.scanline == 10 && ppu.dot > 260 && ppu.dot <= 263 && bus.irq == BUS_IRQ_MAPPER);
+    Cart_close(&cart);
+
+    return 0;
+}
@@ -0,0 +1,216 @@
+#include "recomp.h"
+#include "test.h"
+
+#include <assert.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// An MMC3 game in the fixed bank: NMI and scanline IRQ handlers, a main loop that
+// switches $8000 between two banks and calls into them, then works through a page
+// of RAM with most addressing modes (crossing pages), the stack and an indirect
+// jump before waiting for the NMI
+static const unsigned char fixed[] = {
+    // reset:
+    0x78,                  // $E000 SEI
+    0xD8,                  // $E001 CLD
+    0xA2, 0xFF,            // $E002 LDX #$FF
+    0x9A,                  // $E004 TXS
+    0xA9, 0x40,            // $E005 LDA #$40
+    0x8D, 0x17, 0x40,      // $E007 STA $4017
+    0xA9, 0x80,            // $E00A LDA #$80
+    0x8D, 0x00, 0x20,      // $E00C STA $2000
+    0xA9, 0x1E,            // $E00F LDA #$1E
+    0x8D, 0x01, 0x20,      // $E011 STA $2001
+    0xA9, 0x14,            // $E014 LDA #20
+    0x8D, 0x00, 0xC0,      // $E016 STA $C000
+    0x8D, 0x01, 0xC0,      // $E019 STA $C001
+    0x8D, 0x01, 0xE0,      // $E01C STA $E001
+    0xA9, 0xF0,            // $E01F LDA #$F0
+    0x85, 0x22,            // $E021 STA $22
+    0xA9, 0x03,            // $E023 LDA #$03
+    0x85, 0x23,            // $E025 STA $23
+    0xA9, 0x87,            // $E027 LDA #<after
+    0x8D, 0xF0, 0x07,      // $E029 STA $07F0
+    0xA9, 0xE0,            // $E02C LDA #>after
+    0x8D, 0xF1, 0x07,      // $E02E STA $07F1
+    0x58,                  // $E031 CLI
+    // loop:
+    0xA9, 0x06,            // $E032 LDA #$06
+    0x8D, 0x00, 0x80,      // $E034 STA $8000
+    0xA5, 0x30,            // $E037 LDA $30
+    0x29, 0x01,            // $E039 AND #$01
+    0x8D, 0x01, 0x80,      // $E03B STA $8001
+    0x20, 0x00, 0x80,      // $E03E JSR $8000
+    0xEA,                  // $E041 NOP
+    0xA2, 0x00,            // $E042 LDX #0
+    // mix:
+    0xBD, 0x00, 0x03,      // $E044 LDA $0300,X
+    0x18,                  // $E047 CLC
+    0x69, 0x35,            // $E048 ADC #$35
+    0x9D, 0x00, 0x03,      // $E04A STA $0300,X
+    0x45, 0x30,            // $E04D EOR $30
+    0x38,                  // $E04F SEC
+    0xFD, 0x80, 0x03,      // $E050 SBC $0380,X
+    0x2A,                  // $E053 ROL A
+    0x9D, 0x00, 0x04,      // $E054 STA $0400,X
+    0x7E, 0x00, 0x04,      // $E057 ROR $0400,X
+    0x5E, 0x00, 0x04,      // $E05A LSR $0400,X
+    0x0A,                  // $E05D ASL A
+    0x24, 0x30,            // $E05E BIT $30
+    0x70, 0x03,            // $E060 BVS skip1
+    0xFE, 0x00, 0x04,      // $E062 INC $0400,X
+    // skip1:
+    0xC9, 0x40,            // $E065 CMP #$40
+    0x90, 0x03,            // $E067 BCC skip2
+    0xDE, 0x00, 0x03,      // $E069 DEC $0300,X
+    // skip2:
+    0xE0, 0x80,            // $E06C CPX #$80
+    0xD0, 0x06,            // $E06E BNE skip3
+    0x08,                  // $E070 PHP
+    0x68,                  // $E071 PLA
+    0x85, 0x31,            // $E072 STA $31
+    0x48,                  // $E074 PHA
+    0x28,                  // $E075 PLP
+    // skip3:
+    0x8A,                  // $E076 TXA
+    0xA8,                  // $E077 TAY
+    0xB1, 0x22,            // $E078 LDA ($22),Y
+    0x15, 0x00,            // $E07A ORA $00,X
+    0x29, 0x7F,            // $E07C AND #$7F
+    0x99, 0x00, 0x02,      // $E07E STA $0200,Y
+    0xE8,                  // $E081 INX
+    0xD0, 0xC0,            // $E082 BNE mix
+    0x6C, 0xF0, 0x07,      // $E084 JMP ($07F0)
+    // after:
+    0xA5, 0x30,            // $E087 LDA $30
+    // wait:
+    0xC5, 0x30,            // $E089 CMP $30
+    0xF0, 0xFC,            // $E08B BEQ wait
+    0x4C, 0x32, 0xE0,      // $E08D JMP loop
+    // nmi:
+    0x48,                  // $E090 PHA
+    0x8A,                  // $E091 TXA
+    0x48,                  // $E092 PHA
+    0x98,                  // $E093 TYA
+    0x48,                  // $E094 PHA
+    0xE6, 0x30,            // $E095 INC $30
+    0xA5, 0x30,            // $E097 LDA $30
+    0x8D, 0x05, 0x20,      // $E099 STA $2005
+    0xA9, 0x00,            // $E09C LDA #0
+    0x8D, 0x05, 0x20,      // $E09E STA $2005
+    0x8D, 0x03, 0x20,      // $E0A1 STA $2003
+    0xA9, 0x02,            // $E0A4 LDA #$02
+    0x8D, 0x14, 0x40,      // $E0A6 STA $4014
+    0x68,                  // $E0A9 PLA
+    0xA8,                  // $E0AA TAY
+    0x68,                  // $E0AB PLA
+    0xAA,                  // $E0AC TAX
+    0x68,                  // $E0AD PLA
+    0x40,                  // $E0AE RTI
+    // irq:
+    0x48,                  // $E0AF PHA
+    0xE6, 0x40,            // $E0B0 INC $40
+    0x8D, 0x00, 0xE0,      // $E0B2 STA $E000
+    0x8D, 0x01, 0xE0,      // $E0B5 STA $E001
+    0x68,                  // $E0B8 PLA
+    0x40,                  // $E0B9 RTI
+};
+static const unsigned char bank0[] = {0xE6, 0x41, 0xA9, 0x01, 0x85, 0x42, 0x60}; // INC $41; LDA #1; STA $42; RTS
+static const unsigned char bank1[] = {0xC6, 0x41, 0xA9, 0x02, 0x85, 0x42, 0x60}; // DEC $41; LDA #2; STA $42; RTS
+
+static void run(Machine *machine)
+{
+    unsigned long long frame = machine->ppu.frames;
+    while (machine->ppu.frames == frame)
+    {
+        Bus_tick(&machine->bus);
+    }
+}
+
+static int same(const Machine *a, const Machine *b)
+{
+    const CPU *p = &a->cpu, *q = &b->cpu;
+    return a->bus.cycle == b->bus.cycle && a->bus.irq == b->bus.irq && a->bus.nmi == b->bus.nmi &&
+           p->pc == q->pc && p->a == q->a && p->x == q->x && p->y == q->y && p->sp == q->sp && p->cycles == q->cycles &&
+           p->n == q->n && p->v == q->v && p->b == q->b && p->d == q->d && p->i == q->i && p->z == q->z && p->c == q->c &&
+           memcmp(a->ram_bytes, b->ram_bytes, MACHINE_RAM_SIZE) == 0 &&
+           memcmp(&a->cart.regs, &b->cart.regs, sizeof(a->cart.regs)) == 0 &&
+           memcmp(a->ppu.framebuffer, b->ppu.framebuffer, sizeof(a->ppu.framebuffer)) == 0;
+}
+
+int main()
+{
+    size_t size = 16 + 0x10000 + 0x2000;
+    unsigned char *rom = calloc(1, size);
+    memcpy(rom, "NES\x1A", 4);
+    rom[4] = 4;
+    rom[5] = 1;
+    rom[6] = 0x40;
+    unsigned char *prg = rom + 16;
+    memcpy(prg, bank0, sizeof(bank0));
+    memcpy(prg + 0x2000, bank1, sizeof(bank1));
+    memcpy(prg + 0xE000, fixed, sizeof(fixed));
+    memcpy(prg + 0xFFFA, (unsigned char[]) {0x90, 0xE0, 0x00, 0xE0, 0xAF, 0xE0}, 6);
+    srand(1);
+    for (int i = 0; i < 0x2000; ++i)
+    {
+        prg[0x10000 + i] = rand();
+    }
+    char *path = strdup(write_temp(rom, size));
+    free(rom);
+
+    // translate it and build the result as a shared object
+    Machine *a = Machine_create(path, 0, PPU_SCANLINE, 0);
+    assert(a);
+    char source[256], object[256];
+    snprintf(source, sizeof(source), "%s.c", path);
+    snprintf(object, sizeof(object), "%s.so", path);
+    FILE *out = fopen(source, "w");
+    assert(out);
+    int blocks = Recomp_emit(out, a, "test_program");
+    fclose(out);
+    assert(blocks > 10);
+    assert(build_native(source, object) == 0);
+    void *library = dlopen(object, RTLD_NOW);
+    assert(library);
+    const RecompProgram *program = dlsym(library, "test_program");
+    assert(program && program->count == (size_t) blocks);
+
+    // only for the rom it was made from
+    Machine *b = Machine_create(path, 0, PPU_SCANLINE, 0);
+    assert(b);
+    Recomp recomp;
+    RecompProgram other = *program;
+    ++other.crc;
+    assert(Recomp_init(&recomp, &other, b) == -1 && errno == EINVAL);
+    assert(Recomp_init(&recomp, program, b) == 0);
+
+    // native code runs exactly as the interpreter, frame by frame, through an
+    // IRQ every 20 scanlines and both banks
+    int banks = 0;
+    for (int frame = 0; frame < 120; ++frame)
+    {
+        int irqs = a->ram_bytes[0x40];
+        run(a);
+        Recomp_frame(&recomp, b);
+        assert(same(a, b));
+        assert(frame < 2 || (a->ram_bytes[0x40] - irqs) & 0xFF);
+        banks |= 1 << b->ram_bytes[0x42];
+    }
+    assert(a->ram_bytes[0x30] == 119 && banks == 6);
+    assert(recomp.native > b->bus.cycle / 2 && recomp.interpreted > 0);
+
+    Recomp_free(&recomp);
+    dlclose(library);
+    Machine_destroy(b);
+    Machine_destroy(a);
+    unlink(object);
+    unlink(source);
+    unlink(path);
+    free(path);
+    return 0;
+}
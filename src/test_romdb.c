@@ -0,0 +1,209 @@
+#include "bus.h"
+#include "cart.h"
+#include "crc32.h"
+#include "romdb.h"
+#include "sha1.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Bitwise reference CRC-32
+static uint32_t reference_crc32(const unsigned char *p, size_t size)
+{
+    uint32_t crc = ~0u;
+    while (size--)
+    {
+        crc ^= *p++;
+        for (int bit = 0; bit < 8; ++bit)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static int sha1_is(const void *data, size_t size, const char *hex)
+{
+    unsigned char digest[SHA1_SIZE];
+    char out[SHA1_SIZE * 2 + 1];
+    sha1(data, size, digest);
+    for (int i = 0; i < SHA1_SIZE; ++i)
+    {
+        sprintf(out + i * 2, "%02x", digest[i]);
+    }
+    return strcmp(out, hex) == 0;
+}
+
+// Write a 16KB PRG / 8KB CHR NROM image whose contents depend on seed
+static void write_rom(const char *path, int seed, int mapper)
+{
+    static unsigned char rom[16 + 0x4000 + 0x2000];
+    memset(rom, 0, sizeof(rom));
+    memcpy(rom, "NES\x1A", 4);
+    rom[4] = 1;
+    rom[5] = 1;
+    rom[6] = mapper << 4;
+    for (size_t i = 16; i < sizeof(rom); ++i)
+    {
+        rom[i] = i * seed;
+    }
+
+    FILE *file = fopen(path, "wb");
+    assert(file);
+    assert(fwrite(rom, 1, sizeof(rom), file) == sizeof(rom));
+    fclose(file);
+}
+
+int main()
+{
+    // crc32: check value and the accelerated path against the reference at every alignment
+    assert(crc32(0, "123456789", 9) == 0xCBF43926);
+    static unsigned char data[4096];
+    for (size_t i = 0; i < sizeof(data); ++i)
+    {
+        data[i] = rand();
+    }
+    for (size_t size = 0; size < 300; ++size)
+    {
+        assert(crc32(0, data + size % 7, size) == reference_crc32(data + size % 7, size));
+    }
+    assert(crc32(crc32(0, data, 1000), data + 1000, 3000) == reference_crc32(data, 4000));
+
+    // sha1: FIPS 180 examples
+    assert(sha1_is("", 0, "da39a3ee5e6b4b0d3255bfef95601890afd80709"));
+    assert(sha1_is("abc", 3, "a9993e364706816aba3e25717850c26c9cd0d89d"));
+    assert(sha1_is("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 56, "84983e441c3bd26ebaae4aa1f95129e5e54670f1"));
+    char *a = malloc(1000000);
+    memset(a, 'a', 1000000);
+    assert(sha1_is(a, 1000000, "34aa973cd4c4daa4f61eeb2bdbad27316534016f"));
+    SHA1 sha;
+    unsigned char digest[SHA1_SIZE], expected[SHA1_SIZE];
+    SHA1_init(&sha);
+    for (int i = 0; i < 1000; ++i)
+    {
+        SHA1_update(&sha, a, 999 + (i & 1) * 2);
+    }
+    SHA1_final(&sha, digest);
+    sha1(a, 1000000, expected);
+    assert(memcmp(digest, expected, SHA1_SIZE) == 0);
+    free(a);
+
+    // a small library: two copies of one rom and one with a wrong mapper in its header
+    char root[] = "/tmp/nes_romdb_XXXXXX";
+    assert(mkdtemp(root));
+    char sub[64], rom_a[64], rom_b[64], rom_c[64], skip[64], index[64], fixes[64];
+    snprintf(sub, sizeof(sub), "%s/sub", root);
+    snprintf(rom_a, sizeof(rom_a), "%s/a.nes", root);
+    snprintf(rom_b, sizeof(rom_b), "%s/sub/b.NES", root);
+    snprintf(rom_c, sizeof(rom_c), "%s/sub/c.nes", root);
+    snprintf(skip, sizeof(skip), "%s/readme.txt", root);
+    snprintf(index, sizeof(index), "%s/index", root);
+    snprintf(fixes, sizeof(fixes), "%s/fixes.txt", root);
+    assert(mkdir(sub, 0755) == 0);
+    write_rom(rom_a, 3, 0);
+    write_rom(rom_b, 3, 0);
+    write_rom(rom_c, 5, 7);
+    write_rom(skip, 1, 0);
+
+    RomDB db;
+    assert(RomDB_scan(&db, root, 2, 0) == 0);
+    assert(db.count == 3);
+    assert(strcmp(RomDB_path(&db, &db.entries[0]), rom_a) == 0);
+
+    const RomDBEntry *entry = RomDB_find_path(&db, rom_c);
+    assert(entry && entry->mapper == 7 && !entry->corrected);
+    uint32_t prg_crc = entry->prg_crc, chr_crc = entry->chr_crc;
+    assert(RomDB_find(&db, prg_crc, chr_crc) == entry);
+
+    // the header says AxROM, it is really NROM with vertical mirroring
+    FILE *file = fopen(fixes, "w");
+    fprintf(file, "# prg chr mapper mirroring prg-ram\n%08x %08x 0 v 8 b\n", prg_crc, chr_crc);
+    fclose(file);
+    assert(RomDB_load_corrections(&db, fixes) == 1);
+    assert(RomDB_save(&db, index) == 0);
+    RomDB_free(&db);
+
+    assert(RomDB_load(&db, index) == 0);
+    entry = RomDB_find(&db, prg_crc, chr_crc);
+    assert(entry && entry->corrected && entry->mapper == 0 && entry->mirroring == MIRRORING_VERTICAL);
+    assert(entry->battery && entry->prg_ram_size == 0x2000);
+
+    // by contents, any entry with the CRCs and SHA-1 is found, not just the first
+    static unsigned char contents[16 + 0x4000 + 0x2000];
+    file = fopen(rom_a, "rb");
+    assert(fread(contents, 1, sizeof(contents), file) == sizeof(contents));
+    fclose(file);
+    const RomDBEntry *copy_a = RomDB_find_path(&db, rom_a), *copy_b = RomDB_find_path(&db, rom_b);
+    RomDBEntry *first = (RomDBEntry*) RomDB_find(&db, copy_a->prg_crc, copy_a->chr_crc);
+    const RomDBEntry *second = first == copy_a ? copy_b : copy_a;
+    first->sha1[0] ^= 1;
+    assert(RomDB_identify(&db, "/nonexistent", contents, sizeof(contents), 0) == second);
+    first->sha1[0] ^= 1;
+
+    // the loader uses the index over the header, by path or by contents
+    Bus bus;
+    Cart cart;
+    Bus_init(&bus);
+    assert(Cart_open(&cart, &bus, rom_c, &db) == 0);
+    assert(cart.ines.mapper == 0 && cart.ines.battery);
+    Cart_close(&cart);
+
+    char moved[64];
+    snprintf(moved, sizeof(moved), "%s/moved.bin", root);
+    assert(rename(rom_c, moved) == 0);
+    assert(Cart_open(&cart, &bus, moved, &db) == 0);
+    assert(cart.ines.mapper == 0);
+    Cart_close(&cart);
+    assert(Cart_open(&cart, &bus, moved, 0) == 0);
+    assert(cart.ines.mapper == 7);
+    Cart_close(&cart);
+    assert(rename(moved, rom_c) == 0);
+
+    // a rescan keeps the correction and only rehashes changed files
+    write_rom(rom_b, 9, 0);
+    RomDB rescan;
+    assert(RomDB_scan(&rescan, root, 0, &db) == 0);
+    assert(rescan.count == 3);
+    entry = RomDB_find_path(&rescan, rom_c);
+    assert(entry && entry->corrected && entry->mapper == 0);
+    assert(RomDB_find_path(&rescan, rom_b)->prg_crc != RomDB_find_path(&rescan, rom_a)->prg_crc);
+    RomDB_free(&rescan);
+    RomDB_free(&db);
+
+    // an index pointing outside itself is refused
+    struct stat st;
+    assert(stat(index, &st) == 0);
+    unsigned char *bytes = malloc(st.st_size);
+    file = fopen(index, "rb");
+    assert(fread(bytes, 1, st.st_size, file) == (size_t) st.st_size);
+    fclose(file);
+    size_t by_crc = 32 + 3 * sizeof(RomDBEntry);
+    size_t corrupt[] = {by_crc + 1, offsetof(RomDBEntry, path) + 32 + 3, st.st_size - 1};
+    for (size_t i = 0; i < sizeof(corrupt) / sizeof(corrupt[0]); ++i)
+    {
+        bytes[corrupt[i]] ^= 0x40;
+        file = fopen(fixes, "wb");
+        assert(fwrite(bytes, 1, st.st_size, file) == (size_t) st.st_size);
+        fclose(file);
+        errno = 0;
+        assert(RomDB_load(&db, fixes) < 0 && errno == EINVAL);
+        bytes[corrupt[i]] ^= 0x40;
+    }
+    free(bytes);
+
+    unlink(rom_a);
+    unlink(rom_b);
+    unlink(rom_c);
+    unlink(skip);
+    unlink(index);
+    unlink(fixes);
+    rmdir(sub);
+    rmdir(root);
+    return 0;
+}
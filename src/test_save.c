@@ -0,0 +1,105 @@
+#include "bus.h"
+#include "cart.h"
+#include "save.h"
+#include "test.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+int main()
+{
+    char path[] = "/tmp/nes_save_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+    unlink(path);
+
+    // a new save starts blank
+    Save save;
+    assert(Save_open(&save, path, 0, 0x2000, 1) == 0);
+    assert(save.size == 0x2000 && save.ram[0] == 0 && save.ram[0x1FFF] == 0);
+
+    // writes are visible in the file without any copy
+    save.ram[0x10] = 0xAB;
+    Save_frame(&save);
+    unsigned char byte;
+    fd = open(path, O_RDONLY);
+    assert(pread(fd, &byte, 1, save.ram - save.map + 0x10) == 1 && byte == 0xAB);
+    close(fd);
+    assert(Save_flush(&save) == 0);
+    Save_close(&save);
+
+    assert(Save_open(&save, path, 0, 0x2000, 0) == 0);
+    assert(save.ram[0x10] == 0xAB);
+    Save_close(&save);
+
+    // growing keeps the contents
+    assert(Save_open(&save, path, 0, 0x4000, 0) == 0);
+    assert(save.ram[0x10] == 0xAB && save.ram[0x3FFF] == 0);
+    Save_close(&save);
+    unlink(path);
+
+    // a raw 8KB save is converted
+    static unsigned char raw[0x2000];
+    raw[0] = 0x5A;
+    raw[0x1FFF] = 0xA5;
+    fd = open(path, O_WRONLY | O_CREAT, 0644);
+    assert(write(fd, raw, sizeof(raw)) == sizeof(raw));
+    close(fd);
+    assert(Save_open(&save, path, 0, 0x2000, 0) == 0);
+    assert(save.ram[0] == 0x5A && save.ram[0x1FFF] == 0xA5);
+    Save_close(&save);
+
+    // anything else is refused rather than overwritten
+    fd = open(path, O_WRONLY | O_TRUNC);
+    assert(write(fd, "junk", 4) == 4);
+    close(fd);
+    assert(Save_open(&save, path, 0, 0x2000, 0) < 0);
+    unlink(path);
+
+    // a battery backed cart maps $6000 straight to the file
+    static unsigned char rom[16 + 0x4000 + 0x2000];
+    memcpy(rom, "NES\x1A", 4);
+    rom[4] = 1;
+    rom[5] = 1;
+    rom[6] = 1 << 4 | FLAGS_6_RAM_BATTERY; // MMC1
+    char *rom_path = write_temp(rom, sizeof(rom));
+
+    Bus bus;
+    Cart cart;
+    Bus_init(&bus);
+    assert(Cart_open(&cart, &bus, rom_path, 0) == 0);
+    Bus_connect(&bus, (BusDevice*) &cart);
+    assert(Cart_open_save(&cart, path, 60) == 0);
+    Bus_write(&bus, 0x6123, 0x42);
+    assert(cart.save.ram[0x123] == 0x42);
+    Cart_close(&cart);
+
+    assert(Cart_open(&cart, &bus, rom_path, 0) == 0);
+    assert(Cart_open_save(&cart, path, 60) == 0);
+    assert(Bus_read(&bus, 0x6123) == 0x42);
+    Cart_close(&cart);
+
+    unlink(rom_path);
+    unlink(path);
+
+    // a new save starts from the trainer at $7000
+    static unsigned char trained[16 + 512 + 0x4000 + 0x2000];
+    memcpy(trained, rom, 16);
+    trained[6] |= FLAGS_6_TRAINER_PRESENT;
+    trained[16] = 0x77;
+    rom_path = write_temp(trained, sizeof(trained));
+    assert(Cart_open(&cart, &bus, rom_path, 0) == 0);
+    assert(Cart_open_save(&cart, path, 0) == 0);
+    assert(cart.save.ram[0x1000] == 0x77 && Bus_read(&bus, 0x7000) == 0x77);
+    Cart_close(&cart);
+
+    unlink(rom_path);
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,112 @@
+#include "search.h"
+#include "test.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static unsigned char *byte(Machine *machine, size_t index)
+{
+    return index < MACHINE_RAM_SIZE ? &machine->ram_bytes[index] : &machine->cart.prg_ram[index - MACHINE_RAM_SIZE];
+}
+
+static int value(Machine *machine, size_t index, int width)
+{
+    return width == 1 ? *byte(machine, index) : *byte(machine, index) | *byte(machine, index + 1) << 8;
+}
+
+static int matches(int now, int then, SearchOp op, int width, int target)
+{
+    int mask = width == 1 ? 0xFF : 0xFFFF;
+    switch (op)
+    {
+    case SEARCH_EQUAL:
+        return now == (target & mask);
+    case SEARCH_CHANGED:
+        return now != then;
+    case SEARCH_UNCHANGED:
+        return now == then;
+    case SEARCH_INCREASED:
+        return now > then;
+    case SEARCH_DECREASED:
+        return now < then;
+    default:
+        return ((now - then) & mask) == (target & mask);
+    }
+}
+
+int main()
+{
+    size_t size = 16 + 0x4000;
+    unsigned char *rom = calloc(1, size);
+    memcpy(rom, "NES\x1A", 4);
+    rom[4] = 1;
+    char *path = write_temp(rom, size);
+    free(rom);
+
+    Machine *machine = Machine_create(path, 0, PPU_SCANLINE, 0);
+    assert(machine && machine->cart.prg_ram);
+    Search search;
+    assert(Search_init(&search, machine) == 0);
+    assert(search.size == MACHINE_RAM_SIZE + (size_t) machine->cart.prg_ram_size);
+    assert(Search_count(&search) == search.size && Search_next(&search, 0) == 0);
+
+    // every op and width against a byte at a time, over memory that changes a
+    // little between snapshots
+    unsigned char *last = malloc(search.size + 1);
+    srand(1);
+    for (int round = 0; round < 200; ++round)
+    {
+        if (round % 8 == 0)
+        {
+            Search_reset(&search);
+        }
+        SearchOp op = rand() % (SEARCH_DELTA + 1);
+        int width = 1 + rand() % 2, target = rand() % 3 - 1;
+        for (size_t i = 0; i < search.size; ++i)
+        {
+            last[i] = *byte(machine, i);
+            if (rand() % 4 == 0)
+            {
+                *byte(machine, i) += rand() % 3 - 1;
+            }
+        }
+        last[search.size] = 0;
+
+        uint64_t *before = malloc(search.words * sizeof(uint64_t));
+        memcpy(before, search.candidates, search.words * sizeof(uint64_t));
+        size_t count = Search_filter(&search, machine, op, width, target);
+        size_t expected = 0;
+        for (size_t i = 0; i < search.size; ++i)
+        {
+            int was = before[i / 64] >> i % 64 & 1;
+            int then = width == 1 ? last[i] : last[i] | last[i + 1] << 8;
+            int fits = width == 1 || (i + 1 != search.size && i + 1 != MACHINE_RAM_SIZE);
+            int keep = was && fits && matches(value(machine, i, width), then, op, width, target);
+            assert((int) (search.candidates[i / 64] >> i % 64 & 1) == keep);
+            expected += keep;
+        }
+        assert(count == expected && count == Search_count(&search));
+        free(before);
+    }
+
+    // the usual hunt: a 16-bit score in PRG-RAM that goes up by 300 a time
+    Search_reset(&search);
+    size_t score = MACHINE_RAM_SIZE + 0x123;
+    for (int i = 0; i < 4 && Search_count(&search) > 1; ++i)
+    {
+        int now = value(machine, score, 2) + 300;
+        *byte(machine, score) = now;
+        *byte(machine, score + 1) = now >> 8;
+        Search_filter(&search, machine, SEARCH_DELTA, 2, 300);
+    }
+    assert(Search_count(&search) == 1 && Search_next(&search, 0) == score && Search_next(&search, score + 1) == search.size);
+    assert(Search_value(&search, score, 2) == value(machine, score, 2));
+
+    free(last);
+    Search_free(&search);
+    Machine_destroy(machine);
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include "bus.h"
+#include "cart.h"
+#include "test.h"
+#include "tiles.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static Bus bus;
+static Cart cart;
+
+static void open_rom(int mapper, int chr_kb, const unsigned char *chr)
+{
+    size_t size = 16 + 32 * 1024 + chr_kb * 1024;
+    unsigned char *rom = calloc(1, size);
+    memcpy(rom, "NES\x1A", 4);
+    rom[4] = 2;
+    rom[5] = chr_kb / 8;
+    rom[6] = (mapper & 0xF) << 4;
+    if (chr)
+    {
+        memcpy(rom + 16 + 32 * 1024, chr, chr_kb * 1024);
+    }
+
+    char *path = write_temp(rom, size);
+    Bus_init(&bus);
+    assert(Cart_open(&cart, &bus, path, 0) == 0);
+    Bus_connect(&bus, (BusDevice*) &cart);
+    unlink(path);
+    free(rom);
+}
+
+// Pixel x of a row the slow way
+static int pixel(const unsigned char *planes, int row, int x)
+{
+    return ((planes[row] >> (7 - x)) & 1) | (((planes[row + 8] >> (7 - x)) & 1) << 1);
+}
+
+int main()
+{
+    // decoding matches the bit planes in both directions
+    unsigned char planes[TILE_SIZE];
+    unsigned char pixels[2][8][8];
+    srand(1);
+    for (int n = 0; n < 1000; ++n)
+    {
+        for (int i = 0; i < TILE_SIZE; ++i)
+        {
+            planes[i] = rand();
+        }
+        Tiles_decode(planes, pixels);
+        for (int row = 0; row < 8; ++row)
+        {
+            for (int x = 0; x < 8; ++x)
+            {
+                assert(pixels[0][row][x] == pixel(planes, row, x));
+                assert(pixels[1][row][7 - x] == pixel(planes, row, x));
+            }
+        }
+    }
+
+    // CHR RAM writes invalidate the tile
+    open_rom(0, 0, 0);
+    assert(Cart_chr_row(&cart, 0x1013, 0)[0] == 0);
+    Cart_chr_write(&cart, 0x1013, 0x80);
+    Cart_chr_write(&cart, 0x101B, 0x01);
+    assert(Cart_chr_row(&cart, 0x1013, 0)[0] == 1 && Cart_chr_row(&cart, 0x1013, 0)[7] == 2);
+    assert(Cart_chr_row(&cart, 0x1013, 1)[7] == 1 && Cart_chr_row(&cart, 0x1013, 1)[0] == 2);
+    Cart_close(&cart);
+
+    // CNROM: bank switches re-point windows, the cache follows the physical tile
+    unsigned char chr[0x8000] = {0};
+    for (int bank = 0; bank < 4; ++bank)
+    {
+        chr[bank * 0x2000] = 0xFF >> bank;
+    }
+    open_rom(3, 32, chr);
+    for (int bank = 0; bank < 4; ++bank)
+    {
+        Bus_write(&bus, 0x8000, bank);
+        const unsigned char *row = Cart_chr_row(&cart, 0, 0);
+        for (int x = 0; x < 8; ++x)
+        {
+            assert(row[x] == (x >= bank));
+        }
+    }
+    Cart_close(&cart);
+
+    return 0;
+}
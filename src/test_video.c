@@ -0,0 +1,91 @@
+#include "video.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#define FRAMES 2000
+
+static Video video;
+
+// Fill every published frame with its number
+static void *produce(void *arg)
+{
+    unsigned short *frame = video.frames[video.back];
+    for (int n = 1; n <= FRAMES; ++n)
+    {
+        for (int i = 0; i < VIDEO_PIXELS; ++i)
+        {
+            frame[i] = n;
+        }
+        frame = Video_publish(&video);
+    }
+    return 0;
+}
+
+int main()
+{
+    static uint32_t rgba[VIDEO_PIXELS];
+    static uint16_t rgb565[VIDEO_PIXELS];
+    int fresh;
+
+    // the consumer only ever sees the latest frame, once
+    Video_init(&video);
+    const unsigned short *first = Video_acquire(&video, &fresh);
+    assert(!fresh);
+    unsigned short *back = video.frames[video.back];
+    back[0] = 1;
+    back = Video_publish(&video);
+    back[0] = 2;
+    back = Video_publish(&video);
+    const unsigned short *frame = Video_acquire(&video, &fresh);
+    assert(fresh && frame[0] == 2 && frame != first);
+    assert(Video_acquire(&video, &fresh) == frame && !fresh);
+    assert(back != frame);
+
+    // ... and never a frame the producer is still writing
+    Video_init(&video);
+    pthread_t thread;
+    pthread_create(&thread, 0, produce, 0);
+    int last = 0;
+    while (last < FRAMES)
+    {
+        frame = Video_acquire(&video, &fresh);
+        if (!fresh)
+        {
+            continue;
+        }
+        assert(frame[0] > last);
+        for (int i = 0; i < VIDEO_PIXELS; ++i)
+        {
+            assert(frame[i] == frame[0]);
+        }
+        last = frame[0];
+    }
+    pthread_join(thread, 0);
+
+    // conversion matches the lookup tables
+    Video_init(&video);
+    unsigned short *pixels = video.frames[0];
+    srand(1);
+    for (int i = 0; i < VIDEO_PIXELS; ++i)
+    {
+        pixels[i] = rand() % VIDEO_COLORS;
+    }
+    pixels[0] = 0x30;
+    Video_rgba(&video, pixels, rgba);
+    Video_rgb565(&video, pixels, rgb565);
+    for (int i = 0; i < VIDEO_PIXELS; ++i)
+    {
+        assert(rgba[i] == video.rgba[pixels[i]]);
+        assert(rgb565[i] == video.rgb565[pixels[i]]);
+    }
+    const unsigned char *white = (const unsigned char*) &rgba[0];
+    assert(white[0] == 236 && white[1] == 238 && white[2] == 236 && white[3] == 255);
+    assert(rgb565[0] == ((236 >> 3) << 11 | (238 >> 2) << 5 | 236 >> 3));
+
+    // emphasis darkens the other channels
+    assert((video.rgba[0x30 | 1 << 6] & 0xFF) == 236 && ((video.rgba[0x30 | 1 << 6] >> 8) & 0xFF) == 238 * 3 / 4);
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include "tiles.h"
+
+#include <stdlib.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+int TileCache_init(TileCache *cache, size_t tiles)
+{
+    // untouched tiles cost no memory until they are decoded
+    cache->pixels = calloc(tiles, sizeof(*cache->pixels));
+    cache->valid = calloc(tiles, 1);
+    cache->tiles = tiles;
+    if (!cache->pixels || !cache->valid)
+    {
+        TileCache_free(cache);
+        return -1;
+    }
+    return 0;
+}
+
+void TileCache_free(TileCache *cache)
+{
+    free(cache->pixels);
+    free(cache->valid);
+    cache->pixels = 0;
+    cache->valid = 0;
+    cache->tiles = 0;
+}
+
+#ifdef __SSE2__
+
+// Two rows of plane bytes, each repeated across 8 lanes, to one bit per lane
+static inline __m128i expand(__m128i lo, __m128i hi, __m128i bits)
+{
+    __m128i one = _mm_set1_epi8(1);
+    __m128i l = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(lo, bits), bits), one);
+    __m128i h = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(hi, bits), bits), _mm_add_epi8(one, one));
+    return _mm_or_si128(l, h);
+}
+
+// SSE2 is part of x86-64, so this needs no runtime check
+void Tiles_decode(const unsigned char *planes, unsigned char pixels[2][8][8])
+{
+    const __m128i normal = _mm_set_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    const __m128i flipped = _mm_set_epi8(-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1);
+
+    // repeat every plane byte 8 times: 2 rows per register
+    __m128i lo = _mm_loadl_epi64((const __m128i*) planes);
+    __m128i hi = _mm_loadl_epi64((const __m128i*) (planes + 8));
+    lo = _mm_unpacklo_epi8(lo, lo);
+    hi = _mm_unpacklo_epi8(hi, hi);
+    __m128i lo4[2] = {_mm_unpacklo_epi16(lo, lo), _mm_unpackhi_epi16(lo, lo)};
+    __m128i hi4[2] = {_mm_unpacklo_epi16(hi, hi), _mm_unpackhi_epi16(hi, hi)};
+
+    for (int half = 0; half < 2; ++half)
+    {
+        __m128i lo8[2] = {_mm_unpacklo_epi32(lo4[half], lo4[half]), _mm_unpackhi_epi32(lo4[half], lo4[half])};
+        __m128i hi8[2] = {_mm_unpacklo_epi32(hi4[half], hi4[half]), _mm_unpackhi_epi32(hi4[half], hi4[half])};
+
+        for (int pair = 0; pair < 2; ++pair)
+        {
+            int row = half * 4 + pair * 2;
+            _mm_storeu_si128((__m128i*) pixels[0][row], expand(lo8[pair], hi8[pair], normal));
+            _mm_storeu_si128((__m128i*) pixels[1][row], expand(lo8[pair], hi8[pair], flipped));
+        }
+    }
+}
+
+#else
+
+void Tiles_decode(const unsigned char *planes, unsigned char pixels[2][8][8])
+{
+    for (int row = 0; row < 8; ++row)
+    {
+        int lo = planes[row], hi = planes[row + 8];
+        for (int x = 0; x < 8; ++x)
+        {
+            int color = ((lo >> (7 - x)) & 1) | (((hi >> (7 - x)) & 1) << 1);
+            pixels[0][row][x] = color;
+            pixels[1][row][7 - x] = color;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stddef.h>
+
+// Bytes of a pattern table tile (two 8x8 bit planes)
+#define TILE_SIZE 16
+
+// Pattern table tiles expanded to one byte per pixel (colour 0-3), in normal and
+// horizontally flipped order. Tiles are keyed by their offset in the cart's CHR,
+// not by PPU address, so bank switches never invalidate anything. Only writes to
+// CHR RAM do.
+typedef struct TileCache
+{
+    unsigned char (*pixels)[2][8][8]; // [tile][flipped][row][x]
+    unsigned char *valid;             // [tile]
+    size_t tiles;
+} TileCache;
+
+// Allocate an empty cache for tiles tiles. Returns 0, or -1 if out of memory.
+int TileCache_init(TileCache *cache, size_t tiles);
+
+void TileCache_free(TileCache *cache);
+
+// Expand one tile's bit planes into both pixel orders
+void Tiles_decode(const unsigned char *planes, unsigned char pixels[2][8][8]);
+
+// 8 pixels of a row of a tile, decoding the tile from chr on first use
+static inline const unsigned char *TileCache_row(TileCache *cache, const unsigned char *chr, size_t tile, int row, int flipped)
+{
+    if (!cache->valid[tile])
+    {
+        Tiles_decode(chr + tile * TILE_SIZE, cache->pixels[tile]);
+        cache->valid[tile] = 1;
+    }
+    return cache->pixels[tile][flipped][row];
+}
+
+// The tile's bytes changed
+static inline void TileCache_invalidate(TileCache *cache, size_t tile)
+{
+    cache->valid[tile] = 0;
+}
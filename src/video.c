@@ -0,0 +1,137 @@
+#include "video.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_AVX2 1
+#endif
+
+// the shared buffer holds a frame the consumer hasn't seen
+#define VIDEO_FRESH 4
+
+// 2C02 colours
+static const unsigned char palette[64][3] = {
+    {84, 84, 84}, {0, 30, 116}, {8, 16, 144}, {48, 0, 136}, {68, 0, 100}, {92, 0, 48}, {84, 4, 0}, {60, 24, 0},
+    {32, 42, 0}, {8, 58, 0}, {0, 64, 0}, {0, 60, 0}, {0, 50, 60}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0},
+    {152, 150, 152}, {8, 76, 196}, {48, 50, 236}, {92, 30, 228}, {136, 20, 176}, {160, 20, 100}, {152, 34, 32}, {120, 60, 0},
+    {84, 90, 0}, {40, 114, 0}, {8, 124, 0}, {0, 118, 40}, {0, 102, 120}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0},
+    {236, 238, 236}, {76, 154, 236}, {120, 124, 236}, {176, 98, 236}, {228, 84, 236}, {236, 88, 180}, {236, 106, 100}, {212, 136, 32},
+    {160, 170, 0}, {116, 196, 0}, {76, 208, 32}, {56, 204, 108}, {56, 180, 204}, {60, 60, 60}, {0, 0, 0}, {0, 0, 0},
+    {236, 238, 236}, {168, 204, 236}, {188, 188, 236}, {212, 178, 236}, {236, 174, 236}, {236, 174, 212}, {236, 180, 176}, {228, 196, 144},
+    {204, 210, 120}, {180, 222, 120}, {168, 226, 144}, {152, 226, 180}, {160, 214, 228}, {160, 162, 160}, {0, 0, 0}, {0, 0, 0},
+};
+
+uint32_t Video_color(int color)
+{
+    // emphasis (red, green, blue) darkens the other two channels
+    int emphasis = (color & (VIDEO_COLORS - 1)) >> 6;
+    uint32_t rgba = 0xFFu << 24;
+    for (int c = 0; c < 3; ++c)
+    {
+        int value = palette[color & 0x3F][c];
+        if (emphasis && !(emphasis & (1 << c)))
+        {
+            value = value * 3 / 4;
+        }
+        rgba |= (uint32_t) value << c * 8;
+    }
+    return rgba;
+}
+
+void Video_init(Video *video)
+{
+    memset(video->frames, 0, sizeof(video->frames));
+    video->back = 0;
+    atomic_init(&video->ready, 1);
+    video->front = 2;
+
+    for (int i = 0; i < VIDEO_COLORS; ++i)
+    {
+        uint32_t rgba = Video_color(i);
+        int r = rgba & 0xFF, g = rgba >> 8 & 0xFF, b = rgba >> 16 & 0xFF;
+        video->rgba[i] = rgba;
+        video->rgb565[i] = (r >> 3) << 11 | (g >> 2) << 5 | b >> 3;
+    }
+}
+
+unsigned short *Video_publish(Video *video)
+{
+    int old = atomic_exchange_explicit(&video->ready, video->back | VIDEO_FRESH, memory_order_acq_rel);
+    video->back = old & 3;
+    return video->frames[video->back];
+}
+
+const unsigned short *Video_acquire(Video *video, int *fresh)
+{
+    int is_fresh = atomic_load_explicit(&video->ready, memory_order_relaxed) & VIDEO_FRESH;
+    if (is_fresh)
+    {
+        int old = atomic_exchange_explicit(&video->ready, video->front, memory_order_acq_rel);
+        video->front = old & 3;
+    }
+    if (fresh)
+    {
+        *fresh = is_fresh != 0;
+    }
+    return video->frames[video->front];
+}
+
+#ifdef HAVE_AVX2
+
+// 16 pixels at a time, looked up with gathers
+__attribute__((target("avx2")))
+static void convert_avx2(const uint32_t *lut, const unsigned short *frame, void *out, int rgb565)
+{
+    for (int i = 0; i < VIDEO_PIXELS; i += 16)
+    {
+        __m256i pixels = _mm256_and_si256(_mm256_loadu_si256((const __m256i*) (frame + i)), _mm256_set1_epi16(VIDEO_COLORS - 1));
+        __m256i lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(pixels));
+        __m256i hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(pixels, 1));
+        lo = _mm256_i32gather_epi32((const int*) lut, lo, 4);
+        hi = _mm256_i32gather_epi32((const int*) lut, hi, 4);
+        if (rgb565)
+        {
+            // packing works within 128-bit lanes, so put the quarters back in order
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8);
+            _mm256_storeu_si256((__m256i*) ((uint16_t*) out + i), packed);
+        }
+        else
+        {
+            _mm256_storeu_si256((__m256i*) ((uint32_t*) out + i), lo);
+            _mm256_storeu_si256((__m256i*) ((uint32_t*) out + i + 8), hi);
+        }
+    }
+}
+
+#endif
+
+void Video_rgba(const Video *video, const unsigned short *frame, uint32_t *out)
+{
+#ifdef HAVE_AVX2
+    if (__builtin_cpu_supports("avx2"))
+    {
+        convert_avx2(video->rgba, frame, out, 0);
+        return;
+    }
+#endif
+    for (int i = 0; i < VIDEO_PIXELS; ++i)
+    {
+        out[i] = video->rgba[frame[i] & (VIDEO_COLORS - 1)];
+    }
+}
+
+void Video_rgb565(const Video *video, const unsigned short *frame, uint16_t *out)
+{
+#ifdef HAVE_AVX2
+    if (__builtin_cpu_supports("avx2"))
+    {
+        convert_avx2(video->rgb565, frame, out, 1);
+        return;
+    }
+#endif
+    for (int i = 0; i < VIDEO_PIXELS; ++i)
+    {
+        out[i] = video->rgb565[frame[i] & (VIDEO_COLORS - 1)];
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "ppu.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define VIDEO_PIXELS (PPU_WIDTH * PPU_HEIGHT)
+
+// Colours for a PPU pixel: 6 bit colour | emphasis << 6
+#define VIDEO_COLORS 512
+
+// Hands finished frames from the emulation thread to a presenter without either
+// waiting. The producer renders into its own buffer and swaps it with the shared
+// one when the frame is done; the consumer swaps its buffer with the shared one
+// when that holds a newer frame. Frames stay as palette indices until the
+// consumer converts them.
+typedef struct Video
+{
+    unsigned short frames[3][VIDEO_PIXELS];
+    // on separate cache lines so the threads don't contend
+    _Alignas(64) int back;         // producer's buffer
+    _Alignas(64) atomic_int ready; // shared buffer, flagged while it is unseen
+    _Alignas(64) int front;        // consumer's buffer
+
+    uint32_t rgba[VIDEO_COLORS];   // R, G, B, A in memory order
+    uint32_t rgb565[VIDEO_COLORS]; // widened for 32-bit gathers
+} Video;
+
+void Video_init(Video *video);
+
+// RGBA (R in the low byte) of a PPU pixel
+uint32_t Video_color(int color);
+
+// Producer: publish the frame in the back buffer and return the buffer to render
+// the next one into
+unsigned short *Video_publish(Video *video);
+
+// Consumer: the latest published frame. fresh (if given) is set if it wasn't
+// returned before.
+const unsigned short *Video_acquire(Video *video, int *fresh);
+
+// Convert a frame to RGBA8888 or RGB565
+void Video_rgba(const Video *video, const unsigned short *frame, uint32_t *out);
+void Video_rgb565(const Video *video, const unsigned short *frame, uint16_t *out);